@@ -0,0 +1,124 @@
+/****************************************************
+ File: arena.c
+
+ Bump-pointer arena, see arena.h
+****************************************************/
+
+#include "libs.h"
+#include "arena.h"
+
+/* Header size rounded up, so that the data of each chunk starts aligned */
+#define CHUNK_HEADER (((sizeof(ArenaChunk)) + ARENA_ALIGN - 1) & ~(size_t)(ARENA_ALIGN - 1))
+
+#define ALIGN_UP(n) (((n) + ARENA_ALIGN - 1) & ~(size_t)(ARENA_ALIGN - 1))
+
+void arena_init(Arena * a) {
+    a->head = NULL;
+    a->bytes = 0;
+    a->objects = 0;
+    a->reserved = 0;
+}
+
+static ArenaChunk * new_chunk(Arena * a, size_t size) {
+    ArenaChunk * c = (ArenaChunk *) malloc(CHUNK_HEADER + size);
+    if (c == NULL)
+        return NULL;
+    c->size = size;
+    c->used = 0;
+    c->next = a->head;
+    a->head = c;
+    a->reserved += CHUNK_HEADER + size;
+    return c;
+}
+
+void * arena_alloc(Arena * a, size_t size) {
+    ArenaChunk * c = a->head;
+    size = ALIGN_UP(size);
+    if (c == NULL || c->size - c->used < size) {
+        if (size > ARENA_CHUNK_SIZE) {
+            /* A big block gets its own chunk, put behind the current one so that
+             * the space left in the current chunk is still used. */
+            ArenaChunk * big = (ArenaChunk *) malloc(CHUNK_HEADER + size);
+            if (big == NULL)
+                return NULL;
+            big->size = size;
+            big->used = size;
+            if (c == NULL) {
+                big->next = NULL;
+                a->head = big;
+            } else {
+                big->next = c->next;
+                c->next = big;
+            }
+            a->reserved += CHUNK_HEADER + size;
+            a->bytes += size;
+            a->objects++;
+            return (char *) big + CHUNK_HEADER;
+        }
+        c = new_chunk(a, ARENA_CHUNK_SIZE);
+        if (c == NULL)
+            return NULL;
+    }
+    void * p = (char *) c + CHUNK_HEADER + c->used;
+    c->used += size;
+    a->bytes += size;
+    a->objects++;
+    return p;
+}
+
+int arena_unalloc(Arena * a, void * p, size_t size) {
+    ArenaChunk * c = a->head;
+    size = ALIGN_UP(size);
+    if (c == NULL || c->used < size || (char *) c + CHUNK_HEADER + c->used - size != (char *) p)
+        return 0;
+    c->used -= size;
+    a->bytes -= size;
+    a->objects--;
+    return 1;
+}
+
+void arena_append(Arena * a, Arena * from) {
+    ArenaChunk * tail = from->head;
+    if (tail == NULL)
+        return;
+    if (a->head == NULL) {
+        *a = *from;
+    } else {
+        while (tail->next != NULL)
+            tail = tail->next;
+        tail->next = a->head->next;
+        a->head->next = from->head;
+        a->bytes += from->bytes;
+        a->objects += from->objects;
+        a->reserved += from->reserved;
+    }
+    arena_init(from);
+}
+
+void arena_reset(Arena * a) {
+    ArenaChunk * keep = a->head;
+    ArenaChunk * c;
+    if (keep == NULL)
+        return;
+    c = keep->next;
+    while (c != NULL) {
+        ArenaChunk * next = c->next;
+        free(c);
+        c = next;
+    }
+    keep->next = NULL;
+    keep->used = 0;
+    a->bytes = 0;
+    a->objects = 0;
+    a->reserved = CHUNK_HEADER + keep->size;
+}
+
+void arena_release(Arena * a) {
+    ArenaChunk * c = a->head;
+    while (c != NULL) {
+        ArenaChunk * next = c->next;
+        free(c);
+        c = next;
+    }
+    arena_init(a);
+}
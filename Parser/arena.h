@@ -0,0 +1,56 @@
+/****************************************************
+ File: arena.h
+
+ A bump-pointer arena. All the nodes of one parse
+ tree are taken from one arena, so the whole tree is
+ released by a single arena_release().
+****************************************************/
+
+#ifndef _ARENA_H_
+#define _ARENA_H_
+
+#include <stddef.h>
+
+/* Usable bytes of an ordinary chunk. A request larger than this gets a chunk of its own. */
+#define ARENA_CHUNK_SIZE (64 * 1024)
+
+/* Every pointer returned by arena_alloc() is aligned to ARENA_ALIGN bytes */
+#define ARENA_ALIGN 16
+
+typedef struct arenaChunk {
+    struct arenaChunk * next; /* the chunk allocated before this one */
+    size_t size;              /* usable bytes following the header */
+    size_t used;              /* bytes already handed out */
+} ArenaChunk;
+
+typedef struct {
+    ArenaChunk * head;  /* the newest chunk, the one being bumped */
+    size_t bytes;       /* total bytes handed out, including alignment padding */
+    size_t objects;     /* number of successful arena_alloc() calls */
+    size_t reserved;    /* total bytes obtained from malloc, including headers */
+} Arena;
+
+/* Make an empty arena; no memory is taken until the first arena_alloc() */
+void arena_init(Arena * a);
+
+/* <Return:>
+ * size bytes of uninitialized memory owned by the arena, or NULL when malloc fails.
+ * The memory lives until arena_release() is called on the arena. */
+void * arena_alloc(Arena * a, size_t size);
+
+/* Give back p, of size bytes, when it is the last memory arena_alloc() handed out, so that the next
+ * arena_alloc() reuses it. <Return:> 0, and nothing changes, when it is not the last. */
+int arena_unalloc(Arena * a, void * p, size_t size);
+
+/* Move every chunk of from into a, keeping the chunk a is bumping, and leave from empty.
+ * Memory from either arena stays where it is, so pointers into it remain valid. */
+void arena_append(Arena * a, Arena * from);
+
+/* Make the arena empty but keep its newest chunk, so that it is used again without malloc.
+ * Memory handed out before is invalid. */
+void arena_reset(Arena * a);
+
+/* Free all chunks of the arena in one pass over the chunk list, and reset it to empty. */
+void arena_release(Arena * a);
+
+#endif
@@ -0,0 +1,272 @@
+/****************************************************
+ File: astbin.c
+
+ Binary tree files, see astbin.h
+****************************************************/
+
+#include "libs.h"
+#include "astbin.h"
+#include "intern.h"
+
+/* The links of a record that the writer fills in when the target is written */
+#define SIBLING_SLOT MAX_CHILDREN
+
+typedef struct {
+    const TreeNode * node;
+    uint32_t from;        /* the record that links to node */
+    int slot;             /* which link: a child index or SIBLING_SLOT */
+} Pending;
+
+typedef struct {
+    AstBinNode * nodes;
+    size_t count;
+    size_t capacity;
+    Pending * stack;
+    size_t top;
+    size_t stackCapacity;
+    InternTable names;     /* the names written so far, with the string table order as ids */
+    uint32_t * offsets;    /* offsets[id]: where name id starts in the string table */
+    size_t offsetsCapacity;
+    uint32_t stringsSize;
+} Writer;
+
+static int push_pending(Writer * w, const TreeNode * node, uint32_t from, int slot) {
+    if (w->top == w->stackCapacity) {
+        size_t n = w->stackCapacity == 0 ? 64 : w->stackCapacity * 2;
+        Pending * p = (Pending *) realloc(w->stack, n * sizeof(Pending));
+        if (p == NULL)
+            return 0;
+        w->stack = p;
+        w->stackCapacity = n;
+    }
+    w->stack[w->top].node = node;
+    w->stack[w->top].from = from;
+    w->stack[w->top].slot = slot;
+    w->top++;
+    return 1;
+}
+
+/* The string table offset of name, adding it to the table the first time */
+static uint32_t name_offset(Writer * w, const char * name, int * ok) {
+    size_t before = w->names.count;
+    const char * unique;
+    SymbolId id;
+    if (name == NULL)
+        return ASTBIN_NONE;
+    unique = intern(&w->names, name);
+    if (unique == NULL) {
+        *ok = 0;
+        return ASTBIN_NONE;
+    }
+    id = SYMBOL_ID(unique);
+    if (w->names.count > before) {
+        /* a new name goes at the end of the table */
+        if (id >= w->offsetsCapacity) {
+            size_t n = w->offsetsCapacity == 0 ? 256 : w->offsetsCapacity * 2;
+            uint32_t * p = (uint32_t *) realloc(w->offsets, n * sizeof(uint32_t));
+            if (p == NULL) {
+                *ok = 0;
+                return ASTBIN_NONE;
+            }
+            w->offsets = p;
+            w->offsetsCapacity = n;
+        }
+        w->offsets[id] = w->stringsSize;
+        w->stringsSize += SYMBOL_LENGTH(unique) + 1;
+    }
+    return w->offsets[id];
+}
+
+/* Copy the fields of t into record r */
+static void fill(Writer * w, AstBinNode * r, const TreeNode * t, int * ok) {
+    const char * name = NULL;
+    memset(r, 0, sizeof(AstBinNode));
+    r->nodeKind = (uint8_t) t->nodeKind;
+    r->exprType = (uint8_t) t->type;
+    r->lineNum = t->lineNum;
+    r->name = ASTBIN_NONE;
+    switch (t->nodeKind) {
+        case DCL_ND:
+        case PARAM_ND:
+            r->kind = (uint8_t) (t->nodeKind == DCL_ND ? t->kind.dcl : t->kind.param);
+            r->dclType = (uint8_t) t->attr.dclAttr.type;
+            r->value = t->attr.dclAttr.size;
+            name = t->attr.dclAttr.name;
+            break;
+        case STMT_ND:
+            r->kind = (uint8_t) t->kind.stmt;
+            break;
+        case EXPR_ND:
+            r->kind = (uint8_t) t->kind.expr;
+            if (t->kind.expr == OP_EXPR)
+                r->value = (int32_t) t->attr.exprAttr.op;
+            else if (t->kind.expr == CONST_EXPR)
+                r->value = t->attr.exprAttr.val;
+            else
+                name = t->attr.exprAttr.name;
+            break;
+    }
+    r->name = name_offset(w, name, ok);
+}
+
+int astbin_write(FILE * out, const TreeNode * root) {
+    Writer w;
+    AstBinHeader h;
+    int ok = 1, i;
+    size_t k;
+
+    memset(&w, 0, sizeof(Writer));
+    intern_init(&w.names);
+    if (root != NULL)
+        ok = push_pending(&w, root, 0, -1);
+
+    /* preorder: a node, then its children, then its right sibling */
+    while (ok && w.top > 0) {
+        Pending p = w.stack[--w.top];
+        const TreeNode * t = p.node;
+        uint32_t index = (uint32_t) w.count;
+        if (w.count == w.capacity) {
+            size_t n = w.capacity == 0 ? 1024 : w.capacity * 2;
+            AstBinNode * nodes = (AstBinNode *) realloc(w.nodes, n * sizeof(AstBinNode));
+            if (nodes == NULL || n >= ASTBIN_NONE) {
+                ok = 0;
+                break;
+            }
+            w.nodes = nodes;
+            w.capacity = n;
+        }
+        fill(&w, &w.nodes[index], t, &ok);
+        w.count++;
+        if (p.slot == SIBLING_SLOT)
+            w.nodes[p.from].rSibling = index - p.from;
+        else if (p.slot >= 0)
+            w.nodes[p.from].child[p.slot] = index - p.from;
+        /* pushed in reverse, so child[0] comes out first and the sibling last */
+        if (t->rSibling != NULL)
+            ok = ok && push_pending(&w, t->rSibling, index, SIBLING_SLOT);
+        for (i = MAX_CHILDREN - 1; i >= 0; i--)
+            if (t->child[i] != NULL)
+                ok = ok && push_pending(&w, t->child[i], index, i);
+    }
+
+    if (ok) {
+        memset(&h, 0, sizeof(AstBinHeader));
+        memcpy(h.magic, ASTBIN_MAGIC, sizeof(h.magic));
+        h.version = ASTBIN_VERSION;
+        h.byteOrder = ASTBIN_BYTE_ORDER;
+        h.nodeCount = (uint32_t) w.count;
+        h.root = w.count > 0 ? 0 : ASTBIN_NONE;
+        h.stringsSize = w.stringsSize;
+        ok = fwrite(&h, sizeof(AstBinHeader), 1, out) == 1
+            && fwrite(w.nodes, sizeof(AstBinNode), w.count, out) == w.count;
+        for (k = 0; ok && k < w.names.count; k++) {
+            const char * name = SYMBOL_NAME(&w.names, k);
+            ok = fwrite(name, 1, SYMBOL_LENGTH(name) + 1, out) == SYMBOL_LENGTH(name) + 1;
+        }
+        ok = ok && fflush(out) == 0;
+    }
+    free(w.nodes);
+    free(w.stack);
+    free(w.offsets);
+    intern_release(&w.names);
+    return ok;
+}
+
+/* Check the bytes of f->source and set the section pointers; with records, every record as well */
+static int check(AstBinFile * f, int records) {
+    const char * data = f->source.text;
+    size_t size = f->source.length;
+    const AstBinHeader * h = (const AstBinHeader *) data;
+    size_t nodesEnd;
+    uint32_t i, n;
+    int k;
+
+    if (size < sizeof(AstBinHeader) || ((uintptr_t) data & 3) != 0)
+        return 0;
+    if (memcmp(h->magic, ASTBIN_MAGIC, sizeof(h->magic)) != 0
+        || h->version != ASTBIN_VERSION || h->byteOrder != ASTBIN_BYTE_ORDER)
+        return 0;
+    n = h->nodeCount;
+    nodesEnd = sizeof(AstBinHeader) + (size_t) n * sizeof(AstBinNode);
+    if (nodesEnd > size || size - nodesEnd != h->stringsSize)
+        return 0;
+    if (n == 0 ? h->root != ASTBIN_NONE : h->root >= n)
+        return 0;
+    f->header = h;
+    f->nodes = (const AstBinNode *) (data + sizeof(AstBinHeader));
+    f->strings = data + nodesEnd;
+    if (h->stringsSize > 0 && f->strings[h->stringsSize - 1] != '\0')
+        return 0;
+    if (!records)
+        return 1;
+
+    for (i = 0; i < n; i++) {
+        const AstBinNode * r = &f->nodes[i];
+        for (k = 0; k < MAX_CHILDREN; k++)
+            if (r->child[k] != 0 && r->child[k] >= n - i)
+                return 0;
+        if (r->rSibling != 0 && r->rSibling >= n - i)
+            return 0;
+        if (r->name != ASTBIN_NONE && r->name >= h->stringsSize)
+            return 0;
+    }
+    return 1;
+}
+
+static int open_file(AstBinFile * f, const char * fileName, int records) {
+    f->borrowed = 0;
+    if (!source_open(&f->source, fileName))
+        return 0;
+    if (!check(f, records)) {
+        source_close(&f->source);
+        return 0;
+    }
+    return 1;
+}
+
+int astbin_open(AstBinFile * f, const char * fileName) {
+    return open_file(f, fileName, 1);
+}
+
+int astbin_open_lazy(AstBinFile * f, const char * fileName) {
+    return open_file(f, fileName, 0);
+}
+
+int astbin_view(AstBinFile * f, const void * data, size_t size) {
+    f->source.text = (const char *) data;
+    f->source.length = size;
+    f->source.mapped = 0;
+    f->borrowed = 1;
+    return check(f, 1);
+}
+
+void astbin_close(AstBinFile * f) {
+    if (!f->borrowed)
+        source_close(&f->source);
+    f->header = NULL;
+    f->nodes = NULL;
+    f->strings = NULL;
+}
+
+const AstBinNode * astbin_root(const AstBinFile * f) {
+    return f->header->root == ASTBIN_NONE ? NULL : &f->nodes[f->header->root];
+}
+
+const char * astbin_name(const AstBinFile * f, const AstBinNode * n) {
+    /* the table ends with a '\0', so every offset in it starts a terminated string */
+    return n->name >= f->header->stringsSize ? NULL : f->strings + n->name;
+}
+
+/* The record link records after n, or NULL */
+static const AstBinNode * follow(const AstBinFile * f, const AstBinNode * n, uint32_t link) {
+    uint32_t index = (uint32_t) (n - f->nodes);
+    return link != 0 && link < f->header->nodeCount - index ? n + link : NULL;
+}
+
+const AstBinNode * astbin_child(const AstBinFile * f, const AstBinNode * n, int i) {
+    return follow(f, n, n->child[i]);
+}
+
+const AstBinNode * astbin_sibling(const AstBinFile * f, const AstBinNode * n) {
+    return follow(f, n, n->rSibling);
+}
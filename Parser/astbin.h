@@ -0,0 +1,99 @@
+/****************************************************
+ File: astbin.h
+
+ A binary file format for a whole parse tree, made to
+ be mapped and walked in place. The file is a header,
+ then one fixed-size record per node in preorder, then
+ a string table with each name of the tree once.
+
+ Links are relative: a child or sibling is that many
+ records after the node (0: none). Every link points
+ forward, so any walk of a checked file terminates,
+ and the file has no pointers to fix after mapping.
+
+ The integers are stored in the byte order of the
+ machine that wrote the file; the header records it,
+ and a file from the other byte order is rejected.
+****************************************************/
+
+#ifndef _ASTBIN_H_
+#define _ASTBIN_H_
+
+#include <stdint.h>
+#include "libs.h"
+#include "parse.h"
+#include "source.h"
+
+#define ASTBIN_MAGIC "CMAST\r\n\032"   /* 8 bytes; the \r\n and ^Z catch text mode transfers */
+#define ASTBIN_VERSION 1
+#define ASTBIN_BYTE_ORDER 0x01020304u
+#define ASTBIN_NONE 0xFFFFFFFFu        /* no root, or no name */
+
+typedef struct {
+    char magic[8];
+    uint32_t version;
+    uint32_t byteOrder;     /* ASTBIN_BYTE_ORDER as written */
+    uint32_t nodeCount;
+    uint32_t root;          /* index of the root record, or ASTBIN_NONE for an empty tree */
+    uint32_t stringsSize;   /* bytes of the string table, after the records */
+    uint32_t reserved;
+} AstBinHeader;
+
+/* One TreeNode. The attribute fields used depend on the kind, as in TreeNode:
+   declarations and parameters use type, name and size; OP_EXPR uses op,
+   CONST_EXPR val, and ID_EXPR and CALL_EXPR name. */
+typedef struct {
+    uint8_t nodeKind;       /* NodeKind */
+    uint8_t kind;           /* DclKind, ParamKind, StmtKind or ExprKind */
+    uint8_t exprType;       /* the type field of the node */
+    uint8_t dclType;        /* attr.dclAttr.type */
+    int32_t lineNum;
+    uint32_t child[MAX_CHILDREN];  /* records ahead, 0 for none */
+    uint32_t rSibling;      /* records ahead, 0 for none */
+    int32_t value;          /* op, val, or the size of an array declaration */
+    uint32_t name;          /* offset in the string table, or ASTBIN_NONE */
+} AstBinNode;
+
+/* Write the tree to out. <Return:> 0 on a write error or when memory runs out. */
+int astbin_write(FILE * out, const TreeNode * root);
+
+/* A file opened for reading; nothing in it is copied */
+typedef struct {
+    SourceFile source;            /* the bytes, mapped when the file is a regular one */
+    int borrowed;                 /* TRUE when the bytes belong to the caller of astbin_view() */
+    const AstBinHeader * header;
+    const AstBinNode * nodes;
+    const char * strings;
+} AstBinFile;
+
+/* Map fileName ("-" for stdin) and check it: the header, that every link stays inside
+ * the file and points forward, and that every name is a terminated string in the table.
+ * <Return:> 0 when the file cannot be read or is not a valid tree file. */
+int astbin_open(AstBinFile * f, const char * fileName);
+
+/* Same as astbin_open(), but only the header and the sizes of the sections are checked, so
+ * the records are read from the file only as a walk reaches them. Such a file is walked
+ * with astbin_child() and astbin_sibling(), which check each link as it is followed. */
+int astbin_open_lazy(AstBinFile * f, const char * fileName);
+
+/* Same as astbin_open(), for size bytes already in memory. data must stay valid, and
+ * be aligned to 4 bytes. */
+int astbin_view(AstBinFile * f, const void * data, size_t size);
+
+void astbin_close(AstBinFile * f);
+
+/* The root record, or NULL for an empty tree */
+const AstBinNode * astbin_root(const AstBinFile * f);
+
+/* The name of a record, or NULL when it has none */
+const char * astbin_name(const AstBinFile * f, const AstBinNode * n);
+
+/* Child i and the right sibling of record n, or NULL; a link that would leave the file or
+ * point back reads as none. For any file, and the only safe walk of one of astbin_open_lazy(). */
+const AstBinNode * astbin_child(const AstBinFile * f, const AstBinNode * n, int i);
+const AstBinNode * astbin_sibling(const AstBinFile * f, const AstBinNode * n);
+
+#define ASTBIN_CHILD(n, i) ((n)->child[i] != 0 ? (n) + (n)->child[i] : NULL)
+#define ASTBIN_SIBLING(n) ((n)->rSibling != 0 ? (n) + (n)->rSibling : NULL)
+
+#endif
@@ -0,0 +1,290 @@
+/****************************************************
+ File: batch.c
+
+ Batch parse driver, see batch.h
+****************************************************/
+
+#include "libs.h"
+#include "batch.h"
+#include "parse.h"
+#include "source.h"
+#include "token_buffer.h"
+#include "tokenListIO.h"
+#include "thread_pool.h"
+
+#include <dirent.h>
+#include <sys/stat.h>
+#include <time.h>
+
+void batch_files_init(BatchFiles * files) {
+    files->paths = NULL;
+    files->count = 0;
+    files->capacity = 0;
+}
+
+void batch_files_release(BatchFiles * files) {
+    size_t i;
+    for (i = 0; i < files->count; i++)
+        free(files->paths[i]);
+    free(files->paths);
+    batch_files_init(files);
+}
+
+static int add_file(BatchFiles * files, const char * path) {
+    char * copy;
+    if (files->count == files->capacity) {
+        size_t capacity = files->capacity == 0 ? 64 : files->capacity * 2;
+        char ** paths = (char **) realloc(files->paths, capacity * sizeof(char *));
+        if (paths == NULL)
+            return 0;
+        files->paths = paths;
+        files->capacity = capacity;
+    }
+    copy = (char *) malloc(strlen(path) + 1);
+    if (copy == NULL)
+        return 0;
+    strcpy(copy, path);
+    files->paths[files->count++] = copy;
+    return 1;
+}
+
+static int ends_with(const char * s, const char * suffix) {
+    size_t n = strlen(s), m = strlen(suffix);
+    return n >= m && strcmp(s + n - m, suffix) == 0;
+}
+
+int batch_is_token_list(const char * path) {
+    return ends_with(path, ".tk") || ends_with(path, "tklist.txt");
+}
+
+static int is_source(const char * path) {
+    return ends_with(path, ".cm") || ends_with(path, ".c-");
+}
+
+static int skip_hidden(const struct dirent * e) {
+    return e->d_name[0] != '.';
+}
+
+int batch_add_path(BatchFiles * files, const char * path) {
+    struct stat st;
+    struct dirent ** entries;
+    int n, i, ok = 1;
+
+    if (stat(path, &st) != 0 || !S_ISDIR(st.st_mode))
+        return add_file(files, path);   /* a missing file is reported by batch_parse() */
+
+    n = scandir(path, &entries, skip_hidden, alphasort);
+    if (n < 0)
+        return 0;
+    for (i = 0; i < n; i++) {
+        size_t length = strlen(path) + strlen(entries[i]->d_name) + 2;
+        char * child = (char *) malloc(length);
+        if (child == NULL) {
+            ok = 0;
+        } else if (ok) {
+            snprintf(child, length, "%s/%s", path, entries[i]->d_name);
+            if (stat(child, &st) == 0) {
+                if (S_ISDIR(st.st_mode))
+                    ok = batch_add_path(files, child);
+                else if (is_source(child) || batch_is_token_list(child))
+                    ok = add_file(files, child);
+            }
+        }
+        free(child);
+        free(entries[i]);
+    }
+    free(entries);
+    return ok;
+}
+
+static double now(void) {
+    struct timespec t;
+    clock_gettime(CLOCK_MONOTONIC, &t);
+    return t.tv_sec + t.tv_nsec / 1e9;
+}
+
+/* Read the tokens of path into tokens; a source file stays open in src while they are used */
+static int read_tokens(const char * path, SourceFile * src, TokenBuffer * tokens) {
+    if (batch_is_token_list(path)) {
+        FILE * fp = fopen(path, "r");
+        TokenList list;
+        int ok;
+        if (fp == NULL)
+            return 0;
+        list = read_token_list(fp);
+        fclose(fp);
+        ok = token_buffer_from_list(tokens, list);
+        token_list_free(list);
+        return ok;
+    }
+    return source_open(src, path) && token_buffer_scan(tokens, src->text, src->length);
+}
+
+static void parse_file(const char * path, BatchResult * r) {
+    double start = now();
+    char * diagnostics = NULL;
+    size_t diagnosticsLength = 0;
+    FILE * listing = open_memstream(&diagnostics, &diagnosticsLength);
+    Parser * parser = listing == NULL ? NULL : new_parser(listing);
+    SourceFile src = {"", 0, 0};
+    TokenBuffer tokens;
+
+    r->path = path;
+    token_buffer_init(&tokens);
+    if (parser != NULL && read_tokens(path, &src, &tokens)) {
+        TreeNode * root;
+        parser_set_token_buffer(parser, &tokens);
+        root = parser->parse(parser);
+        r->ok = 1;
+        r->syntaxError = parser_error(parser);
+        r->tokens = tokens.count;
+        r->nodes = parser_stats(parser).nodes;
+        parser->free_tree(parser, root);
+    }
+    delete_parser(parser);
+    token_buffer_release(&tokens);
+    source_close(&src);
+    if (listing != NULL)
+        fclose(listing);
+    if (diagnostics != NULL && diagnosticsLength == 0) {
+        free(diagnostics);
+        diagnostics = NULL;
+    }
+    r->diagnostics = diagnostics;
+    r->seconds = now() - start;
+}
+
+typedef struct {
+    ThreadPool * pool;
+    TaskGroup group;
+    const BatchFiles * files;
+    BatchResult * results;
+    struct range * ranges;
+} Batch;
+
+/* The files begin .. end-1. Each range starts at a different file, so ranges[begin] is its slot. */
+typedef struct range {
+    Batch * batch;
+    size_t begin;
+    size_t end;
+} Range;
+
+/* Split off the upper half of the range as a new task on this worker's queue, where an idle
+ worker can steal it, until one file is left, and parse that file. Files next to each other
+ stay on one worker while no other worker is idle. */
+static void parse_range(void * arg, int worker) {
+    Range * range = (Range *) arg;
+    Batch * b = range->batch;
+    size_t begin = range->begin, end = range->end;
+
+    while (end - begin > 1) {
+        size_t mid = begin + (end - begin) / 2;
+        Range * upper = &b->ranges[mid];
+        upper->batch = b;
+        upper->begin = mid;
+        upper->end = end;
+        pool_submit(b->pool, &b->group, parse_range, upper);
+        end = mid;
+    }
+    b->results[begin].worker = worker;
+    parse_file(b->files->paths[begin], &b->results[begin]);
+}
+
+int batch_parse(const BatchFiles * files, int threads, BatchResult * results, BatchSummary * summary) {
+    Batch b;
+    double start = now();
+    size_t i;
+
+    memset(results, 0, files->count * sizeof(BatchResult));
+    memset(summary, 0, sizeof(BatchSummary));
+    b.pool = pool_create(threads);
+    if (b.pool == NULL)
+        return 0;
+    b.ranges = (Range *) malloc((files->count + 1) * sizeof(Range));
+    if (b.ranges == NULL) {
+        pool_destroy(b.pool);
+        return 0;
+    }
+    task_group_init(&b.group);
+    b.files = files;
+    b.results = results;
+
+    if (files->count > 0) {
+        b.ranges[0].batch = &b;
+        b.ranges[0].begin = 0;
+        b.ranges[0].end = files->count;
+        pool_submit(b.pool, &b.group, parse_range, &b.ranges[0]);
+        pool_wait(b.pool, &b.group);
+    }
+
+    summary->threads = pool_size(b.pool);
+    task_group_destroy(&b.group);
+    pool_destroy(b.pool);
+    free(b.ranges);
+
+    summary->files = files->count;
+    for (i = 0; i < files->count; i++) {
+        if (!results[i].ok)
+            summary->failed++;
+        else if (results[i].syntaxError)
+            summary->withErrors++;
+        summary->tokens += results[i].tokens;
+        summary->nodes += results[i].nodes;
+    }
+    summary->seconds = now() - start;
+    return 1;
+}
+
+void batch_results_release(BatchResult * results, size_t count) {
+    size_t i;
+    for (i = 0; i < count; i++) {
+        free(results[i].diagnostics);
+        results[i].diagnostics = NULL;
+    }
+}
+
+static double per_second(size_t n, double seconds) {
+    return seconds > 0 ? n / seconds : 0.0;
+}
+
+void batch_print_report(FILE * out, const BatchResult * results, const BatchSummary * summary) {
+    size_t i;
+    int w;
+
+    for (i = 0; i < summary->files; i++) {
+        const BatchResult * r = &results[i];
+        if (!r->ok)
+            fprintf(out, "%s: cannot read the file\n", r->path);
+        else if (r->syntaxError || r->diagnostics != NULL)
+            fprintf(out, "%s: syntax error\n", r->path);
+        if (r->diagnostics != NULL) {
+            size_t n = strlen(r->diagnostics);
+            fputs(r->diagnostics, out);
+            if (r->diagnostics[n - 1] != '\n')
+                fputc('\n', out);
+        }
+    }
+
+    /* the thread that waits for the batch helps, and is counted as worker number threads */
+    for (w = 0; w <= summary->threads; w++) {
+        size_t files = 0, tokens = 0;
+        double busy = 0;
+        for (i = 0; i < summary->files; i++) {
+            if (results[i].worker == w) {
+                files++;
+                tokens += results[i].tokens;
+                busy += results[i].seconds;
+            }
+        }
+        if (files > 0 || w < summary->threads)
+            fprintf(out, "%s %d: %zu files, %zu tokens, %.3f s busy\n",
+                    w < summary->threads ? "worker" : "caller", w, files, tokens, busy);
+    }
+
+    fprintf(out, "%zu files on %d threads in %.3f s, %zu not read, %zu with syntax errors\n",
+            summary->files, summary->threads, summary->seconds, summary->failed, summary->withErrors);
+    fprintf(out, "%.1f files/s, %.1f tokens/s, %.1f nodes/s\n",
+            per_second(summary->files, summary->seconds),
+            per_second(summary->tokens, summary->seconds),
+            per_second(summary->nodes, summary->seconds));
+}
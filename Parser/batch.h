@@ -0,0 +1,66 @@
+/****************************************************
+ File: batch.h
+
+ Batch mode: parse many files on a pool of worker
+ threads (see thread_pool.h). Every file is parsed by
+ its own Parser, and its syntax errors are collected
+ in its own BatchResult, so the output of different
+ files and workers never mixes. The summary gives the
+ throughput in files/s, tokens/s and nodes/s.
+****************************************************/
+
+#ifndef _BATCH_H_
+#define _BATCH_H_
+
+#include "libs.h"
+
+/* The files to parse, in the order they were added */
+typedef struct {
+    char ** paths;
+    size_t count;
+    size_t capacity;
+} BatchFiles;
+
+typedef struct {
+    const char * path;
+    int ok;               /* 0 when the file could not be read, or memory ran out */
+    int syntaxError;      /* TRUE when the parser reported a syntax error */
+    int worker;           /* the worker thread that parsed the file */
+    size_t tokens;
+    size_t nodes;
+    double seconds;       /* time spent on this file, reading included */
+    char * diagnostics;   /* what the parser reported, '\0' terminated; NULL when nothing */
+} BatchResult;
+
+typedef struct {
+    int threads;
+    size_t files;
+    size_t failed;        /* files not read */
+    size_t withErrors;    /* files with syntax errors */
+    size_t tokens;
+    size_t nodes;
+    double seconds;       /* wall-clock time of the whole batch */
+} BatchSummary;
+
+void batch_files_init(BatchFiles * files);
+void batch_files_release(BatchFiles * files);
+
+/* Add path. A directory adds, recursively and in name order, the C-Minus sources (*.cm, *.c-)
+ * and token lists (*.tk, *tklist.txt) in it; any other path is added as it is.
+ * <Return:> 0 when the directory cannot be read or memory runs out. */
+int batch_add_path(BatchFiles * files, const char * path);
+
+/* TRUE when path is a token list file, read with read_token_list(), rather than a source file */
+int batch_is_token_list(const char * path);
+
+/* Parse every file on threads workers (threads < 1: one per CPU). results has files->count entries.
+ * <Return:> 0 when the worker threads cannot be started. */
+int batch_parse(const BatchFiles * files, int threads, BatchResult * results, BatchSummary * summary);
+
+/* Free the diagnostics of the results */
+void batch_results_release(BatchResult * results, size_t count);
+
+/* Print the diagnostics of each file, in file order, then the summary */
+void batch_print_report(FILE * out, const BatchResult * results, const BatchSummary * summary);
+
+#endif
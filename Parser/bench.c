@@ -0,0 +1,486 @@
+/****************************************************
+ File: bench.c
+
+ Parser benchmarks, see bench.h
+****************************************************/
+
+#include "libs.h"
+#include "bench.h"
+#include "parse.h"
+#include "parse_print.h"
+#include "compact_tree.h"
+#include "dag.h"
+#include "token_buffer.h"
+#include "tokenListIO.h"
+#include "bytecode.h"
+#include "interp.h"
+
+#include <time.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/resource.h>
+
+static double now(void) {
+    struct timespec t;
+    clock_gettime(CLOCK_MONOTONIC, &t);
+    return t.tv_sec + t.tv_nsec / 1e9;
+}
+
+#if defined(BENCH_COUNT_MALLOC)
+/* The Makefile links with --wrap=malloc, --wrap=calloc and --wrap=realloc, so the calls the
+ * program makes come here and are counted; those the C library makes inside are not */
+static long mallocCalls;
+
+void * __real_malloc(size_t size);
+void * __real_calloc(size_t count, size_t size);
+void * __real_realloc(void * p, size_t size);
+
+void * __wrap_malloc(size_t size) {
+    __atomic_add_fetch(&mallocCalls, 1, __ATOMIC_RELAXED);
+    return __real_malloc(size);
+}
+
+void * __wrap_calloc(size_t count, size_t size) {
+    __atomic_add_fetch(&mallocCalls, 1, __ATOMIC_RELAXED);
+    return __real_calloc(count, size);
+}
+
+void * __wrap_realloc(void * p, size_t size) {
+    __atomic_add_fetch(&mallocCalls, 1, __ATOMIC_RELAXED);
+    return __real_realloc(p, size);
+}
+#endif
+
+/* Calls of malloc, calloc and realloc so far, or -1 when they are not counted */
+static long malloc_calls(void) {
+#if defined(BENCH_COUNT_MALLOC)
+    return __atomic_load_n(&mallocCalls, __ATOMIC_RELAXED);
+#else
+    return -1;
+#endif
+}
+
+static long peak_rss_kib(void) {
+    struct rusage u;
+    if (getrusage(RUSAGE_SELF, &u) != 0)
+        return -1;
+#if defined(__APPLE__)
+    return u.ru_maxrss / 1024;   /* bytes on macOS, KiB elsewhere */
+#else
+    return u.ru_maxrss;
+#endif
+}
+
+static int compare_doubles(const void * a, const void * b) {
+    double x = *(const double *) a, y = *(const double *) b;
+    return (x > y) - (x < y);
+}
+
+/* Set the times of phase from the times of its runs */
+static void summarize(BenchPhase * phase, double * times, int reps) {
+    qsort(times, (size_t) reps, sizeof(double), compare_doubles);
+    phase->best = times[0];
+    phase->median = reps % 2 == 1 ? times[reps / 2] : (times[reps / 2 - 1] + times[reps / 2]) / 2;
+    phase->peakKiB = peak_rss_kib();
+}
+
+/* The calls of malloc counted after a run, minus before; -1 when they are not counted */
+static long malloc_delta(long before, long after) {
+    return before < 0 || after < 0 ? -1 : after - before;
+}
+
+static int bench_scan(const char * text, size_t length, int reps, double * times, BenchPhase * phase) {
+    int k;
+    for (k = -1; k < reps; k++) {
+        TokenBuffer b;
+        long before = malloc_calls();
+        double start;
+        int ok;
+        token_buffer_init(&b);
+        start = now();
+        ok = token_buffer_scan(&b, text, length);
+        if (k >= 0)
+            times[k] = now() - start;
+        phase->mallocs = malloc_delta(before, malloc_calls());
+        token_buffer_release(&b);
+        if (!ok)
+            return 0;
+    }
+    summarize(phase, times, reps);
+    return 1;
+}
+
+/* read_token_list() echoes each token to stdout, which goes to /dev/null meanwhile; the echo is timed */
+static int bench_read_list(const char * list, size_t length, int reps, double * times, BenchPhase * phase) {
+    int k, null, saved;
+    fflush(stdout);
+    null = open("/dev/null", O_WRONLY);
+    saved = dup(STDOUT_FILENO);
+    if (null < 0 || saved < 0 || dup2(null, STDOUT_FILENO) < 0) {
+        if (null >= 0)
+            close(null);
+        if (saved >= 0)
+            close(saved);
+        return 0;
+    }
+    close(null);
+    for (k = -1; k < reps; k++) {
+        TokenBuffer b;
+        TokenList tokens;
+        long before = malloc_calls();
+        FILE * in = fmemopen((void *) list, length, "r");
+        double start;
+        int ok;
+        if (in == NULL)
+            break;
+        token_buffer_init(&b);
+        start = now();
+        tokens = read_token_list(in);
+        ok = token_buffer_from_list(&b, tokens);
+        if (k >= 0)
+            times[k] = now() - start;
+        phase->mallocs = malloc_delta(before, malloc_calls());
+        phase->arenaObjects = tokens.store != NULL ? (long) tokens.store->objects : 0;
+        token_list_free(tokens);
+        fclose(in);
+        token_buffer_release(&b);
+        if (!ok)
+            break;
+    }
+    fflush(stdout);
+    dup2(saved, STDOUT_FILENO);
+    close(saved);
+    if (k < reps)
+        return 0;
+    summarize(phase, times, reps);
+    return 1;
+}
+
+static int bench_parse(Parser * parser, TokenBuffer * tokens, int reps, double * times,
+                       BenchPhase * phase, BenchReport * report) {
+    int k;
+    for (k = -1; k < reps; k++) {
+        long before = malloc_calls();
+        double start;
+        TreeNode * root;
+        ParseStats stats;
+        parser_set_token_buffer(parser, tokens);
+        start = now();
+        root = parser->parse(parser);
+        if (k >= 0)
+            times[k] = now() - start;
+        phase->mallocs = malloc_delta(before, malloc_calls());
+        stats = parser_stats(parser);
+        report->nodes = stats.nodes;
+        report->arenaBytes = stats.bytes;
+        report->nameBytes = stats.nameBytes;
+        phase->arenaObjects = (long) stats.arenaObjects;
+        report->syntaxError = parser_error(parser);
+        parser->free_tree(parser, root);
+    }
+    summarize(phase, times, reps);
+    return 1;
+}
+
+static int bench_print(AstRef root, int reps, double * times, BenchPhase * phase) {
+    FILE * out = fopen("/dev/null", "w");
+    int k, ok = 1;
+    if (out == NULL)
+        return 0;
+    for (k = -1; k < reps && ok; k++) {
+        long before = malloc_calls();
+        double start = now();
+        ok = print_ast_file(out, root) && fflush(out) == 0;
+        if (k >= 0)
+            times[k] = now() - start;
+        phase->mallocs = malloc_delta(before, malloc_calls());
+    }
+    fclose(out);
+    if (ok)
+        summarize(phase, times, reps);
+    return ok;
+}
+
+/* The text of the tree parser makes of tokens, which has printed bytes, into text */
+static int tree_text(Parser * parser, TokenBuffer * tokens, int recursive, char * text, size_t printed) {
+    TreeNode * root;
+    int ok;
+    parser_set_recursive_expressions(parser, recursive);
+    parser_set_token_buffer(parser, tokens);
+    root = parser->parse(parser);
+    parser_set_recursive_expressions(parser, 0);
+    ok = print_tree_buffer(text, printed + 1, root) == printed;
+    parser->free_tree(parser, root);
+    return ok;
+}
+
+/* TRUE when the expressions parsed by recursive descent make the tree of the same text as the
+ * ones parsed by precedence climbing, whose text has printed bytes */
+static int same_recursive_tree(Parser * parser, TokenBuffer * tokens, size_t printed) {
+    char * climbed = (char *) malloc(printed + 1);
+    char * descended = (char *) malloc(printed + 1);
+    int same = climbed != NULL && descended != NULL
+        && tree_text(parser, tokens, 0, climbed, printed)
+        && tree_text(parser, tokens, 1, descended, printed)
+        && memcmp(climbed, descended, printed) == 0;
+    free(climbed);
+    free(descended);
+    return same;
+}
+
+/* Parse once more with sharing on, untimed, for the numbers of the DAG */
+static int bench_sharing(Parser * parser, TokenBuffer * tokens, BenchReport * report) {
+    TreeNode * root;
+    ExprDag dag;
+    ParseStats stats;
+    int ok;
+    parser_set_sharing(parser, 1);
+    parser_set_token_buffer(parser, tokens);
+    root = parser->parse(parser);
+    parser_set_sharing(parser, 0);
+    stats = parser_stats(parser);
+    report->sharedNodes = stats.nodes;
+    report->sharedSaved = stats.shared;
+    ok = expr_dag_build(&dag, root);
+    report->dagNodes = dag.count;
+    report->dagCommon = dag.common;
+    expr_dag_release(&dag);
+    parser->free_tree(parser, root);
+    return ok;
+}
+
+int bench_run(const char * text, size_t length, int reps, BenchReport * report) {
+    static const char * names[BENCH_PHASES] = {"scan", "read list", "parse", "parse rd", "print", "compact"};
+    TokenBuffer tokens;
+    TokenList list;
+    char * listText = NULL;
+    size_t listLength = 0;
+    FILE * listOut;
+    Parser * parser = NULL;
+    FILE * listing = NULL;
+    TreeNode * root;
+    CompactTree compact;
+    double * times;
+    int k, ok;
+
+    if (reps < 1)
+        reps = 1;
+    memset(report, 0, sizeof(BenchReport));
+    report->bytes = length;
+    report->reps = reps;
+    for (k = 0; k < BENCH_PHASES; k++)
+        report->phases[k].name = names[k];
+    times = (double *) malloc((size_t) reps * sizeof(double));
+    token_buffer_init(&tokens);
+    if (times == NULL || !token_buffer_scan(&tokens, text, length)) {
+        free(times);
+        token_buffer_release(&tokens);
+        return 0;
+    }
+    report->tokens = tokens.count;
+
+    /* the same tokens as a token list file, kept in memory so that no disk is timed */
+    listOut = open_memstream(&listText, &listLength);
+    ok = listOut != NULL;
+    if (ok) {
+        list = token_buffer_to_list(&tokens);
+        /* the tokens end with EOP, so an empty list means memory ran out */
+        ok = list.head != NULL;
+        if (ok)
+            print_token_list(listOut, list);
+        token_list_free(list);
+        fclose(listOut);
+    }
+
+    /* syntax errors would go to the listing: they only matter through report->syntaxError */
+    listing = fopen("/dev/null", "w");
+    parser = listing != NULL ? new_parser(listing) : NULL;
+    ok = ok && parser != NULL
+        && bench_scan(text, length, reps, times, &report->phases[BENCH_SCAN])
+        && bench_read_list(listText, listLength, reps, times, &report->phases[BENCH_READ_LIST])
+        && bench_parse(parser, &tokens, reps, times, &report->phases[BENCH_PARSE], report);
+    /* the same tokens through the other expression parser; the counters of the tree are the same */
+    if (ok) {
+        parser_set_recursive_expressions(parser, 1);
+        bench_parse(parser, &tokens, reps, times, &report->phases[BENCH_PARSE_RECURSIVE], report);
+        parser_set_recursive_expressions(parser, 0);
+    }
+    if (ok) {
+        parser_set_token_buffer(parser, &tokens);
+        root = parser->parse(parser);
+        report->printedBytes = print_tree_buffer(NULL, 0, root);
+        ok = bench_print(ast_of_tree(root), reps, times, &report->phases[BENCH_PRINT])
+            && compact_tree_build(&compact, root);
+        parser->free_tree(parser, root);
+        report->recursiveSame = same_recursive_tree(parser, &tokens, report->printedBytes);
+        /* the compact tree prints without the tree it was made from */
+        if (ok) {
+            report->compactBytes = compact_tree_bytes(&compact);
+            ok = bench_print(ast_of_compact(&compact), reps, times, &report->phases[BENCH_PRINT_COMPACT]);
+            compact_tree_release(&compact);
+        }
+    }
+    ok = ok && bench_sharing(parser, &tokens, report);
+    delete_parser(parser);
+    if (listing != NULL)
+        fclose(listing);
+    free(listText);
+    free(times);
+    token_buffer_release(&tokens);
+    return ok;
+}
+
+void bench_print_report(FILE * out, const BenchReport * r) {
+    int k;
+    fprintf(out, "program: %zu bytes, %zu tokens, %zu nodes (%zu bytes of arena), tree text %zu bytes%s\n",
+            r->bytes, r->tokens, r->nodes, r->arenaBytes, r->printedBytes,
+            r->syntaxError ? ", WITH SYNTAX ERRORS" : "");
+    fprintf(out, "compact tree: %zu bytes, %.1f bytes/node", r->compactBytes, (double) r->compactBytes / (r->nodes > 0 ? r->nodes : 1));
+    if (r->compactBytes > 0)
+        fprintf(out, ", %.2fx smaller than the arena%s", (double) (r->arenaBytes + r->nameBytes) / r->compactBytes,
+                r->nameBytes > 0 ? " and the names" : "");
+    fputc('\n', out);
+    fprintf(out, "with sharing: %zu nodes, %zu saved; the expression DAG has %zu nodes, %zu of them common subexpressions\n",
+            r->sharedNodes, r->sharedSaved, r->dagNodes, r->dagCommon);
+    fprintf(out, "parse rd parses the expressions by recursive descent, parse by precedence climbing: %s\n",
+            r->recursiveSame ? "the same tree" : "NOT the same tree");
+    fprintf(out, "%d timed runs per phase, after one untimed run; read list includes the echo of read_token_list()\n", r->reps);
+    fprintf(out, "%-10s %12s %12s %12s %12s %12s %12s %14s\n",
+            "phase", "median ms", "best ms", "Mtokens/s", "Mnodes/s", "mallocs", "arena allocs", "peak RSS KiB");
+    for (k = 0; k < BENCH_PHASES; k++) {
+        const BenchPhase * p = &r->phases[k];
+        double seconds = p->median > 0 ? p->median : 1e-9;
+        fprintf(out, "%-10s %12.3f %12.3f %12.2f ", p->name, p->median * 1e3, p->best * 1e3, r->tokens / seconds / 1e6);
+        if (k == BENCH_PARSE || k == BENCH_PARSE_RECURSIVE || k == BENCH_PRINT || k == BENCH_PRINT_COMPACT)
+            fprintf(out, "%12.2f ", r->nodes / seconds / 1e6);
+        else
+            fprintf(out, "%12s ", "-");
+        if (p->mallocs >= 0)
+            fprintf(out, "%12ld ", p->mallocs);
+        else
+            fprintf(out, "%12s ", "?");
+        fprintf(out, "%12ld ", p->arenaObjects);
+        fprintf(out, "%14ld\n", p->peakKiB);
+    }
+}
+
+/* TRUE when two runs ended the same way */
+static int same_run(const RunResult * a, const RunResult * b) {
+    return a->status == b->status && a->value == b->value && a->globalCells == b->globalCells
+        && (a->globalCells == 0 || memcmp(a->globals, b->globals, (size_t) a->globalCells * sizeof(int)) == 0);
+}
+
+static void bench_vm(const Program * program, int reps, double * times, BenchPhase * phase, RunResult * last) {
+    int k;
+    for (k = -1; k < reps; k++) {
+        double start = now();
+        run_result_release(last);
+        vm_run(program, last);
+        if (k >= 0)
+            times[k] = now() - start;
+    }
+    phase->mallocs = -1;
+    summarize(phase, times, reps);
+}
+
+static void bench_interp(const Layout * layout, int reps, double * times, BenchPhase * phase, RunResult * last) {
+    int k;
+    for (k = -1; k < reps; k++) {
+        double start = now();
+        run_result_release(last);
+        interp_run(layout, last);
+        if (k >= 0)
+            times[k] = now() - start;
+    }
+    phase->mallocs = -1;
+    summarize(phase, times, reps);
+}
+
+int bench_execute(const char * text, size_t length, int reps, ExecReport * report, FILE * errors) {
+    TokenBuffer tokens;
+    Parser * parser = NULL;
+    FILE * listing;
+    TreeNode * root = NULL;
+    DiagnosticList diagnostics;
+    Program program;
+    Layout layout;
+    RunResult vmResult, interpResult;
+    double * times, start;
+    int ok;
+
+    if (reps < 1)
+        reps = 1;
+    memset(report, 0, sizeof(ExecReport));
+    memset(&program, 0, sizeof(Program));
+    memset(&layout, 0, sizeof(Layout));
+    memset(&vmResult, 0, sizeof(RunResult));
+    memset(&interpResult, 0, sizeof(RunResult));
+    report->bytes = length;
+    report->reps = reps;
+    report->vm.name = "vm";
+    report->interp.name = "tree walk";
+    diagnostic_list_init(&diagnostics);
+    times = (double *) malloc((size_t) reps * sizeof(double));
+    token_buffer_init(&tokens);
+    listing = fopen("/dev/null", "w");
+    parser = listing != NULL ? new_parser(listing) : NULL;
+    ok = times != NULL && parser != NULL && token_buffer_scan(&tokens, text, length);
+    if (ok) {
+        parser_set_token_buffer(parser, &tokens);
+        root = parser->parse(parser);
+        report->nodes = parser_stats(parser).nodes;
+        if (parser_error(parser)) {
+            fputs("The program has syntax errors\n", errors);
+            ok = 0;
+        }
+    }
+    if (ok) {
+        start = now();
+        ok = bytecode_compile(&program, root, &diagnostics);
+        report->compile = now() - start;
+        report->instructions = program.count;
+        report->functions = program.functionCount;
+        /* the tree is checked now, as the interpreter needs it */
+        ok = ok && layout_program(&layout, root, &diagnostics);
+        diagnostic_list_write(&diagnostics, 0, errors);
+    }
+    if (ok) {
+        bench_vm(&program, reps, times, &report->vm, &vmResult);
+        bench_interp(&layout, reps, times, &report->interp, &interpResult);
+        report->status = vmResult.status;
+        report->value = vmResult.value;
+        report->agree = same_run(&vmResult, &interpResult);
+    }
+    run_result_release(&vmResult);
+    run_result_release(&interpResult);
+    layout_release(&layout);
+    bytecode_release(&program);
+    if (root != NULL)
+        parser->free_tree(parser, root);
+    delete_parser(parser);
+    if (listing != NULL)
+        fclose(listing);
+    diagnostic_list_release(&diagnostics);
+    token_buffer_release(&tokens);
+    free(times);
+    return ok;
+}
+
+void bench_print_exec_report(FILE * out, const ExecReport * r) {
+    const BenchPhase * phases[2];
+    int k;
+    phases[0] = &r->vm;
+    phases[1] = &r->interp;
+    fprintf(out, "program: %zu bytes, %zu nodes, %d functions, %d instructions, compiled in %.3f ms\n",
+            r->bytes, r->nodes, r->functions, r->instructions, r->compile * 1e3);
+    fprintf(out, "main() %s", run_status_text(r->status));
+    if (r->status == RUN_OK)
+        fprintf(out, ", returned %d", r->value);
+    fprintf(out, "; the VM and the tree walk %s\n", r->agree ? "agree" : "DISAGREE");
+    fprintf(out, "%d timed runs each, after one untimed run\n", r->reps);
+    fprintf(out, "%-10s %12s %12s %14s\n", "run", "median ms", "best ms", "peak RSS KiB");
+    for (k = 0; k < 2; k++)
+        fprintf(out, "%-10s %12.3f %12.3f %14ld\n", phases[k]->name, phases[k]->median * 1e3, phases[k]->best * 1e3, phases[k]->peakKiB);
+    if (r->vm.median > 0)
+        fprintf(out, "speedup of the VM: %.2fx\n", r->interp.median / r->vm.median);
+}
@@ -0,0 +1,86 @@
+/****************************************************
+ File: bench.h
+
+ Benchmarks of the phases of the parser on one
+ program: scanning the source into tokens, reading the
+ same tokens from a token list, parsing them, parsing
+ them again with the recursive descent expression
+ parser of parse.h, and printing the tree, from the TreeNode tree and from
+ its compact copy (compact_tree.h). Each phase runs once untimed, then
+ reps timed times; the median and the best time are
+ reported with the throughput in tokens/s and nodes/s,
+ the allocations of one run, from malloc and from the
+ arenas, and the peak resident set size of the process
+ after the phase.
+ The programs of gen.h make the runs repeatable.
+
+ The execution benchmark compiles a program to
+ bytecode and runs it, reps times on the VM of vm.h
+ and reps times on the tree interpreter of interp.h,
+ checking that both end the same way.
+****************************************************/
+
+#ifndef _BENCH_H_
+#define _BENCH_H_
+
+#include "libs.h"
+#include "vm.h"
+
+typedef enum {BENCH_SCAN, BENCH_READ_LIST, BENCH_PARSE, BENCH_PARSE_RECURSIVE, BENCH_PRINT, BENCH_PRINT_COMPACT, BENCH_PHASES} BenchPhaseKind;
+
+typedef struct {
+    const char * name;
+    double median;        /* seconds of one run */
+    double best;
+    long mallocs;         /* calls of malloc, calloc and realloc in one run; -1 when not counted (Makefile) */
+    long arenaObjects;    /* allocations from arenas in one run, which take no malloc of their own */
+    long peakKiB;         /* peak resident set size after the phase, in KiB */
+} BenchPhase;
+
+typedef struct {
+    size_t bytes;         /* of the source text */
+    size_t tokens;
+    size_t nodes;
+    size_t arenaBytes;    /* taken by the nodes of the tree from the parser's arena */
+    size_t nameBytes;     /* taken by the interned names of the tree, 0 unless counted (parse.h) */
+    size_t compactBytes;  /* taken by the compact copy of the tree, names included */
+    size_t sharedNodes;   /* nodes of the tree parsed with sharing on (parse.h) */
+    size_t sharedSaved;   /* nodes replaced by an equal one */
+    size_t dagNodes;      /* nodes of the expression DAG of that tree (dag.h) */
+    size_t dagCommon;     /* of them, common subexpressions */
+    size_t printedBytes;  /* of the printed tree */
+    int syntaxError;      /* TRUE when the program has a syntax error, which makes the numbers suspect */
+    int recursiveSame;    /* TRUE when both expression parsers gave the tree of the same text */
+    int reps;
+    BenchPhase phases[BENCH_PHASES];
+} BenchReport;
+
+/* Run the benchmarks on the length characters of source text.
+ * <Return:> 0 when memory runs out. */
+int bench_run(const char * text, size_t length, int reps, BenchReport * report);
+
+/* Print the report as a table */
+void bench_print_report(FILE * out, const BenchReport * report);
+
+typedef struct {
+    size_t bytes;         /* of the source text */
+    size_t nodes;
+    int instructions;     /* of the bytecode */
+    int functions;
+    int reps;
+    double compile;       /* seconds to check, lay out and compile the tree */
+    BenchPhase vm;
+    BenchPhase interp;
+    RunStatus status;     /* how the runs ended */
+    int value;            /* what main() returned */
+    int agree;            /* TRUE when the VM and the interpreter ended with the same status, value and globals */
+} ExecReport;
+
+/* Run the execution benchmark on the length characters of source text. Why the program
+ * cannot be compiled is written to errors.
+ * <Return:> 0 when it cannot be compiled, or when memory runs out. */
+int bench_execute(const char * text, size_t length, int reps, ExecReport * report, FILE * errors);
+
+void bench_print_exec_report(FILE * out, const ExecReport * report);
+
+#endif
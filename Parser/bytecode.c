@@ -0,0 +1,497 @@
+/****************************************************
+ File: bytecode.c
+
+ The bytecode compiler, see bytecode.h
+****************************************************/
+
+#include "libs.h"
+#include "bytecode.h"
+#include "layout.h"
+#include "typecheck.h"
+#include "util.h"
+
+/* The compiler recurses once per level of an expression; deeper expressions are not compiled */
+#define COMPILE_DEPTH_MAX 10000
+
+typedef struct {
+    Program * program;
+    const Layout * layout;
+    DiagnosticList * diagnostics;
+    const FunctionLayout * function;
+    int top;              /* the first free register */
+    int maxTop;
+    int lastWrite;        /* the last instruction, when it writes to a temporary in a; otherwise -1 */
+    int depth;
+    int pure;             /* > 0 inside of an expression known to assign to no variable */
+    int ok;
+} Compiler;
+
+static void compileError(Compiler * c, const TreeNode * t, const char * message) {
+    int lineno = t != NULL ? t->lineNum : 0;
+    if (c->ok)
+        diagnostic_list_add(c->diagnostics, lineno, "\n>>> Compile error at line %d: %s\n", lineno, message);
+    c->ok = FALSE;
+}
+
+static int emit(Compiler * c, int op, int a, int b, int x) {
+    Program * p = c->program;
+    Instr * i;
+    if (p->count == p->capacity) {
+        int capacity = p->capacity > 0 ? 2 * p->capacity : 1024;
+        Instr * more = (Instr *) realloc(p->code, (size_t) capacity * sizeof(Instr));
+        if (more == NULL) {
+            compileError(c, NULL, "ran out of memory");
+            return p->count - 1;
+        }
+        p->code = more;
+        p->capacity = capacity;
+    }
+    i = &p->code[p->count];
+    i->op = op;
+    i->a = a;
+    i->b = b;
+    i->c = x;
+    c->lastWrite = -1;
+    return p->count++;
+}
+
+/* An instruction that writes its result to r[a], which is a temporary */
+static int emit_value(Compiler * c, int op, int a, int b, int x) {
+    int k = emit(c, op, a, b, x);
+    if (a >= c->function->slots)
+        c->lastWrite = k;
+    return k;
+}
+
+static int temp(Compiler * c) {
+    int r = c->top++;
+    if (c->top > c->maxTop)
+        c->maxTop = c->top;
+    return r;
+}
+
+/* Make the jump at k go to target */
+static void patch_to(Compiler * c, int k, int target) {
+    Instr * i;
+    if (k < 0 || !c->ok)
+        return;
+    i = &c->program->code[k];
+    if (i->op == OP_JMP)
+        i->a = target;
+    else if (i->op == OP_JZ || i->op == OP_JNZ)
+        i->b = target;
+    else
+        i->c = target;
+}
+
+/* Make the jump at k go to the next instruction, which is the target of a jump now */
+static void patch(Compiler * c, int k) {
+    patch_to(c, k, c->program->count);
+    c->lastWrite = -1;
+}
+
+static const Storage * storage_of(Compiler * c, const TreeNode * t) {
+    const Storage * s = layout_find(c->layout, (const TreeNode *) t->something);
+    if (s == NULL)
+        compileError(c, t, "a name has no storage");
+    return s;
+}
+
+static int is_const(const TreeNode * t) {
+    return t != NULL && t->nodeKind == EXPR_ND && t->kind.expr == CONST_EXPR;
+}
+
+static int compile_expression(Compiler * c, const TreeNode * t);
+
+/* TRUE when the expression t may assign to a variable: when it has an assignment, or is too deep to tell */
+static int assigns(const TreeNode * t, int depth) {
+    const TreeNode * arg;
+    int k;
+    if (t == NULL)
+        return FALSE;
+    if (depth > COMPILE_DEPTH_MAX || t->nodeKind == STMT_ND || t->attr.exprAttr.op == ASSIGN)
+        return TRUE;
+    if (t->kind.expr == CALL_EXPR) {
+        for (arg = t->child[0]; arg != NULL; arg = arg->rSibling)
+            if (assigns(arg, depth + 1))
+                return TRUE;
+        return FALSE;
+    }
+    for (k = 0; k < MAX_CHILDREN; k++)
+        if (assigns(t->child[k], depth + 1))
+            return TRUE;
+    return FALSE;
+}
+
+/* Compile the operand t, which the operands next and then follow. Operands are read from left to
+   right: when t is a variable that one of them may assign to, its value is copied first. *pure is
+   set when they are found to assign nothing, so that they are not looked at again. */
+static int compile_operand(Compiler * c, const TreeNode * t, const TreeNode * next, const TreeNode * then, int * pure) {
+    int r = compile_expression(c, t);
+    *pure = FALSE;
+    if (r < c->function->slots && c->pure == 0) {
+        if (assigns(next, 0) || assigns(then, 0)) {
+            int copy = temp(c);
+            emit_value(c, OP_MOVE, copy, r, 0);
+            return copy;
+        }
+        *pure = TRUE;
+    }
+    return r;
+}
+
+/* Compile t, which assigns to no variable when pure is TRUE */
+static int compile_pure(Compiler * c, const TreeNode * t, int pure) {
+    int r;
+    c->pure += pure;
+    r = compile_expression(c, t);
+    c->pure -= pure;
+    return r;
+}
+
+/* The register of the value of the ID_EXPR t: its slot, or a temporary it is loaded into */
+static int compile_name(Compiler * c, const TreeNode * t) {
+    const Storage * s = storage_of(c, t);
+    int r;
+    if (s == NULL)
+        return 0;
+    switch (s->kind) {
+        case STORE_SLOT:
+            return s->offset;
+        case STORE_GLOBAL:
+            r = temp(c);
+            emit_value(c, s->array ? OP_LOADK : OP_GLOAD, r, s->offset, 0);
+            return r;
+        case STORE_FRAME:
+            r = temp(c);
+            emit_value(c, OP_FADDR, r, s->offset, 0);
+            return r;
+        default:
+            compileError(c, t, "a function is used as a variable");
+            return 0;
+    }
+}
+
+/* Put the value of r into slot: the instruction that made r writes to slot instead, if it can */
+static void move_to(Compiler * c, int slot, int r) {
+    if (r == slot)
+        return;
+    /* only a temporary: a variable, such as the one an inner assignment returns, keeps its own value */
+    if (c->lastWrite >= 0 && r >= c->function->slots && c->program->code[c->lastWrite].a == r) {
+        c->program->code[c->lastWrite].a = slot;
+        /* it writes a variable now, which a later move must not take */
+        c->lastWrite = -1;
+    } else
+        emit(c, OP_MOVE, slot, r, 0);
+}
+
+/* An assignment, an OP_EXPR or an ASSIGN_STMT; with value, its value is left in the register returned */
+static int compile_assign(Compiler * c, const TreeNode * t, int value) {
+    const TreeNode * left = t->child[0];
+    int saved = c->top;
+    int ra, ri, rv, pure, pureValue;
+
+    if (left == NULL || t->child[1] == NULL) {
+        compileError(c, t, "an assignment is incomplete");
+        return 0;
+    }
+    if (left->nodeKind == EXPR_ND && left->kind.expr == ID_EXPR) {
+        const Storage * s = storage_of(c, left);
+        if (s == NULL)
+            return 0;
+        if (s->array || s->kind == STORE_FUNCTION) {
+            compileError(c, t, "an array or a function is assigned");
+            return 0;
+        }
+        rv = compile_expression(c, t->child[1]);
+        if (s->kind == STORE_SLOT) {
+            move_to(c, s->offset, rv);
+            c->top = saved;
+            return s->offset;
+        }
+        emit(c, OP_GSTORE, s->offset, rv, 0);
+    } else {
+        /* left is a[i] */
+        if (left->child[0] == NULL || left->child[1] == NULL) {
+            compileError(c, t, "an assignment is incomplete");
+            return 0;
+        }
+        ra = compile_operand(c, left->child[0], left->child[1], t->child[1], &pure);
+        c->pure += pure;
+        ri = compile_operand(c, left->child[1], t->child[1], NULL, &pureValue);
+        rv = compile_pure(c, t->child[1], pureValue);
+        c->pure -= pure;
+        emit(c, OP_STORE, ra, ri, rv);
+    }
+    c->top = saved;
+    if (!value || rv < saved)
+        return rv;
+    ra = temp(c);
+    if (ra != rv)
+        emit_value(c, OP_MOVE, ra, rv, 0);
+    return ra;
+}
+
+/* The arguments go to the registers from the first free one on, where the window of the callee starts */
+static int compile_call(Compiler * c, const TreeNode * t) {
+    const Storage * s = storage_of(c, t);
+    const TreeNode * arg;
+    int base = c->top, k = 0;
+
+    if (s == NULL)
+        return 0;
+    if (s->kind != STORE_FUNCTION) {
+        compileError(c, t, "a variable is called");
+        return 0;
+    }
+    for (arg = t->child[0]; arg != NULL; arg = arg->rSibling, k++) {
+        int r;
+        c->top = base + k;
+        r = compile_expression(c, arg);
+        c->top = base + k;
+        move_to(c, temp(c), r);
+    }
+    c->top = base;
+    temp(c);
+    emit_value(c, OP_CALL, base, s->offset, base);
+    return base;
+}
+
+static int compile_expression(Compiler * c, const TreeNode * t) {
+    int saved = c->top;
+    int ra, rb, r, pure;
+
+    if (t == NULL) {
+        compileError(c, t, "an expression is missing");
+        return 0;
+    }
+    if (++c->depth > COMPILE_DEPTH_MAX) {
+        compileError(c, t, "an expression is nested too deeply to compile");
+        c->depth--;
+        return 0;
+    }
+    if (t->nodeKind == STMT_ND)
+        r = compile_assign(c, t, TRUE);
+    else if (t->kind.expr == CONST_EXPR) {
+        r = temp(c);
+        emit_value(c, OP_LOADK, r, t->attr.exprAttr.val, 0);
+    } else if (t->kind.expr == ID_EXPR)
+        r = compile_name(c, t);
+    else if (t->kind.expr == CALL_EXPR)
+        r = compile_call(c, t);
+    else if (t->attr.exprAttr.op == ASSIGN)
+        r = compile_assign(c, t, TRUE);
+    else if (t->child[0] == NULL || t->child[1] == NULL) {
+        compileError(c, t, "an expression is incomplete");
+        r = 0;
+    } else if ((t->attr.exprAttr.op == PLUS || t->attr.exprAttr.op == MINUS) && is_const(t->child[1])) {
+        int k = t->child[1]->attr.exprAttr.val;
+        ra = compile_expression(c, t->child[0]);
+        c->top = saved;
+        r = temp(c);
+        emit_value(c, OP_ADDK, r, ra, t->attr.exprAttr.op == PLUS ? k : (int) (0u - (unsigned) k));
+    } else {
+        int op;
+        switch (t->attr.exprAttr.op) {
+            case LBR: op = OP_LOAD; break;
+            case PLUS: op = OP_ADD; break;
+            case MINUS: op = OP_SUB; break;
+            case STAR: op = OP_MUL; break;
+            case OVER: op = OP_DIV; break;
+            case MOD: op = OP_MOD; break;
+            case LT: op = OP_LT; break;
+            case LTE: op = OP_LE; break;
+            case GT: op = OP_GT; break;
+            case GTE: op = OP_GE; break;
+            case EQ: op = OP_EQ; break;
+            default: op = OP_NE; break;
+        }
+        ra = compile_operand(c, t->child[0], t->child[1], NULL, &pure);
+        rb = compile_pure(c, t->child[1], pure);
+        c->top = saved;
+        r = temp(c);
+        emit_value(c, op, r, ra, rb);
+    }
+    c->depth--;
+    return r;
+}
+
+/* The compare-and-jump of a comparison, to c when it holds, from OP_JLT */
+static int jump_of(TokenType op) {
+    switch (op) {
+        case LT: return 0;
+        case LTE: return 1;
+        case GT: return 2;
+        case GTE: return 3;
+        case EQ: return 4;
+        case NEQ: return 5;
+        default: return -1;
+    }
+}
+
+/* The comparison that holds when k does not: LT and GE, LE and GT, EQ and NE */
+static const int negated[] = {3, 2, 1, 0, 5, 4};
+
+/* A jump taken when the condition t is when; the instruction is returned, for patch() */
+static int compile_branch(Compiler * c, const TreeNode * t, int when) {
+    int saved = c->top;
+    int k, ra, rb, j, pure;
+
+    if (t == NULL) {
+        compileError(c, t, "a condition is missing");
+        return -1;
+    }
+    k = t->nodeKind == EXPR_ND && t->kind.expr == OP_EXPR ? jump_of(t->attr.exprAttr.op) : -1;
+    if (k < 0 || t->child[0] == NULL || t->child[1] == NULL) {
+        ra = compile_expression(c, t);
+        j = emit(c, when ? OP_JNZ : OP_JZ, ra, -1, 0);
+    } else {
+        if (!when)
+            k = negated[k];
+        if (is_const(t->child[1])) {
+            ra = compile_expression(c, t->child[0]);
+            j = emit(c, OP_JLTK + k, ra, t->child[1]->attr.exprAttr.val, -1);
+        } else {
+            ra = compile_operand(c, t->child[0], t->child[1], NULL, &pure);
+            rb = compile_pure(c, t->child[1], pure);
+            j = emit(c, OP_JLT + k, ra, rb, -1);
+        }
+    }
+    c->top = saved;
+    return j;
+}
+
+static void compile_list(Compiler * c, const TreeNode * list);
+
+static void compile_statement(Compiler * c, const TreeNode * t) {
+    int saved = c->top;
+    int j, end, body;
+
+    if (t->nodeKind == EXPR_ND) {
+        compile_expression(c, t);
+    } else if (t->nodeKind == STMT_ND) {
+        switch (t->kind.stmt) {
+            case ASSIGN_STMT:
+                compile_assign(c, t, FALSE);
+                break;
+            case RTN_STMT:
+                if (t->child[0] != NULL)
+                    emit(c, OP_RET, compile_expression(c, t->child[0]), 0, 0);
+                else
+                    emit(c, OP_RETZ, 0, 0, 0);
+                break;
+            case SLCT_STMT:
+                j = compile_branch(c, t->child[0], FALSE);
+                compile_list(c, t->child[1]);
+                if (t->child[2] != NULL) {
+                    end = emit(c, OP_JMP, -1, 0, 0);
+                    patch(c, j);
+                    compile_list(c, t->child[2]);
+                    patch(c, end);
+                } else
+                    patch(c, j);
+                break;
+            case WHILE_STMT:
+                /* the test comes after the body: a jump to it, then the body, then a jump back while it holds */
+                j = emit(c, OP_JMP, -1, 0, 0);
+                body = c->program->count;
+                compile_list(c, t->child[1]);
+                patch(c, j);
+                patch_to(c, compile_branch(c, t->child[0], TRUE), body);
+                break;
+            case CMPD_STMT:
+            case FUNC_STMT:
+                compile_list(c, t->child[0]);
+                break;
+            default:
+                break;
+        }
+    }
+    c->top = saved;
+}
+
+/* This recurses once per level of nested blocks, which the parser bounds */
+static void compile_list(Compiler * c, const TreeNode * list) {
+    for (; list != NULL && c->ok; list = list->rSibling)
+        compile_statement(c, list);
+}
+
+static int compile_function(Compiler * c, const FunctionLayout * f, BcFunction * out) {
+    const TreeNode * body = f->decl->child[1];
+    c->function = f;
+    c->top = c->maxTop = f->slots;
+    c->lastWrite = -1;
+    c->depth = 0;
+    out->name = f->decl->attr.dclAttr.name;
+    out->entry = c->program->count;
+    out->params = f->params;
+    out->frameCells = f->frameCells;
+    if (body != NULL)
+        compile_list(c, body->child[0]);
+    emit(c, OP_RETZ, 0, 0, 0);
+    out->registers = c->maxTop;
+    return c->ok;
+}
+
+int bytecode_compile(Program * program, TreeNode * tree, DiagnosticList * diagnostics) {
+    Compiler c;
+    Layout layout;
+    TypeCheckStats checked;
+    int k;
+
+    memset(program, 0, sizeof(Program));
+    if (!typecheck_tree(tree, diagnostics, &checked)) {
+        diagnostic_list_add(diagnostics, 0, "\n>>> Compile error at line 0: ran out of memory\n");
+        return 0;
+    }
+    if (checked.errors > 0)
+        return 0;
+    if (!layout_program(&layout, tree, diagnostics)) {
+        layout_release(&layout);
+        return 0;
+    }
+    memset(&c, 0, sizeof(Compiler));
+    c.program = program;
+    c.layout = &layout;
+    c.diagnostics = diagnostics;
+    c.ok = TRUE;
+    program->functions = (BcFunction *) calloc((size_t) layout.functionCount + 1, sizeof(BcFunction));
+    if (program->functions == NULL)
+        compileError(&c, NULL, "ran out of memory");
+    for (k = 0; k < layout.functionCount && c.ok; k++)
+        compile_function(&c, &layout.functions[k], &program->functions[k]);
+    program->functionCount = layout.functionCount;
+    program->globalCells = layout.globalCells;
+    program->main = layout.main;
+    layout_release(&layout);
+    if (!c.ok)
+        bytecode_release(program);
+    return c.ok;
+}
+
+void bytecode_release(Program * program) {
+    free(program->code);
+    free(program->functions);
+    memset(program, 0, sizeof(Program));
+}
+
+void bytecode_print(FILE * out, const Program * p) {
+    static const char * names[OP_COUNT] = {
+        "LOADK", "MOVE", "GLOAD", "GSTORE", "FADDR", "LOAD", "STORE",
+        "ADD", "SUB", "MUL", "DIV", "MOD", "LT", "LE", "GT", "GE", "EQ", "NE", "ADDK",
+        "JMP", "JZ", "JNZ", "JLT", "JLE", "JGT", "JGE", "JEQ", "JNE",
+        "JLTK", "JLEK", "JGTK", "JGEK", "JEQK", "JNEK", "CALL", "RET", "RETZ"
+    };
+    int f, k;
+    fprintf(out, "%d cells of globals, %d instructions\n", p->globalCells, p->count);
+    for (f = 0; f < p->functionCount; f++) {
+        const BcFunction * fn = &p->functions[f];
+        int end = f + 1 < p->functionCount ? p->functions[f + 1].entry : p->count;
+        fprintf(out, "\nfunction %d %s: %d parameters, %d registers, %d cells of arrays\n",
+                f, fn->name != NULL ? fn->name : "(null)", fn->params, fn->registers, fn->frameCells);
+        for (k = fn->entry; k < end; k++) {
+            const Instr * i = &p->code[k];
+            fprintf(out, "%6d  %-7s %d %d %d\n", k, names[i->op], i->a, i->b, i->c);
+        }
+    }
+}
@@ -0,0 +1,103 @@
+/****************************************************
+ File: bytecode.h
+
+ A compiler from the tree of a program to bytecode
+ for the virtual machine of vm.h. The bytecode works
+ on registers: each call of a function has a window
+ of them, with the parameters first, then the num and
+ * variables, then the temporaries of its expressions.
+ Every instruction is an operation and three operands
+ a, b and c; r[x] is register x of the current call,
+ and mem[x] the memory cell x (layout.h).
+
+ A comparison that decides an if or a while is
+ compiled to one compare-and-jump, with a constant
+ operand when it has one, and the test of a while
+ comes after its body, so each time around a loop
+ costs one jump.
+****************************************************/
+
+#ifndef _BYTECODE_H_
+#define _BYTECODE_H_
+
+#include "libs.h"
+#include "parse.h"
+#include "diagnostics.h"
+
+typedef enum {
+    OP_LOADK,     /* r[a] = b */
+    OP_MOVE,      /* r[a] = r[b] */
+    OP_GLOAD,     /* r[a] = mem[b] */
+    OP_GSTORE,    /* mem[a] = r[b] */
+    OP_FADDR,     /* r[a] = the address of cell b of the frame of the call */
+    OP_LOAD,      /* r[a] = mem[r[b] + r[c]] */
+    OP_STORE,     /* mem[r[a] + r[b]] = r[c] */
+    OP_ADD,       /* r[a] = r[b] op r[c], for each operator down to OP_NE */
+    OP_SUB,
+    OP_MUL,
+    OP_DIV,
+    OP_MOD,
+    OP_LT,
+    OP_LE,
+    OP_GT,
+    OP_GE,
+    OP_EQ,
+    OP_NE,
+    OP_ADDK,      /* r[a] = r[b] + c */
+    OP_JMP,       /* go to a */
+    OP_JZ,        /* go to b if r[a] == 0 */
+    OP_JNZ,       /* go to b if r[a] != 0 */
+    OP_JLT,       /* go to c if r[a] op r[b], for each comparison down to OP_JNE */
+    OP_JLE,
+    OP_JGT,
+    OP_JGE,
+    OP_JEQ,
+    OP_JNE,
+    OP_JLTK,      /* go to c if r[a] op b, for each comparison down to OP_JNEK */
+    OP_JLEK,
+    OP_JGTK,
+    OP_JGEK,
+    OP_JEQK,
+    OP_JNEK,
+    OP_CALL,      /* r[a] = function b of the arguments r[c], r[c + 1], ... */
+    OP_RET,       /* return r[a] */
+    OP_RETZ,      /* return 0: the end of a function, or return without a value */
+    OP_COUNT
+} Opcode;
+
+typedef struct {
+    int op;
+    int a;
+    int b;
+    int c;
+} Instr;
+
+typedef struct {
+    const char * name;    /* points into the tree the program was compiled from */
+    int entry;            /* its first instruction */
+    int params;
+    int registers;        /* the size of its window */
+    int frameCells;       /* the memory of its local arrays */
+} BcFunction;
+
+typedef struct {
+    Instr * code;
+    int count;
+    int capacity;
+    BcFunction * functions;
+    int functionCount;
+    int globalCells;      /* the cells of the globals, from cell 0, zero when the program starts */
+    int main;             /* the index of main() */
+} Program;
+
+/* Check (typecheck.h), lay out (layout.h) and compile the program tree, which must have no
+ * syntax error. The reasons it cannot be compiled are added to diagnostics.
+ * <Return:> 0 when it cannot be, or when memory runs out. */
+int bytecode_compile(Program * program, TreeNode * tree, DiagnosticList * diagnostics);
+
+void bytecode_release(Program * program);
+
+/* Write the instructions of the program, a function at a time */
+void bytecode_print(FILE * out, const Program * program);
+
+#endif
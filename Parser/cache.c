@@ -0,0 +1,219 @@
+/****************************************************
+ File: cache.c
+
+ The parse cache on disk, see cache.h
+****************************************************/
+
+#include "libs.h"
+#include "cache.h"
+
+#include <errno.h>
+#include <time.h>
+#include <dirent.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/file.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+
+#define ENTRY_SUFFIX ".ast"
+#define TEMP_PREFIX ".tmp-"
+#define COUNTS_FILE "counts"
+
+/* A temporary file this old was left by a run that died while storing */
+#define STALE_SECONDS 3600
+
+typedef struct {
+    char name[CACHE_KEY_SIZE + sizeof(ENTRY_SUFFIX)];
+    off_t size;
+    time_t mtime;
+} Entry;
+
+int cache_open(ParseCache * c, const char * dir, size_t maxBytes) {
+    struct stat st;
+    memset(c, 0, sizeof(ParseCache));
+    /* room for the name of an entry after the directory */
+    if (strlen(dir) + 1 + sizeof(((Entry *) 0)->name) > sizeof(c->dir))
+        return 0;
+    strcpy(c->dir, dir);
+    c->maxBytes = maxBytes;
+    if (mkdir(dir, 0777) != 0 && errno != EEXIST)
+        return 0;
+    return stat(dir, &st) == 0 && S_ISDIR(st.st_mode);
+}
+
+void cache_key(char key[CACHE_KEY_SIZE], const char * kind, const void * data, size_t length) {
+    static const char digits[] = "0123456789abcdef";
+    unsigned char digest[SHA256_BYTES];
+    char versions[64];
+    Sha256 s;
+    int i;
+
+    sha256_init(&s);
+    snprintf(versions, sizeof(versions), "C-Minus parse cache, parser %d, tree file %d, ", PARSER_VERSION, ASTBIN_VERSION);
+    sha256_update(&s, versions, strlen(versions));
+    sha256_update(&s, kind, strlen(kind) + 1);
+    sha256_update(&s, data, length);
+    sha256_final(&s, digest);
+    for (i = 0; i < SHA256_BYTES; i++) {
+        key[2 * i] = digits[digest[i] >> 4];
+        key[2 * i + 1] = digits[digest[i] & 15];
+    }
+    key[2 * SHA256_BYTES] = '\0';
+}
+
+/* <Return:> 0 when the path of name is too long */
+static int entry_path(char * path, const ParseCache * c, const char * name) {
+    int n = snprintf(path, CACHE_PATH_SIZE, "%s/%s", c->dir, name);
+    return n > 0 && n < CACHE_PATH_SIZE;
+}
+
+static int key_path(char * path, const ParseCache * c, const char * key) {
+    char name[sizeof(((Entry *) 0)->name)];
+    snprintf(name, sizeof(name), "%.*s" ENTRY_SUFFIX, CACHE_KEY_SIZE - 1, key);
+    return entry_path(path, c, name);
+}
+
+int cache_lookup(ParseCache * c, const char * key, AstBinFile * f) {
+    char path[CACHE_PATH_SIZE];
+    if (!key_path(path, c, key) || !astbin_open_lazy(f, path)) {
+        c->counts.misses++;
+        return 0;
+    }
+    /* used now: the last entry to be evicted */
+    utimes(path, NULL);
+    c->counts.hits++;
+    return 1;
+}
+
+static int older(const void * a, const void * b) {
+    const Entry * x = (const Entry *) a;
+    const Entry * y = (const Entry *) b;
+    if (x->mtime != y->mtime)
+        return x->mtime < y->mtime ? -1 : 1;
+    return strcmp(x->name, y->name);
+}
+
+/* Remove the oldest entries but keep, until the others take at most maxBytes.
+   Another run may remove the same ones at the same time, which does no harm. */
+static void evict(ParseCache * c, const char * keep) {
+    char path[CACHE_PATH_SIZE];
+    Entry * entries = NULL;
+    size_t count = 0, capacity = 0, k;
+    unsigned long long total = 0;
+    time_t now = time(NULL);
+    struct dirent * d;
+    DIR * dir = opendir(c->dir);
+
+    if (dir == NULL)
+        return;
+    while ((d = readdir(dir)) != NULL) {
+        size_t n = strlen(d->d_name);
+        struct stat st;
+        if (!entry_path(path, c, d->d_name))
+            continue;
+        if (strncmp(d->d_name, TEMP_PREFIX, strlen(TEMP_PREFIX)) == 0) {
+            if (stat(path, &st) == 0 && now - st.st_mtime > STALE_SECONDS)
+                unlink(path);
+            continue;
+        }
+        if (n != CACHE_KEY_SIZE - 1 + strlen(ENTRY_SUFFIX) || strcmp(d->d_name + n - strlen(ENTRY_SUFFIX), ENTRY_SUFFIX) != 0
+            || stat(path, &st) != 0)
+            continue;
+        total += (unsigned long long) st.st_size;
+        if (strncmp(d->d_name, keep, CACHE_KEY_SIZE - 1) == 0)
+            continue;
+        if (count == capacity) {
+            size_t more = capacity > 0 ? 2 * capacity : 64;
+            Entry * bigger = (Entry *) realloc(entries, more * sizeof(Entry));
+            if (bigger == NULL)
+                break;
+            entries = bigger;
+            capacity = more;
+        }
+        strcpy(entries[count].name, d->d_name);
+        entries[count].size = st.st_size;
+        entries[count].mtime = st.st_mtime;
+        count++;
+    }
+    closedir(dir);
+    if (total > c->maxBytes) {
+        qsort(entries, count, sizeof(Entry), older);
+        for (k = 0; k < count && total > c->maxBytes; k++) {
+            if (entry_path(path, c, entries[k].name) && unlink(path) == 0)
+                c->counts.evictions++;
+            total -= (unsigned long long) entries[k].size;
+        }
+    }
+    free(entries);
+}
+
+int cache_store(ParseCache * c, const char * key, const TreeNode * root) {
+    char temp[CACHE_PATH_SIZE], path[CACHE_PATH_SIZE];
+    FILE * out;
+    int fd, ok;
+
+    if (!entry_path(temp, c, TEMP_PREFIX "XXXXXX") || !key_path(path, c, key))
+        return 0;
+    fd = mkstemp(temp);
+    if (fd < 0)
+        return 0;
+    fchmod(fd, 0644);
+    out = fdopen(fd, "wb");
+    if (out == NULL) {
+        close(fd);
+        unlink(temp);
+        return 0;
+    }
+    /* the whole file is on disk before it gets its name, so no reader sees a part of it */
+    ok = astbin_write(out, root) && fsync(fd) == 0;
+    ok = fclose(out) == 0 && ok;
+    ok = ok && rename(temp, path) == 0;
+    if (!ok) {
+        unlink(temp);
+        return 0;
+    }
+    c->counts.stores++;
+    evict(c, key);
+    return 1;
+}
+
+int cache_save_counts(ParseCache * c) {
+    char path[CACHE_PATH_SIZE], text[256];
+    CacheCounts saved;
+    ssize_t n;
+    int fd, ok;
+
+    memset(&saved, 0, sizeof(CacheCounts));
+    if (!entry_path(path, c, COUNTS_FILE))
+        return 0;
+    fd = open(path, O_RDWR | O_CREAT, 0644);
+    if (fd < 0)
+        return 0;
+    if (flock(fd, LOCK_EX) != 0) {
+        close(fd);
+        return 0;
+    }
+    n = read(fd, text, sizeof(text) - 1);
+    if (n > 0) {
+        text[n] = '\0';
+        sscanf(text, "hits %zu misses %zu stores %zu evictions %zu",
+               &saved.hits, &saved.misses, &saved.stores, &saved.evictions);
+    }
+    saved.hits += c->counts.hits;
+    saved.misses += c->counts.misses;
+    saved.stores += c->counts.stores;
+    saved.evictions += c->counts.evictions;
+    n = snprintf(text, sizeof(text), "hits %zu misses %zu stores %zu evictions %zu\n",
+                 saved.hits, saved.misses, saved.stores, saved.evictions);
+    ok = n > 0 && ftruncate(fd, 0) == 0 && pwrite(fd, text, (size_t) n, 0) == n;
+    flock(fd, LOCK_UN);
+    close(fd);
+    c->totals = saved;
+    return ok;
+}
+
+void cache_print_report(FILE * out, const ParseCache * c) {
+    fprintf(out, "Parse cache %s: %zu hits, %zu misses in this run; %zu hits, %zu misses, %zu stores, %zu evictions in all\n",
+            c->dir, c->counts.hits, c->counts.misses, c->totals.hits, c->totals.misses, c->totals.stores, c->totals.evictions);
+}
@@ -0,0 +1,69 @@
+/****************************************************
+ File: cache.h
+
+ A parse cache on disk, shared by every run that uses
+ the same directory. An entry is the tree of one input
+ as a tree file (astbin.h), named by the SHA-256 of
+ the input bytes, what kind of input it is, and the
+ versions of the parser and of the file format, so an
+ input that changed, or a new parser, never finds an
+ old tree. A hit maps the file, and its records are
+ read only as the tree is walked.
+
+ An entry is written to a temporary file and renamed
+ into place, so a reader sees a whole entry or none,
+ and concurrent runs can share the directory. After a
+ store the directory is cut back to its size bound,
+ oldest entries first; a hit makes an entry new
+ again. The counts of hits and misses are kept in the
+ directory too, under a lock, for all of the runs.
+****************************************************/
+
+#ifndef _CACHE_H_
+#define _CACHE_H_
+
+#include "libs.h"
+#include "parse.h"
+#include "astbin.h"
+#include "sha256.h"
+
+#define CACHE_PATH_SIZE 1024
+#define CACHE_KEY_SIZE (2 * SHA256_BYTES + 1)   /* in hex, with the '\0' */
+#define CACHE_DEFAULT_BYTES (256L * 1024 * 1024)
+
+typedef struct {
+    size_t hits;
+    size_t misses;
+    size_t stores;
+    size_t evictions;     /* entries removed to keep the size bound */
+} CacheCounts;
+
+typedef struct {
+    char dir[CACHE_PATH_SIZE];
+    size_t maxBytes;      /* the bound on the bytes of the entries */
+    CacheCounts counts;   /* of this run */
+    CacheCounts totals;   /* of every run, as of cache_save_counts() */
+} ParseCache;
+
+/* Use the directory dir, which is made when it is not there, for at most maxBytes of entries.
+ * <Return:> 0 when it cannot be made. */
+int cache_open(ParseCache * c, const char * dir, size_t maxBytes);
+
+/* The key of an input: length bytes of data, of the kind ("source", "tokens", ...) */
+void cache_key(char key[CACHE_KEY_SIZE], const char * kind, const void * data, size_t length);
+
+/* Map the tree of key into f, lazily (astbin_open_lazy()), counting a hit or a miss.
+ * <Return:> 0 on a miss. */
+int cache_lookup(ParseCache * c, const char * key, AstBinFile * f);
+
+/* Store the tree of key, then evict entries to keep the bound.
+ * <Return:> 0 when it could not be stored; the cache is then as it was. */
+int cache_store(ParseCache * c, const char * key, const TreeNode * root);
+
+/* Add the counts of this run to those of the directory, and read the totals.
+ * <Return:> 0 when they cannot be read or written. */
+int cache_save_counts(ParseCache * c);
+
+void cache_print_report(FILE * out, const ParseCache * c);
+
+#endif
@@ -0,0 +1,385 @@
+/****************************************************
+ File: compact_tree.c
+
+ The compact layout of a parse tree, see compact_tree.h
+****************************************************/
+
+#include "libs.h"
+#include "compact_tree.h"
+#include "intern.h"
+
+/* The fields of the header word of a record */
+#define NODE_KIND(h) ((NodeKind) ((h) & 0x3))
+#define KIND(h) ((int) (((h) >> 2) & 0xF))
+#define CHILDREN(h) (((h) >> 6) & 0xF)          /* bit k: child list k is not empty */
+#define TYPE(h) ((ExprType) (((h) >> 10) & 0x3))
+#define DCL_TYPE(h) ((ExprType) (((h) >> 12) & 0x3))
+#define HEADER(nodeKind, kind, children, type, dclType) \
+    ((uint32_t) (nodeKind) | (uint32_t) (kind) << 2 | (uint32_t) (children) << 6 \
+     | (uint32_t) (type) << 10 | (uint32_t) (dclType) << 12)
+
+/* The words of the payload of a record with header h */
+static int payload_words(uint32_t h) {
+    switch (NODE_KIND(h)) {
+        case DCL_ND: return KIND(h) == ARRAY_DCL ? 2 : 1;
+        case PARAM_ND:
+        case EXPR_ND: return 1;
+        default: return 0;
+    }
+}
+
+/* A node still to copy, and the word that gets its id */
+typedef struct {
+    const TreeNode * node;
+    size_t link;
+} BuildItem;
+
+typedef struct {
+    CompactTree * c;
+    uint32_t * nameOf;       /* by symbol id: the offset of the name in c->names, or COMPACT_NONE */
+    size_t nameOfCapacity;
+    BuildItem * stack;
+    size_t top;
+    size_t stackCapacity;
+} Builder;
+
+/* Room for n more words. <Return:> the index of the first, or COMPACT_NONE */
+static size_t reserve(CompactTree * c, size_t n) {
+    size_t first = c->count;
+    if (c->count + n >= COMPACT_NONE)
+        return COMPACT_NONE;
+    if (c->count + n > c->capacity) {
+        size_t capacity = c->capacity > 0 ? c->capacity : 1024;
+        uint32_t * more;
+        while (capacity < c->count + n)
+            capacity *= 2;
+        more = (uint32_t *) realloc(c->words, capacity * sizeof(uint32_t));
+        if (more == NULL)
+            return COMPACT_NONE;
+        c->words = more;
+        c->capacity = capacity;
+    }
+    c->count += n;
+    return first;
+}
+
+/* The offset of name in the names of the tree, where it is copied the first time */
+static uint32_t name_offset(Builder * b, const char * name) {
+    CompactTree * c = b->c;
+    SymbolId id;
+    size_t length;
+    if (name == NULL)
+        return COMPACT_NONE;
+    id = SYMBOL_ID(name);
+    if (id >= b->nameOfCapacity) {
+        size_t capacity = b->nameOfCapacity > 0 ? b->nameOfCapacity : 256;
+        uint32_t * more;
+        while (capacity <= id)
+            capacity *= 2;
+        more = (uint32_t *) realloc(b->nameOf, capacity * sizeof(uint32_t));
+        if (more == NULL)
+            return COMPACT_NONE;
+        memset(more + b->nameOfCapacity, 0xFF, (capacity - b->nameOfCapacity) * sizeof(uint32_t));
+        b->nameOf = more;
+        b->nameOfCapacity = capacity;
+    }
+    if (b->nameOf[id] != COMPACT_NONE)
+        return b->nameOf[id];
+    length = SYMBOL_LENGTH(name) + 1;
+    if (c->namesLength + length > c->namesCapacity) {
+        size_t capacity = c->namesCapacity > 0 ? c->namesCapacity : 4096;
+        char * more;
+        while (capacity < c->namesLength + length)
+            capacity *= 2;
+        if (capacity >= COMPACT_NONE || (more = (char *) realloc(c->names, capacity)) == NULL)
+            return COMPACT_NONE;
+        c->names = more;
+        c->namesCapacity = capacity;
+    }
+    memcpy(c->names + c->namesLength, name, length);
+    b->nameOf[id] = (uint32_t) c->namesLength;
+    c->namesLength += length;
+    return b->nameOf[id];
+}
+
+/* Push the nodes of the list, in reverse so that the first is copied first; their ids go
+   to the words from link on. <Return:> 0 when memory runs out. */
+static int push_list(Builder * b, const TreeNode * list, size_t n, size_t link) {
+    size_t i;
+    if (b->top + n > b->stackCapacity) {
+        size_t capacity = b->stackCapacity > 0 ? b->stackCapacity : 256;
+        BuildItem * more;
+        while (capacity < b->top + n)
+            capacity *= 2;
+        more = (BuildItem *) realloc(b->stack, capacity * sizeof(BuildItem));
+        if (more == NULL)
+            return 0;
+        b->stack = more;
+        b->stackCapacity = capacity;
+    }
+    for (i = 0; i < n; i++, list = list->rSibling) {
+        b->stack[b->top + n - 1 - i].node = list;
+        b->stack[b->top + n - 1 - i].link = link + i;
+    }
+    b->top += n;
+    return 1;
+}
+
+static size_t list_length(const TreeNode * list) {
+    size_t n = 0;
+    for (; list != NULL; list = list->rSibling)
+        n++;
+    return n;
+}
+
+/* Copy the record of t, and push its children */
+static int copy_node(Builder * b, const TreeNode * t, size_t link) {
+    CompactTree * c = b->c;
+    size_t lengths[MAX_CHILDREN], links[MAX_CHILDREN];
+    size_t words = 2, at;
+    uint32_t children = 0, h, name = COMPACT_NONE;
+    int k;
+
+    for (k = 0; k < MAX_CHILDREN; k++) {
+        lengths[k] = list_length(t->child[k]);
+        if (lengths[k] > 0) {
+            children |= 1u << k;
+            words += 1 + lengths[k];
+        }
+    }
+    h = HEADER(t->nodeKind, t->kind.stmt, children, t->type,
+               t->nodeKind == DCL_ND || t->nodeKind == PARAM_ND ? t->attr.dclAttr.type : 0);
+    if (t->nodeKind == DCL_ND || t->nodeKind == PARAM_ND
+        || (t->nodeKind == EXPR_ND && (t->kind.expr == ID_EXPR || t->kind.expr == CALL_EXPR))) {
+        const char * s = t->nodeKind == EXPR_ND ? t->attr.exprAttr.name : t->attr.dclAttr.name;
+        name = name_offset(b, s);
+        if (name == COMPACT_NONE && s != NULL)
+            return 0;
+    }
+    words += payload_words(h);
+    at = reserve(c, words);
+    if (at == COMPACT_NONE)
+        return 0;
+    c->words[link] = (uint32_t) at;
+    c->words[at] = h;
+    c->words[at + 1] = (uint32_t) t->lineNum;
+    at += 2;
+    if (t->nodeKind == DCL_ND || t->nodeKind == PARAM_ND) {
+        c->words[at++] = name;
+        if (t->nodeKind == DCL_ND && t->kind.dcl == ARRAY_DCL)
+            c->words[at++] = (uint32_t) t->attr.dclAttr.size;
+    } else if (t->nodeKind == EXPR_ND) {
+        if (t->kind.expr == CONST_EXPR)
+            c->words[at++] = (uint32_t) t->attr.exprAttr.val;
+        else if (t->kind.expr == OP_EXPR)
+            c->words[at++] = (uint32_t) t->attr.exprAttr.op;
+        else
+            c->words[at++] = name;
+    }
+    for (k = 0; k < MAX_CHILDREN; k++) {
+        if (lengths[k] == 0)
+            continue;
+        c->words[at] = (uint32_t) lengths[k];
+        links[k] = at + 1;
+        at += 1 + lengths[k];
+    }
+    c->nodes++;
+    /* the last list first, so that the first one comes off the stack first */
+    for (k = MAX_CHILDREN - 1; k >= 0; k--)
+        if (lengths[k] > 0 && !push_list(b, t->child[k], lengths[k], links[k]))
+            return 0;
+    return 1;
+}
+
+int compact_tree_build(CompactTree * c, const TreeNode * tree) {
+    Builder b;
+    size_t n = list_length(tree), top;
+    int ok;
+
+    memset(c, 0, sizeof(CompactTree));
+    memset(&b, 0, sizeof(Builder));
+    b.c = c;
+    top = reserve(c, 1 + n);
+    ok = top != COMPACT_NONE && push_list(&b, tree, n, 1);
+    if (ok)
+        c->words[0] = (uint32_t) n;
+    while (ok && b.top > 0) {
+        BuildItem item = b.stack[--b.top];
+        ok = copy_node(&b, item.node, item.link);
+    }
+    free(b.stack);
+    free(b.nameOf);
+    if (!ok)
+        compact_tree_release(c);
+    return ok;
+}
+
+void compact_tree_release(CompactTree * c) {
+    free(c->words);
+    free(c->names);
+    memset(c, 0, sizeof(CompactTree));
+}
+
+size_t compact_tree_bytes(const CompactTree * c) {
+    return c->count * sizeof(uint32_t) + c->namesLength;
+}
+
+/* The record of a compact node */
+#define RECORD(ref) ((ref).tree->words + (ref).tree->words[(ref).link])
+
+static const AstRef nullRef = {NULL, NULL, 0, 0, NULL, NULL};
+
+AstRef ast_of_tree(const TreeNode * tree) {
+    AstRef ref = nullRef;
+    ref.node = tree;
+    return ref;
+}
+
+AstRef ast_of_compact(const CompactTree * c) {
+    AstRef ref = nullRef;
+    if (c->count > 0 && c->words[0] > 0) {
+        ref.tree = c;
+        ref.link = 1;
+        ref.left = c->words[0] - 1;
+    }
+    return ref;
+}
+
+AstRef ast_of_astbin(const AstBinFile * f) {
+    AstRef ref = nullRef;
+    ref.file = f;
+    ref.record = astbin_root(f);
+    return ref;
+}
+
+int ast_is_null(AstRef ref) {
+    return ref.node == NULL && ref.tree == NULL && ref.record == NULL;
+}
+
+/* The record r of the file of ref, as a reference */
+static AstRef record_ref(AstRef ref, const AstBinNode * r) {
+    ref.record = r;
+    return ref;
+}
+
+AstRef ast_next(AstRef ref) {
+    if (ref.record != NULL)
+        return record_ref(ref, astbin_sibling(ref.file, ref.record));
+    if (ref.tree == NULL)
+        return ast_of_tree(ref.node != NULL ? ref.node->rSibling : NULL);
+    if (ref.left == 0)
+        return nullRef;
+    ref.link++;
+    ref.left--;
+    return ref;
+}
+
+AstRef ast_child(AstRef ref, int k) {
+    const uint32_t * r;
+    uint32_t h;
+    size_t at;
+    int j;
+
+    if (ref.record != NULL)
+        return record_ref(ref, astbin_child(ref.file, ref.record, k));
+    if (ref.tree == NULL)
+        return ast_of_tree(ref.node != NULL ? ref.node->child[k] : NULL);
+    r = RECORD(ref);
+    h = r[0];
+    if ((CHILDREN(h) & (1u << k)) == 0)
+        return nullRef;
+    at = 2 + (size_t) payload_words(h);
+    for (j = 0; j < k; j++)
+        if (CHILDREN(h) & (1u << j))
+            at += 1 + r[at];
+    ref.link = (uint32_t) (r + at + 1 - ref.tree->words);
+    ref.left = r[at] - 1;
+    return ref;
+}
+
+NodeKind ast_node_kind(AstRef ref) {
+    if (ref.record != NULL)
+        return (NodeKind) ref.record->nodeKind;
+    return ref.tree == NULL ? ref.node->nodeKind : NODE_KIND(RECORD(ref)[0]);
+}
+
+int ast_kind(AstRef ref) {
+    if (ref.record != NULL)
+        return ref.record->kind;
+    if (ref.tree != NULL)
+        return KIND(RECORD(ref)[0]);
+    switch (ref.node->nodeKind) {
+        case DCL_ND: return ref.node->kind.dcl;
+        case PARAM_ND: return ref.node->kind.param;
+        case STMT_ND: return ref.node->kind.stmt;
+        default: return ref.node->kind.expr;
+    }
+}
+
+int ast_line(AstRef ref) {
+    if (ref.record != NULL)
+        return ref.record->lineNum;
+    return ref.tree == NULL ? ref.node->lineNum : (int) RECORD(ref)[1];
+}
+
+TokenType ast_op(AstRef ref) {
+    const uint32_t * r;
+    if (ref.record != NULL) {
+        if (ref.record->nodeKind == STMT_ND)
+            return ref.record->kind == ASSIGN_STMT ? ASSIGN : NONE;
+        return ref.record->nodeKind == EXPR_ND && ref.record->kind == OP_EXPR ? (TokenType) ref.record->value : NONE;
+    }
+    if (ref.tree == NULL)
+        return ref.node->attr.exprAttr.op;
+    r = RECORD(ref);
+    if (NODE_KIND(r[0]) == STMT_ND)
+        return KIND(r[0]) == ASSIGN_STMT ? ASSIGN : NONE;
+    return NODE_KIND(r[0]) == EXPR_ND && KIND(r[0]) == OP_EXPR ? (TokenType) r[2] : NONE;
+}
+
+int ast_val(AstRef ref) {
+    const uint32_t * r;
+    if (ref.record != NULL)
+        return ref.record->nodeKind == EXPR_ND && ref.record->kind == CONST_EXPR ? ref.record->value : 0;
+    if (ref.tree == NULL)
+        return ref.node->attr.exprAttr.val;
+    r = RECORD(ref);
+    return NODE_KIND(r[0]) == EXPR_ND && KIND(r[0]) == CONST_EXPR ? (int) r[2] : 0;
+}
+
+const char * ast_name(AstRef ref) {
+    const uint32_t * r;
+    if (ref.record != NULL)
+        return astbin_name(ref.file, ref.record);
+    if (ref.tree == NULL) {
+        if (ref.node->nodeKind == EXPR_ND)
+            return ref.node->attr.exprAttr.name;
+        return ref.node->nodeKind == STMT_ND ? NULL : ref.node->attr.dclAttr.name;
+    }
+    r = RECORD(ref);
+    if (NODE_KIND(r[0]) == STMT_ND || (NODE_KIND(r[0]) == EXPR_ND && (KIND(r[0]) == OP_EXPR || KIND(r[0]) == CONST_EXPR)))
+        return NULL;
+    return r[2] != COMPACT_NONE ? ref.tree->names + r[2] : NULL;
+}
+
+ExprType ast_dcl_type(AstRef ref) {
+    if (ref.record != NULL)
+        return (ExprType) ref.record->dclType;
+    return ref.tree == NULL ? ref.node->attr.dclAttr.type : DCL_TYPE(RECORD(ref)[0]);
+}
+
+int ast_size(AstRef ref) {
+    const uint32_t * r;
+    if (ref.record != NULL)
+        return ref.record->nodeKind == DCL_ND ? ref.record->value : 0;
+    if (ref.tree == NULL)
+        return ref.node->attr.dclAttr.size;
+    r = RECORD(ref);
+    return NODE_KIND(r[0]) == DCL_ND && KIND(r[0]) == ARRAY_DCL ? (int) r[3] : 0;
+}
+
+ExprType ast_type(AstRef ref) {
+    if (ref.record != NULL)
+        return (ExprType) ref.record->exprType;
+    return ref.tree == NULL ? ref.node->type : TYPE(RECORD(ref)[0]);
+}
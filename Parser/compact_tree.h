@@ -0,0 +1,109 @@
+/****************************************************
+ File: compact_tree.h
+
+ A compact layout of a parse tree, and accessors that
+ read a tree in any layout, so that a pass written
+ with them (the printer of parse_print.h) runs on the
+ TreeNode tree of the parser, on a compact one, or in
+ place on a tree file (astbin.h).
+
+ A compact tree is one array of 32-bit words. A node
+ is a record of words in it, and its id is the index
+ of its first word. The records are in preorder, the
+ order the printer visits them in, and their size
+ depends on the kind of the node:
+
+   header     node kind, kind, types, child lists
+   lineNum
+   payload    op or val of an expression, the name
+              of an ID or a call; the name of a
+              declaration or parameter, then the size
+              of an array declaration
+   children   for each child list that is not empty:
+              its length n, then the ids of its n
+              nodes, a range in the array
+
+ A constant is 3 words, where a TreeNode takes over
+ 100 bytes. The names are copied into the tree, each
+ once, so it does not need the tree it was made from.
+ Words 0 to n of the array are the top-level list.
+ The something field of a TreeNode is not kept.
+****************************************************/
+
+#ifndef _COMPACT_TREE_H_
+#define _COMPACT_TREE_H_
+
+#include <stdint.h>
+#include "libs.h"
+#include "parse.h"
+#include "astbin.h"
+
+#define COMPACT_NONE 0xFFFFFFFFu   /* no name */
+
+typedef struct {
+    uint32_t * words;
+    size_t count;
+    size_t capacity;
+    char * names;            /* the names, each once and NUL-terminated */
+    size_t namesLength;
+    size_t namesCapacity;
+    size_t nodes;
+} CompactTree;
+
+/* Make the compact copy of the tree, whose names must be interned (intern.h) as the parser's are.
+ * <Return:> 0 when memory runs out, or when the tree is too large for 32-bit ids. */
+int compact_tree_build(CompactTree * c, const TreeNode * tree);
+
+void compact_tree_release(CompactTree * c);
+
+/* The bytes the tree takes */
+size_t compact_tree_bytes(const CompactTree * c);
+
+/* A node of any layout, with the nodes after it in its list: a TreeNode and its
+   rSibling chain, the node of a compact tree whose id is words[link], followed
+   by the ids of the next left nodes of its list, or a record of a tree file. */
+typedef struct {
+    const TreeNode * node;
+    const CompactTree * tree;
+    uint32_t link;
+    uint32_t left;
+    const AstBinFile * file;
+    const AstBinNode * record;
+} AstRef;
+
+/* The first node of the list of tree, of the top-level list of c, or of the tree file f */
+AstRef ast_of_tree(const TreeNode * tree);
+AstRef ast_of_compact(const CompactTree * c);
+AstRef ast_of_astbin(const AstBinFile * f);
+
+/* TRUE when ref is no node: the end of a list, or a child that is not there */
+int ast_is_null(AstRef ref);
+
+/* The next node of the list of ref, as rSibling */
+AstRef ast_next(AstRef ref);
+
+/* The first node of the list of child k of ref, as child[k] */
+AstRef ast_child(AstRef ref, int k);
+
+NodeKind ast_node_kind(AstRef ref);
+
+/* The kind of a node of that node kind: a DclKind, ParamKind, StmtKind or ExprKind */
+int ast_kind(AstRef ref);
+
+int ast_line(AstRef ref);
+
+/* attr.exprAttr.op of an OP_EXPR or an ASSIGN_STMT, val of a CONST_EXPR */
+TokenType ast_op(AstRef ref);
+int ast_val(AstRef ref);
+
+/* The name of an ID_EXPR or a CALL_EXPR, or of a declaration or a parameter */
+const char * ast_name(AstRef ref);
+
+/* attr.dclAttr.type and size of a declaration or a parameter */
+ExprType ast_dcl_type(AstRef ref);
+int ast_size(AstRef ref);
+
+/* The type field, set by the type checker */
+ExprType ast_type(AstRef ref);
+
+#endif
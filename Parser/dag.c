@@ -0,0 +1,186 @@
+/****************************************************
+ File: dag.c
+
+ The expression DAG of a tree, see dag.h
+****************************************************/
+
+#include "libs.h"
+#include "dag.h"
+#include "util.h"
+
+#include <stdint.h>
+
+#define INITIAL_SLOTS 256
+
+/* A node still to add: first reached, or with its operands added already */
+typedef struct {
+    TreeNode * node;
+    int expanded;
+} DagItem;
+
+typedef struct {
+    ExprDag * dag;
+    DagItem * stack;
+    size_t top;
+    size_t capacity;
+} Walker;
+
+/* Nodes come from an arena aligned to 16 bytes, so the low bits say nothing */
+static size_t slot_of(const ExprDag * dag, const TreeNode * t) {
+    return (size_t) (((uintptr_t) t >> 4) * 2654435761u) & (dag->slotCount - 1);
+}
+
+static int * find(const ExprDag * dag, const TreeNode * t) {
+    size_t j = slot_of(dag, t);
+    while (dag->slots[j] != 0 && dag->nodes[dag->slots[j] - 1].node != t)
+        j = (j + 1) & (dag->slotCount - 1);
+    return &dag->slots[j];
+}
+
+static int grow_slots(ExprDag * dag) {
+    ExprDag bigger = *dag;
+    size_t i;
+    bigger.slotCount = dag->slotCount == 0 ? INITIAL_SLOTS : dag->slotCount * 2;
+    bigger.slots = (int *) calloc(bigger.slotCount, sizeof(int));
+    if (bigger.slots == NULL)
+        return 0;
+    for (i = 0; i < dag->count; i++)
+        *find(&bigger, dag->nodes[i].node) = (int) i + 1;
+    free(dag->slots);
+    dag->slots = bigger.slots;
+    dag->slotCount = bigger.slotCount;
+    return 1;
+}
+
+int expr_dag_find(const ExprDag * dag, const TreeNode * t) {
+    if (dag->count == 0)
+        return -1;
+    return *find(dag, t) - 1;
+}
+
+static int push(Walker * w, TreeNode * t, int expanded) {
+    if (w->top == w->capacity) {
+        size_t capacity = w->capacity > 0 ? 2 * w->capacity : 256;
+        DagItem * more = (DagItem *) realloc(w->stack, capacity * sizeof(DagItem));
+        if (more == NULL)
+            return 0;
+        w->stack = more;
+        w->capacity = capacity;
+    }
+    w->stack[w->top].node = t;
+    w->stack[w->top].expanded = expanded;
+    w->top++;
+    return 1;
+}
+
+/* Add t, whose operands are in the DAG */
+static int add_node(ExprDag * dag, TreeNode * t) {
+    DagNode * d;
+    TreeNode * c;
+    int i;
+
+    if ((dag->count + 1) * 2 > dag->slotCount && !grow_slots(dag))
+        return 0;
+    if (dag->count == dag->capacity) {
+        size_t capacity = dag->capacity > 0 ? 2 * dag->capacity : 256;
+        DagNode * more = (DagNode *) realloc(dag->nodes, capacity * sizeof(DagNode));
+        if (more == NULL)
+            return 0;
+        dag->nodes = more;
+        dag->capacity = capacity;
+    }
+    d = &dag->nodes[dag->count];
+    d->node = t;
+    d->uses = 1;
+    d->operand = (int) dag->operandCount;
+    d->operandCount = 0;
+    for (i = 0; i < MAX_CHILDREN; i++) {
+        for (c = t->child[i]; c != NULL; c = c->rSibling) {
+            if (dag->operandCount == dag->operandCapacity) {
+                size_t capacity = dag->operandCapacity > 0 ? 2 * dag->operandCapacity : 256;
+                int * more = (int *) realloc(dag->operands, capacity * sizeof(int));
+                if (more == NULL)
+                    return 0;
+                dag->operands = more;
+                dag->operandCapacity = capacity;
+            }
+            dag->operands[dag->operandCount++] = expr_dag_find(dag, c);
+            d->operandCount++;
+        }
+    }
+    *find(dag, t) = (int) dag->count + 1;
+    dag->count++;
+    dag->occurrences++;
+    return 1;
+}
+
+/* Add the expression whose root is t, operands first; a node that is in already is used once more */
+static int add_expression(Walker * w, TreeNode * t) {
+    ExprDag * dag = w->dag;
+    TreeNode * c;
+    int i;
+
+    if (!push(w, t, FALSE))
+        return 0;
+    while (w->top > 0) {
+        DagItem item = w->stack[--w->top];
+        int index = expr_dag_find(dag, item.node);
+        if (item.expanded) {
+            if (index < 0 && !add_node(dag, item.node))
+                return 0;
+            continue;
+        }
+        if (index >= 0) {
+            dag->nodes[index].uses++;
+            dag->occurrences++;
+            if (dag->nodes[index].uses == 2)
+                dag->common++;
+            continue;
+        }
+        if (!push(w, item.node, TRUE))
+            return 0;
+        for (i = MAX_CHILDREN - 1; i >= 0; i--)
+            for (c = item.node->child[i]; c != NULL; c = c->rSibling)
+                if (!push(w, c, FALSE))
+                    return 0;
+    }
+    return 1;
+}
+
+/* Add the expressions of the statements of the list and under them.
+   This recurses once per level of nested blocks, which the parser bounds. */
+static int add_list(Walker * w, TreeNode * list) {
+    int i;
+    for (; list != NULL; list = list->rSibling) {
+        if (list->nodeKind == EXPR_ND) {
+            if (!add_expression(w, list))
+                return 0;
+            continue;
+        }
+        for (i = 0; i < MAX_CHILDREN; i++)
+            if (!add_list(w, list->child[i]))
+                return 0;
+    }
+    return 1;
+}
+
+int expr_dag_build(ExprDag * dag, TreeNode * tree) {
+    Walker w;
+    int ok;
+
+    memset(dag, 0, sizeof(ExprDag));
+    memset(&w, 0, sizeof(Walker));
+    w.dag = dag;
+    ok = add_list(&w, tree);
+    free(w.stack);
+    if (!ok)
+        expr_dag_release(dag);
+    return ok;
+}
+
+void expr_dag_release(ExprDag * dag) {
+    free(dag->nodes);
+    free(dag->operands);
+    free(dag->slots);
+    memset(dag, 0, sizeof(ExprDag));
+}
@@ -0,0 +1,56 @@
+/****************************************************
+ File: dag.h
+
+ The expression DAG of a tree: every distinct node of
+ its expressions once, each after its operands, with
+ the number of places it is used. Parsed with sharing
+ on (parser_set_sharing() of parse.h), the equal
+ subexpressions of a region are one node, so a node
+ used in more than one place is a common
+ subexpression; without sharing every node is used
+ once. A pass that works on the DAG rather than on the
+ tree, such as a constant folder or a code generator,
+ handles a common subexpression once.
+
+ A common subexpression is the same text in the same
+ scope, not the same value: a code generator that
+ keeps its value must drop it when a name it reads is
+ assigned in between.
+****************************************************/
+
+#ifndef _DAG_H_
+#define _DAG_H_
+
+#include "libs.h"
+#include "parse.h"
+
+typedef struct {
+    TreeNode * node;
+    int uses;             /* the places it is used: as an operand, or as an expression of a statement */
+    int operand;          /* its first operand in operands: child[0], then the others, arguments in order */
+    int operandCount;
+} DagNode;
+
+typedef struct {
+    DagNode * nodes;      /* every node of an expression once, after its operands */
+    size_t count;
+    size_t capacity;
+    int * operands;       /* the indices in nodes of the operands of the nodes */
+    size_t operandCount;
+    size_t operandCapacity;
+    int * slots;          /* open addressing from a node to its index + 1; 0 marks an empty slot */
+    size_t slotCount;     /* a power of 2 */
+    size_t occurrences;   /* the uses of all of the nodes: the nodes the expressions would have as a tree */
+    size_t common;        /* the nodes used in more than one place */
+} ExprDag;
+
+/* Make the DAG of the expressions of the tree.
+ * <Return:> 0 when memory runs out. */
+int expr_dag_build(ExprDag * dag, TreeNode * tree);
+
+/* The index in dag->nodes of the expression node t, or -1 when it is not in the DAG */
+int expr_dag_find(const ExprDag * dag, const TreeNode * t);
+
+void expr_dag_release(ExprDag * dag);
+
+#endif
@@ -0,0 +1,123 @@
+/****************************************************
+ File: diagnostics.c
+
+ Collected parse messages, see diagnostics.h
+****************************************************/
+
+#include "libs.h"
+#include "diagnostics.h"
+
+#include <stdarg.h>
+
+void diagnostic_list_init(DiagnosticList * d) {
+    d->items = NULL;
+    d->count = 0;
+    d->capacity = 0;
+    d->text = NULL;
+    d->textLength = 0;
+    d->textCapacity = 0;
+    d->lost = 0;
+}
+
+void diagnostic_list_release(DiagnosticList * d) {
+    free(d->items);
+    free(d->text);
+    diagnostic_list_init(d);
+}
+
+void diagnostic_list_clear(DiagnosticList * d) {
+    d->count = 0;
+    d->textLength = 0;
+    d->lost = 0;
+}
+
+/* Room for one more item and length more characters of text */
+static int reserve(DiagnosticList * d, size_t length) {
+    if (d->count == d->capacity) {
+        size_t n = d->capacity == 0 ? 16 : d->capacity * 2;
+        Diagnostic * items = (Diagnostic *) realloc(d->items, n * sizeof(Diagnostic));
+        if (items == NULL)
+            return 0;
+        d->items = items;
+        d->capacity = n;
+    }
+    if (d->textLength + length > d->textCapacity) {
+        size_t n = d->textCapacity == 0 ? 1024 : d->textCapacity;
+        char * text;
+        while (n < d->textLength + length)
+            n *= 2;
+        text = (char *) realloc(d->text, n);
+        if (text == NULL)
+            return 0;
+        d->text = text;
+        d->textCapacity = n;
+    }
+    return 1;
+}
+
+int diagnostic_list_add(DiagnosticList * d, int lineno, const char * format, ...) {
+    va_list args;
+    int length;
+
+    va_start(args, format);
+    length = vsnprintf(NULL, 0, format, args);
+    va_end(args);
+    if (length < 0 || !reserve(d, (size_t) length + 1)) {
+        d->lost = 1;
+        return 0;
+    }
+    va_start(args, format);
+    vsnprintf(d->text + d->textLength, (size_t) length + 1, format, args);
+    va_end(args);
+    d->items[d->count].lineno = lineno;
+    d->items[d->count].offset = d->textLength;
+    d->items[d->count].length = (size_t) length;
+    d->count++;
+    d->textLength += (size_t) length + 1;
+    return 1;
+}
+
+int diagnostic_list_append(DiagnosticList * d, const DiagnosticList * from, size_t first) {
+    size_t k;
+    if (from->lost)
+        d->lost = 1;
+    for (k = first; k < from->count; k++) {
+        const Diagnostic * m = &from->items[k];
+        if (!reserve(d, m->length + 1)) {
+            d->lost = 1;
+            return 0;
+        }
+        memcpy(d->text + d->textLength, from->text + m->offset, m->length + 1);
+        d->items[d->count].lineno = m->lineno;
+        d->items[d->count].offset = d->textLength;
+        d->items[d->count].length = m->length;
+        d->count++;
+        d->textLength += m->length + 1;
+    }
+    return 1;
+}
+
+void diagnostic_list_write(const DiagnosticList * d, size_t first, FILE * out) {
+    size_t k;
+    for (k = first; k < d->count; k++)
+        fwrite(DIAGNOSTIC_TEXT(d, k), 1, d->items[k].length, out);
+}
+
+char * diagnostic_list_text(const DiagnosticList * d, size_t first) {
+    size_t k, length = 0;
+    char * s, * p;
+    if (first >= d->count)
+        return NULL;
+    for (k = first; k < d->count; k++)
+        length += d->items[k].length;
+    s = (char *) malloc(length + 1);
+    if (s == NULL)
+        return NULL;
+    p = s;
+    for (k = first; k < d->count; k++) {
+        memcpy(p, DIAGNOSTIC_TEXT(d, k), d->items[k].length);
+        p += d->items[k].length;
+    }
+    *p = '\0';
+    return s;
+}
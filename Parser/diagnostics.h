@@ -0,0 +1,57 @@
+/****************************************************
+ File: diagnostics.h
+
+ The messages of a parse, collected in source order
+ instead of being written to the listing while
+ parsing. The messages are kept one after the other
+ in one growing text, so adding one rarely allocates,
+ and a run of them can be written out, or moved
+ behind those of another list, in one go.
+****************************************************/
+
+#ifndef _DIAGNOSTICS_H_
+#define _DIAGNOSTICS_H_
+
+#include "libs.h"
+
+typedef struct {
+    int lineno;          /* the line it is about */
+    size_t offset;       /* where its message starts in the text of the list */
+    size_t length;       /* the length of the message, without its terminating NUL */
+} Diagnostic;
+
+typedef struct {
+    Diagnostic * items;
+    size_t count;
+    size_t capacity;
+    char * text;         /* the messages, each as a listing shows it and NUL-terminated */
+    size_t textLength;
+    size_t textCapacity;
+    int lost;            /* TRUE when memory ran out and a message was dropped */
+} DiagnosticList;
+
+void diagnostic_list_init(DiagnosticList * d);
+
+void diagnostic_list_release(DiagnosticList * d);
+
+/* Forget every message, keeping the memory for the next ones */
+void diagnostic_list_clear(DiagnosticList * d);
+
+/* Add a message made from format as printf() makes it.
+ * <Return:> 0 when memory runs out; the message is dropped and lost is set. */
+int diagnostic_list_add(DiagnosticList * d, int lineno, const char * format, ...);
+
+/* Add the messages of from, starting at its message first, behind those of d.
+ * <Return:> 0 when memory runs out. */
+int diagnostic_list_append(DiagnosticList * d, const DiagnosticList * from, size_t first);
+
+/* Write the messages from message first on to out, in order */
+void diagnostic_list_write(const DiagnosticList * d, size_t first, FILE * out);
+
+/* The messages from message first on, as one new string.
+ * <Return:> NULL when there are none, or when memory runs out. */
+char * diagnostic_list_text(const DiagnosticList * d, size_t first);
+
+#define DIAGNOSTIC_TEXT(d, i) ((d)->text + (d)->items[i].offset)
+
+#endif
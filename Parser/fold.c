@@ -0,0 +1,333 @@
+/****************************************************
+ File: fold.c
+
+ Constant folding, see fold.h
+****************************************************/
+
+#include "libs.h"
+#include "fold.h"
+#include "visit.h"
+#include "util.h"
+
+#include <limits.h>
+
+#define NO_PARENT ((size_t) -1)
+
+/* A node of the expression being folded */
+typedef struct {
+    TreeNode * node;
+    size_t parent;        /* its index in the items, or NO_PARENT for the root */
+    size_t size;          /* the nodes of its subtree, once its children are folded */
+    int impure;           /* TRUE when the subtree calls, assigns, divides or indexes: it may do more than give a value */
+} FoldItem;
+
+typedef struct {
+    FoldItem * items;     /* the nodes of a subtree, parents before children */
+    size_t count;
+    size_t capacity;
+    FoldStats stats;
+} Folder;
+
+static int add_item(Folder * f, TreeNode * t, size_t parent) {
+    FoldItem * item;
+    if (f->count == f->capacity) {
+        size_t capacity = f->capacity > 0 ? 2 * f->capacity : 256;
+        FoldItem * more = (FoldItem *) realloc(f->items, capacity * sizeof(FoldItem));
+        if (more == NULL)
+            return 0;
+        f->items = more;
+        f->capacity = capacity;
+    }
+    item = &f->items[f->count++];
+    item->node = t;
+    item->parent = parent;
+    item->size = 1;
+    item->impure = FALSE;
+    return 1;
+}
+
+/* Put the nodes of tree in the items, breadth first, so that every node comes after its parent;
+   with siblings, the right siblings of tree as well. Nothing recurses, however deep the tree. */
+static int collect(Folder * f, TreeNode * tree, int siblings) {
+    size_t k;
+    int i;
+    f->count = 0;
+    for (; tree != NULL; tree = siblings ? tree->rSibling : NULL)
+        if (!add_item(f, tree, NO_PARENT))
+            return 0;
+    for (k = 0; k < f->count; k++) {
+        for (i = 0; i < MAX_CHILDREN; i++) {
+            TreeNode * c;
+            for (c = f->items[k].node->child[i]; c != NULL; c = c->rSibling)
+                if (!add_item(f, c, k))
+                    return 0;
+        }
+    }
+    return 1;
+}
+
+/* The number of nodes in the list and under it */
+static int count_nodes(Folder * f, TreeNode * list, size_t * count) {
+    if (!collect(f, list, TRUE))
+        return 0;
+    *count = f->count;
+    return 1;
+}
+
+static int is_const(const TreeNode * t, int val) {
+    return t->nodeKind == EXPR_ND && t->kind.expr == CONST_EXPR && t->attr.exprAttr.val == val;
+}
+
+/* The value of a op b, as C computes it with wrap-around; FALSE when there is none before run time */
+static int evaluate(TokenType op, int a, int b, int * value) {
+    switch (op) {
+        case PLUS: *value = (int) ((unsigned) a + (unsigned) b); return TRUE;
+        case MINUS: *value = (int) ((unsigned) a - (unsigned) b); return TRUE;
+        case STAR: *value = (int) ((unsigned) a * (unsigned) b); return TRUE;
+        case OVER:
+        case MOD:
+            if (b == 0 || (a == INT_MIN && b == -1))
+                return FALSE;
+            *value = op == OVER ? a / b : a % b;
+            return TRUE;
+        case LT: *value = a < b; return TRUE;
+        case LTE: *value = a <= b; return TRUE;
+        case GT: *value = a > b; return TRUE;
+        case GTE: *value = a >= b; return TRUE;
+        case EQ: *value = a == b; return TRUE;
+        case NEQ: *value = a != b; return TRUE;
+        default: return FALSE;
+    }
+}
+
+static void make_const(TreeNode * t, int value) {
+    int i;
+    t->kind.expr = CONST_EXPR;
+    t->attr.exprAttr.val = value;
+    for (i = 0; i < MAX_CHILDREN; i++)
+        t->child[i] = NULL;
+}
+
+/* t takes the place of its operand x, and keeps its own place in a list of arguments */
+static void replace(TreeNode * t, const TreeNode * x) {
+    TreeNode * next = t->rSibling;
+    *t = *x;
+    t->rSibling = next;
+}
+
+/* Fold the operator of item, whose operands are folded already */
+static void fold_node(Folder * f, FoldItem * item) {
+    TreeNode * t = item->node;
+    TreeNode * a = t->child[0];
+    TreeNode * b = t->child[1];
+    TokenType op = t->attr.exprAttr.op;
+    size_t before = item->size;
+    int value;
+
+    /* the operands are missing after a syntax error */
+    if (a == NULL || b == NULL)
+        return;
+    if (a->kind.expr == CONST_EXPR && b->kind.expr == CONST_EXPR
+        && evaluate(op, a->attr.exprAttr.val, b->attr.exprAttr.val, &value)) {
+        make_const(t, value);
+        item->size = 1;
+        f->stats.constants++;
+    } else if ((op == PLUS && is_const(a, 0)) || (op == STAR && is_const(a, 1))) {
+        replace(t, b);
+        item->size -= 2;
+        f->stats.identities++;
+    } else if (((op == PLUS || op == MINUS) && is_const(b, 0)) || ((op == STAR || op == OVER) && is_const(b, 1))) {
+        replace(t, a);
+        item->size -= 2;
+        f->stats.identities++;
+    } else if (!item->impure && ((op == STAR && (is_const(a, 0) || is_const(b, 0))) || (op == MOD && is_const(b, 1)))) {
+        make_const(t, 0);
+        item->size = 1;
+        f->stats.identities++;
+    }
+    f->stats.eliminated += before - item->size;
+}
+
+/* Fold the expression tree, children before parents */
+static int fold_expression(Folder * f, TreeNode * tree) {
+    size_t k;
+    if (tree == NULL)
+        return 1;
+    if (!collect(f, tree, FALSE))
+        return 0;
+    for (k = f->count; k-- > 0;) {
+        FoldItem * item = &f->items[k];
+        TreeNode * t = item->node;
+        if (t->nodeKind == EXPR_ND) {
+            if (t->kind.expr == CALL_EXPR || (t->kind.expr == OP_EXPR && t->attr.exprAttr.op == ASSIGN))
+                item->impure = TRUE;
+            if (t->kind.expr == OP_EXPR)
+                fold_node(f, item);
+            /* what is left of a division or an index may fail at run time (by 0, out of bounds), which x*0 must keep */
+            if (t->kind.expr == OP_EXPR && (t->attr.exprAttr.op == OVER || t->attr.exprAttr.op == MOD || t->attr.exprAttr.op == LBR))
+                item->impure = TRUE;
+        }
+        if (item->parent != NO_PARENT) {
+            f->items[item->parent].size += item->size;
+            f->items[item->parent].impure |= item->impure;
+        }
+    }
+    return 1;
+}
+
+static int fold_list(Folder * f, TreeNode ** link);
+
+/* Fold statement t; *drop is set to TRUE when it is to be taken out of its list */
+static int fold_statement(Folder * f, TreeNode * t, int * drop) {
+    TreeNode * cond = t->child[0];
+    TreeNode * taken;
+    TreeNode * other;
+    size_t count;
+
+    *drop = FALSE;
+    if (t->nodeKind == EXPR_ND)
+        return fold_expression(f, t);
+    if (t->nodeKind == DCL_ND) {
+        /* the body of a function is its child[1] */
+        return t->kind.dcl != FUN_DCL || t->child[1] == NULL || fold_statement(f, t->child[1], drop);
+    }
+    if (t->nodeKind != STMT_ND)
+        return 1;
+    switch (t->kind.stmt) {
+        case ASSIGN_STMT:
+            return fold_expression(f, t->child[0]) && fold_expression(f, t->child[1]);
+        case RTN_STMT:
+            return fold_expression(f, cond);
+        case FUNC_STMT:
+        case CMPD_STMT:
+            return fold_list(f, &t->child[0]);
+        case WHILE_STMT:
+            if (!fold_expression(f, cond) || !fold_list(f, &t->child[1]))
+                return 0;
+            if (cond == NULL || !is_const(cond, 0))
+                return 1;
+            if (!count_nodes(f, t->child[1], &count))
+                return 0;
+            f->stats.eliminated += 2 + count;
+            f->stats.branches++;
+            *drop = TRUE;
+            return 1;
+        case SLCT_STMT:
+            if (!fold_expression(f, cond) || !fold_list(f, &t->child[1]) || !fold_list(f, &t->child[2]))
+                return 0;
+            if (cond == NULL || cond->nodeKind != EXPR_ND || cond->kind.expr != CONST_EXPR)
+                return 1;
+            taken = cond->attr.exprAttr.val != 0 ? t->child[1] : t->child[2];
+            other = cond->attr.exprAttr.val != 0 ? t->child[2] : t->child[1];
+            if (!count_nodes(f, other, &count))
+                return 0;
+            f->stats.eliminated += 1 + count;
+            f->stats.branches++;
+            if (taken == NULL) {
+                f->stats.eliminated++;
+                *drop = TRUE;
+                return 1;
+            }
+            /* a block of its own, so the declarations in it keep their scope */
+            t->kind.stmt = CMPD_STMT;
+            t->child[0] = taken;
+            t->child[1] = NULL;
+            t->child[2] = NULL;
+            return 1;
+        default:
+            return 1;
+    }
+}
+
+/* Fold the statements of the list at link, taking out those that go away.
+   This recurses once per level of nested blocks, which the parser bounds. */
+static int fold_list(Folder * f, TreeNode ** link) {
+    while (*link != NULL) {
+        TreeNode * t = *link;
+        int drop;
+        if (!fold_statement(f, t, &drop))
+            return 0;
+        if (drop)
+            *link = t->rSibling;
+        else
+            link = &t->rSibling;
+    }
+    return 1;
+}
+
+int fold_tree(TreeNode ** tree, FoldStats * stats) {
+    Folder f;
+    int ok;
+
+    memset(&f, 0, sizeof(Folder));
+    ok = fold_list(&f, tree);
+    free(f.items);
+    if (stats != NULL)
+        *stats = f.stats;
+    return ok;
+}
+
+static int is_function(const TreeNode * t) {
+    return t->nodeKind == DCL_ND && t->kind.dcl == FUN_DCL;
+}
+
+/* The folder as a visitor (visit.h) of the top-level list: each function
+   is folded by the run it falls in, with a folder of its own */
+static VisitResult fold_function(TreeNode * t, int depth, void * data) {
+    int drop;
+    (void) depth;
+    return fold_statement((Folder *) data, t, &drop) ? VISIT_SKIP : VISIT_FAILED;
+}
+
+static VisitResult skip_statement(TreeNode * t, int depth, void * data) {
+    (void) t;
+    (void) depth;
+    (void) data;
+    return VISIT_SKIP;
+}
+
+static void * fold_fork(void * data) {
+    (void) data;
+    return calloc(1, sizeof(Folder));
+}
+
+static int fold_join(void * data, void * run) {
+    Folder * f = (Folder *) data;
+    Folder * r = (Folder *) run;
+    f->stats.constants += r->stats.constants;
+    f->stats.identities += r->stats.identities;
+    f->stats.branches += r->stats.branches;
+    f->stats.eliminated += r->stats.eliminated;
+    free(r->items);
+    free(r);
+    return 1;
+}
+
+int fold_tree_parallel(TreeNode ** tree, FoldStats * stats, ThreadPool * pool) {
+    Folder f;
+    Visitor v;
+    TreeNode ** link = tree;
+    int ok;
+
+    memset(&f, 0, sizeof(Folder));
+    visitor_init(&v, skip_statement, NULL);
+    visitor_on(&v, DCL_ND, FUN_DCL, fold_function, NULL);
+    v.fork = fold_fork;
+    v.join = fold_join;
+    ok = visit_parallel(pool, &v, *tree, &f) == VISIT_CONTINUE;
+    /* the other top-level statements may go away, which changes the list: they are folded here */
+    while (ok && *link != NULL) {
+        TreeNode * t = *link;
+        int drop = FALSE;
+        if (!is_function(t))
+            ok = fold_statement(&f, t, &drop);
+        if (drop)
+            *link = t->rSibling;
+        else
+            link = &t->rSibling;
+    }
+    free(f.items);
+    if (stats != NULL)
+        *stats = f.stats;
+    return ok;
+}
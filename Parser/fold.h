@@ -0,0 +1,43 @@
+/****************************************************
+ File: fold.h
+
+ Constant folding over the syntax tree of a program.
+ An OP_EXPR of arithmetic or comparison over two
+ constants becomes the constant it computes, as C
+ computes it; / and % by 0 are left to run time. The
+ identities x+0, 0+x, x-0, x*1, 1*x and x/1 become x,
+ and x*0, 0*x and x%1 become 0 when x calls nothing,
+ assigns nothing, and has no / % or index left, which
+ could fail at run time. An if with a constant
+ condition becomes a compound statement of the branch
+ it takes, or nothing when that branch is empty, and a
+ while with a condition of 0 goes away.
+
+ The tree is changed in place: a node that is replaced
+ takes over the contents of its replacement, so the
+ links to it stay valid. The nodes taken out stay in
+ the store of the tree until it is freed.
+****************************************************/
+
+#ifndef _FOLD_H_
+#define _FOLD_H_
+
+#include "parse.h"
+
+typedef struct {
+    size_t constants;     /* operators replaced by their value */
+    size_t identities;    /* operators replaced by an operand, or by 0 */
+    size_t branches;      /* if and while statements decided by their condition */
+    size_t eliminated;    /* nodes the tree has less */
+} FoldStats;
+
+/* Fold the constants of the statement list tree, a program or any part of one.
+ * stats may be NULL.
+ * <Return:> 0 when memory runs out; the tree is then folded only in part, but still correct. */
+int fold_tree(TreeNode ** tree, FoldStats * stats);
+
+/* The same folding, with the functions of the top-level list folded on the workers of pool
+ * (visit_parallel() of visit.h), each by itself; with no pool, on this thread. */
+int fold_tree_parallel(TreeNode ** tree, FoldStats * stats, ThreadPool * pool);
+
+#endif
@@ -0,0 +1,370 @@
+/****************************************************
+ File: gen.c
+
+ Synthetic C-Minus programs, see gen.h
+
+ A program has a few globals, then functions f0, f1,
+ ... and main(). Function k may call fk-1, at most
+ once and outside of its loops, so there is no
+ recursion and a run makes one call per function at
+ most; every while loop counts a counter of its own up
+ to a small bound, so a program also terminates soon
+ when it is run. / and % always have a
+ constant divisor that is not 0, and ga is only
+ indexed by constants.
+****************************************************/
+
+#include "libs.h"
+#include "gen.h"
+#include "token_buffer.h"
+#include "tokenListIO.h"
+#include "util.h"
+
+/* Parentheses, brackets and calls are nested at most this deep inside an expression */
+#define GEN_NEST_MAX 16
+
+/* Lines are indented by 4 spaces a level, up to this level */
+#define GEN_INDENT_MAX 20
+
+/* Size of the global array ga */
+#define GEN_ARRAY_SIZE 100
+
+/* Globals g0 .. g3 */
+#define GEN_GLOBALS 4
+
+/* A while loop runs at most this many times, unless the options say otherwise */
+#define GEN_LOOP_BOUND 4
+
+typedef struct {
+    FILE * out;
+    const GenOptions * o;
+    unsigned long long state;  /* of the random numbers */
+    int function;              /* the function being written: f(function-1) can be called */
+    int called;                /* TRUE once it has its call */
+    int inCall;                /* TRUE in the arguments of a call, where calls would multiply the size */
+    int loop;                  /* the level of the innermost while loop around, 0 outside of loops */
+} Gen;
+
+void gen_options_default(GenOptions * o, GenShape shape, int functions, unsigned long seed) {
+    o->shape = shape;
+    o->functions = functions;
+    o->seed = seed;
+    o->depth = 3;
+    o->statements = 5;
+    o->operands = 6;
+    o->params = 2;
+    o->loopBound = GEN_LOOP_BOUND;
+    switch (shape) {
+        case GEN_MIXED:
+            break;
+        case GEN_DEEP:
+            o->depth = 200;
+            o->statements = 2;
+            o->operands = 3;
+            o->params = 1;
+            break;
+        case GEN_EXPR:
+            o->depth = 1;
+            o->statements = 4;
+            o->operands = 400;
+            break;
+        case GEN_FUNCS:
+            o->depth = 0;
+            o->statements = 2;
+            o->operands = 3;
+            o->params = 1;
+            break;
+        case GEN_PARAMS:
+            o->depth = 1;
+            o->statements = 3;
+            o->operands = 4;
+            o->params = 64;
+            break;
+        case GEN_LOOPS:
+            o->depth = 3;
+            o->statements = 3;
+            o->operands = 4;
+            o->params = 1;
+            o->loopBound = 64;
+            break;
+    }
+}
+
+int gen_shape(const char * name, GenShape * shape) {
+    static const char * names[] = {"mixed", "deep", "expr", "funcs", "params", "loops"};
+    int k;
+    for (k = 0; k < 6; k++) {
+        if (strcmp(name, names[k]) == 0) {
+            *shape = (GenShape) k;
+            return 1;
+        }
+    }
+    return 0;
+}
+
+/* xorshift64*: the same numbers everywhere, unlike rand() */
+static unsigned long long next_random(Gen * g) {
+    g->state ^= g->state >> 12;
+    g->state ^= g->state << 25;
+    g->state ^= g->state >> 27;
+    return g->state * 2685821657736338717ULL;
+}
+
+/* A random number from 0 to n - 1 */
+static int below(Gen * g, int n) {
+    return (int) ((next_random(g) >> 33) % (unsigned long long) n);
+}
+
+static void indent(Gen * g, int level) {
+    fprintf(g->out, "%*s", 4 * (level < GEN_INDENT_MAX ? level : GEN_INDENT_MAX), "");
+}
+
+static void expr(Gen * g, int operands, int nest);
+
+/* The arguments of a call of a function of the program */
+static void args(Gen * g, int nest) {
+    int k;
+    g->inCall = TRUE;
+    for (k = 0; k < g->o->params; k++) {
+        if (k > 0)
+            fputs(", ", g->out);
+        expr(g, 1 + below(g, 2), nest);
+    }
+    g->inCall = FALSE;
+}
+
+static void variable(Gen * g) {
+    int k = below(g, 2 + g->o->params + GEN_GLOBALS);
+    if (k == 0)
+        fputs("i", g->out);
+    else if (k == 1)
+        fputs("t", g->out);
+    else if (k < 2 + g->o->params)
+        fprintf(g->out, "p%d", k - 2);
+    else
+        fprintf(g->out, "g%d", k - 2 - g->o->params);
+}
+
+/* An element of ga: in a loop of a loops program, the one its counter points at */
+static void element(Gen * g) {
+    if (g->o->shape == GEN_LOOPS && g->loop > 0)
+        fprintf(g->out, "ga[l%d]", g->loop);
+    else
+        fprintf(g->out, "ga[%d]", below(g, GEN_ARRAY_SIZE));
+}
+
+/* One call per function, outside of loops, but in a loops program, where each function runs on its
+   own. More calls, or calls to any earlier function, would make the run time exponential in the
+   number of functions. */
+static int may_call(Gen * g) {
+    return g->function > 0 && g->o->shape != GEN_LOOPS && !g->called && g->loop == 0;
+}
+
+static void atom(Gen * g, int nest) {
+    int k = below(g, 10);
+    if (nest < GEN_NEST_MAX && k == 0 && may_call(g) && !g->inCall) {
+        g->called = TRUE;
+        fprintf(g->out, "f%d(", g->function - 1);
+        args(g, nest + 1);
+        fputs(")", g->out);
+    } else if (nest < GEN_NEST_MAX && k == 1) {
+        element(g);
+    } else if (k < 5) {
+        fprintf(g->out, "%d", below(g, 1000));
+    } else
+        variable(g);
+}
+
+/* An expression of the given number of operands, with parentheses at random */
+static void expr(Gen * g, int operands, int nest) {
+    static const char * ops[] = {"+", "-", "*", "/", "%"};
+    const char * op;
+    int paren, left;
+
+    if (operands <= 1) {
+        atom(g, nest);
+        return;
+    }
+    paren = nest < GEN_NEST_MAX && below(g, 4) == 0;
+    if (paren)
+        fputs("(", g->out);
+    op = ops[below(g, 5)];
+    if (op[0] == '/' || op[0] == '%') {
+        expr(g, operands - 1, nest + paren);
+        fprintf(g->out, " %s %d", op, 1 + below(g, 9));
+    } else {
+        left = 1 + below(g, operands - 1);
+        expr(g, left, nest + paren);
+        fprintf(g->out, " %s ", op);
+        expr(g, operands - left, nest + paren);
+    }
+    if (paren)
+        fputs(")", g->out);
+}
+
+static void condition(Gen * g) {
+    static const char * relations[] = {"<", "<=", ">", ">=", "==", "!="};
+    int operands = g->o->operands / 2 > 1 ? g->o->operands / 2 : 1;
+    expr(g, operands, 0);
+    fprintf(g->out, " %s ", relations[below(g, 6)]);
+    expr(g, operands, 0);
+}
+
+/* An assignment or a call */
+static void simple(Gen * g, int level) {
+    int k = below(g, 6);
+    const char * name = NULL;
+    indent(g, level);
+    if (k == 0 && may_call(g)) {
+        g->called = TRUE;
+        fprintf(g->out, "f%d(", g->function - 1);
+        args(g, 1);
+        fputs(");\n", g->out);
+        return;
+    }
+    if (k == 1)
+        element(g);
+    else if (k == 2)
+        fprintf(g->out, "g%d", below(g, GEN_GLOBALS));
+    else {
+        name = below(g, 2) == 0 ? "i" : "t";
+        fputs(name, g->out);
+    }
+    /* some assignments are chained, which stores the value of the inner one again: ga[e] = t = ..., i = t = ... */
+    if (k == 1)
+        fputs(" = t", g->out);
+    else if (k == 5)
+        fputs(name[0] == 'i' ? " = t" : " = i", g->out);
+    fputs(" = ", g->out);
+    expr(g, g->o->operands, 0);
+    fputs(";\n", g->out);
+}
+
+static void block(Gen * g, int depth, int level);
+
+/* An if, an if with else, or a while, with blocks depth - 1 deep inside; always a while in a loops program */
+static void compound(Gen * g, int depth, int level) {
+    int k = g->o->shape == GEN_LOOPS ? 2 : below(g, 3);
+    if (k == 2) {
+        int outer = g->loop;
+        /* the counter of the loop is l<level>, which nothing inside assigns */
+        indent(g, level);
+        fprintf(g->out, "l%d = 0;\n", level);
+        indent(g, level);
+        fprintf(g->out, "while (l%d < %d) {\n", level, 1 + below(g, g->o->loopBound));
+        g->loop = level;
+        block(g, depth - 1, level + 1);
+        g->loop = outer;
+        indent(g, level + 1);
+        fprintf(g->out, "l%d = l%d + 1;\n", level, level);
+        indent(g, level);
+        fputs("}\n", g->out);
+        return;
+    }
+    indent(g, level);
+    fputs("if (", g->out);
+    condition(g);
+    fputs(") {\n", g->out);
+    block(g, depth - 1, level + 1);
+    indent(g, level);
+    if (k == 1) {
+        /* only one branch goes deeper, or the size would double with each level */
+        fputs("} else {\n", g->out);
+        block(g, 0, level + 1);
+        indent(g, level);
+    }
+    fputs("}\n", g->out);
+}
+
+/* The statements of a block. While depth > 0, one of them is a compound statement, and in a
+   mixed program any of them may be. */
+static void block(Gen * g, int depth, int level) {
+    int k, nested = depth > 0 ? below(g, g->o->statements) : -1;
+    for (k = 0; k < g->o->statements; k++) {
+        if (k == nested || (depth > 0 && g->o->shape == GEN_MIXED && below(g, 4) == 0))
+            compound(g, depth, level);
+        else
+            simple(g, level);
+    }
+}
+
+/* The locals of a function: i, t, and a loop counter for each level of blocks */
+static void locals(Gen * g) {
+    int k;
+    fputs("    num i;\n    num t;\n", g->out);
+    for (k = 1; k <= g->o->depth; k++)
+        fprintf(g->out, "    num l%d;\n", k);
+}
+
+static void function(Gen * g) {
+    int k;
+    fprintf(g->out, "num f%d(", g->function);
+    if (g->o->params == 0)
+        fputs("void", g->out);
+    for (k = 0; k < g->o->params; k++)
+        fprintf(g->out, "%snum p%d", k > 0 ? ", " : "", k);
+    fputs(")\n-->\n", g->out);
+    g->called = FALSE;
+    locals(g);
+    block(g, g->o->depth, 1);
+    fputs("    return ", g->out);
+    expr(g, g->o->operands, 0);
+    fputs(";\n:)\n", g->out);
+}
+
+int gen_program(FILE * out, const GenOptions * o) {
+    Gen g;
+    int k;
+
+    g.out = out;
+    g.o = o;
+    g.state = o->seed * 0x9E3779B97F4A7C15ULL + 1;
+    g.function = 0;
+    g.called = FALSE;
+    g.inCall = FALSE;
+    g.loop = 0;
+    fprintf(out, "/* generated: %d functions, seed %lu */\n", o->functions, o->seed);
+    for (k = 0; k < GEN_GLOBALS; k++)
+        fprintf(out, "num g%d;\n", k);
+    fprintf(out, "num ga[%d];\n", GEN_ARRAY_SIZE);
+    for (g.function = 0; g.function < o->functions; g.function++)
+        function(&g);
+
+    /* main() calls the last function, or in a loops program each function, with constant arguments */
+    fputs("void main(void)\n-->\n    num i;\n", out);
+    for (g.function = o->shape == GEN_LOOPS ? 0 : o->functions - 1; g.function >= 0 && g.function < o->functions; g.function++) {
+        fprintf(out, "    i = f%d(", g.function);
+        for (k = 0; k < o->params; k++)
+            fprintf(out, "%s%d", k > 0 ? ", " : "", below(&g, 1000));
+        fputs(");\n", out);
+    }
+    fputs("    return;\n:)\n", out);
+    return !ferror(out);
+}
+
+int gen_token_list(FILE * out, const GenOptions * o) {
+    char * text = NULL;
+    size_t length = 0;
+    FILE * mem = open_memstream(&text, &length);
+    TokenBuffer tokens;
+    TokenList list;
+    int ok;
+
+    if (mem == NULL)
+        return 0;
+    ok = gen_program(mem, o);
+    fclose(mem);
+    token_buffer_init(&tokens);
+    ok = ok && text != NULL && token_buffer_scan(&tokens, text, length);
+    if (ok) {
+        list = token_buffer_to_list(&tokens);
+        ok = list.tail != NULL && list.tail->token->type == EOP;
+        if (ok)
+            print_token_list(out, list);
+        token_list_free(list);
+        ok = ok && !ferror(out);
+    }
+    token_buffer_release(&tokens);
+    free(text);
+    return ok;
+}
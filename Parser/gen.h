@@ -0,0 +1,55 @@
+/****************************************************
+ File: gen.h
+
+ A generator of synthetic C-Minus programs, for the
+ benchmarks (bench.h) and for testing the parser on
+ inputs of any size. The programs are valid: every
+ name is declared before it is used, and every call
+ goes to the function defined just before, with the
+ right number of arguments, so a run is short. The same options and seed give
+ the same program on every platform, so benchmark
+ numbers can be compared from run to run.
+****************************************************/
+
+#ifndef _GEN_H_
+#define _GEN_H_
+
+#include "libs.h"
+
+/* What the program stresses */
+typedef enum {
+    GEN_MIXED,    /* a bit of everything, like a hand-written program */
+    GEN_DEEP,     /* if and while blocks nested depth deep */
+    GEN_EXPR,     /* long expressions */
+    GEN_FUNCS,    /* many small functions */
+    GEN_PARAMS,   /* wide parameter lists, and calls with as many arguments */
+    GEN_LOOPS     /* kernels to run: while loops nested depth deep over ga, each called by main() */
+} GenShape;
+
+typedef struct {
+    GenShape shape;
+    int functions;       /* functions before main(); the size of the program grows with it */
+    int depth;           /* how deeply blocks are nested */
+    int statements;      /* statements in each block */
+    int operands;        /* operands of an expression */
+    int params;          /* parameters of each function */
+    int loopBound;       /* a while loop runs at most this many times, at most the size of ga */
+    unsigned long seed;
+} GenOptions;
+
+/* The options of shape, for a program of the given number of functions */
+void gen_options_default(GenOptions * o, GenShape shape, int functions, unsigned long seed);
+
+/* The shape named name: "mixed", "deep", "expr", "funcs", "params" or "loops".
+ * <Return:> 0 for any other name. */
+int gen_shape(const char * name, GenShape * shape);
+
+/* Write the source text of the program to out.
+ * <Return:> 0 on a write error. */
+int gen_program(FILE * out, const GenOptions * o);
+
+/* Write the program as a token list, as print_token_list() writes it and read_token_list() reads it.
+ * <Return:> 0 on a write error, or when memory runs out. */
+int gen_token_list(FILE * out, const GenOptions * o);
+
+#endif
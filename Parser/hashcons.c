@@ -0,0 +1,136 @@
+/****************************************************
+ File: hashcons.c
+
+ Hash-consing of expression nodes, see hashcons.h
+****************************************************/
+
+#include "libs.h"
+#include "hashcons.h"
+#include "util.h"
+
+#define INITIAL_SLOTS 256
+
+/* Stands in the slot of a node that was taken out; it equals no expression */
+static TreeNode taken = {.nodeKind = STMT_ND};
+
+static size_t mix(size_t h, size_t v) {
+    return (h ^ v) * 0x9E3779B1u + (h >> 15);
+}
+
+static size_t hash_of(const TreeNode * t) {
+    size_t h = (size_t) t->kind.expr;
+    int i;
+    switch (t->kind.expr) {
+        case CONST_EXPR: h = mix(h, (size_t) (unsigned) t->attr.exprAttr.val); break;
+        case ID_EXPR: h = mix(h, (size_t) t->attr.exprAttr.name >> 4); break;
+        default: h = mix(h, (size_t) t->attr.exprAttr.op); break;
+    }
+    /* nodes come from an arena aligned to 16 bytes */
+    for (i = 0; i < MAX_CHILDREN; i++)
+        h = mix(h, (size_t) t->child[i] >> 4);
+    return h ^ (h >> 17);
+}
+
+static int equal(const TreeNode * a, const TreeNode * b) {
+    int i;
+    if (a->nodeKind != b->nodeKind || a->kind.expr != b->kind.expr)
+        return FALSE;
+    switch (a->kind.expr) {
+        case CONST_EXPR:
+            if (a->attr.exprAttr.val != b->attr.exprAttr.val)
+                return FALSE;
+            break;
+        case ID_EXPR:
+            if (a->attr.exprAttr.name != b->attr.exprAttr.name)
+                return FALSE;
+            break;
+        default:
+            if (a->attr.exprAttr.op != b->attr.exprAttr.op)
+                return FALSE;
+            break;
+    }
+    for (i = 0; i < MAX_CHILDREN; i++)
+        if (a->child[i] != b->child[i])
+            return FALSE;
+    return TRUE;
+}
+
+/* The slot of the node equal to key, or the empty slot where it goes */
+static ConsSlot * find(const ConsTable * t, const TreeNode * key) {
+    size_t j = hash_of(key) & (t->capacity - 1);
+    while (t->slots[j].generation == t->generation && !equal(t->slots[j].node, key))
+        j = (j + 1) & (t->capacity - 1);
+    return &t->slots[j];
+}
+
+static int grow(ConsTable * t) {
+    ConsTable bigger = *t;
+    size_t i;
+    bigger.capacity = t->capacity == 0 ? INITIAL_SLOTS : t->capacity * 2;
+    bigger.slots = (ConsSlot *) calloc(bigger.capacity, sizeof(ConsSlot));
+    if (bigger.slots == NULL)
+        return 0;
+    bigger.count = 0;
+    for (i = 0; i < t->capacity; i++)
+        if (t->slots[i].generation == t->generation && t->slots[i].node != &taken) {
+            *find(&bigger, t->slots[i].node) = t->slots[i];
+            bigger.count++;
+        }
+    free(t->slots);
+    t->slots = bigger.slots;
+    t->capacity = bigger.capacity;
+    t->count = bigger.count;
+    return 1;
+}
+
+void cons_init(ConsTable * t) {
+    memset(t, 0, sizeof(ConsTable));
+    t->generation = 1;
+}
+
+void cons_release(ConsTable * t) {
+    free(t->slots);
+    cons_init(t);
+}
+
+void cons_clear(ConsTable * t) {
+    t->count = 0;
+    if (++t->generation == 0) {
+        /* the stamps wrapped around: the old ones could look current again */
+        if (t->slots != NULL)
+            memset(t->slots, 0, t->capacity * sizeof(ConsSlot));
+        t->generation = 1;
+    }
+}
+
+TreeNode * cons_share(ConsTable * t, TreeNode * node, int * found) {
+    ConsSlot * slot;
+    *found = FALSE;
+    if ((t->count + 1) * 2 > t->capacity && !grow(t))
+        return node;
+    slot = find(t, node);
+    if (slot->generation == t->generation) {
+        slot->shared = TRUE;
+        *found = TRUE;
+        return slot->node;
+    }
+    slot->node = node;
+    slot->generation = t->generation;
+    slot->shared = FALSE;
+    t->count++;
+    return node;
+}
+
+int cons_take(ConsTable * t, TreeNode * node) {
+    ConsSlot * slot;
+    if (t->count == 0)
+        return TRUE;
+    slot = find(t, node);
+    if (slot->generation != t->generation || slot->node != node)
+        return TRUE;
+    if (slot->shared)
+        return FALSE;
+    /* the slot stays in use, so that the probe sequences through it still work */
+    slot->node = &taken;
+    return TRUE;
+}
@@ -0,0 +1,56 @@
+/****************************************************
+ File: hashcons.h
+
+ Hash-consing of expression nodes. With sharing on
+ (parser_set_sharing() of parse.h), the parser makes
+ the side-effect-free expression nodes through a
+ ConsTable, keyed on the kind, the operator, value
+ or name, and the identity of the children. When an
+ equal node is in the table already, that node is
+ used instead of a new one, so the equal
+ subexpressions of a region of the program are one
+ node, and the tree becomes a DAG (see dag.h).
+
+ A region ends at every declaration and at both ends
+ of a block, where cons_clear() forgets the table, so
+ a shared ID always names the same declaration. Calls
+ and assignments are never shared, and neither is a
+ node that gets a sibling: an argument or a statement.
+****************************************************/
+
+#ifndef _HASHCONS_H_
+#define _HASHCONS_H_
+
+#include "libs.h"
+#include "parse.h"
+
+typedef struct {
+    TreeNode * node;
+    unsigned int generation;  /* the slot is empty unless this is the generation of the table */
+    unsigned int shared;      /* TRUE once node was used in a second place */
+} ConsSlot;
+
+typedef struct {
+    ConsSlot * slots;         /* open addressing; the capacity is a power of 2 */
+    size_t capacity;
+    size_t count;             /* slots of this generation, taken ones included */
+    unsigned int generation;  /* cons_clear() starts a new one, so that it costs nothing */
+} ConsTable;
+
+void cons_init(ConsTable * t);
+
+void cons_release(ConsTable * t);
+
+/* Forget every node of the table */
+void cons_clear(ConsTable * t);
+
+/* The node of the table equal to node, whose children are final: the same kind, attribute and children.
+ * When there is one, *found is set to TRUE and the caller gives node back; otherwise node goes into
+ * the table and is returned. When memory runs out node is returned and not shared, which is still correct. */
+TreeNode * cons_share(ConsTable * t, TreeNode * node, int * found);
+
+/* Take node out of the table, so that it can be changed, when it is used in one place only.
+ * <Return:> FALSE when it is used in more places, and a copy has to be changed instead. */
+int cons_take(ConsTable * t, TreeNode * node);
+
+#endif
@@ -0,0 +1,525 @@
+/****************************************************
+ File: incremental.c
+
+ Incremental reparsing, see incremental.h
+
+ The top-level loop of stmt_sequence keeps no state but
+ the token position (see parse_statements()), so a
+ reparse that reaches the start of an old top-level
+ statement behind the edit goes on exactly as the old
+ parse did from there, and the old statements from
+ there on are kept.
+
+ A top-level statement may look up to TOKEN_LOOKAHEAD
+ tokens past its end (declare_stmt() peeks 3 ahead,
+ and the loop looks at the next token), and one token
+ before its start (the separator check), so those
+ margins decide which statements saw a changed token.
+
+ A statement is parsed again in a window: a buffer
+ the tokens are copied into from the one before its
+ start on, more of them whenever the parser comes near
+ its end (the fill of ParserInfo). The tokens of the
+ tree stay where they are.
+****************************************************/
+
+#include "libs.h"
+#include "incremental.h"
+#include "parser_info.h"
+#include "util.h"
+
+/* Tokens copied into the window at a time, past the lookahead of the current one */
+#define WINDOW_TOKENS 256
+
+/* The messages the parser collected since the last call, as a new string, or NULL */
+static char * diagnostics_take(ParserInfo * ps) {
+    char * s = diagnostic_list_text(&ps->diagnostics, 0);
+    diagnostic_list_clear(&ps->diagnostics);
+    return s;
+}
+
+/* Statement k, on either side of the gap */
+static TopStatement * statement_at(IncrementalTree * it, size_t k) {
+    return k < it->front ? &it->stmts[k] : &it->stmts[it->capacity - it->count + k];
+}
+
+/* The first token of statement k, when there are count tokens */
+static long statement_start(IncrementalTree * it, size_t k, size_t count) {
+    TopStatement * s = statement_at(it, k);
+    return k < it->front ? s->start : (long) count - s->start;
+}
+
+/* Move the gap of the statements in front of statement k, when there are count tokens */
+static void move_statements(IncrementalTree * it, size_t k, size_t count) {
+    while (it->front < k) {
+        TopStatement * s = &it->stmts[it->capacity - it->count + it->front];
+        s->start = (long) count - s->start;
+        it->stmts[it->front++] = *s;
+        it->stats.statementsMoved++;
+    }
+    while (it->front > k) {
+        TopStatement * s = &it->stmts[--it->front];
+        s->start = (long) count - s->start;
+        it->stmts[it->capacity - it->count + it->front] = *s;
+        it->stats.statementsMoved++;
+    }
+}
+
+/* Make room for count statements, moving those after the gap to the end of the larger array */
+static int widen_statements(IncrementalTree * it, size_t count) {
+    size_t after = it->count - it->front, capacity = it->capacity == 0 ? 64 : it->capacity;
+    TopStatement * p;
+    while (capacity < count)
+        capacity *= 2;
+    if (capacity == it->capacity)
+        return 1;
+    p = (TopStatement *) realloc(it->stmts, capacity * sizeof(TopStatement));
+    if (p == NULL)
+        return 0;
+    memmove(p + capacity - after, p + it->capacity - after, after * sizeof(TopStatement));
+    it->stmts = p;
+    it->capacity = capacity;
+    return 1;
+}
+
+/* Make the last token of the window an EOP, where the parse ends */
+static void end_window(TokenBuffer * w) {
+    int k;
+    w->types[w->count - 1] = EOP;
+    for (k = 0; k < TOKEN_LOOKAHEAD; k++) {
+        w->types[w->count + k] = EOP;
+        w->offsets[w->count + k] = NO_LEXEME;
+        w->lengths[w->count + k] = 0;
+        w->lines[w->count + k] = w->lines[w->count - 1];
+    }
+}
+
+/* The fill of the parser: copy the next tokens of the tree into the window */
+static void window_fill(ParserInfo * ps) {
+    IncrementalTree * it = (IncrementalTree *) ps->fillData;
+    TokenBuffer * w = &it->window;
+    size_t count = TOKEN_GAP_COUNT(&it->tokens), from = (size_t) it->base + w->count, n;
+
+    if (w->count > 0 && w->types[w->count - 1] == EOP)
+        return;
+    n = (size_t) ps->pos + TOKEN_LOOKAHEAD + WINDOW_TOKENS - w->count;
+    if (n > count - from)
+        n = count - from;
+    if (!token_gap_copy(&it->tokens, from, n, w)) {
+        it->failed = TRUE;
+        if (w->count > (size_t) ps->pos)
+            end_window(w);
+        return;
+    }
+    it->stats.tokensCopied += n;
+}
+
+/* Parse one iteration of the top-level loop, the first of the program when first is TRUE */
+static void parse_top(IncrementalTree * it, ParserInfo * ps, int first, TopStatement * s) {
+    TreeNode * last;
+    s->start = it->base + ps->pos;
+    s->line = ps->tokens->lines[ps->pos];
+    /* with end just after pos the loop of parse_statements() runs once */
+    s->node = parse_statements(ps, ps->pos + 1, first, &last);
+    s->next = s->node != NULL ? s->node->rSibling : NULL;
+    s->diagnostics = diagnostics_take(ps);
+    it->stats.statementsParsed++;
+}
+
+static int push(TopStatement ** stmts, size_t * count, size_t * capacity, const TopStatement * s) {
+    if (*count == *capacity) {
+        size_t n = *capacity == 0 ? 64 : *capacity * 2;
+        TopStatement * p = (TopStatement *) realloc(*stmts, n * sizeof(TopStatement));
+        if (p == NULL)
+            return 0;
+        *stmts = p;
+        *capacity = n;
+    }
+    (*stmts)[(*count)++] = *s;
+    return 1;
+}
+
+/* Link the statements lo .. hi-1 into the chain, between the nearest ones before and after them */
+static void relink(IncrementalTree * it, size_t lo, size_t hi) {
+    TopStatement * prev = NULL;
+    size_t k = lo;
+
+    while (k > 0 && prev == NULL)
+        if (statement_at(it, --k)->node != NULL)
+            prev = statement_at(it, k);
+    for (k = lo; k < it->count; k++) {
+        TopStatement * s = statement_at(it, k);
+        if (s->node == NULL)
+            continue;
+        if (prev == NULL)
+            it->root = s->node;
+        else
+            prev->node->rSibling = s->node;
+        prev = s;
+        if (k >= hi)
+            return;   /* reached an unchanged statement, which links the rest */
+    }
+    /* as in stmt_sequence, the last statement keeps the rSibling its parse gave it */
+    if (prev == NULL)
+        it->root = NULL;
+    else
+        prev->node->rSibling = prev->next;
+}
+
+/* Add delta to the lineNum of every node of the top-level statement s */
+static int move_lines(TopStatement * s, int delta) {
+    TreeNode * t = s->node;
+    TreeNode ** stack;
+    size_t top = 0, capacity = 64;
+    int i;
+
+    stack = (TreeNode **) malloc(capacity * sizeof(TreeNode *));
+    if (stack == NULL)
+        return 0;
+    t->lineNum += delta;
+    if (s->next != NULL)
+        stack[top++] = s->next;
+    for (i = 0; i < MAX_CHILDREN; i++)
+        if (t->child[i] != NULL)
+            stack[top++] = t->child[i];
+    while (top > 0) {
+        TreeNode * n = stack[--top];
+        n->lineNum += delta;
+        if (top + MAX_CHILDREN + 1 > capacity) {
+            TreeNode ** more = (TreeNode **) realloc(stack, 2 * capacity * sizeof(TreeNode *));
+            if (more == NULL) {
+                free(stack);
+                return 0;
+            }
+            stack = more;
+            capacity *= 2;
+        }
+        /* below the top level, siblings belong to the same statement */
+        if (n->rSibling != NULL)
+            stack[top++] = n->rSibling;
+        for (i = 0; i < MAX_CHILDREN; i++)
+            if (n->child[i] != NULL)
+                stack[top++] = n->child[i];
+    }
+    free(stack);
+    return 1;
+}
+
+static void release_statements(IncrementalTree * it) {
+    size_t k;
+    for (k = 0; k < it->count; k++)
+        free(statement_at(it, k)->diagnostics);
+    free(it->stmts);
+    it->stmts = NULL;
+    it->count = 0;
+    it->front = 0;
+    it->capacity = 0;
+}
+
+/* Start ps on token pos of tokens. The error limit is off meanwhile: a statement parsed again
+ does not know the errors before it, so it could not stop where a full parse stops.
+ <Return:> the limit, for finish() */
+static int begin(IncrementalTree * it, ParserInfo * ps, TokenBuffer * tokens, long pos) {
+    int limit = ps->errorLimit;
+    parser_set_token_buffer(it->parser, tokens);
+    ps->pos = pos;
+    ps->lineno = tokens->lines[pos];
+    ps->errorLimit = 0;
+    ps->errorCount = 0;
+    ps->recovering = FALSE;
+    ps->stopped = FALSE;
+    ps->depth = 0;
+    diagnostic_list_clear(&ps->diagnostics);
+    ps->store = it->store;
+    ps->names = it->store != NULL ? &it->store->names : NULL;
+    return limit;
+}
+
+/* begin() on token start of the tree, in a window that starts at the token before it.
+ it->failed is TRUE when memory runs out. */
+static int begin_window(IncrementalTree * it, ParserInfo * ps, long start) {
+    it->window.count = 0;
+    it->window.text = it->tokens.tokens.text;
+    it->base = start > 0 ? start - 1 : 0;
+    it->failed = FALSE;
+    ps->fill = window_fill;
+    ps->fillData = it;
+    ps->pos = start - it->base;
+    window_fill(ps);
+    if (it->failed)
+        return ps->errorLimit;
+    return begin(it, ps, &it->window, start - it->base);
+}
+
+static void finish(IncrementalTree * it, ParserInfo * ps, int limit) {
+    ps->errorLimit = limit;
+    ps->fill = NULL;
+    ps->fillData = NULL;
+    ps->error = it->errors > 0;
+    it->store->root = it->root;
+    tree_store_end(ps, it->root);
+}
+
+/* Leave ps as finish() does, without ending the tree, which is given up */
+static void give_up(ParserInfo * ps, int limit) {
+    ps->errorLimit = limit;
+    ps->fill = NULL;
+    ps->fillData = NULL;
+    ps->store = NULL;
+    ps->names = NULL;
+}
+
+int incremental_parse(IncrementalTree * it, Parser * p, const char * text, size_t length) {
+    ParserInfo * ps = PARSER_INFO(p);
+    TopStatement s;
+    int limit;
+    int ok = 1;
+
+    it->parser = p;
+    it->base = 0;
+    it->root = NULL;
+    it->stmts = NULL;
+    it->count = 0;
+    it->front = 0;
+    it->capacity = 0;
+    it->end = 0;
+    it->errors = 0;
+    it->failed = FALSE;
+    it->store = NULL;
+    memset(&it->stats, 0, sizeof(IncrementalStats));
+    token_buffer_init(&it->window);
+    if (!token_gap_scan(&it->tokens, text, length)) {
+        token_gap_release(&it->tokens);
+        return 0;
+    }
+    it->stats.tokensScanned = TOKEN_GAP_COUNT(&it->tokens);
+    /* the gap is at the end: the tokens are parsed where they are */
+    limit = begin(it, ps, &it->tokens.tokens, 0);
+    it->store = tree_store_begin(ps);
+    if (it->store == NULL) {
+        ps->errorLimit = limit;
+        token_gap_release(&it->tokens);
+        return 0;
+    }
+
+    /* stmt_sequence: iterations until the loop stops */
+    parse_top(it, ps, TRUE, &s);
+    ok = push(&it->stmts, &it->count, &it->capacity, &s);
+    while (ok && !parse_statements_end(ps)) {
+        parse_top(it, ps, FALSE, &s);
+        ok = push(&it->stmts, &it->count, &it->capacity, &s);
+    }
+    it->front = it->count;
+    it->end = ps->pos;
+    if (ok) {
+        size_t k;
+        for (k = 0; k < it->count; k++)
+            if (it->stmts[k].diagnostics != NULL)
+                it->errors++;
+        relink(it, 0, it->count);
+    }
+    finish(it, ps, limit);
+    if (!ok) {
+        incremental_release(it);
+        return 0;
+    }
+    /* both gaps start at the top */
+    move_statements(it, 0, TOKEN_GAP_COUNT(&it->tokens));
+    token_gap_move(&it->tokens, 0);
+    it->stats.tokensMoved = it->tokens.moved;
+    return 1;
+}
+
+/* Memory ran out: give up on reuse and parse the new text from scratch */
+static int parse_again(IncrementalTree * it, const char * text, size_t length) {
+    Parser * p = it->parser;
+    incremental_release(it);
+    incremental_parse(it, p, text, length);
+    return 0;
+}
+
+int incremental_edit(IncrementalTree * it, const char * text, size_t length, const TextEdit * edit) {
+    ParserInfo * ps = PARSER_INFO(it->parser);
+    TokenChange c;
+    long tokenDelta;
+    size_t count, moved, lo, hi, k0, m, f, k;
+    TopStatement * fresh = NULL;
+    size_t freshCount = 0, freshCapacity = 0;
+    TopStatement s;
+    int limit;
+    int first, ok;
+
+    if (it->store == NULL)   /* an earlier failure left the tree empty */
+        return incremental_parse(it, it->parser, text, length);
+    memset(&it->stats, 0, sizeof(IncrementalStats));
+    /* the statements keep the token numbers from before the edit until they are parsed again */
+    count = TOKEN_GAP_COUNT(&it->tokens);
+    moved = it->tokens.moved;
+    ok = token_gap_rescan(&it->tokens, text, length, edit, &c);
+    it->stats.tokensMoved = it->tokens.moved - moved;
+    if (!ok)
+        return parse_again(it, text, length);
+    it->stats.tokensScanned = c.scanned;
+    tokenDelta = (long) c.newEnd - (long) c.oldEnd;
+
+    /* k0: the first statement that saw a changed token, looking TOKEN_LOOKAHEAD past its end */
+    lo = 0;
+    hi = it->count;
+    while (lo < hi) {
+        size_t mid = lo + (hi - lo) / 2;
+        long next = mid + 1 < it->count ? statement_start(it, mid + 1, count) : it->end;
+        if (next + TOKEN_LOOKAHEAD > (long) c.first)
+            hi = mid;
+        else
+            lo = mid + 1;
+    }
+    k0 = lo;
+    if (k0 == it->count) {
+        /* the change is after where the parse stopped and looked */
+        return 1;
+    }
+    move_statements(it, k0, count);
+
+    limit = begin_window(it, ps, statement_start(it, k0, count));
+    ok = !it->failed;
+
+    /* parse from statement k0 until a statement starts where an old one started behind the change */
+    m = k0 + 1;
+    first = k0 == 0;
+    while (ok) {
+        long pos, old;
+        parse_top(it, ps, first, &s);
+        first = FALSE;
+        if (it->failed || !push(&fresh, &freshCount, &freshCapacity, &s)) {
+            free(s.diagnostics);
+            ok = 0;
+            break;
+        }
+        pos = it->base + ps->pos;
+        if (parse_statements_end(ps)) {
+            m = it->count;   /* the loop stops here now: the old statements behind are gone */
+            it->end = pos;
+            break;
+        }
+        /* also the token before pos, seen by the separator check, must be an old one */
+        if (pos <= (long) c.newEnd)
+            continue;
+        old = pos - tokenDelta;
+        while (m < it->count && statement_start(it, m, count) < old)
+            m++;
+        if (m < it->count && statement_start(it, m, count) == old) {
+            it->end += tokenDelta;
+            break;
+        }
+        if (m == it->count && it->end == old) {
+            it->end = pos;
+            break;
+        }
+    }
+    f = freshCount;
+    if (!ok || !widen_statements(it, it->count - (m - k0) + f)) {
+        for (k = 0; k < freshCount; k++)
+            free(fresh[k].diagnostics);
+        free(fresh);
+        give_up(ps, limit);
+        return parse_again(it, text, length);
+    }
+
+    /* replace the statements k0 .. m-1, the first ones after the gap, with the fresh ones before it;
+       the statements from m on count their tokens from the end, and need no change */
+    for (k = k0; k < m; k++) {
+        TopStatement * t = statement_at(it, k);
+        if (t->diagnostics != NULL) {
+            it->errors--;
+            free(t->diagnostics);
+        }
+    }
+    it->count -= m - k0;
+    memcpy(it->stmts + k0, fresh, f * sizeof(TopStatement));
+    free(fresh);
+    it->front += f;
+    it->count += f;
+    for (k = k0; k < k0 + f; k++)
+        if (it->stmts[k].diagnostics != NULL)
+            it->errors++;
+    relink(it, k0, k0 + f);
+    finish(it, ps, limit);
+    return 1;
+}
+
+/* Bring the lineNum of the nodes of statement k up to date with the line it starts on now.
+ <Return:> 0 when memory runs out */
+static int update(IncrementalTree * it, size_t k) {
+    TopStatement * s = statement_at(it, k);
+    size_t count = TOKEN_GAP_COUNT(&it->tokens);
+    long start = statement_start(it, k, count);
+    int line = token_gap_line(&it->tokens, (size_t) start);
+
+    if (line == s->line)
+        return 1;
+    if (s->diagnostics != NULL) {
+        /* its messages have line numbers: parse it again, it ends where it did */
+        ParserInfo * ps = PARSER_INFO(it->parser);
+        int limit = begin_window(it, ps, start);
+        if (it->failed) {
+            give_up(ps, limit);
+            return 0;
+        }
+        free(s->diagnostics);
+        parse_top(it, ps, k == 0, s);
+        if (k >= it->front)
+            s->start = (long) count - s->start;
+        if (s->diagnostics == NULL)
+            it->errors--;
+        relink(it, k, k + 1);
+        finish(it, ps, limit);
+        return !it->failed;
+    }
+    if (s->node != NULL && !move_lines(s, line - s->line))
+        return 0;
+    s->line = line;
+    return 1;
+}
+
+TreeNode * incremental_tree(IncrementalTree * it) {
+    size_t k;
+    for (k = 0; k < it->count; k++)
+        if (!update(it, k)) {
+            /* a full parse is up to date */
+            parse_again(it, it->tokens.tokens.text, it->tokens.length);
+            break;
+        }
+    return it->root;
+}
+
+TopStatement * incremental_statement(IncrementalTree * it, size_t k) {
+    if (!update(it, k)) {
+        parse_again(it, it->tokens.tokens.text, it->tokens.length);
+        return NULL;
+    }
+    return statement_at(it, k);
+}
+
+void incremental_print_diagnostics(IncrementalTree * it, FILE * out) {
+    size_t k;
+    for (k = 0; k < it->count; k++)
+        if (statement_at(it, k)->diagnostics != NULL && !update(it, k)) {
+            parse_again(it, it->tokens.tokens.text, it->tokens.length);
+            break;
+        }
+    for (k = 0; k < it->count; k++)
+        if (statement_at(it, k)->diagnostics != NULL)
+            fputs(statement_at(it, k)->diagnostics, out);
+}
+
+void incremental_release(IncrementalTree * it) {
+    release_statements(it);
+    if (it->store != NULL)
+        tree_store_free(PARSER_INFO(it->parser), it->store);
+    it->store = NULL;
+    it->root = NULL;
+    it->end = 0;
+    it->errors = 0;
+    token_buffer_release(&it->window);
+    token_gap_release(&it->tokens);
+}
@@ -0,0 +1,101 @@
+/****************************************************
+ File: incremental.h
+
+ Incremental reparsing for an editor. The tree of a
+ source text remembers where each top-level statement
+ of the program starts in its token buffer. After an
+ edit, only the tokens around the edit are scanned
+ again (token_gap_rescan()), and only the top-level
+ declarations that saw the changed tokens are parsed
+ again; their new nodes are spliced into the rSibling
+ list in place of the old ones.
+
+ Nothing after the edit is rewritten. The tokens and
+ the statements are kept with a gap at the last edit,
+ those after it counted back from the end (TokenGap in
+ token_buffer.h), and the lineNum of the nodes of a
+ statement after an edit that adds or removes lines is
+ only moved when the tree is read. So the work of an
+ edit inside one function is the size of that
+ function, plus the distance from the previous edit,
+ which the gaps move over; the gaps start at the top.
+
+ The tree and the syntax errors, as incremental_tree()
+ and incremental_print_diagnostics() give them, are
+ always those of a full parse of the new text. A
+ declaration after an edit that moved its lines with
+ a syntax error is parsed again then, since its
+ message has a line number in it. The error limit of
+ the parser (parser_set_error_limit()) does not apply:
+ every syntax error is kept. Replaced nodes stay in
+ the store of the tree until incremental_release().
+****************************************************/
+
+#ifndef _INCREMENTAL_H_
+#define _INCREMENTAL_H_
+
+#include "parse.h"
+#include "token_buffer.h"
+
+struct treeStore;
+
+/* One iteration of the top-level loop of stmt_sequence */
+typedef struct {
+    long start;           /* its first token; for a statement after the gap, the number of tokens from it on */
+    int line;             /* the line of its first token when its nodes got their lineNum */
+    TreeNode * node;      /* the statement, or NULL for an empty one such as a blank line */
+    TreeNode * next;      /* the rSibling its parse gave node; the chain overwrites it unless node is last */
+    char * diagnostics;   /* what the parser reported in it, or NULL */
+} TopStatement;
+
+/* The work of the last incremental_parse() or incremental_edit() */
+typedef struct {
+    size_t tokensScanned;   /* by the scanner */
+    size_t tokensMoved;     /* over by the gap of the tokens */
+    size_t tokensCopied;    /* into the window of the parser */
+    size_t statementsMoved; /* over by the gap of the statements */
+    size_t statementsParsed;
+} IncrementalStats;
+
+typedef struct {
+    Parser * parser;
+    TokenGap tokens;         /* the tokens of the current text; they point into it */
+    TokenBuffer window;      /* the tokens being parsed again, copied from tokens as the parser needs them */
+    long base;               /* the token of tokens at token 0 of window */
+    TreeNode * root;         /* the first statement of the chain; read it with incremental_tree() */
+    TopStatement * stmts;    /* the statements before the gap, free slots, then the statements after it */
+    size_t count;            /* statements */
+    size_t front;            /* statements before the gap */
+    size_t capacity;
+    long end;                /* the token where the top-level loop stopped */
+    size_t errors;           /* number of statements with diagnostics */
+    int failed;              /* TRUE when memory ran out while filling the window */
+    struct treeStore * store;  /* where the nodes of the tree live */
+    IncrementalStats stats;
+} IncrementalTree;
+
+/* Scan and parse the length characters at text with parser p. text must stay valid, unchanged,
+ * until the next incremental_edit() or incremental_release().
+ * <Return:> 0 when memory runs out, and then the tree is empty. */
+int incremental_parse(IncrementalTree * it, Parser * p, const char * text, size_t length);
+
+/* text is the new text after edit; see TextEdit in token_buffer.h. Bring the tree up to date.
+ * <Return:> 0 when memory runs out; the tree is then left as a full parse of the new text,
+ * or empty when even that fails. */
+int incremental_edit(IncrementalTree * it, const char * text, size_t length, const TextEdit * edit);
+
+/* The tree of the current text, with the lineNum of every node up to date.
+ * <Return:> NULL for an empty program, or when memory runs out and the tree is empty. */
+TreeNode * incremental_tree(IncrementalTree * it);
+
+/* Statement k of the tree, k < it->count, with the lineNum of its nodes and its diagnostics up to date.
+ * <Return:> NULL when memory runs out, and then the tree is left as a full parse of the text, or empty. */
+TopStatement * incremental_statement(IncrementalTree * it, size_t k);
+
+/* Write the diagnostics of the tree, in source order, as a full parse writes them to its listing */
+void incremental_print_diagnostics(IncrementalTree * it, FILE * out);
+
+/* Free the tree, its tokens and its diagnostics. The parser is not deleted. */
+void incremental_release(IncrementalTree * it);
+
+#endif
@@ -0,0 +1,142 @@
+/****************************************************
+ File: instrument.c
+
+ Compile instrumentation, see instrument.h
+****************************************************/
+
+#include "libs.h"
+#include "instrument.h"
+
+#include <time.h>
+
+static double clock_seconds(clockid_t clock) {
+    struct timespec t;
+    clock_gettime(clock, &t);
+    return t.tv_sec + t.tv_nsec / 1e9;
+}
+
+void instrument_init(Instrument * in, const char * file) {
+    memset(in, 0, sizeof(Instrument));
+    in->file = file;
+}
+
+void instrument_begin(Instrument * in) {
+    in->wallStart = clock_seconds(CLOCK_MONOTONIC);
+    in->cpuStart = clock_seconds(CLOCK_PROCESS_CPUTIME_ID);
+}
+
+void instrument_end(Instrument * in, Phase phase) {
+    in->phases[phase].wall += clock_seconds(CLOCK_MONOTONIC) - in->wallStart;
+    in->phases[phase].cpu += clock_seconds(CLOCK_PROCESS_CPUTIME_ID) - in->cpuStart;
+}
+
+static void count_node(Instrument * in, const TreeNode * t) {
+    if ((unsigned) t->nodeKind > EXPR_ND)
+        return;
+    in->nodeKinds[t->nodeKind]++;
+    switch (t->nodeKind) {
+        case STMT_ND:
+            if ((unsigned) t->kind.stmt <= DCL_STMT)
+                in->stmtKinds[t->kind.stmt]++;
+            break;
+        case EXPR_ND:
+            if ((unsigned) t->kind.expr <= CALL_EXPR)
+                in->exprKinds[t->kind.expr]++;
+            break;
+        case DCL_ND:
+            if ((unsigned) t->kind.dcl <= FUN_DCL)
+                in->dclKinds[t->kind.dcl]++;
+            break;
+        default:
+            break;
+    }
+}
+
+int instrument_count_nodes(Instrument * in, const TreeNode * tree) {
+    const TreeNode ** stack;
+    size_t top = 0, capacity = 256;
+    int i;
+
+    if (tree == NULL)
+        return 1;
+    stack = (const TreeNode **) malloc(capacity * sizeof(TreeNode *));
+    if (stack == NULL)
+        return 0;
+    stack[top++] = tree;
+    while (top > 0) {
+        const TreeNode * t = stack[--top];
+        count_node(in, t);
+        if (top + MAX_CHILDREN + 1 > capacity) {
+            const TreeNode ** more = (const TreeNode **) realloc(stack, 2 * capacity * sizeof(TreeNode *));
+            if (more == NULL) {
+                free(stack);
+                return 0;
+            }
+            stack = more;
+            capacity *= 2;
+        }
+        if (t->rSibling != NULL)
+            stack[top++] = t->rSibling;
+        for (i = 0; i < MAX_CHILDREN; i++)
+            if (t->child[i] != NULL)
+                stack[top++] = t->child[i];
+    }
+    free(stack);
+    return 1;
+}
+
+/* s as a JSON string */
+static void put_string(FILE * out, const char * s) {
+    fputc('"', out);
+    for (; *s != '\0'; s++) {
+        unsigned char c = (unsigned char) *s;
+        if (c == '"' || c == '\\')
+            fprintf(out, "\\%c", c);
+        else if (c < 0x20)
+            fprintf(out, "\\u%04x", c);
+        else
+            fputc(c, out);
+    }
+    fputc('"', out);
+}
+
+/* "name":{"key":count,...} for the counts of the given names */
+static void put_counts(FILE * out, const char * name, const char * const * keys, const size_t * counts, int n) {
+    int k;
+    fprintf(out, ",\"%s\":{", name);
+    for (k = 0; k < n; k++)
+        fprintf(out, "%s\"%s\":%zu", k > 0 ? "," : "", keys[k], counts[k]);
+    fputc('}', out);
+}
+
+int instrument_write_json(FILE * out, const Instrument * in) {
+    static const char * const phases[] = {"read", "parse", "print"};
+    static const char * const nodeKinds[] = {"DCL_ND", "PARAM_ND", "STMT_ND", "EXPR_ND"};
+    static const char * const stmtKinds[] = {"SLCT_STMT", "WHILE_STMT", "EXPR_STMT", "CMPD_STMT", "RTN_STMT",
+        "NULL_STMT", "ASSIGN_STMT", "FUNC_STMT", "DCL_STMT"};
+    static const char * const exprKinds[] = {"OP_EXPR", "CONST_EXPR", "ID_EXPR", "CALL_EXPR"};
+    static const char * const dclKinds[] = {"VAR_DCL", "ARRAY_DCL", "FUN_DCL"};
+    const ParseStats * s = &in->stats;
+    int k;
+
+    fputs("{\"file\":", out);
+    put_string(out, in->file != NULL ? in->file : "");
+#ifdef PARSER_INSTRUMENT
+    fputs(",\"instrumented\":true", out);
+#else
+    fputs(",\"instrumented\":false", out);
+#endif
+    fputs(",\"phases\":{", out);
+    for (k = 0; k < PHASE_COUNT; k++)
+        fprintf(out, "%s\"%s\":{\"wall_ms\":%.3f,\"cpu_ms\":%.3f}", k > 0 ? "," : "", phases[k],
+                in->phases[k].wall * 1e3, in->phases[k].cpu * 1e3);
+    fprintf(out, "},\"tokens\":%zu,\"nodes\":%zu,\"bytes\":{\"nodes\":%zu,\"names\":%zu}",
+            s->tokens, s->nodes, s->bytes, s->nameBytes);
+    put_counts(out, "node_kinds", nodeKinds, in->nodeKinds, EXPR_ND + 1);
+    put_counts(out, "stmt_kinds", stmtKinds, in->stmtKinds, DCL_STMT + 1);
+    put_counts(out, "expr_kinds", exprKinds, in->exprKinds, CALL_EXPR + 1);
+    put_counts(out, "dcl_kinds", dclKinds, in->dclKinds, FUN_DCL + 1);
+    fprintf(out, ",\"max_lookahead\":%d,\"max_block_depth\":%d,\"max_expression_depth\":%d,\"syntax_errors\":%d}\n",
+            s->maxLookahead, s->maxBlockDepth, s->maxExpressionDepth, s->syntaxErrors);
+    return !ferror(out);
+}
@@ -0,0 +1,61 @@
+/****************************************************
+ File: instrument.h
+
+ Instrumentation of one compile: the wall-clock and
+ CPU time of each phase (reading the tokens, parsing,
+ printing), the counters of the parse (ParseStats),
+ and the nodes of the tree by kind, written as one
+ JSON object per line so that a monitor can collect
+ the reports of many runs from one file. The nodes
+ by kind are those of the tree; "nodes" counts every
+ node the parse allocated, with those it dropped.
+
+ The parser keeps the lookahead and depth counters
+ only when compiled with PARSER_INSTRUMENT defined;
+ without it the code that keeps them is not compiled
+ at all, and those counters are reported as 0. The
+ report says which build it came from.
+****************************************************/
+
+#ifndef _INSTRUMENT_H_
+#define _INSTRUMENT_H_
+
+#include "libs.h"
+#include "parse.h"
+
+typedef enum {PHASE_READ, PHASE_PARSE, PHASE_PRINT, PHASE_COUNT} Phase;
+
+typedef struct {
+    double wall;          /* seconds */
+    double cpu;           /* seconds of CPU time of the process, all threads */
+} PhaseTime;
+
+typedef struct {
+    const char * file;    /* the program compiled */
+    PhaseTime phases[PHASE_COUNT];
+    double wallStart;     /* of the phase being timed */
+    double cpuStart;
+    ParseStats stats;
+    size_t nodeKinds[EXPR_ND + 1];     /* the nodes of the tree by NodeKind */
+    size_t stmtKinds[DCL_STMT + 1];    /* the STMT_ND nodes by StmtKind */
+    size_t exprKinds[CALL_EXPR + 1];   /* the EXPR_ND nodes by ExprKind */
+    size_t dclKinds[FUN_DCL + 1];      /* the DCL_ND nodes by DclKind */
+} Instrument;
+
+void instrument_init(Instrument * in, const char * file);
+
+/* Start timing a phase */
+void instrument_begin(Instrument * in);
+
+/* Stop timing phase; the time adds to what it had */
+void instrument_end(Instrument * in, Phase phase);
+
+/* Count the nodes of tree by kind.
+ * <Return:> 0 when memory runs out. */
+int instrument_count_nodes(Instrument * in, const TreeNode * tree);
+
+/* Write the report as one line of JSON.
+ * <Return:> 0 on a write error. */
+int instrument_write_json(FILE * out, const Instrument * in);
+
+#endif
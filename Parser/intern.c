@@ -0,0 +1,118 @@
+/****************************************************
+ File: intern.c
+
+ Identifier interning, see intern.h
+****************************************************/
+
+#include "libs.h"
+#include "intern.h"
+
+#define INITIAL_SLOTS 256
+
+/* FNV-1a; names are short, so it is cheap and spreads well enough for linear probing */
+static unsigned int hash_chars(const char * s, size_t len) {
+    unsigned int h = 2166136261u;
+    size_t i;
+    for (i = 0; i < len; i++) {
+        h ^= (unsigned char) s[i];
+        h *= 16777619u;
+    }
+    return h;
+}
+
+void intern_init(InternTable * t) {
+    t->slots = NULL;
+    t->capacity = 0;
+    t->names = NULL;
+    t->count = 0;
+    t->namesCapacity = 0;
+    arena_init(&t->storage);
+}
+
+static const InternHeader * header_of(const char * name) {
+    return (const InternHeader *) name - 1;
+}
+
+/* Double the slot array; the hash of each name is kept in its header, so nothing is rehashed from the characters */
+static int grow_slots(InternTable * t) {
+    size_t capacity = t->capacity == 0 ? INITIAL_SLOTS : t->capacity * 2;
+    SymbolId * slots = (SymbolId *) calloc(capacity, sizeof(SymbolId));
+    size_t i;
+    if (slots == NULL)
+        return 0;
+    for (i = 0; i < t->count; i++) {
+        size_t j = header_of(t->names[i])->hash & (capacity - 1);
+        while (slots[j] != 0)
+            j = (j + 1) & (capacity - 1);
+        slots[j] = (SymbolId) i + 1;
+    }
+    free(t->slots);
+    t->slots = slots;
+    t->capacity = capacity;
+    return 1;
+}
+
+const char * intern_n(InternTable * t, const char * s, size_t len) {
+    unsigned int h = hash_chars(s, len);
+    size_t j;
+    InternHeader * header;
+    char * name;
+
+    /* keep the load factor at or below 1/2 */
+    if ((t->count + 1) * 2 > t->capacity && !grow_slots(t))
+        return NULL;
+
+    j = h & (t->capacity - 1);
+    while (t->slots[j] != 0) {
+        const char * other = t->names[t->slots[j] - 1];
+        const InternHeader * oh = header_of(other);
+        if (oh->hash == h && oh->length == len && memcmp(other, s, len) == 0)
+            return other;
+        j = (j + 1) & (t->capacity - 1);
+    }
+
+    if (t->count == t->namesCapacity) {
+        size_t capacity = t->namesCapacity == 0 ? INITIAL_SLOTS : t->namesCapacity * 2;
+        const char ** names = (const char **) realloc((void *) t->names, capacity * sizeof(const char *));
+        if (names == NULL)
+            return NULL;
+        t->names = names;
+        t->namesCapacity = capacity;
+    }
+
+    header = (InternHeader *) arena_alloc(&t->storage, sizeof(InternHeader) + len + 1);
+    if (header == NULL)
+        return NULL;
+    header->id = (SymbolId) t->count;
+    header->hash = h;
+    header->length = (unsigned int) len;
+    header->pad = 0;
+    name = (char *) (header + 1);
+    memcpy(name, s, len);
+    name[len] = '\0';
+
+    t->names[t->count] = name;
+    t->count++;
+    t->slots[j] = header->id + 1;
+    return name;
+}
+
+const char * intern(InternTable * t, const char * s) {
+    if (s == NULL)
+        return NULL;
+    return intern_n(t, s, strlen(s));
+}
+
+void intern_clear(InternTable * t) {
+    if (t->capacity > 0)
+        memset(t->slots, 0, t->capacity * sizeof(SymbolId));
+    t->count = 0;
+    arena_reset(&t->storage);
+}
+
+void intern_release(InternTable * t) {
+    free(t->slots);
+    free((void *) t->names);
+    arena_release(&t->storage);
+    intern_init(t);
+}
@@ -0,0 +1,58 @@
+/****************************************************
+ File: intern.h
+
+ Identifier interning. Every distinct name is stored
+ once; equal names get the same pointer and the same
+ 32-bit symbol id, so later passes can compare names
+ with == instead of strcmp.
+****************************************************/
+
+#ifndef _INTERN_H_
+#define _INTERN_H_
+
+#include <stddef.h>
+#include "arena.h"
+
+typedef unsigned int SymbolId;
+
+/* Stored in front of the characters of each interned name */
+typedef struct {
+    SymbolId id;
+    unsigned int hash;
+    unsigned int length;
+    unsigned int pad; /* keeps the characters ARENA_ALIGN aligned */
+} InternHeader;
+
+typedef struct {
+    SymbolId * slots;      /* open addressing table of id + 1; 0 marks an empty slot */
+    size_t capacity;       /* number of slots, always a power of 2 */
+    const char ** names;   /* names[id] is the interned name with that id */
+    size_t count;          /* number of distinct names */
+    size_t namesCapacity;
+    Arena storage;         /* the headers and characters of the names */
+} InternTable;
+
+void intern_init(InternTable * t);
+
+/* <Return:>
+ * The unique copy of the first len characters of s, terminated by '\0'.
+ * s does not need to be terminated. NULL only when memory runs out. */
+const char * intern_n(InternTable * t, const char * s, size_t len);
+
+/* Same as intern_n(), for a '\0' terminated string. intern(t, NULL) is NULL. */
+const char * intern(InternTable * t, const char * s);
+
+/* Forget all of the names but keep the memory of the table for the next ones; pointers returned before become invalid. */
+void intern_clear(InternTable * t);
+
+/* Free the table and all of the names; pointers returned before become invalid. */
+void intern_release(InternTable * t);
+
+/* The symbol id and length of a name returned by intern()/intern_n(), in O(1) */
+#define SYMBOL_ID(name) (((const InternHeader *) (name))[-1].id)
+#define SYMBOL_LENGTH(name) (((const InternHeader *) (name))[-1].length)
+
+/* The interned name of an id, valid for id < t->count */
+#define SYMBOL_NAME(t, id) ((t)->names[(id)])
+
+#endif
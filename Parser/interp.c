@@ -0,0 +1,234 @@
+/****************************************************
+ File: interp.c
+
+ The tree interpreter, see interp.h
+****************************************************/
+
+#include "libs.h"
+#include "interp.h"
+#include "util.h"
+
+typedef struct {
+    const Layout * layout;
+    int * mem;
+    int memTop;
+    int memEnd;
+    int * slots;          /* the variables of all of the calls under way */
+    int slotTop;
+    int * r;              /* those of the current call */
+    int fp;               /* its frame in memory */
+    int depth;
+    RunStatus status;     /* the run stops as soon as it is not RUN_OK */
+    int returning;        /* TRUE from a return to the end of its call */
+    int value;            /* what the return gave */
+} Interp;
+
+static const Storage * storage_of(const Interp * in, const TreeNode * t) {
+    return layout_find(in->layout, (const TreeNode *) t->something);
+}
+
+static int eval(Interp * in, const TreeNode * t);
+static int call(Interp * in, const FunctionLayout * f, const TreeNode * args);
+
+/* The address of a[i], not checked yet; a is evaluated first, as everywhere else */
+static unsigned address_of(Interp * in, const TreeNode * t) {
+    int a = eval(in, t->child[0]);
+    return (unsigned) NUM_ADD(a, eval(in, t->child[1]));
+}
+
+/* The cell at address */
+static int * cell_at(Interp * in, unsigned address) {
+    if (in->status != RUN_OK)
+        return NULL;
+    if (address >= (unsigned) in->memTop) {
+        in->status = RUN_BAD_ADDRESS;
+        return NULL;
+    }
+    return &in->mem[address];
+}
+
+/* The variable the ID_EXPR t names */
+static int * variable(Interp * in, const TreeNode * t) {
+    const Storage * s = storage_of(in, t);
+    return s->kind == STORE_SLOT ? &in->r[s->offset] : &in->mem[s->offset];
+}
+
+static int assign(Interp * in, const TreeNode * t) {
+    const TreeNode * left = t->child[0];
+    int * cell;
+    int value;
+    if (left->nodeKind == EXPR_ND && left->kind.expr == ID_EXPR) {
+        value = eval(in, t->child[1]);
+        cell = variable(in, left);
+    } else {
+        /* as in the VM, the address is checked once the value is known */
+        unsigned address = address_of(in, left);
+        value = eval(in, t->child[1]);
+        cell = cell_at(in, address);
+    }
+    if (in->status != RUN_OK)
+        return 0;
+    *cell = value;
+    return value;
+}
+
+static int eval(Interp * in, const TreeNode * t) {
+    const Storage * s;
+    int * cell;
+    int a, b;
+
+    if (in->status != RUN_OK)
+        return 0;
+    if (t->nodeKind == STMT_ND)
+        return assign(in, t);
+    switch (t->kind.expr) {
+        case CONST_EXPR:
+            return t->attr.exprAttr.val;
+        case ID_EXPR:
+            s = storage_of(in, t);
+            if (s->array)
+                return s->kind == STORE_FRAME ? in->fp + s->offset : s->offset;
+            return *variable(in, t);
+        case CALL_EXPR:
+            s = storage_of(in, t);
+            return call(in, &in->layout->functions[s->offset], t->child[0]);
+        default:
+            break;
+    }
+    if (t->attr.exprAttr.op == ASSIGN)
+        return assign(in, t);
+    if (t->attr.exprAttr.op == LBR) {
+        cell = cell_at(in, address_of(in, t));
+        return cell != NULL ? *cell : 0;
+    }
+    a = eval(in, t->child[0]);
+    b = eval(in, t->child[1]);
+    if (in->status != RUN_OK)
+        return 0;
+    switch (t->attr.exprAttr.op) {
+        case PLUS: return NUM_ADD(a, b);
+        case MINUS: return NUM_SUB(a, b);
+        case STAR: return NUM_MUL(a, b);
+        case OVER:
+        case MOD:
+            if (b == 0) {
+                in->status = RUN_DIVIDE_BY_ZERO;
+                return 0;
+            }
+            return t->attr.exprAttr.op == OVER ? NUM_DIV(a, b) : NUM_MOD(a, b);
+        case LT: return a < b;
+        case LTE: return a <= b;
+        case GT: return a > b;
+        case GTE: return a >= b;
+        case EQ: return a == b;
+        default: return a != b;
+    }
+}
+
+static void exec_list(Interp * in, const TreeNode * list);
+
+static void exec(Interp * in, const TreeNode * t) {
+    if (t->nodeKind == EXPR_ND) {
+        eval(in, t);
+        return;
+    }
+    if (t->nodeKind != STMT_ND)
+        return;
+    switch (t->kind.stmt) {
+        case ASSIGN_STMT:
+            assign(in, t);
+            break;
+        case RTN_STMT:
+            in->value = t->child[0] != NULL ? eval(in, t->child[0]) : 0;
+            in->returning = TRUE;
+            break;
+        case SLCT_STMT:
+            if (eval(in, t->child[0]))
+                exec_list(in, t->child[1]);
+            else
+                exec_list(in, t->child[2]);
+            break;
+        case WHILE_STMT:
+            while (eval(in, t->child[0]) && in->status == RUN_OK && !in->returning)
+                exec_list(in, t->child[1]);
+            break;
+        case CMPD_STMT:
+        case FUNC_STMT:
+            exec_list(in, t->child[0]);
+            break;
+        default:
+            break;
+    }
+}
+
+static void exec_list(Interp * in, const TreeNode * list) {
+    for (; list != NULL && in->status == RUN_OK && !in->returning; list = list->rSibling)
+        exec(in, list);
+}
+
+/* Evaluate the arguments into the slots of a new call, then run the body of f */
+static int call(Interp * in, const FunctionLayout * f, const TreeNode * args) {
+    int * caller = in->r;
+    int fp = in->fp, memTop = in->memTop, slotTop = in->slotTop;
+    int base = in->slotTop, k, value;
+
+    if (in->depth == VM_CALL_DEPTH_MAX || base + f->slots > VM_REGISTERS || in->memTop + f->frameCells > in->memEnd) {
+        in->status = RUN_STACK_OVERFLOW;
+        return 0;
+    }
+    in->slotTop = base + f->slots;
+    for (k = 0; args != NULL; args = args->rSibling, k++)
+        in->slots[base + k] = eval(in, args);
+    if (in->status != RUN_OK)
+        return 0;
+    for (; k < f->slots; k++)
+        in->slots[base + k] = 0;
+    memset(in->mem + in->memTop, 0, (size_t) f->frameCells * sizeof(int));
+    in->r = in->slots + base;
+    in->fp = in->memTop;
+    in->memTop += f->frameCells;
+    in->depth++;
+    in->value = 0;
+    if (f->decl->child[1] != NULL)
+        exec_list(in, f->decl->child[1]->child[0]);
+    value = in->returning ? in->value : 0;
+    in->returning = FALSE;
+    in->depth--;
+    in->r = caller;
+    in->fp = fp;
+    in->memTop = memTop;
+    in->slotTop = slotTop;
+    return value;
+}
+
+int interp_run(const Layout * layout, RunResult * result) {
+    Interp in;
+
+    memset(&in, 0, sizeof(Interp));
+    memset(result, 0, sizeof(RunResult));
+    in.layout = layout;
+    in.memEnd = layout->globalCells + VM_FRAME_CELLS;
+    in.memTop = layout->globalCells;
+    in.mem = (int *) calloc((size_t) in.memEnd, sizeof(int));
+    in.slots = (int *) calloc(VM_REGISTERS, sizeof(int));
+    in.r = in.slots;
+    in.status = RUN_NO_MEMORY;
+    if (in.mem != NULL && in.slots != NULL && layout->main >= 0) {
+        in.status = RUN_OK;
+        /* main() runs as a call of depth 0, as in the VM */
+        in.depth = -1;
+        result->value = call(&in, &layout->functions[layout->main], NULL);
+        result->globals = (int *) malloc(((size_t) layout->globalCells + 1) * sizeof(int));
+        if (result->globals != NULL) {
+            memcpy(result->globals, in.mem, (size_t) layout->globalCells * sizeof(int));
+            result->globalCells = layout->globalCells;
+        } else
+            in.status = RUN_NO_MEMORY;
+    }
+    result->status = in.status;
+    if (result->status != RUN_OK)
+        result->value = 0;
+    free(in.mem);
+    free(in.slots);
+    return result->status == RUN_OK;
+}
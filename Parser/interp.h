@@ -0,0 +1,24 @@
+/****************************************************
+ File: interp.h
+
+ A plain interpreter that runs a program by walking
+ its tree, one recursive call per node, finding each
+ variable through the layout (layout.h) as it goes.
+ It runs a program as the VM of vm.h does, with the
+ same memory, arithmetic and runtime errors, so the
+ two check each other, and it is the baseline the
+ benchmarks of the VM are measured against.
+****************************************************/
+
+#ifndef _INTERP_H_
+#define _INTERP_H_
+
+#include "libs.h"
+#include "layout.h"
+#include "vm.h"
+
+/* Run main() of the program laid out in layout, whose tree must still be alive.
+ * <Return:> 0 when the run stopped at an error; result->status says which. */
+int interp_run(const Layout * layout, RunResult * result);
+
+#endif
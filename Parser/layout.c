@@ -0,0 +1,174 @@
+/****************************************************
+ File: layout.c
+
+ The storage of the variables of a program, see layout.h
+****************************************************/
+
+#include "libs.h"
+#include "layout.h"
+#include "util.h"
+
+#include <stdint.h>
+
+#define INITIAL_SLOTS 256
+
+typedef struct {
+    Layout * layout;
+    DiagnosticList * diagnostics;
+    int ok;
+    FunctionLayout * function;  /* the function being laid out, or NULL at the top level */
+} LayoutState;
+
+static size_t slot_of(const Layout * l, const TreeNode * decl) {
+    return (size_t) (((uintptr_t) decl >> 4) * 2654435761u) & (l->capacity - 1);
+}
+
+static Storage * find(const Layout * l, const TreeNode * decl) {
+    size_t j = slot_of(l, decl);
+    while (l->table[j].decl != NULL && l->table[j].decl != decl)
+        j = (j + 1) & (l->capacity - 1);
+    return &l->table[j];
+}
+
+static int grow_table(Layout * l) {
+    Layout bigger = *l;
+    size_t i;
+    bigger.capacity = l->capacity == 0 ? INITIAL_SLOTS : l->capacity * 2;
+    bigger.table = (Storage *) calloc(bigger.capacity, sizeof(Storage));
+    if (bigger.table == NULL)
+        return 0;
+    for (i = 0; i < l->capacity; i++)
+        if (l->table[i].decl != NULL)
+            *find(&bigger, l->table[i].decl) = l->table[i];
+    free(l->table);
+    l->table = bigger.table;
+    l->capacity = bigger.capacity;
+    return 1;
+}
+
+static void layoutError(LayoutState * s, int lineno, const char * message) {
+    diagnostic_list_add(s->diagnostics, lineno, "\n>>> Compile error at line %d: %s\n", lineno, message);
+    s->ok = FALSE;
+}
+
+static void place(LayoutState * s, const TreeNode * decl, StorageKind kind, int array, int offset) {
+    Layout * l = s->layout;
+    Storage * storage;
+    if ((l->count + 1) * 2 > l->capacity && !grow_table(l)) {
+        layoutError(s, decl->lineNum, "ran out of memory");
+        return;
+    }
+    storage = find(l, decl);
+    if (storage->decl == NULL)
+        l->count++;
+    storage->decl = decl;
+    storage->kind = kind;
+    storage->array = array;
+    storage->offset = offset;
+}
+
+/* An array with a size takes cells; any other variable or a pointer takes a slot, or a global cell */
+static void place_variable(LayoutState * s, const TreeNode * decl) {
+    int size = decl->kind.dcl == ARRAY_DCL ? decl->attr.dclAttr.size : 0;
+    if (size < 0) {
+        layoutError(s, decl->lineNum, "an array has a negative size");
+        return;
+    }
+    if (s->function == NULL) {
+        place(s, decl, STORE_GLOBAL, size > 0, s->layout->globalCells);
+        s->layout->globalCells += size > 0 ? size : 1;
+    } else if (size > 0) {
+        place(s, decl, STORE_FRAME, TRUE, s->function->frameCells);
+        s->function->frameCells += size;
+    } else
+        place(s, decl, STORE_SLOT, FALSE, s->function->slots++);
+}
+
+static void layout_list(LayoutState * s, const TreeNode * list);
+
+static void layout_function(LayoutState * s, const TreeNode * t) {
+    Layout * l = s->layout;
+    FunctionLayout * f;
+    const TreeNode * p;
+
+    if (s->function != NULL) {
+        layoutError(s, t->lineNum, "a function is declared inside a function");
+        return;
+    }
+    if (l->functionCount == l->functionsCapacity) {
+        int capacity = l->functionsCapacity > 0 ? 2 * l->functionsCapacity : 64;
+        FunctionLayout * more = (FunctionLayout *) realloc(l->functions, (size_t) capacity * sizeof(FunctionLayout));
+        if (more == NULL) {
+            layoutError(s, t->lineNum, "ran out of memory");
+            return;
+        }
+        l->functions = more;
+        l->functionsCapacity = capacity;
+    }
+    if (t->attr.dclAttr.name != NULL && strcmp(t->attr.dclAttr.name, "main") == 0)
+        l->main = l->functionCount;
+    place(s, t, STORE_FUNCTION, FALSE, l->functionCount);
+    f = &l->functions[l->functionCount++];
+    f->decl = t;
+    f->params = 0;
+    f->slots = 0;
+    f->frameCells = 0;
+    s->function = f;
+    for (p = t->child[0]; p != NULL; p = p->rSibling) {
+        if (p->nodeKind == PARAM_ND && p->kind.param != VOID_PARAM) {
+            place(s, p, STORE_SLOT, FALSE, f->slots++);
+            f->params++;
+        }
+    }
+    if (t->child[1] != NULL)
+        layout_list(s, t->child[1]->child[0]);
+    s->function = NULL;
+}
+
+/* The declarations of the list and of the blocks inside it */
+static void layout_list(LayoutState * s, const TreeNode * list) {
+    for (; list != NULL && s->ok; list = list->rSibling) {
+        if (list->nodeKind == DCL_ND) {
+            if (list->kind.dcl == FUN_DCL)
+                layout_function(s, list);
+            else
+                place_variable(s, list);
+        } else if (s->function == NULL)
+            layoutError(s, list->lineNum, "a statement is outside of a function");
+        else if (list->nodeKind == STMT_ND) {
+            if (list->kind.stmt == SLCT_STMT || list->kind.stmt == WHILE_STMT) {
+                layout_list(s, list->child[1]);
+                layout_list(s, list->child[2]);
+            } else if (list->kind.stmt == CMPD_STMT)
+                layout_list(s, list->child[0]);
+        }
+    }
+}
+
+int layout_program(Layout * layout, const TreeNode * tree, DiagnosticList * diagnostics) {
+    LayoutState s;
+    memset(layout, 0, sizeof(Layout));
+    layout->main = -1;
+    s.layout = layout;
+    s.diagnostics = diagnostics;
+    s.ok = TRUE;
+    s.function = NULL;
+    layout_list(&s, tree);
+    if (s.ok && layout->main < 0)
+        layoutError(&s, 0, "there is no main()");
+    return s.ok;
+}
+
+void layout_release(Layout * layout) {
+    free(layout->table);
+    free(layout->functions);
+    memset(layout, 0, sizeof(Layout));
+}
+
+const Storage * layout_find(const Layout * layout, const TreeNode * decl) {
+    const Storage * storage;
+    if (layout->capacity == 0 || decl == NULL)
+        return NULL;
+    storage = find(layout, decl);
+    return storage->decl != NULL ? storage : NULL;
+}
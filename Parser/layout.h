@@ -0,0 +1,72 @@
+/****************************************************
+ File: layout.h
+
+ Where the variables of a program live when it runs,
+ for the bytecode compiler (bytecode.h) and the tree
+ interpreter (interp.h) alike. Memory is one array of
+ num cells: the globals first, then the local arrays
+ of the functions being called, a frame of them for
+ each call. An address is the index of a cell.
+
+ In a function, the parameters are slots 0, 1, ...
+ in order, and the num and * variables the next
+ slots; each array takes a run of cells of the frame
+ of its function. A declaration num *p is a pointer,
+ and so is an array without a size.
+
+ The program must be checked by typecheck_tree(),
+ which binds each name to its declaration. It is
+ laid out only if every statement outside a function
+ is a declaration, no function is declared inside
+ another, and there is a main().
+****************************************************/
+
+#ifndef _LAYOUT_H_
+#define _LAYOUT_H_
+
+#include "libs.h"
+#include "parse.h"
+#include "diagnostics.h"
+
+typedef enum {
+    STORE_GLOBAL,         /* offset is the cell of a global, or the first cell of a global array */
+    STORE_SLOT,           /* offset is the slot of a parameter or a variable */
+    STORE_FRAME,          /* offset is the first cell of a local array in the frame */
+    STORE_FUNCTION        /* offset is the index of the function */
+} StorageKind;
+
+typedef struct {
+    const TreeNode * decl;   /* NULL marks an empty slot of the table */
+    StorageKind kind;
+    int array;               /* TRUE when the value of the name is the address of its cells */
+    int offset;
+} Storage;
+
+typedef struct {
+    const TreeNode * decl;   /* the FUN_DCL */
+    int params;
+    int slots;               /* the parameters included */
+    int frameCells;          /* of the local arrays */
+} FunctionLayout;
+
+typedef struct {
+    Storage * table;         /* open addressing, keyed by the declaration */
+    size_t capacity;
+    size_t count;
+    FunctionLayout * functions;
+    int functionCount;
+    int functionsCapacity;
+    int globalCells;
+    int main;                /* the index of main() */
+} Layout;
+
+/* Lay out the checked program tree. What keeps it from being laid out is added to diagnostics.
+ * <Return:> 0 when it cannot be laid out, or when memory runs out. */
+int layout_program(Layout * layout, const TreeNode * tree, DiagnosticList * diagnostics);
+
+void layout_release(Layout * layout);
+
+/* <Return:> Where the name declared by decl lives, or NULL when decl is not laid out */
+const Storage * layout_find(const Layout * layout, const TreeNode * decl);
+
+#endif
@@ -0,0 +1,237 @@
+/****************************************************
+ File: native.c
+
+ The harness of the x86-64 backend, see native.h
+****************************************************/
+
+#include "libs.h"
+#include "native.h"
+#include "x86_64.h"
+#include "bytecode.h"
+#include "token_buffer.h"
+#include "diagnostics.h"
+#include "util.h"
+
+#include <time.h>
+#include <unistd.h>
+#if defined(__x86_64__) && defined(__linux__)
+#define NATIVE_RUNS
+#include <dlfcn.h>
+#endif
+
+#define PATH_SIZE 128
+
+static const char * const files[] = {"program.s", "program.o", "program.so"};
+
+static double now(void) {
+    struct timespec t;
+    clock_gettime(CLOCK_MONOTONIC, &t);
+    return t.tv_sec + t.tv_nsec / 1e9;
+}
+
+static void path_of(char * path, const NativeCode * code, int file) {
+    snprintf(path, PATH_SIZE, "%s/%s", code->dir, files[file]);
+}
+
+int native_build(NativeCode * code, TreeNode * tree, FILE * errors) {
+#ifdef NATIVE_RUNS
+    DiagnosticList diagnostics;
+    char s[PATH_SIZE], o[PATH_SIZE], so[PATH_SIZE], command[4 * PATH_SIZE + 64];
+    const char * cc = getenv("CC");
+    const int * cells;
+    FILE * out;
+    int ok;
+
+    memset(code, 0, sizeof(NativeCode));
+    strcpy(code->dir, "/tmp/parser-XXXXXX");
+    if (mkdtemp(code->dir) == NULL) {
+        code->dir[0] = '\0';
+        fputs("Cannot make a directory for the native code\n", errors);
+        return 0;
+    }
+    path_of(s, code, 0);
+    path_of(o, code, 1);
+    path_of(so, code, 2);
+    out = fopen(s, "w");
+    diagnostic_list_init(&diagnostics);
+    ok = out != NULL && x86_compile(out, tree, &diagnostics);
+    if (out != NULL && fclose(out) != 0)
+        ok = 0;
+    diagnostic_list_write(&diagnostics, 0, errors);
+    diagnostic_list_release(&diagnostics);
+    if (!ok) {
+        fputs("Cannot compile the program to assembly\n", errors);
+        return 0;
+    }
+    if (cc == NULL || cc[0] == '\0')
+        cc = "cc";
+    snprintf(command, sizeof(command), "%s -c -o %s %s && %s -shared -o %s %s", cc, o, s, cc, so, o);
+    if (system(command) != 0) {
+        fprintf(errors, "Cannot build the native code: %s\n", command);
+        return 0;
+    }
+    code->library = dlopen(so, RTLD_NOW | RTLD_LOCAL);
+    if (code->library == NULL) {
+        fprintf(errors, "Cannot load the native code: %s\n", dlerror());
+        return 0;
+    }
+    /* the way POSIX converts the address of a symbol to a function pointer */
+    *(void **) &code->run = dlsym(code->library, "cm_run");
+    cells = (const int *) dlsym(code->library, "cm_global_cells");
+    if (code->run == NULL || cells == NULL) {
+        fputs("The native code has no cm_run()\n", errors);
+        code->run = NULL;
+        return 0;
+    }
+    code->globalCells = *cells;
+    return 1;
+#else
+    memset(code, 0, sizeof(NativeCode));
+    fputs("Native code runs on x86-64 Linux only\n", errors);
+    return 0;
+#endif
+}
+
+int native_run(const NativeCode * code, RunResult * result) {
+    int memEnd = code->globalCells + VM_FRAME_CELLS;
+    int * mem = (int *) calloc((size_t) memEnd, sizeof(int));
+
+    memset(result, 0, sizeof(RunResult));
+    result->status = RUN_NO_MEMORY;
+    if (mem != NULL && code->run != NULL) {
+        result->status = (RunStatus) code->run(mem, memEnd, &result->value);
+        result->globals = (int *) malloc(((size_t) code->globalCells + 1) * sizeof(int));
+        if (result->globals != NULL) {
+            memcpy(result->globals, mem, (size_t) code->globalCells * sizeof(int));
+            result->globalCells = code->globalCells;
+        } else
+            result->status = RUN_NO_MEMORY;
+    }
+    free(mem);
+    return result->status == RUN_OK;
+}
+
+void native_release(NativeCode * code) {
+    char path[PATH_SIZE];
+    int k;
+#ifdef NATIVE_RUNS
+    if (code->library != NULL)
+        dlclose(code->library);
+#endif
+    if (code->dir[0] != '\0') {
+        for (k = 0; k < 3; k++) {
+            path_of(path, code, k);
+            unlink(path);
+        }
+        rmdir(code->dir);
+    }
+    memset(code, 0, sizeof(NativeCode));
+}
+
+/* TRUE when two runs ended the same way */
+static int same_run(const RunResult * a, const RunResult * b) {
+    return a->status == b->status && a->value == b->value && a->globalCells == b->globalCells
+        && (a->globalCells == 0 || memcmp(a->globals, b->globals, (size_t) a->globalCells * sizeof(int)) == 0);
+}
+
+int native_check(const char * text, size_t length, int reps, NativeReport * report, FILE * errors) {
+    TokenBuffer tokens;
+    Parser * parser = NULL;
+    FILE * listing;
+    TreeNode * root = NULL;
+    DiagnosticList diagnostics;
+    Program program;
+    NativeCode code;
+    double start;
+    int k, ok;
+
+    if (reps < 1)
+        reps = 1;
+    memset(report, 0, sizeof(NativeReport));
+    memset(&program, 0, sizeof(Program));
+    memset(&code, 0, sizeof(NativeCode));
+    report->bytes = length;
+    report->reps = reps;
+    diagnostic_list_init(&diagnostics);
+    token_buffer_init(&tokens);
+    listing = fopen("/dev/null", "w");
+    parser = listing != NULL ? new_parser(listing) : NULL;
+    ok = parser != NULL && token_buffer_scan(&tokens, text, length);
+    if (ok) {
+        parser_set_token_buffer(parser, &tokens);
+        root = parser->parse(parser);
+        if (parser_error(parser)) {
+            fputs("The program has syntax errors\n", errors);
+            ok = FALSE;
+        }
+    }
+    if (ok) {
+        ok = bytecode_compile(&program, root, &diagnostics);
+        diagnostic_list_write(&diagnostics, 0, errors);
+    }
+    if (ok) {
+        start = now();
+        ok = native_build(&code, root, errors);
+        report->build = now() - start;
+    }
+    for (k = 0; k < reps && ok; k++) {
+        double vm, native;
+        run_result_release(&report->expected);
+        run_result_release(&report->actual);
+        start = now();
+        vm_run(&program, &report->expected);
+        vm = now() - start;
+        start = now();
+        native_run(&code, &report->actual);
+        native = now() - start;
+        if (k == 0 || vm < report->vm)
+            report->vm = vm;
+        if (k == 0 || native < report->native)
+            report->native = native;
+    }
+    report->agree = ok && same_run(&report->expected, &report->actual);
+    native_release(&code);
+    bytecode_release(&program);
+    if (root != NULL)
+        parser->free_tree(parser, root);
+    delete_parser(parser);
+    if (listing != NULL)
+        fclose(listing);
+    diagnostic_list_release(&diagnostics);
+    token_buffer_release(&tokens);
+    return ok;
+}
+
+static void print_run(FILE * out, const char * name, const RunResult * r) {
+    fprintf(out, "%s: %s", name, run_status_text(r->status));
+    if (r->status == RUN_OK)
+        fprintf(out, ", main() returned %d", r->value);
+    fputc('\n', out);
+}
+
+void native_print_report(FILE * out, const NativeReport * r) {
+    int k;
+    fprintf(out, "program: %zu bytes, native code built in %.1f ms\n", r->bytes, r->build * 1e3);
+    print_run(out, "vm (reference)", &r->expected);
+    print_run(out, "native", &r->actual);
+    if (r->agree)
+        fputs("the native run agrees with the reference\n", out);
+    else {
+        fputs("the native run DISAGREES with the reference", out);
+        for (k = 0; k < r->expected.globalCells && k < r->actual.globalCells; k++)
+            if (r->expected.globals[k] != r->actual.globals[k]) {
+                fprintf(out, ": global cell %d is %d, not %d", k, r->actual.globals[k], r->expected.globals[k]);
+                break;
+            }
+        fputc('\n', out);
+    }
+    fprintf(out, "best of %d runs: vm %.3f ms, native %.3f ms", r->reps, r->vm * 1e3, r->native * 1e3);
+    if (r->native > 0)
+        fprintf(out, ", speedup of the native code: %.2fx", r->vm / r->native);
+    fputc('\n', out);
+}
+
+void native_report_release(NativeReport * report) {
+    run_result_release(&report->expected);
+    run_result_release(&report->actual);
+}
@@ -0,0 +1,63 @@
+/****************************************************
+ File: native.h
+
+ The harness of the x86-64 backend (x86_64.h). It
+ compiles a program to assembly in a directory of
+ its own, builds it with the system compiler driver
+ ($CC, or cc) into an object and a shared library,
+ loads that, and runs main() natively. The reference
+ output of a run is that of the VM (vm.h): the
+ harness checks that the native run ends with the
+ same status, value and globals, and times both.
+
+ Native code runs on x86-64 Linux only; elsewhere
+ the assembly can still be written, but not run.
+****************************************************/
+
+#ifndef _NATIVE_H_
+#define _NATIVE_H_
+
+#include "libs.h"
+#include "parse.h"
+#include "vm.h"
+
+typedef struct {
+    char dir[64];         /* where the assembly, the object and the library are */
+    void * library;
+    int (* run)(int * mem, int memEnd, int * value);
+    int globalCells;
+} NativeCode;
+
+/* Compile the program tree, which must have no syntax error, and build and load its native code.
+ * Why it cannot be is written to errors.
+ * <Return:> 0 when it cannot be. */
+int native_build(NativeCode * code, TreeNode * tree, FILE * errors);
+
+/* Run main() of the native code with the memory the VM has.
+ * <Return:> 0 when the run stopped at an error; result->status says which. */
+int native_run(const NativeCode * code, RunResult * result);
+
+/* Unload the code and remove its files, after a native_build() that failed too */
+void native_release(NativeCode * code);
+
+typedef struct {
+    size_t bytes;         /* of the source text */
+    int reps;
+    double build;         /* seconds to compile, assemble, link and load */
+    double vm;            /* the best of reps runs, in seconds */
+    double native;
+    RunResult expected;   /* of the VM */
+    RunResult actual;     /* of the native code */
+    int agree;            /* TRUE when both ended with the same status, value and globals */
+} NativeReport;
+
+/* Run the length characters of source text reps times on the VM and natively, and compare the runs.
+ * Why the program cannot be run is written to errors.
+ * <Return:> 0 when it cannot be run. */
+int native_check(const char * text, size_t length, int reps, NativeReport * report, FILE * errors);
+
+void native_print_report(FILE * out, const NativeReport * report);
+
+void native_report_release(NativeReport * report);
+
+#endif
@@ -10,167 +10,244 @@
 #include "parse.h"
 #include "parse_print.h"
 #include "tokenListIO.h"
+#include "token_buffer.h"
+#include "source.h"
+#include "parser_info.h"
+#include "batch.h"
+#include "astbin.h"
+#include "gen.h"
+#include "bench.h"
+#include "instrument.h"
+#include "fold.h"
+#include "typecheck.h"
+#include "bytecode.h"
+#include "vm.h"
+#include "x86_64.h"
+#include "native.h"
+#include "compact_tree.h"
+#include "dag.h"
+#include "cache.h"
+#include "stream.h"
+#include "incremental.h"
 
-FILE* listing;
-int lineno;
-int Error;
+#include <limits.h>
 
-static TokenNode* node;
+/* How a syntax error shows a token: this text, followed by the lexeme for the tokens that have one */
+static const char * const tokenNames[EOP + 1] = {
+    [NONE] = "NONE", [ERROR] = "ERROR: ",
+    [IF] = "reserved word: ", [ELSE] = "reserved word: ", [NUM] = "reserved word: ",
+    [RETURN] = "reserved word: ", [VOID] = "reserved word: ", [WHILE] = "reserved word: ",
+    [ID] = "ID, name= ", [NUMBER] = "NUMBER, val= ", [STRING] = "STRING, val= ", [COMMENT] = "COMMENT, val= ",
+    [PLUS] = "+", [MINUS] = "-", [STAR] = "*", [OVER] = "/", [MOD] = "%",
+    [LT] = "<", [LTE] = "<=", [GT] = ">", [GTE] = ">=", [EQ] = "==", [NEQ] = "!=", [ASSIGN] = "=",
+    [SEMI] = ";", [COMMA] = ",", [LPAR] = "(", [RPAR] = ")", [LBR] = "[", [RBR] = "]",
+    [LCUR] = "{", [RCUR] = "}", [ARROW] = "-->", [SMILE] = ":)", [ENTER] = "ENTER", [EOP] = "EOF"
+};
 
-void printToken(TokenType token, const char* tokenString) {
-    switch (token) {
-        case IF:
-        case NUM:
-        case ELSE:
-        case RETURN:
-        case VOID:
-        case WHILE:
-            fprintf(listing,
-                    "reserved word: %s\n", tokenString);
-            break;
-        case ASSIGN: fprintf(listing,"=\n"); break;
-        case LT: fprintf(listing,"<\n"); break;
-        case LTE: fprintf(listing,"<=\n"); break;
-        case GT: fprintf(listing,">\n"); break;
-        case GTE: fprintf(listing,">=\n"); break;
-        case EQ: fprintf(listing,"==\n"); break;
-        case NEQ: fprintf(listing,"!=\n"); break;
-        case LPAR: fprintf(listing,"(\n"); break;
-        case RPAR: fprintf(listing,")\n"); break;
-        case LBR: fprintf(listing,"[\n"); break;
-        case RBR: fprintf(listing,"]\n"); break;
-        case LCUR: fprintf(listing,"{\n"); break;
-        case RCUR: fprintf(listing,"}\n"); break;
-        case SEMI: fprintf(listing,";\n"); break;
-        case COMMA: fprintf(listing,",\n"); break;
-        case PLUS: fprintf(listing,"+\n"); break;
-        case MINUS: fprintf(listing,"-\n"); break;
-        case STAR: fprintf(listing,"*\n"); break;
-        case OVER: fprintf(listing,"/\n"); break;
-        case MOD: fprintf(listing,"%%\n"); break;
-        case EOP: fprintf(listing,"EOF\n"); break;
-        case ARROW: fprintf(listing,"-->\n"); break;
-        case SMILE: fprintf(listing,":)\n"); break;
-        case ENTER: fprintf(listing,"ENTER\n"); break;
-        case NONE: fprintf(listing,"NONE\n"); break;
-        case NUMBER:
-            fprintf(listing,
-                    "NUMBER, val= %s\n",tokenString);
-            break;
-        case ID:
-            fprintf(listing,
-                    "ID, name= %s\n",tokenString);
-            break;
-        case STRING:
-            fprintf(listing,
-                    "STRING, val= %s\n",tokenString);
-            break;
-        case COMMENT:
-            fprintf(listing,
-                    "COMMENT, val= %s\n",tokenString);
-            break;
-        case ERROR:
-            fprintf(listing,
-                    "ERROR: %s\n",tokenString);
-            break;
-        default: /* should never happen */
-            fprintf(listing,"Unknown token: %d\n",token);
-    }
-}
-
-static void syntaxError(char * message) {
-    fprintf(listing, "\n>>> ");
-    fprintf(listing, "Syntax error at line %d: %s", lineno, message);
-    Error = TRUE;
-}
-
-void next() {
-    node = node->next;
-}
-
-static TreeNode * stmt_sequence(void);
-static TreeNode * statement(void);
-static TreeNode * para_list(void);
-static TreeNode * arg_list(void);
-static TreeNode * declare_stmt(void);
-static TreeNode * func_stmt(void);
-static TreeNode * func_dcl(void);
-static TreeNode * param_dcl(void);
-static TreeNode * var_dcl(void);
-static TreeNode * if_stmt(void);
-static TreeNode * while_stmt(void);
-//static TreeNode * expression_stmt(void);
-static TreeNode * compound_stmt(void);
-static TreeNode * assign_stmt(void);
-static TreeNode * assign(void);
-static TreeNode * return_stmt(void);
-static TreeNode * expression(void);
-static TreeNode * simple_exp(void);
-static TreeNode * call_exp(void);
-static TreeNode * term(void);
-static TreeNode * factor(void);
-
-char * copyString(const char * s) {
-    int n;
-    char * t;
+/* Token sets for error recovery: token t is in a set when bit t is set */
+typedef unsigned long long TokenSet;
+#define TOKEN_SET(t) ((TokenSet) 1 << (t))
+#define IN_SET(set, t) ((((set) >> (t)) & 1) != 0)
+
+/* After a syntax error in a statement, the parser skips to one of the tokens that end
+   a statement, so that a line with an error costs one message and the parse goes on
+   with the next line. Each rule adds the tokens it can go on with itself. */
+#define STMT_SYNC (TOKEN_SET(SEMI) | TOKEN_SET(ENTER) | TOKEN_SET(RCUR) | TOKEN_SET(SMILE) | TOKEN_SET(EOP))
+#define PARAM_SYNC (TOKEN_SET(COMMA) | TOKEN_SET(RPAR) | TOKEN_SET(ARROW) | STMT_SYNC)
+/* An expression never consumes these when an operand is missing */
+#define EXPR_FOLLOW (TOKEN_SET(RPAR) | TOKEN_SET(RBR) | TOKEN_SET(COMMA) | TOKEN_SET(LCUR) | STMT_SYNC)
+
+/* Compound statements nested deeper than this are skipped, so the recursion of the parser is bounded */
+#define STMT_NESTING_MAX 1000
+
+static void outOfMemory(ParserInfo * ps) {
+    diagnostic_list_add(&ps->diagnostics, ps->lineno, "Out of memory error at line %d\n", ps->lineno);
+}
+
+/* Report a syntax error at the current token. After an error, nothing more is reported
+ until a token is matched, so one mistake gives one message. When the error limit is
+ reached the parse stops: the parser moves to EOP, where every rule returns. */
+static void syntaxError(ParserInfo * ps, char * message) {
+    TokenType token = TOKEN;
+    const char * text = NULL;
+    int length = 0;
+
+    ps->error = TRUE;
+    if (ps->recovering || ps->stopped)
+        return;
+    ps->recovering = TRUE;
+    if (token >= IF && token <= WHILE) {
+        /* tokens of a token list have no lexeme for reserved words */
+        static const char * reservedWords[] = {"if", "else", "num", "return", "void", "while"};
+        text = TOKEN_TEXT(ps->tokens, ps->pos);
+        length = (int) TOKEN_LENGTH(ps->tokens, ps->pos);
+        if (text == NULL) {
+            text = reservedWords[token - IF];
+            length = (int) strlen(text);
+        }
+    } else if (token == ID || token == NUMBER || token == STRING || token == COMMENT || token == ERROR) {
+        text = TOKEN_TEXT(ps->tokens, ps->pos);
+        length = (int) TOKEN_LENGTH(ps->tokens, ps->pos);
+    }
+    if (token < 0 || token > EOP || tokenNames[token] == NULL)
+        diagnostic_list_add(&ps->diagnostics, ps->lineno, "\n>>> Syntax error at line %d: %sUnknown token: %d\n",
+                            ps->lineno, message, token);
+    else
+        diagnostic_list_add(&ps->diagnostics, ps->lineno, "\n>>> Syntax error at line %d: %s%s%.*s\n",
+                            ps->lineno, message, tokenNames[token], text != NULL ? length : 0, text != NULL ? text : "");
+    ps->errorCount++;
+    if (ps->errorLimit > 0 && ps->errorCount >= ps->errorLimit) {
+        diagnostic_list_add(&ps->diagnostics, ps->lineno, "\n>>> %d syntax errors, parsing stopped at line %d\n",
+                            ps->errorCount, ps->lineno);
+        ps->stopped = TRUE;
+        if (ps->stream != NULL)
+            token_stream_stop(ps);
+        else
+            ps->pos = (long) ps->tokens->count - 1;
+        ps->lineno = ps->tokens->lines[ps->pos];
+    }
+}
+
+/* Move to the next token; the EOP token is never passed */
+static void next(ParserInfo * ps) {
+    if (TOKEN != EOP) {
+        ps->pos++;
+        if (ps->fill != NULL && ps->pos + TOKEN_LOOKAHEAD >= (long) ps->tokens->count)
+            ps->fill(ps);
+    }
+    ps->lineno = ps->tokens->lines[ps->pos];
+}
+
+/* Skip to the next token of sync, or to EOP */
+static void skipTo(ParserInfo * ps, TokenSet sync) {
+    sync |= TOKEN_SET(EOP);
+    while (!IN_SET(sync, TOKEN))
+        next(ps);
+}
+
+static TreeNode * stmt_sequence(ParserInfo * ps, TokenSet follow);
+static TreeNode * statement(ParserInfo * ps);
+static TreeNode * para_list(ParserInfo * ps);
+static TreeNode * declare_stmt(ParserInfo * ps);
+static TreeNode * func_stmt(ParserInfo * ps);
+static TreeNode * func_dcl(ParserInfo * ps);
+static TreeNode * param_dcl(ParserInfo * ps);
+static TreeNode * var_dcl(ParserInfo * ps);
+static TreeNode * if_stmt(ParserInfo * ps);
+static TreeNode * while_stmt(ParserInfo * ps);
+//static TreeNode * expression_stmt(ParserInfo * ps);
+static TreeNode * compound_stmt(ParserInfo * ps);
+static TreeNode * assign_stmt(ParserInfo * ps);
+static TreeNode * assign(ParserInfo * ps);
+static TreeNode * return_stmt(ParserInfo * ps);
+static TreeNode * expression(ParserInfo * ps);
+
+/* The unique copy of the lexeme of token i, owned by the tree being built */
+static const char * copyName(ParserInfo * ps, long i) {
+    const char * s = TOKEN_TEXT(ps->tokens, i);
+    const char * t;
     if(s == NULL)
         return NULL;
-    n = strlen(s) + 1;
-    t = malloc(n);
+    if(ps->namesLock != NULL)
+        pthread_mutex_lock(ps->namesLock);
+    t = intern_n(ps->names, s, TOKEN_LENGTH(ps->tokens, i));
+    if(ps->namesLock != NULL)
+        pthread_mutex_unlock(ps->namesLock);
     if(t == NULL)
-        fprintf(listing,"Out of memory error at line %d\n", lineno);
-    else
-        strcpy(t,s);
-    
+        outOfMemory(ps);
     return t;
 }
 
-static void match(TokenType expected) {
-    if(node->token->type == expected) {
-        next();
-    } else {
-        syntaxError("unexpected token -> ");
-        printToken(node->token->type, node->token->string);
-        fprintf(listing,"      ");
+/* The value of the digits at the start of the lexeme of token i, like atoi() */
+static int tokenNumber(ParserInfo * ps, long i) {
+    const char * s = TOKEN_TEXT(ps->tokens, i);
+    unsigned int k, n = TOKEN_LENGTH(ps->tokens, i);
+    int val = 0;
+    if(s == NULL)
+        return 0;
+    for(k = 0; k < n && isdigit((unsigned char) s[k]); k++)
+        val = val * 10 + (s[k] - '0');
+    return val;
+}
+
+/* Match the expected token. Otherwise report it and skip to the expected token, which is
+ then matched, or to a token of sync, where the caller goes on. */
+static void match(ParserInfo * ps, TokenType expected, TokenSet sync) {
+    if(TOKEN != expected) {
+        syntaxError(ps, "unexpected token -> ");
+        skipTo(ps, sync | TOKEN_SET(expected));
+        if(TOKEN != expected)
+            return;
     }
+    next(ps);
+    ps->recovering = FALSE;
 }
 
-TreeNode * newStmtNode(StmtKind kind) {
-    TreeNode * t = (TreeNode *) malloc(sizeof(TreeNode));
-    int i;
+/* newNode takes a zero-filled node from the arena, so every child and sibling is NULL */
+static TreeNode * newNode(ParserInfo * ps, NodeKind kind) {
+    TreeNode * t = (TreeNode *) arena_alloc(&ps->store->nodes, sizeof(TreeNode));
     if (t == NULL)
-        fprintf(listing, "Out of memory error at line %d\n", lineno);
+        outOfMemory(ps);
     else {
-        for (i = 0; i < MAX_CHILDREN; i++)
-            t->child[i] = NULL;
-        t->rSibling = NULL;
-        t->lSibling = NULL;
-        t->nodeKind = STMT_ND;
-        t->kind.stmt = kind;
-        t->lineNum = lineno;
+        memset(t, 0, sizeof(TreeNode));
+        t->nodeKind = kind;
+        t->lineNum = ps->lineno;
+        ps->store->nodeCount++;
     }
     return t;
 }
 
-TreeNode * newExpNode(ExprKind kind) {
-    TreeNode * t = (TreeNode *) malloc(sizeof(TreeNode));
-    int i;
-    if (t==NULL)
-        fprintf(listing,"Out of memory error at line %d\n",lineno);
-    else {
-        for (i = 0;i < MAX_CHILDREN; i++)
-            t->child[i] = NULL;
-        t->rSibling = NULL;
-        t->lSibling = NULL;
-        t->nodeKind = EXPR_ND;
+static TreeNode * newStmtNode(ParserInfo * ps, StmtKind kind) {
+    TreeNode * t = newNode(ps, STMT_ND);
+    if (t != NULL)
+        t->kind.stmt = kind;
+    return t;
+}
+
+static TreeNode * newExpNode(ParserInfo * ps, ExprKind kind) {
+    TreeNode * t = newNode(ps, EXPR_ND);
+    if (t != NULL) {
         t->kind.expr = kind;
-        t->lineNum = lineno;
         t->type = VOID_TYPE;
     }
     return t;
 }
 
-ExprType tokenType_to_expr(TokenType token) {
+/* The finished expression node t, or with sharing on the equal node made before, when there is one;
+ t is then given back to the arena, where it is the last node when its children were shared as well */
+static TreeNode * share(ParserInfo * ps, TreeNode * t) {
+    TreeNode * s;
+    int found;
+    if (!ps->sharing || t == NULL)
+        return t;
+    s = cons_share(&ps->shared, t, &found);
+    if (found) {
+        if (arena_unalloc(&ps->store->nodes, t, sizeof(TreeNode)))
+            ps->store->nodeCount--;
+        ps->stats.shared++;
+    }
+    return s;
+}
+
+/* The expression t, to be given a sibling as an argument or to become a statement: a copy when it is shared */
+static TreeNode * own(ParserInfo * ps, TreeNode * t) {
+    TreeNode * copy;
+    if (!ps->sharing || t == NULL || cons_take(&ps->shared, t))
+        return t;
+    copy = newNode(ps, EXPR_ND);
+    if (copy != NULL) {
+        *copy = *t;
+        ps->stats.shared--;
+    }
+    return copy;
+}
+
+/* A declaration or either end of a block: the names after it may mean other declarations, so nothing made before is shared */
+static void newRegion(ParserInfo * ps) {
+    cons_clear(&ps->shared);
+}
+
+static ExprType tokenType_to_expr(TokenType token) {
     if(token == NUM) {
         return NUM_TYPE;
     } else {
@@ -178,16 +255,33 @@ ExprType tokenType_to_expr(TokenType token) {
     }
 }
 
-/* stmt_sequence -> stmt_sequence statement | statment */
-TreeNode * stmt_sequence(void) {
-    TreeNode * t = statement();
-    TreeNode * p = t;
-    while ((node->token->type != EOP) && (node->token->type != ELSE)
-           && (node->token->type != SMILE)) {
-        TreeNode * q;
-        if((node->prev->token->type != ENTER) && (node->token->type != ENTER))
-            match(SEMI);
-        q = statement();
+/* TRUE when the statement at the current token is separated from the one before it */
+static int separated(ParserInfo * ps) {
+    TokenType before = PEEK(-1);
+    return TOKEN == ENTER || TOKEN == SEMI
+        || before == ENTER || before == SEMI || before == RCUR || before == SMILE;
+}
+
+/* One iteration of the loop of stmt_sequence, at a token that does not end the sequence */
+static TreeNode * nextStatement(ParserInfo * ps, int first) {
+    ps->recovering = FALSE;
+    if (!first && !separated(ps))
+        syntaxError(ps, "unexpected token -> ");
+    return statement(ps);
+}
+
+/* The loop of stmt_sequence: statements up to a token of follow, or up to token end.
+ The loop keeps no state but the token position from one iteration to the next, so a
+ run started at an iteration boundary of another run continues it exactly;
+ parse_parallel.c and incremental.c rely on this. */
+static TreeNode * statements(ParserInfo * ps, TokenSet follow, long end, int first, TreeNode ** last) {
+    TreeNode * t = NULL;
+    TreeNode * p = NULL;
+
+    follow |= TOKEN_SET(EOP);
+    while ((ps->pos < end) && !IN_SET(follow, TOKEN)) {
+        TreeNode * q = nextStatement(ps, first);
+        first = FALSE;
         if (q != NULL) {
             if (t == NULL)
                 t = p = q;
@@ -198,94 +292,132 @@ TreeNode * stmt_sequence(void) {
             }
         }
     }
+    *last = p;
     return t;
 }
 
-/* statement -> if_stmt | while_stmt | assign_stmt | compound_stmt | declare_stmt | ENTER | LBR | return_stmt */
-TreeNode* statement(void) {
+/* stmt_sequence -> stmt_sequence statement | statment
+ follow holds the tokens that end the sequence; the others that cannot start a statement
+ are reported and skipped. */
+static TreeNode * stmt_sequence(ParserInfo * ps, TokenSet follow) {
+    TreeNode * last;
+    return statements(ps, follow, LONG_MAX, TRUE, &last);
+}
+
+/* TRUE when the top-level loop stops at the current token */
+int parse_statements_end(ParserInfo * ps) {
+    return TOKEN == EOP;
+}
+
+/* The top-level loop, for the iterations that start before token end */
+TreeNode * parse_statements(ParserInfo * ps, long end, int first, TreeNode ** last) {
+    newRegion(ps);
+    return statements(ps, TOKEN_SET(EOP), end, first, last);
+}
+
+/* One iteration of the top-level loop */
+TreeNode * parse_statement(ParserInfo * ps, int first) {
+    newRegion(ps);
+    return nextStatement(ps, first);
+}
+
+/* statement -> if_stmt | while_stmt | assign_stmt | compound_stmt | declare_stmt | ENTER | ; | LBR | return_stmt */
+static TreeNode * statement(ParserInfo * ps) {
     TreeNode * t = NULL;
-    
-    switch (node->token->type) {
-        case IF : t = if_stmt(); break;
-        case WHILE : t = while_stmt(); break;
-        case ID : t = assign_stmt(); break;
-        case LCUR: t = compound_stmt(); break;
+
+    switch (TOKEN) {
+        case IF : t = if_stmt(ps); break;
+        case WHILE : t = while_stmt(ps); break;
+        case ID : t = assign_stmt(ps); break;
+        case LCUR: t = compound_stmt(ps); break;
         case NUM:
         case VOID:
-            t = declare_stmt();
+            t = declare_stmt(ps);
+            break;
+        case ENTER:
+        case SEMI:
+        case LBR:
+            next(ps);
             break;
-        case ENTER: match(ENTER); break;
-        case LBR: match(LBR); break;
-        case RETURN: t = return_stmt(); break;
-        default : syntaxError("unexpected token -> ");
-            printToken(node->token->type, node->token->string);
-            next();
+        case RETURN: t = return_stmt(ps); break;
+        default : syntaxError(ps, "unexpected token -> ");
+            next(ps);
+            skipTo(ps, STMT_SYNC);
             break;
     } /* end case */
-    
+
     return t;
 }
 
 /* declare_stmt -> func_dcl | var_dcl */
-TreeNode* declare_stmt() {
+static TreeNode * declare_stmt(ParserInfo * ps) {
     TreeNode* t = NULL;
     
+    newRegion(ps);
     // Function return type NUM or NUM*
-    if((node->next->next->token->type == LPAR) || (node->next->next->next->token->type == LPAR)) {
-        t = func_dcl();
+    if((PEEK(2) == LPAR) || (PEEK(3) == LPAR)) {
+        t = func_dcl(ps);
     } else {
-        t = var_dcl();
+        t = var_dcl(ps);
     }
     
     return t;
 }
 
-/* func_dcl -> type-specifier ID ( para-list ) func-stmt */
-TreeNode* func_dcl() {
-    TreeNode* t = newStmtNode(DCL_STMT);
+/* func_dcl -> type-specifier ID ( para-list ) func-stmt | type-specifier * ID ( para-list ) func-stmt */
+static TreeNode * func_dcl(ParserInfo * ps) {
+    TreeNode* t = newStmtNode(ps, DCL_STMT);
     
     t->nodeKind = DCL_ND;
     t->kind.dcl = FUN_DCL;
-    if(node->next->token->type == STAR) {
+    if(PEEK(1) == STAR) {
         t->attr.dclAttr.type = ADDR_TYPE;
     } else {
-        t->attr.dclAttr.type = tokenType_to_expr(node->token->type);
+        t->attr.dclAttr.type = tokenType_to_expr(TOKEN);
     }
     
-    match(node->token->type);
+    next(ps);   /* the type */
+    if(TOKEN == STAR)
+        next(ps);
     
-    t->attr.dclAttr.name = copyString(node->token->string);
-    match(ID);
+    if(TOKEN == ID)
+        t->attr.dclAttr.name = copyName(ps, ps->pos);
+    match(ps, ID, TOKEN_SET(LPAR) | PARAM_SYNC);
     
-    t->child[0] = para_list();
-    t->child[1] = func_stmt();
+    t->child[0] = para_list(ps);
+    t->child[1] = func_stmt(ps);
     
     return t;
 }
 
 /* func_stmt -> ARROW stmt_sequence SMILE */
-TreeNode* func_stmt() {
-    TreeNode* t = newStmtNode(FUNC_STMT);
+static TreeNode * func_stmt(ParserInfo * ps) {
+    TreeNode* t = newStmtNode(ps, FUNC_STMT);
     
-    match(ARROW);
-    t->child[0] = stmt_sequence();
-    match(SMILE);
+    /* the --> may start a line of its own */
+    while(TOKEN == ENTER)
+        next(ps);
+    match(ps, ARROW, STMT_SYNC);
+    newRegion(ps);
+    t->child[0] = stmt_sequence(ps, TOKEN_SET(SMILE));
+    newRegion(ps);
+    match(ps, SMILE, STMT_SYNC);
     
     return t;
 }
 
-/* para-list -> para-list, param_dcl | param_dcl */
-TreeNode* para_list() {
+/* para-list -> ( param_dcl {, param_dcl} ) | ( void ) */
+static TreeNode * para_list(ParserInfo * ps) {
     TreeNode* t = NULL;
     
-    match(LPAR);
-    if(node->token->type != VOID) {
-        t = param_dcl();
-        TreeNode* p = t;
-        while(node->token->type != RPAR) {
+    match(ps, LPAR, PARAM_SYNC);
+    if(TOKEN != VOID) {
+        TreeNode* p;
+        t = p = param_dcl(ps);
+        while(TOKEN == COMMA) {
             TreeNode* q;
-            match(COMMA);
-            q = param_dcl();
+            next(ps);
+            q = param_dcl(ps);
             if (q != NULL) {
                 if (t == NULL)
                     t = p = q;
@@ -297,150 +429,135 @@ TreeNode* para_list() {
             }
         }
     } else {
-        TreeNode * t = (TreeNode *) malloc(sizeof(TreeNode));
-        int i;
-        if (t == NULL)
-            fprintf(listing, "Out of memory error at line %d\n", lineno);
-        else {
-            for (i = 0; i < MAX_CHILDREN; i++)
-                t->child[i] = NULL;
-            t->rSibling = NULL;
-            t->lSibling = NULL;
-            t->nodeKind = PARAM_ND;
-            t->lineNum = lineno;
-        }
+        TreeNode * t = newNode(ps, PARAM_ND);
         
         t->attr.dclAttr.type = VOID_TYPE;
         t->kind.param = VOID_PARAM;
-        match(VOID);
+        next(ps);
         
     }
-    match(RPAR);
+    match(ps, RPAR, TOKEN_SET(ARROW) | STMT_SYNC);
     
     return t;
 }
 
 /* param_dcl -> type-specifier ID | type-specifier ID [ ] | type-specifier * ID */
-TreeNode* param_dcl() {
-    TreeNode * t = (TreeNode *) malloc(sizeof(TreeNode));
-    int i;
-    if (t == NULL)
-        fprintf(listing, "Out of memory error at line %d\n", lineno);
-    else {
-        for (i = 0; i < MAX_CHILDREN; i++)
-            t->child[i] = NULL;
-        t->rSibling = NULL;
-        t->lSibling = NULL;
-        t->nodeKind = PARAM_ND;
-        t->lineNum = lineno;
-    }
+static TreeNode * param_dcl(ParserInfo * ps) {
+    TreeNode * t = newNode(ps, PARAM_ND);
     
-    if(node->next->token->type == STAR || node->next->next->token->type == LBR) {
+    if(PEEK(1) == STAR || PEEK(2) == LBR) {
         t->attr.dclAttr.type = ADDR_TYPE;
         t->kind.param = ARRAY_PARAM;
     } else {
-        t->attr.dclAttr.type = tokenType_to_expr(node->token->type);
+        t->attr.dclAttr.type = tokenType_to_expr(TOKEN);
         t->kind.param = VAR_PARAM;
     }
     
-    match(node->token->type);
+    if(TOKEN == NUM || TOKEN == VOID)
+        next(ps);
+    else
+        match(ps, NUM, PARAM_SYNC);
     
-    if(node->token->type == STAR)
-        match(STAR);
-    t->attr.dclAttr.name = copyString(node->token->string);
-    match(ID);
+    if(TOKEN == STAR)
+        next(ps);
+    if(TOKEN == ID)
+        t->attr.dclAttr.name = copyName(ps, ps->pos);
+    match(ps, ID, PARAM_SYNC);
+    if(TOKEN == LBR) {
+        next(ps);
+        match(ps, RBR, PARAM_SYNC);
+    }
     
     return t;
 }
 
 /* var_dcl -> type-specifier ID | type-specifier ID [ INT ] | type-specifier * ID */
-TreeNode* var_dcl() {
-    TreeNode* t = newStmtNode(DCL_STMT);
+static TreeNode * var_dcl(ParserInfo * ps) {
+    TreeNode* t = newStmtNode(ps, DCL_STMT);
     
     t->nodeKind = DCL_ND;
-    if(node->next->token->type == STAR || node->next->next->token->type == LBR) {
+    if(PEEK(1) == STAR || PEEK(2) == LBR) {
         t->attr.dclAttr.type = ADDR_TYPE;
         t->kind.dcl = ARRAY_DCL;
     } else {
-        t->attr.dclAttr.type = tokenType_to_expr(node->token->type);
+        t->attr.dclAttr.type = tokenType_to_expr(TOKEN);
         t->kind.dcl = VAR_DCL;
     }
     
-    match(node->token->type);
-    if(node->token->type == STAR)
-        match(STAR);
+    next(ps);   /* the type */
+    if(TOKEN == STAR)
+        next(ps);
     
-    t->attr.dclAttr.name = copyString(node->token->string);
-    match(ID);
+    if(TOKEN == ID)
+        t->attr.dclAttr.name = copyName(ps, ps->pos);
+    match(ps, ID, TOKEN_SET(LBR) | STMT_SYNC);
     
-    if(node->token->type == LBR) {
-        match(LBR);
-        t->attr.dclAttr.size = atoi(node->token->string);
-        match(RBR);
+    if(TOKEN == LBR) {
+        next(ps);
+        if(TOKEN == NUMBER)
+            t->attr.dclAttr.size = tokenNumber(ps, ps->pos);
+        match(ps, NUMBER, TOKEN_SET(RBR) | STMT_SYNC);
+        match(ps, RBR, STMT_SYNC);
     }
 
-    match(SEMI);
+    match(ps, SEMI, STMT_SYNC);
 
     return t;
 }
 
 /* assign_stmt -> assign ; */
-TreeNode* assign_stmt() {
+static TreeNode * assign_stmt(ParserInfo * ps) {
     TreeNode* t = NULL;
-    t = assign();
-    match(SEMI);
+    t = assign(ps);
+    match(ps, SEMI, STMT_SYNC);
     return t;
 }
 
 /* assign -> ID = expression | expression
  Note: The name "assign" is not perfect, it doesn't only refer to assign op but also expression.
+ An assignment comes back from expression() as an = operator, and becomes the statement node.
  */
-TreeNode* assign() {
-    TreeNode* t = newStmtNode(ASSIGN_STMT);
+static TreeNode * assign(ParserInfo * ps) {
+    TreeNode* t = own(ps, expression(ps));
     
-    if((node->token->type == ID) && (node->next->token->type == ASSIGN)) {
-        TreeNode* p = newExpNode(ID_EXPR);
-        
-        p->attr.exprAttr.name = copyString(node->token->string);
-        match(ID);
-        
-        t->attr.exprAttr.op = ASSIGN;
-        t->child[0] = p;
-        match(ASSIGN);
-        t->child[1] = expression();
-    } else {
-        t = expression();
+    if((t != NULL) && (t->nodeKind == EXPR_ND) && (t->kind.expr == OP_EXPR) && (t->attr.exprAttr.op == ASSIGN)) {
+        t->nodeKind = STMT_ND;
+        t->kind.stmt = ASSIGN_STMT;
     }
     
     return t;
 }
 
-/* return_stmt -> return expression ; */
-TreeNode * return_stmt() {
-    TreeNode* t = newStmtNode(RTN_STMT);
-    match(RETURN);
-    t->child[0] = expression();
-    match(SEMI);
+/* return_stmt -> return expression ; | return ; */
+static TreeNode * return_stmt(ParserInfo * ps) {
+    TreeNode* t = newStmtNode(ps, RTN_STMT);
+    next(ps);   /* return */
+    if(TOKEN != SEMI)
+        t->child[0] = expression(ps);
+    match(ps, SEMI, STMT_SYNC);
     return t;
 }
 
 /* if_stmt -> if (expression ) compound_stmt | if (expression ) compound_stmt else compound_stmt */
-TreeNode* if_stmt() {
-    TreeNode* t = newStmtNode(SLCT_STMT);
+static TreeNode * if_stmt(ParserInfo * ps) {
+    TreeNode* t = newStmtNode(ps, SLCT_STMT);
     
-    match(IF);
+    next(ps);   /* if */
     if(t != NULL) {
-        match(LPAR);
-        t->child[0] = expression();
-        match(RPAR);
+        match(ps, LPAR, TOKEN_SET(LCUR) | STMT_SYNC);
+        t->child[0] = expression(ps);
+        match(ps, RPAR, TOKEN_SET(LCUR) | STMT_SYNC);
     }
     if(t != NULL) {
-        t->child[1] = compound_stmt();
+        t->child[1] = compound_stmt(ps);
     }
-    if(node->token->type == ELSE) {
-        match(ELSE);
+    /* the else may start the next line */
+    if(TOKEN == ENTER && PEEK(1) == ELSE)
+        next(ps);
+    if(TOKEN == ELSE) {
+        next(ps);
         if(t != NULL) {
-            t->child[2] = compound_stmt();
+            t->child[2] = compound_stmt(ps);
         }
     }
     
@@ -448,204 +565,1311 @@ TreeNode* if_stmt() {
 }
 
 /* while_stmt -> while ( expression ) compound_stmt */
-TreeNode* while_stmt() {
-    TreeNode* t = newStmtNode(WHILE_STMT);
+static TreeNode * while_stmt(ParserInfo * ps) {
+    TreeNode* t = newStmtNode(ps, WHILE_STMT);
     
-    match(WHILE);
+    next(ps);   /* while */
     if(t != NULL) {
-        match(LPAR);
-        t->child[0] = expression();
-        match(RPAR);
+        match(ps, LPAR, TOKEN_SET(LCUR) | STMT_SYNC);
+        t->child[0] = expression(ps);
+        match(ps, RPAR, TOKEN_SET(LCUR) | STMT_SYNC);
     }
     if(t != NULL) {
-        t->child[1] = compound_stmt();
+        t->child[1] = compound_stmt(ps);
     }
     
     return t;
 }
 
 /* compoud_stmt -> { stmt_sequence } */
-TreeNode* compound_stmt() {
-    TreeNode* t = newStmtNode(CMPD_STMT);
+static TreeNode * compound_stmt(ParserInfo * ps) {
+    TreeNode* t;
     
-    match(LCUR);
-    t = stmt_sequence();
-    match(RCUR);
+    if(TOKEN != LCUR) {
+        /* without its { nothing that follows belongs to the statement */
+        syntaxError(ps, "unexpected token -> ");
+        return NULL;
+    }
+    if(ps->depth >= STMT_NESTING_MAX) {
+        syntaxError(ps, "statements nested too deeply -> ");
+        next(ps);
+        skipTo(ps, STMT_SYNC);
+        return NULL;
+    }
+    next(ps);
+    ps->depth++;
+    INSTRUMENT_MAX(ps->stats.maxBlockDepth, ps->depth);
+    newRegion(ps);
+    t = stmt_sequence(ps, TOKEN_SET(RCUR) | TOKEN_SET(SMILE));
+    newRegion(ps);
+    ps->depth--;
+    match(ps, RCUR, STMT_SYNC);
     
     return t;
 }
 
 /* deprecated */
 //TreeNode* expression_stmt() {
-//    TreeNode* t = expression();
-//    match(SEMI);
+//    TreeNode* t = expression(ps);
+//    match(ps, SEMI);
 //    return t;
 //}
 
-/* expression -> simple_exp | simple_exp relop simple_exp | call_exp */
-TreeNode* expression() {
-    TreeNode* t = simple_exp();
-    
-    if((node->token->type == LT) || (node->token->type == LTE) || (node->token->type == GT) || (node->token->type == GTE) || (node->token->type == EQ) || (node->token->type == NEQ)) {
-        TreeNode* p = newExpNode(OP_EXPR);
-        if(p != NULL) {
-            p->child[0] = t;
-            p->attr.exprAttr.op = node->token->type;
-            t = p;
-        }
-        match(node->token->type);
-        if(t != NULL) {
-            t->child[1] = simple_exp();
+/* expression -> expression binop expression | operand postfix*
+ operand -> ( expression ) | ID | NUMBER
+ postfix -> [ expression ] | ( arg_list ), after an ID only
+ arg_list -> arg_list , expression | expression | empty
+
+ Expressions are parsed by precedence climbing over the table below,
+ with an explicit, bounded stack of pending operators and operands
+ instead of one recursive call per precedence level. A ( [ or call
+ that is still open is an entry of the operator stack as well, so
+ nothing in an expression recurses.
+ */
+
+/* The most operators, open parentheses, brackets and calls an expression can have pending */
+#define EXPR_STACK_MAX 256
+
+/* The binding power of each binary operator; 0 for the other tokens. Only ASSIGN is right associative. */
+static const unsigned char binaryPower[EOP + 1] = {
+    [ASSIGN] = 1,
+    [EQ] = 2, [NEQ] = 2,
+    [LT] = 3, [LTE] = 3, [GT] = 3, [GTE] = 3,
+    [PLUS] = 4, [MINUS] = 4,
+    [STAR] = 5, [OVER] = 5, [MOD] = 5,
+};
+
+typedef enum { BINARY_OP, OPEN_PAREN, OPEN_INDEX, OPEN_CALL } PendingKind;
+
+/* The node of an operator is made when the operator is read, as the recursive parser made it */
+typedef struct {
+    TreeNode * node;         /* the operator, the [] node or the call; NULL for ( or when memory ran out */
+    TreeNode * left;         /* OPEN_INDEX: the array; OPEN_CALL: the last argument so far */
+    unsigned char kind;      /* PendingKind */
+    unsigned char power;     /* BINARY_OP: binaryPower of the operator */
+} PendingOp;
+
+typedef struct {
+    ParserInfo * ps;
+    PendingOp ops[EXPR_STACK_MAX];
+    int opTop;
+    TreeNode * vals[EXPR_STACK_MAX + 1];   /* there is at most one more operand than operators */
+    int valTop;
+} ExprStack;
+
+/* The token that closes an open entry */
+static TokenType closingToken(const PendingOp * op) {
+    return op->kind == OPEN_INDEX ? RBR : RPAR;
+}
+
+static int isAssignable(const TreeNode * t) {
+    return t != NULL && t->nodeKind == EXPR_ND
+        && (t->kind.expr == ID_EXPR || (t->kind.expr == OP_EXPR && t->attr.exprAttr.op == LBR));
+}
+
+/* Complete the binary operators on top of the stack that bind at least as tightly as power */
+static void reduce(ExprStack * s, int power) {
+    while (s->opTop > 0 && s->ops[s->opTop - 1].kind == BINARY_OP && s->ops[s->opTop - 1].power >= power) {
+        TreeNode * t = s->ops[--s->opTop].node;
+        TreeNode * right = s->vals[--s->valTop];
+        if (t != NULL) {
+            t->child[0] = s->vals[s->valTop - 1];
+            t->child[1] = right;
+            s->vals[s->valTop - 1] = t->attr.exprAttr.op != ASSIGN ? share(s->ps, t) : t;
         }
     }
-    
-    if(node->token->type == LPAR) {
-        t = call_exp();
+}
+
+/* Pop the open entry on top of the stack; its last operand is on top of the operand stack */
+static void closeOpen(ExprStack * s) {
+    PendingOp * op = &s->ops[--s->opTop];
+    TreeNode * t;
+    switch (op->kind) {
+        case OPEN_INDEX:
+            t = s->vals[--s->valTop];
+            if (op->node != NULL) {
+                op->node->child[0] = op->left;
+                op->node->child[1] = t;
+                s->vals[s->valTop++] = share(s->ps, op->node);
+            } else
+                s->vals[s->valTop++] = op->left;
+            break;
+        case OPEN_CALL:
+            t = own(s->ps, s->vals[--s->valTop]);
+            if (t != NULL) {
+                if (op->left == NULL)
+                    op->node->child[0] = t;
+                else
+                    op->left->rSibling = t;
+            }
+            s->vals[s->valTop++] = op->node;
+            break;
+        default:      /* OPEN_PAREN: the value is the expression inside */
+            break;
     }
-    
-    return t;
 }
 
-/* call_exp -> ID (arg_list) */
-TreeNode* call_exp() {
-    TreeNode* t = newExpNode(CALL_EXPR);
-    t->attr.exprAttr.name = copyString(node->prev->token->string);
-    match(node->token->type);
-    t->child[0] = arg_list();
-    return t;
+/* Room for one more pending operator; when the stack is full, the expression ends here */
+static int hasRoom(ParserInfo * ps, const ExprStack * s) {
+    if (s->opTop < EXPR_STACK_MAX) {
+        INSTRUMENT_MAX(ps->stats.maxExpressionDepth, s->opTop + 1);
+        return TRUE;
+    }
+    syntaxError(ps, "expression nested too deeply -> ");
+    return FALSE;
 }
 
-/* arg_list -> arg_list, factor | factor */
-TreeNode* arg_list() {
-    TreeNode* t = NULL;
-    
-    match(LPAR);
-    if(node->token->type != RPAR) {
-        t = factor();
-        TreeNode* p = t;
-        while(node->token->type != RPAR) {
-            TreeNode* q;
-            match(COMMA);
-            q = factor();
-            if (q != NULL) {
-                if (t == NULL)
-                    t = p = q;
-                else /* now p cannot be NULL either */
-                {
-                    p->rSibling = q;
-                    p = q;
+static void pushOp(ExprStack * s, PendingKind kind, int power, TreeNode * node, TreeNode * left) {
+    PendingOp * op = &s->ops[s->opTop++];
+    op->node = node;
+    op->left = left;
+    op->kind = (unsigned char) kind;
+    op->power = (unsigned char) power;
+}
+
+static TreeNode * descentAssign(ParserInfo * ps, int depth);
+
+static TreeNode * expression(ParserInfo * ps) {
+    ExprStack s;
+    TreeNode * t;
+    int callable;      /* the operand just parsed is a plain ID, which ( makes a call */
+    int done = FALSE;
+
+    if (ps->recursive)
+        return descentAssign(ps, 0);
+    s.ps = ps;
+    s.opTop = 0;
+    s.valTop = 0;
+    for (;;) {
+        /* an operand */
+        t = NULL;
+        callable = FALSE;
+        switch (TOKEN) {
+            case NUMBER:
+                t = newExpNode(ps, CONST_EXPR);
+                if (t != NULL)
+                    t->attr.exprAttr.val = tokenNumber(ps, ps->pos);
+                t = share(ps, t);
+                next(ps);
+                break;
+            case ID:
+                t = newExpNode(ps, ID_EXPR);
+                if (t != NULL)
+                    t->attr.exprAttr.name = copyName(ps, ps->pos);
+                next(ps);
+                /* an ID followed by ( becomes a call, which is never shared */
+                if (TOKEN != LPAR)
+                    t = share(ps, t);
+                callable = t != NULL;
+                break;
+            case LPAR:
+                if (hasRoom(ps, &s)) {
+                    pushOp(&s, OPEN_PAREN, 0, NULL, NULL);
+                    next(ps);
+                    continue;
                 }
+                done = TRUE;
+                break;
+            default:
+                /* a missing operand: skip the token, unless the statement can go on with it */
+                syntaxError(ps, "unexpected token -> ");
+                if (!IN_SET(EXPR_FOLLOW, TOKEN))
+                    next(ps);
+                break;
+        }
+        s.vals[s.valTop++] = t;
+        if (done)
+            break;
+
+        /* the postfix and binary operators after it */
+        for (;;) {
+            TokenType token = TOKEN;
+            int power = binaryPower[token];
+            if (power > 0) {
+                /* every operator binds more tightly than =, so its left side is complete once reduced */
+                reduce(&s, token == ASSIGN ? power + 1 : power);
+                if (token == ASSIGN && !isAssignable(s.vals[s.valTop - 1])) {
+                    done = TRUE;
+                    break;
+                }
+                if (!hasRoom(ps, &s)) {
+                    done = TRUE;
+                    break;
+                }
+                t = newExpNode(ps, OP_EXPR);
+                if (t != NULL)
+                    t->attr.exprAttr.op = token;
+                pushOp(&s, BINARY_OP, power, t, NULL);
+                next(ps);
+                break;
+            } else if (token == LBR) {
+                /* the [] index operator: the array is child[0] and the index is child[1] */
+                if (!hasRoom(ps, &s)) {
+                    done = TRUE;
+                    break;
+                }
+                t = newExpNode(ps, OP_EXPR);
+                if (t != NULL)
+                    t->attr.exprAttr.op = LBR;
+                pushOp(&s, OPEN_INDEX, 0, t, s.vals[--s.valTop]);
+                next(ps);
+                break;
+            } else if (token == LPAR && callable) {
+                /* a call: the ID becomes the call node, and the arguments are its child[0] */
+                if (!hasRoom(ps, &s)) {
+                    done = TRUE;
+                    break;
+                }
+                t = s.vals[--s.valTop];
+                t->kind.expr = CALL_EXPR;
+                next(ps);
+                callable = FALSE;
+                if (TOKEN == RPAR) {
+                    next(ps);
+                    s.vals[s.valTop++] = t;
+                    continue;
+                }
+                pushOp(&s, OPEN_CALL, 0, t, NULL);
+                break;
+            } else if (token == RPAR || token == RBR || token == COMMA) {
+                PendingOp * open;
+                reduce(&s, 0);
+                if (s.opTop == 0) {
+                    done = TRUE;       /* it closes something outside the expression */
+                    break;
+                }
+                open = &s.ops[s.opTop - 1];
+                callable = FALSE;
+                if (token == COMMA && open->kind == OPEN_CALL) {
+                    /* the next argument */
+                    TreeNode * q = own(ps, s.vals[--s.valTop]);
+                    if (q != NULL) {
+                        if (open->left == NULL)
+                            open->node->child[0] = q;
+                        else
+                            open->left->rSibling = q;
+                        open->left = q;
+                    }
+                    next(ps);
+                    break;
+                }
+                if (token == closingToken(open)) {
+                    closeOpen(&s);
+                    next(ps);
+                } else {
+                    /* report the missing ) or ], then try the token on the enclosing entry */
+                    syntaxError(ps, "unexpected token -> ");
+                    closeOpen(&s);
+                }
+            } else {
+                done = TRUE;
+                break;
             }
         }
+        if (done)
+            break;
+    }
+
+    /* the end of the expression: whatever is still open misses its ) or ] */
+    for (;;) {
+        reduce(&s, 0);
+        if (s.opTop == 0)
+            break;
+        syntaxError(ps, "unexpected token -> ");
+        closeOpen(&s);
+    }
+    return s.vals[0];
+}
+
+/* The same grammar by recursive descent, for parser_set_recursive_expressions():
+ assign -> level2 = assign | level2, when level2 is an ID or an index
+ levelN -> levelN+1 { binop of binaryPower N levelN+1 }, for N = 2 .. 5
+ level6 -> operand postfix*
+ Each operand costs a call per precedence level, as the chain expression(), simple_exp(), term(),
+ factor() of the parser before precedence climbing did. depth counts the open parentheses,
+ brackets, calls and = on the way down, and bounds the recursion as EXPR_STACK_MAX bounds the stack above. */
+
+#define DESCENT_LEVELS 6
+
+/* Room for one more nesting level; when there is none, the expression ends here */
+static int descentRoom(ParserInfo * ps, int depth) {
+    if (depth < EXPR_STACK_MAX) {
+        INSTRUMENT_MAX(ps->stats.maxExpressionDepth, depth + 1);
+        return TRUE;
+    }
+    syntaxError(ps, "expression nested too deeply -> ");
+    return FALSE;
+}
+
+/* The ) or ] that closes what the caller opened; otherwise it is reported and left for the enclosing one */
+static void descentClose(ParserInfo * ps, TokenType closing) {
+    if (TOKEN == closing)
+        next(ps);
+    else
+        syntaxError(ps, "unexpected token -> ");
+}
+
+static TreeNode * descentOperand(ParserInfo * ps, int depth) {
+    TreeNode * t = NULL;
+    int callable = FALSE;      /* t is a plain ID, which ( makes a call */
+
+    switch (TOKEN) {
+        case NUMBER:
+            t = newExpNode(ps, CONST_EXPR);
+            if (t != NULL)
+                t->attr.exprAttr.val = tokenNumber(ps, ps->pos);
+            t = share(ps, t);
+            next(ps);
+            break;
+        case ID:
+            t = newExpNode(ps, ID_EXPR);
+            if (t != NULL)
+                t->attr.exprAttr.name = copyName(ps, ps->pos);
+            next(ps);
+            if (TOKEN != LPAR)
+                t = share(ps, t);
+            callable = t != NULL;
+            break;
+        case LPAR:
+            if (!descentRoom(ps, depth))
+                return NULL;
+            next(ps);
+            t = descentAssign(ps, depth + 1);
+            descentClose(ps, RPAR);
+            break;
+        default:
+            syntaxError(ps, "unexpected token -> ");
+            if (!IN_SET(EXPR_FOLLOW, TOKEN))
+                next(ps);
+            break;
+    }
+
+    for (;;) {
+        if (TOKEN == LBR) {
+            /* the [] index operator: the array is child[0] and the index is child[1] */
+            TreeNode * p;
+            TreeNode * index;
+            if (!descentRoom(ps, depth))
+                return t;
+            p = newExpNode(ps, OP_EXPR);
+            next(ps);
+            index = descentAssign(ps, depth + 1);
+            descentClose(ps, RBR);
+            if (p != NULL) {
+                p->attr.exprAttr.op = LBR;
+                p->child[0] = t;
+                p->child[1] = index;
+                t = share(ps, p);
+            }
+        } else if (TOKEN == LPAR && callable) {
+            /* a call: the ID becomes the call node, and the arguments are its child[0] */
+            TreeNode * last = NULL;
+            if (!descentRoom(ps, depth))
+                return t;
+            t->kind.expr = CALL_EXPR;
+            next(ps);
+            if (TOKEN != RPAR) {
+                for (;;) {
+                    TreeNode * q = own(ps, descentAssign(ps, depth + 1));
+                    if (q != NULL) {
+                        if (last == NULL)
+                            t->child[0] = q;
+                        else
+                            last->rSibling = q;
+                        last = q;
+                    }
+                    if (TOKEN != COMMA)
+                        break;
+                    next(ps);
+                }
+            }
+            descentClose(ps, RPAR);
+        } else
+            break;
+        callable = FALSE;
     }
-    match(RPAR);
-    
     return t;
 }
 
-/* simple_exp -> term addop term */
-TreeNode* simple_exp() {
-    TreeNode* t = term();
-    
-    while((node->token->type == PLUS) || (node->token->type == MINUS)) {
-        TreeNode* p = newExpNode(OP_EXPR);
-        
-        if(p != NULL) {
+static TreeNode * descentLevel(ParserInfo * ps, int power, int depth) {
+    TreeNode * t;
+    if (power == DESCENT_LEVELS)
+        return descentOperand(ps, depth);
+    t = descentLevel(ps, power + 1, depth);
+    while (binaryPower[TOKEN] == power) {
+        TreeNode * p = newExpNode(ps, OP_EXPR);
+        TreeNode * right;
+        TokenType op = TOKEN;
+        next(ps);
+        right = descentLevel(ps, power + 1, depth);
+        if (p != NULL) {
+            p->attr.exprAttr.op = op;
             p->child[0] = t;
-            p->attr.exprAttr.op = node->token->type;
-            t = p;
-            match(node->token->type);
-            t->child[1] = term();
+            p->child[1] = right;
+            t = share(ps, p);
         }
     }
-    
     return t;
 }
 
-/* term -> factor mulop factor */
-TreeNode* term() {
-    TreeNode* t = factor();
-    
-    while((node->token->type == STAR) || (node->token->type == OVER)) {
-        TreeNode* p = newExpNode(OP_EXPR);
-        
-        if(p != NULL) {
+static TreeNode * descentAssign(ParserInfo * ps, int depth) {
+    TreeNode * t = descentLevel(ps, 2, depth);
+    if (TOKEN == ASSIGN && isAssignable(t) && descentRoom(ps, depth)) {
+        TreeNode * p = newExpNode(ps, OP_EXPR);
+        TreeNode * right;
+        next(ps);
+        right = descentAssign(ps, depth + 1);
+        if (p != NULL) {
+            p->attr.exprAttr.op = ASSIGN;
             p->child[0] = t;
-            p->attr.exprAttr.op = node->token->type;
+            p->child[1] = right;
             t = p;
-            match(node->token->type);
-            p->child[1] = factor();
         }
     }
-    
     return t;
 }
 
-/* factor -> ( expression ) | ID | NUMBER */
-TreeNode* factor() {
-    TreeNode* t = NULL;
-    switch(node->token->type) {
-        case NUMBER:
-            t = newExpNode(CONST_EXPR);
-            if((t != NULL) && (node->token->type) == NUMBER) {
-                t->attr.exprAttr.val = atoi(node->token->string);
-            }
-            match(NUMBER);
-            break;
-        case ID:
-            t = newExpNode(ID_EXPR);
-            if ((t != NULL) && (node->token->type == ID)) {
-                t->attr.exprAttr.name = copyString(node->token->string);
-                match(ID);
-                // Array:
-                if(node->token->type == LBR) {
-                    match(LBR);
-                    char tail[20] = "[";
-                    strcat(tail, node->token->string);
-                    strcat(tail, "]");
-                    char* array_name = strcat(t->attr.exprAttr.name, tail);
-                    t->attr.exprAttr.name = array_name;
-                    match(node->token->type);
-                    match(RBR);
-                }
-            } else {
-                match(ID);
-            }
-            break;
-        case LPAR :
-            match(LPAR);
-            t = expression();
-            match(RPAR);
-            break;
-        default:
-            syntaxError("unexpected token -> ");
-            printToken(node->token->type, node->token->string);
-            next();
-            break;
+TreeStore * tree_store_begin(ParserInfo * ps) {
+    TreeStore * store = ps->spare;
+    if (store != NULL)
+        ps->spare = NULL;
+    else {
+        store = (TreeStore *) malloc(sizeof(TreeStore));
+        if (store == NULL) {
+            outOfMemory(ps);
+            return NULL;
+        }
+        arena_init(&store->nodes);
+        intern_init(&store->names);
     }
-    return t;
+    store->nodeCount = 0;
+    store->root = NULL;
+    store->next = ps->trees;
+    ps->trees = store;
+    ps->store = store;
+    ps->names = &store->names;
+    return store;
+}
+
+void tree_store_end(ParserInfo * ps, TreeNode * root) {
+    TreeStore * store = ps->store;
+    store->root = root;
+    ps->store = NULL;
+    ps->names = NULL;
+    ps->stats.nodes = store->nodeCount;
+    ps->stats.bytes = store->nodes.bytes;
+    ps->stats.nameBytes = store->names.storage.bytes;
+    ps->stats.arenaObjects = store->nodes.objects + store->names.storage.objects;
 }
 
-/* program -> stmt_sequence */
-TreeNode* parse() {
-    TreeNode* root = stmt_sequence();
+void tree_store_free(ParserInfo * ps, TreeStore * store) {
+    TreeStore ** link = &ps->trees;
+    while (*link != NULL && *link != store)
+        link = &(*link)->next;
+    if (*link != NULL) {
+        *link = store->next;
+        if (ps->stream != NULL && ps->spare == NULL) {
+            /* a stream frees a store for each statement: its memory is used again, not given back to malloc every time */
+            arena_reset(&store->nodes);
+            intern_clear(&store->names);
+            ps->spare = store;
+            return;
+        }
+        arena_release(&store->nodes);
+        intern_release(&store->names);
+        free(store);
+    }
+}
+
+/* program -> stmt_sequence
+ Each parse gets a fresh TreeStore: the tree is owned by it until free_tree().
+ The diagnostics are collected while parsing and written to the listing at the end. */
+static TreeNode * parser_parse(Parser * p) {
+    ParserInfo * ps = PARSER_INFO(p);
+    TreeNode * root;
+    TreeNode * last;
+    long begin = ps->pos;
+
+    if (ps->tokens == NULL)
+        return NULL;
+    memset(&ps->stats, 0, sizeof(ParseStats));
+    diagnostic_list_clear(&ps->diagnostics);
+    ps->error = FALSE;
+    ps->errorCount = 0;
+    ps->recovering = FALSE;
+    ps->stopped = FALSE;
+    ps->depth = 0;
+    ps->lineno = ps->tokens->lines[ps->pos];
+    if (tree_store_begin(ps) == NULL) {
+        diagnostic_list_write(&ps->diagnostics, 0, ps->listing);
+        return NULL;
+    }
+
+    root = ps->pool != NULL ? parse_parallel(ps) : parse_statements(ps, LONG_MAX, TRUE, &last);
+
+    tree_store_end(ps, root);
+    ps->stats.tokens = (size_t) (ps->pos - begin);
+    ps->stats.syntaxErrors = ps->errorCount;
+    diagnostic_list_write(&ps->diagnostics, 0, ps->listing);
     return root;
 }
 
-int main(int argc, const char * argv[]) {
-    // insert code here...
-    FILE * fp = fopen("arrayMaxMean_n_tklist.txt", "r");
-    listing = fopen("errorlog.txt", "w+");
-    if(fp==NULL){
+/* Release a tree built by this parser. All of its nodes and names live in its
+ TreeStore, so this costs one free() per arena chunk and never walks the tree. */
+static void parser_free_tree(Parser * p, TreeNode * tree) {
+    ParserInfo * ps = PARSER_INFO(p);
+    TreeStore * store = ps->trees;
+    while (store != NULL && store->root != tree)
+        store = store->next;
+    if (store != NULL)
+        tree_store_free(ps, store);
+}
+
+static void parser_print_tree(Parser * p, TreeNode * tree) {
+    (void) p;
+    print_tree(tree);
+}
+
+/* TokenList adapter: the list is copied into a token buffer kept by the parser */
+static void parser_set_token_list(Parser * p, TokenList tokenList) {
+    ParserInfo * ps = PARSER_INFO(p);
+    token_buffer_release(&ps->listTokens);
+    if(!token_buffer_from_list(&ps->listTokens, tokenList))
+        fprintf(ps->listing, "Out of memory error while reading the token list\n");
+    parser_set_token_buffer(p, &ps->listTokens);
+}
+
+void parser_set_token_buffer(Parser * p, TokenBuffer * tokenBuffer) {
+    ParserInfo * ps = PARSER_INFO(p);
+    ps->tokens = tokenBuffer;
+    ps->pos = 0;
+}
+
+void parser_set_pool(Parser * p, ThreadPool * pool) {
+    PARSER_INFO(p)->pool = pool;
+}
+
+void parser_set_sharing(Parser * p, int sharing) {
+    PARSER_INFO(p)->sharing = sharing;
+}
+
+void parser_set_recursive_expressions(Parser * p, int recursive) {
+    PARSER_INFO(p)->recursive = recursive;
+}
+
+ParseStats parser_stats(Parser * p) {
+    return PARSER_INFO(p)->stats;
+}
+
+int parser_error(Parser * p) {
+    return PARSER_INFO(p)->error;
+}
+
+const DiagnosticList * parser_diagnostics(Parser * p) {
+    return &PARSER_INFO(p)->diagnostics;
+}
+
+void parser_set_error_limit(Parser * p, int max) {
+    PARSER_INFO(p)->errorLimit = max > 0 ? max : 0;
+}
+
+Parser * new_parser(FILE * listing) {
+    Parser * p = (Parser *) malloc(sizeof(Parser));
+    ParserInfo * ps = (ParserInfo *) malloc(sizeof(ParserInfo));
+    if (p == NULL || ps == NULL) {
+        free(p);
+        free(ps);
+        return NULL;
+    }
+    p->parse = parser_parse;
+    p->set_token_list = parser_set_token_list;
+    p->print_tree = parser_print_tree;
+    p->free_tree = parser_free_tree;
+    p->info = ps;
+
+    ps->tokens = NULL;
+    ps->pos = 0;
+    token_buffer_init(&ps->listTokens);
+    ps->stream = NULL;
+    ps->fill = NULL;
+    ps->fillData = NULL;
+    ps->lineno = 0;
+    ps->error = FALSE;
+    ps->listing = listing != NULL ? listing : stderr;
+    diagnostic_list_init(&ps->diagnostics);
+    ps->errorLimit = PARSER_ERROR_LIMIT;
+    ps->errorCount = 0;
+    ps->recovering = FALSE;
+    ps->stopped = FALSE;
+    ps->depth = 0;
+    ps->store = NULL;
+    ps->names = NULL;
+    ps->namesLock = NULL;
+    ps->pool = NULL;
+    ps->trees = NULL;
+    ps->spare = NULL;
+    ps->sharing = FALSE;
+    ps->recursive = FALSE;
+    cons_init(&ps->shared);
+    memset(&ps->stats, 0, sizeof(ParseStats));
+    return p;
+}
+
+void delete_parser(Parser * p) {
+    ParserInfo * ps;
+    if (p == NULL)
+        return;
+    ps = PARSER_INFO(p);
+    while (ps->trees != NULL)
+        tree_store_free(ps, ps->trees);
+    token_buffer_release(&ps->listTokens);
+    diagnostic_list_release(&ps->diagnostics);
+    cons_release(&ps->shared);
+    free(ps);
+    free(p);
+}
+
+/* Batch mode: Parser -j threads path ..., or Parser path path ...
+ Paths may be directories (a single directory needs -j); 0 threads means one per CPU. Only the report is printed, no trees. */
+static int batch_main(int argc, const char * argv[]) {
+    BatchFiles files;
+    BatchResult * results;
+    BatchSummary summary;
+    int threads = 0, i = 1;
+
+    if (strcmp(argv[1], "-j") == 0) {
+        if (argc < 4) {
+            puts("Usage: Parser -j threads file-or-directory ...");
+            return 1;
+        }
+        threads = atoi(argv[2]);
+        i = 3;
+    }
+    batch_files_init(&files);
+    for (; i < argc; i++) {
+        if (!batch_add_path(&files, argv[i])) {
+            printf("Cannot read %s\n", argv[i]);
+            batch_files_release(&files);
+            return 1;
+        }
+    }
+    results = (BatchResult *) malloc((files.count + 1) * sizeof(BatchResult));
+    if (results == NULL || !batch_parse(&files, threads, results, &summary)) {
+        puts("Ran out of memory!");
+        free(results);
+        batch_files_release(&files);
+        return 1;
+    }
+    batch_print_report(stdout, results, &summary);
+    batch_results_release(results, files.count);
+    free(results);
+    batch_files_release(&files);
+    return summary.failed > 0 || summary.withErrors > 0;
+}
+
+/* Parser -g [-t] shape functions [seed]: write a generated program to stdout, as a token list with -t */
+static int gen_main(int argc, const char * argv[]) {
+    GenOptions options;
+    GenShape shape;
+    int i = 2, tokenList = FALSE;
+
+    if (i < argc && strcmp(argv[i], "-t") == 0) {
+        tokenList = TRUE;
+        i++;
+    }
+    if (argc - i < 2 || argc - i > 3 || !gen_shape(argv[i], &shape)) {
+        puts("Usage: Parser -g [-t] mixed|deep|expr|funcs|params|loops functions [seed]");
+        return 1;
+    }
+    gen_options_default(&options, shape, atoi(argv[i + 1]), argc - i == 3 ? strtoul(argv[i + 2], NULL, 10) : 1);
+    if (!(tokenList ? gen_token_list(stdout, &options) : gen_program(stdout, &options))) {
+        fputs("Cannot write the program\n", stderr);
+        return 1;
+    }
+    return 0;
+}
+
+/* The program to benchmark, from argv[3] on: a file, or shape functions [seed] for a generated program.
+   A generated program is in *text, to be freed; a file is mapped by src. */
+static int bench_program(int argc, const char * argv[], SourceFile * src, char ** text, size_t * length) {
+    GenShape shape;
+    *text = NULL;
+    *length = 0;
+    if (argc > 4) {
+        GenOptions options;
+        FILE * out = open_memstream(text, length);
+        int ok;
+        if (!gen_shape(argv[3], &shape))
+            return 0;
+        gen_options_default(&options, shape, atoi(argv[4]), argc == 6 ? strtoul(argv[5], NULL, 10) : 1);
+        ok = out != NULL && gen_program(out, &options);
+        if (out != NULL)
+            fclose(out);
+        if (!ok) {
+            puts("Ran out of memory!");
+            free(*text);
+            *text = NULL;
+        }
+        return ok;
+    }
+    if (!source_open(src, argv[3])) {
         puts("Cannot open the file");
         return 0;
     }
-    TokenList scanResult = read_token_list(fp);
+    *length = src->length;
+    return 1;
+}
+
+/* Parser -b reps file, or Parser -b reps shape functions [seed] to benchmark a generated program */
+static int bench_main(int argc, const char * argv[]) {
+    SourceFile src = {"", 0, 0};
+    BenchReport report;
+    char * text;
+    size_t length;
+    int ok;
+
+    if (argc < 4 || argc > 6 || !bench_program(argc, argv, &src, &text, &length)) {
+        puts("Usage: Parser -b reps file");
+        puts("       Parser -b reps mixed|deep|expr|funcs|params|loops functions [seed]");
+        return 1;
+    }
+    ok = bench_run(text != NULL ? text : src.text, length, atoi(argv[2]), &report);
+    if (ok)
+        bench_print_report(stdout, &report);
+    else
+        puts("Ran out of memory!");
+    free(text);
+    source_close(&src);
+    return !ok;
+}
+
+/* Parser -r reps file, or Parser -r reps shape functions [seed]: time the VM against the tree walk */
+static int exec_main(int argc, const char * argv[]) {
+    SourceFile src = {"", 0, 0};
+    ExecReport report;
+    char * text;
+    size_t length;
+    int ok;
+
+    if (argc < 4 || argc > 6 || !bench_program(argc, argv, &src, &text, &length)) {
+        puts("Usage: Parser -r reps file");
+        puts("       Parser -r reps mixed|deep|expr|funcs|params|loops functions [seed]");
+        return 1;
+    }
+    ok = bench_execute(text != NULL ? text : src.text, length, atoi(argv[2]), &report, stdout);
+    if (ok)
+        bench_print_exec_report(stdout, &report);
+    else
+        puts("The program cannot be run");
+    free(text);
+    source_close(&src);
+    return !ok || !report.agree;
+}
+
+/* Parser -n reps file, or Parser -n reps shape functions [seed]: run natively and check against the VM */
+static int native_main(int argc, const char * argv[]) {
+    SourceFile src = {"", 0, 0};
+    NativeReport report;
+    char * text;
+    size_t length;
+    int ok;
+
+    if (argc < 4 || argc > 6 || !bench_program(argc, argv, &src, &text, &length)) {
+        puts("Usage: Parser -n reps file");
+        puts("       Parser -n reps mixed|deep|expr|funcs|params|loops functions [seed]");
+        return 1;
+    }
+    ok = native_check(text != NULL ? text : src.text, length, atoi(argv[2]), &report, stdout);
+    if (ok)
+        native_print_report(stdout, &report);
+    else
+        puts("The program cannot be run natively");
+    native_report_release(&report);
+    free(text);
+    source_close(&src);
+    return !ok || !report.agree;
+}
+
+/* Print a statement of a stream and free it */
+static int print_statement(Parser * p, TreeNode * statement, void * data) {
+    (void) data;
+    p->print_tree(p, statement);
+    p->free_tree(p, statement);
+    return TRUE;
+}
+
+/* Parser -S file: parse the file ("-" for stdin) as a stream, printing each top-level statement as soon as it is parsed */
+static int stream_main(const char * fileName) {
+    FILE * in = strcmp(fileName, "-") == 0 ? stdin : fopen(fileName, "rb");
+    FILE * listing;
+    Parser * parser;
+    StreamStats stats;
+    int ok;
+
+    if(in == NULL) {
+        puts("Cannot open the file");
+        return 1;
+    }
+    listing = fopen("errorlog.txt", "w+");
+    parser = new_parser(listing);
+    if(parser == NULL) {
+        puts("Ran out of memory!");
+        if(listing != NULL)
+            fclose(listing);
+        if(in != stdin)
+            fclose(in);
+        return 1;
+    }
     puts("Scanner is happy.");
-    node = scanResult.head;
-    TreeNode* root = parse();
-    print_tree(root);
-    
+    ok = parse_stream(parser, in, print_statement, NULL, &stats);
+    if(!ok)
+        puts("Ran out of memory, or the file cannot be read");
+    printf("Streamed %zu statements, %zu tokens: the window held at most %zu tokens and %zu bytes of the file, the largest statement took %zu bytes\n",
+           stats.statements, stats.tokens, stats.maxTokens, stats.maxTextBytes, stats.maxTreeBytes);
+    delete_parser(parser);
+    if(listing != NULL)
+        fclose(listing);
+    if(in != stdin)
+        fclose(in);
     printf("Hello, World!\n");
+    return !ok;
+}
+
+/* The edits of Parser -e, made at the top of the file one after the other:
+   the bytes start .. start+removed-1 are replaced with inserted */
+static const struct {
+    size_t start;
+    size_t removed;
+    const char * inserted;
+} topEdits[] = {
+    {0, 0, "num edited;\n"},     /* a declaration more */
+    {4, 6, "changed"},           /* a name in it */
+    {0, 0, "\n\n"},              /* every line after it moves */
+    {0, 0, "num (;\n"},          /* a syntax error */
+    {0, 22, ""}                  /* the file as it was */
+};
+
+/* TRUE when the nodes of both trees have the same lineNum; the trees have the same shape */
+static int same_lines(const TreeNode * a, const TreeNode * b) {
+    for(; a != NULL && b != NULL; a = a->rSibling, b = b->rSibling) {
+        int i;
+        if(a->lineNum != b->lineNum)
+            return FALSE;
+        for(i = 0; i < MAX_CHILDREN; i++)
+            if(!same_lines(a->child[i], b->child[i]))
+                return FALSE;
+    }
+    return a == NULL && b == NULL;
+}
+
+/* The tree as print_tree() prints it, as a new string, or NULL when memory runs out */
+static char * tree_text(const TreeNode * tree) {
+    size_t n = print_tree_buffer(NULL, 0, tree);
+    char * text = n == (size_t) -1 ? NULL : (char *) malloc(n + 1);
+    if(text != NULL)
+        print_tree_buffer(text, n + 1, tree);
+    return text;
+}
+
+/* TRUE when the tree and the diagnostics of it are those of a full parse of text by p */
+static int same_as_full_parse(IncrementalTree * it, Parser * p, const char * text, size_t length) {
+    TokenBuffer tokens;
+    TreeNode * root;
+    TreeNode * tree = incremental_tree(it);
+    char * a = tree_text(tree);
+    char * b = NULL;
+    char * messages = NULL;
+    char * expected;
+    size_t messagesLength = 0;
+    FILE * out = open_memstream(&messages, &messagesLength);
+    int same;
+
+    token_buffer_init(&tokens);
+    if(out != NULL) {
+        incremental_print_diagnostics(it, out);
+        fclose(out);
+    }
+    if(!token_buffer_scan(&tokens, text, length)) {
+        token_buffer_release(&tokens);
+        free(a);
+        free(messages);
+        return FALSE;
+    }
+    parser_set_token_buffer(p, &tokens);
+    // as in the incremental tree, every syntax error is kept
+    parser_set_error_limit(p, 0);
+    root = p->parse(p);
+    b = tree_text(root);
+    expected = diagnostic_list_text(parser_diagnostics(p), 0);
+    same = out != NULL && a != NULL && b != NULL && strcmp(a, b) == 0 && same_lines(tree, root)
+        && strcmp(messages != NULL ? messages : "", expected != NULL ? expected : "") == 0;
+    p->free_tree(p, root);
+    token_buffer_release(&tokens);
+    free(a);
+    free(b);
+    free(messages);
+    free(expected);
+    return same;
+}
+
+/* Parser -e file: parse the file incrementally (incremental.h), then make the edits of topEdits at its top.
+   The work of each edit is printed, which does not grow with the file, and whether the tree is then that of a full parse */
+static int edit_main(const char * fileName) {
+    SourceFile src = {"", 0, 0};
+    FILE * listing;
+    Parser * parser;
+    Parser * full;
+    IncrementalTree it;
+    char * text;
+    size_t length, i;
+    int ok = TRUE;
+
+    if(!source_open(&src, fileName)) {
+        puts("Cannot open the file");
+        return 1;
+    }
+    length = src.length;
+    text = (char *) malloc(length + 1);
+    listing = fopen("errorlog.txt", "w+");
+    parser = new_parser(listing);
+    full = new_parser(listing);
+    if(text == NULL || parser == NULL || full == NULL) {
+        puts("Ran out of memory!");
+        free(text);
+        delete_parser(parser);
+        delete_parser(full);
+        if(listing != NULL)
+            fclose(listing);
+        source_close(&src);
+        return 1;
+    }
+    memcpy(text, src.text, length);
+    source_close(&src);
+    if(!incremental_parse(&it, parser, text, length)) {
+        puts("Ran out of memory!");
+        ok = FALSE;
+    }
+    for(i = 0; ok && i < sizeof(topEdits) / sizeof(topEdits[0]); i++) {
+        size_t start = topEdits[i].start, removed = topEdits[i].removed, inserted = strlen(topEdits[i].inserted);
+        size_t newLength = length - removed + inserted;
+        char * newText = (char *) malloc(newLength + 1);
+        TextEdit edit;
+        IncrementalStats work;
+        if(newText == NULL || start + removed > length) {
+            puts(newText == NULL ? "Ran out of memory!" : "The file is too short");
+            free(newText);
+            ok = FALSE;
+            break;
+        }
+        memcpy(newText, text, start);
+        memcpy(newText + start, topEdits[i].inserted, inserted);
+        memcpy(newText + start + inserted, text + start + removed, length - start - removed);
+        edit.start = start;
+        edit.oldEnd = start + removed;
+        edit.newEnd = start + inserted;
+        // the tree points into the old text until the edit is made
+        if(!incremental_edit(&it, newText, newLength, &edit))
+            puts("Ran out of memory!");
+        free(text);
+        text = newText;
+        length = newLength;
+        work = it.stats;
+        printf("Edit %zu: tokens %zu scanned, %zu moved, %zu copied; statements %zu moved, %zu parsed",
+               i + 1, work.tokensScanned, work.tokensMoved, work.tokensCopied, work.statementsMoved, work.statementsParsed);
+        if(same_as_full_parse(&it, full, text, length))
+            puts(", the same tree as a full parse");
+        else {
+            puts(", NOT the tree of a full parse");
+            ok = FALSE;
+        }
+    }
+    incremental_release(&it);
+    delete_parser(parser);
+    delete_parser(full);
+    if(listing != NULL)
+        fclose(listing);
+    free(text);
+    return !ok;
+}
+
+static void print_run(int ok, const RunResult * result) {
+    if(ok)
+        printf("main() returned %d\n", result->value);
+    else
+        printf("Runtime error: %s\n", run_status_text(result->status));
+}
+
+/* Compile the tree and run it on the VM ('x') or natively ('N'), or write its bytecode ('d') or its
+   x86-64 assembly ('a') */
+static void run_tree(TreeNode * root, char mode) {
+    DiagnosticList errors;
+    Program program;
+    RunResult result;
+    diagnostic_list_init(&errors);
+    if(mode == 'a') {
+        x86_compile(stdout, root, &errors);
+    } else if(mode == 'N') {
+        NativeCode code;
+        if(native_build(&code, root, stdout)) {
+            print_run(native_run(&code, &result), &result);
+            run_result_release(&result);
+        }
+        native_release(&code);
+    } else if(bytecode_compile(&program, root, &errors)) {
+        if(mode == 'd')
+            bytecode_print(stdout, &program);
+        else {
+            print_run(vm_run(&program, &result), &result);
+            run_result_release(&result);
+        }
+        bytecode_release(&program);
+    }
+    diagnostic_list_write(&errors, 0, mode == 'a' ? stderr : stdout);
+    diagnostic_list_release(&errors);
+}
+
+/* How main() got its input */
+typedef enum {NO_INPUT, INPUT_READ, INPUT_CACHED} InputRead;
+
+/* Give parser the tokens of fileName, or of the token list file when it is NULL; a source file stays
+   mapped in src while its tokens are used. With cacheDir, the tree is first looked up in the parse cache,
+   under the key of the bytes of the input, and printed when it is there.
+   <Return:> NO_INPUT, after saying why, when the input cannot be read */
+static InputRead read_input(Parser * parser, const char * fileName, const char * cacheDir, ParseCache * cache,
+                            char key[CACHE_KEY_SIZE], SourceFile * src, TokenBuffer * tokens) {
+    if(cacheDir != NULL) {
+        // The key is the bytes of the input, so a hit neither reads the tokens nor parses
+        AstBinFile cached;
+        if(!cache_open(cache, cacheDir, CACHE_DEFAULT_BYTES)) {
+            puts("Cannot open the parse cache");
+            return NO_INPUT;
+        }
+        if(!source_open(src, fileName != NULL ? fileName : "arrayMaxMean_n_tklist.txt")) {
+            puts("Cannot open the file");
+            return NO_INPUT;
+        }
+        cache_key(key, fileName != NULL ? "source" : "tokens", src->text, src->length);
+        if(cache_lookup(cache, key, &cached)) {
+            puts("Scanner is happy.");
+            print_ast_file(stdout, ast_of_astbin(&cached));
+            astbin_close(&cached);
+            cache_save_counts(cache);
+            cache_print_report(stdout, cache);
+            return INPUT_CACHED;
+        }
+    }
+    if(fileName != NULL) {
+        if(cacheDir == NULL && !source_open(src, fileName)) {
+            puts("Cannot open the file");
+            return NO_INPUT;
+        }
+        if(!token_buffer_scan(tokens, src->text, src->length)) {
+            puts("Ran out of memory!");
+            return NO_INPUT;
+        }
+        parser_set_token_buffer(parser, tokens);
+    } else {
+        FILE * fp = fopen("arrayMaxMean_n_tklist.txt", "r");
+        TokenList scanResult;
+        if(fp==NULL){
+            puts("Cannot open the file");
+            return NO_INPUT;
+        }
+        // the parser copies the list
+        scanResult = read_token_list(fp);
+        fclose(fp);
+        parser->set_token_list(parser, scanResult);
+        token_list_free(scanResult);
+    }
+    return INPUT_READ;
+}
+
+int main(int argc, const char * argv[]) {
+    // With a C-Minus source file as argument ("-" for stdin), scan it directly; otherwise read the token list file.
+    // The tokens of a source file point into its mapping, which stays open until the tree is printed.
+    SourceFile src = {"", 0, 0};
+    TokenBuffer sourceTokens;
+    Parser * parser;
+    ThreadPool * pool = NULL;
+    const char * fileName = argc > 1 ? argv[1] : NULL;
+    const char * treeFile = NULL;
+    const char * cacheDir = NULL;
+    ParseCache cache;
+    char key[CACHE_KEY_SIZE];
+    FILE * report = NULL;
+    FILE * listing;
+    InputRead input = NO_INPUT;
+    int fold = FALSE, check = FALSE, compact = FALSE, sharing = FALSE;
+    char run = '\0';
+    Instrument in;
+    // Parser -p threads file: parse the functions of one file in parallel, and print the tree in parallel (visit.h)
+    // Parser -o tree file: write the tree to a binary tree file (astbin.h) instead of printing it
+    // Parser -s report file: append the timings and counters of the compile to report, as a line of JSON (instrument.h)
+    // Parser -f [threads] file: fold the constants of the tree (fold.h) before printing it; with threads, parse, fold and print in parallel
+    // Parser -c file: resolve the names and check the types of the tree (typecheck.h) before printing it
+    // Parser -k file: print the tree from its compact copy (compact_tree.h), made before the tree is freed
+    // Parser -C dir [file]: look the tree up in the parse cache in dir (cache.h) before reading the tokens, and store it there on a miss
+    // Parser -S file: parse the file as a stream (stream.h), printing each top-level statement as soon as it is parsed
+    // Parser -e file: edit the top of the file and parse it again incrementally (incremental.h), printing the work of each edit
+    // Parser -h file: share the equal subexpressions while parsing (hashcons.h), and report the DAG (dag.h) after the tree
+    // Parser -x file: compile the tree to bytecode and run it (vm.h) instead of printing it
+    // Parser -N file: run the tree as native code (native.h), printing what -x prints
+    // Parser -d file: write the bytecode of the tree (bytecode.h) instead of printing it
+    // Parser -a file: write the x86-64 assembly of the tree (x86_64.h) instead of printing it, and nothing else, to stdout
+    // Parser -g ...: generate a program (gen.h); Parser -b ...: run the benchmarks (bench.h)
+    // Parser -r ...: run the execution benchmark (bench.h); Parser -n ...: check the native code (native.h)
+    if(argc > 1 && strcmp(argv[1], "-g") == 0)
+        return gen_main(argc, argv);
+    if(argc > 1 && strcmp(argv[1], "-b") == 0)
+        return bench_main(argc, argv);
+    if(argc > 1 && strcmp(argv[1], "-r") == 0)
+        return exec_main(argc, argv);
+    if(argc > 1 && strcmp(argv[1], "-n") == 0)
+        return native_main(argc, argv);
+    if(argc == 3 && strcmp(argv[1], "-S") == 0)
+        return stream_main(argv[2]);
+    if(argc == 3 && strcmp(argv[1], "-e") == 0)
+        return edit_main(argv[2]);
+    if(argc == 4 && strcmp(argv[1], "-p") == 0) {
+        pool = pool_create(atoi(argv[2]));
+        fileName = argv[3];
+    } else if(argc == 4 && strcmp(argv[1], "-o") == 0) {
+        treeFile = argv[2];
+        fileName = argv[3];
+    } else if(argc == 4 && strcmp(argv[1], "-s") == 0) {
+        report = fopen(argv[2], "a");
+        if(report == NULL) {
+            puts("Cannot open the report");
+            return 1;
+        }
+        fileName = argv[3];
+    } else if((argc == 3 || argc == 4) && strcmp(argv[1], "-f") == 0) {
+        fold = TRUE;
+        if(argc == 4)
+            pool = pool_create(atoi(argv[2]));
+        fileName = argv[argc - 1];
+    } else if(argc == 3 && strcmp(argv[1], "-c") == 0) {
+        check = TRUE;
+        fileName = argv[2];
+    } else if(argc == 3 && strcmp(argv[1], "-k") == 0) {
+        compact = TRUE;
+        fileName = argv[2];
+    } else if((argc == 3 || argc == 4) && strcmp(argv[1], "-C") == 0) {
+        cacheDir = argv[2];
+        fileName = argc == 4 ? argv[3] : NULL;
+    } else if(argc == 3 && strcmp(argv[1], "-h") == 0) {
+        sharing = TRUE;
+        fileName = argv[2];
+    } else if(argc == 3 && (strcmp(argv[1], "-x") == 0 || strcmp(argv[1], "-N") == 0 || strcmp(argv[1], "-d") == 0
+                          || strcmp(argv[1], "-a") == 0)) {
+        run = argv[1][1];
+        fileName = argv[2];
+    } else if(argc > 2 || (argc > 1 && strcmp(argv[1], "-j") == 0))
+        return batch_main(argc, argv);
+    listing = fopen("errorlog.txt", "w+");
+    parser = new_parser(listing);
+    token_buffer_init(&sourceTokens);
+    if(parser == NULL)
+        puts("Ran out of memory!");
+    else {
+        parser_set_pool(parser, pool);
+        parser_set_sharing(parser, sharing);
+        instrument_init(&in, fileName != NULL ? fileName : "arrayMaxMean_n_tklist.txt");
+        instrument_begin(&in);
+        input = read_input(parser, fileName, cacheDir, &cache, key, &src, &sourceTokens);
+        instrument_end(&in, PHASE_READ);
+    }
+    if(input == INPUT_READ) {
+        // With -a, stdout is only the assembly, so that it can be redirected to a .s file
+        if(run != 'a')
+            puts("Scanner is happy.");
+        instrument_begin(&in);
+        TreeNode* root = parser->parse(parser);
+        instrument_end(&in, PHASE_PARSE);
+        if(fold) {
+            FoldStats folded;
+            if(!fold_tree_parallel(&root, &folded, pool))
+                puts("Ran out of memory!");
+            printf("Folding eliminated %zu nodes: %zu constants, %zu identities, %zu branches\n",
+                   folded.eliminated, folded.constants, folded.identities, folded.branches);
+        }
+        if(check) {
+            DiagnosticList errors;
+            TypeCheckStats checked;
+            diagnostic_list_init(&errors);
+            if(!typecheck_tree(root, &errors, &checked))
+                puts("Ran out of memory!");
+            diagnostic_list_write(&errors, 0, stdout);
+            printf("Type checker: %zu declarations, %zu names resolved, %d errors\n",
+                   checked.declarations, checked.resolved, checked.errors);
+            diagnostic_list_release(&errors);
+        }
+        instrument_begin(&in);
+        if(run) {
+            if(parser_error(parser))
+                fputs("The program has syntax errors\n", run == 'a' ? stderr : stdout);
+            else
+                run_tree(root, run);
+        } else if(treeFile != NULL) {
+            FILE * out = fopen(treeFile, "wb");
+            if(out == NULL || !astbin_write(out, root))
+                puts("Cannot write the tree file");
+            if(out != NULL)
+                fclose(out);
+        } else if(compact) {
+            CompactTree c;
+            if(!compact_tree_build(&c, root))
+                puts("Ran out of memory!");
+            else {
+                ParseStats stats = parser_stats(parser);
+                parser->free_tree(parser, root);
+                root = NULL;
+                print_ast_file(stdout, ast_of_compact(&c));
+                printf("Compact tree: %zu nodes in %zu bytes, the arena took %zu\n", c.nodes, compact_tree_bytes(&c), stats.bytes);
+                compact_tree_release(&c);
+            }
+        } else if(pool != NULL) {
+            if(!print_tree_parallel(stdout, root, pool))
+                puts("Ran out of memory!");
+        } else
+            parser->print_tree(parser, root);
+        instrument_end(&in, PHASE_PRINT);
+        if(cacheDir != NULL) {
+            // A tree with syntax errors is not kept: the errors would not be reported on a hit
+            if(!parser_error(parser) && !cache_store(&cache, key, root))
+                puts("Cannot store the tree in the parse cache");
+            cache_save_counts(&cache);
+            cache_print_report(stdout, &cache);
+        }
+        if(sharing) {
+            ExprDag dag;
+            if(!expr_dag_build(&dag, root))
+                puts("Ran out of memory!");
+            else
+                printf("Sharing saved %zu nodes: the expressions have %zu nodes for %zu uses, %zu of them common subexpressions\n",
+                       parser_stats(parser).shared, dag.count, dag.occurrences, dag.common);
+            expr_dag_release(&dag);
+        }
+        if(report != NULL) {
+            in.stats = parser_stats(parser);
+            if(!instrument_count_nodes(&in, root) || !instrument_write_json(report, &in))
+                puts("Cannot write the report");
+        }
+        parser->free_tree(parser, root);
+    }
+    if(report != NULL)
+        fclose(report);
+    delete_parser(parser);
+    if(listing != NULL)
+        fclose(listing);
+    token_buffer_release(&sourceTokens);
+    source_close(&src);
+    if(pool != NULL)
+        pool_destroy(pool);
+    
+    if(input == NO_INPUT)
+        return 1;
+    if(run != 'a')
+        printf("Hello, World!\n");
     return 0;
 }
@@ -1,101 +1,165 @@
-/****************************************************
-
- File: parse.h                               
- A compiler for the C-Minus language
-
- MUST CS106 2016 Fall
- Programming designed by the teacher: Liang, Zhiyao
-***************************************************/
-
-#ifndef _PARSE_H_
-#define _PARSE_H_
-
-
-#include "scan.h"
-
-
-typedef enum {DCL_ND, PARAM_ND, STMT_ND, EXPR_ND} NodeKind;
-typedef enum {VAR_DCL, ARRAY_DCL, FUN_DCL} DclKind;
-typedef enum {VAR_PARAM, ARRAY_PARAM, VOID_PARAM} ParamKind;
-//No Need for ArgKind, since every argument is just an expression, 
-//typedef enum {VAR_ARG, ARRAY_ARG} ArgKind;
-//typedef enum {SLCT_STMT, ITER_STMT, EXPR_STMT, CMPD_STMT, RTN_STMT, NULL_STMT} StmtKind;
-// On 11152013 replace ITER_STMT, with WHILE_STMT and DO_WHILE_STMT
-// 12/nov/2014 add FOR_STMT
-typedef enum {SLCT_STMT, WHILE_STMT, EXPR_STMT, CMPD_STMT, RTN_STMT, NULL_STMT, ASSIGN_STMT, FUNC_STMT, DCL_STMT} StmtKind;
-/*Although assign  = is  an operator of C- according to our common sense, and it is true that according to its grammar, ( x = 3)*5 can appear in C-, which means x =3 has a return value 3, = is not treated as an operator according to the TINY grammar.  So in 2011-2013, it is considered necessary to to use Asn_EXPR
-Now, in 12/nov/2014, assignment is back to the common sense, it is an operator. , so ASN_EXPR is removed. 
- */
-// Distuiguish ID_EXPR and Array_EXPR
-//typedef enum {OP_EXPR, CONST_EXPR, ID_EXPR, ARRAY_EXPR, CALL_EXPR,  ASN_EXPR} ExprKind;
-// Since for loop is used, the comma expression is considered, since without it for loop cannot do much. Put it as  bonus for student. 
-/* remove COMMA_EXPR, since commar is an operator */
-/* remove array_expr, since [] is introduced as an operator */
-typedef enum {OP_EXPR, CONST_EXPR, ID_EXPR, /* ARRAY_EXPR, */ CALL_EXPR} ExprKind;
-
-/* The type of the value of an expression
-   ExprType is used for type checking 
-*/
-/* No need for Boolean type, since C- uses integer as
-   boolean valus */
-
-typedef enum {VOID_TYPE, NUM_TYPE, INT_TYPE, ADDR_TYPE} ExprType;
-
-#define MAX_CHILDREN 4
-
-
-/**************************************************/
-/***********   Syntax tree for parsing ************/
-/**************************************************/
-
-typedef struct treeNode {
-  struct treeNode * child[MAX_CHILDREN];
-  struct treeNode * lSibling;
-  struct treeNode * rSibling;
-  // sibling is useful for declaration_list, param_list, local_declarations, statement_list, arg_list.
-  struct treeNode * parent;
-  /* parent is useful to check the containing structure of a node during parsing. So, the connected tree nodes can be found in all directions, up (to parents), down (to children), and horizontally (left and right to siblings).  */
-  /* LineNum:  At the momemt in parsing, when this treeNode is constructed, what is the line number of the token being handled. */
-  int lineNum; 
-  NodeKind nodeKind;
-  union {DclKind dcl; ParamKind param; StmtKind stmt; ExprKind expr;} kind;
-  union{
-    union {
-      TokenType op; // used by Op_EXPR
-      int val;      // used by Const_EXPR,
-      const char * name;  // used by ID_EXPR, Call_EXPR, Array_EXPR
-    } exprAttr;
-    struct { // it is a struct, not union, because an array declaration need all the three fields.
-      ExprType type; // used by all dcl and param
-      const char * name;  // used by all dcl and param
-      int size;     // used by array declaration
-      /* size is only used for and array declaration; i.e., when  Dcl_Kind is Array_DCL. The requirement that size must be a constant should be checked by semantic analyzer.   For parameters, for Array_PARAM, size is ignored. For array element argument, the index is a child of the node, and should not be considered as dclAttr. */
-    } dclAttr; // for declaration and parameters.
-  }attr;
-  ExprType type;
-  /* type is for type-checking of exps, will be updated by type-checker,  the parser does not touch it.  */
-  void * something; //can carry something possibly useful for other tasks of compiling
-} TreeNode;
-
-
-typedef struct parser Parser;
-
-/* Each function has a parameter p, that is a pointer to the parser itself, in order to use the resources belong to the parser */
-typedef struct parser{
-	TreeNode * (* parse)(Parser * p); /* returning a parse tree, based on the tokenList that the parser knows */
-	void (* set_token_list)(Parser * p, TokenList tokenList); /* let the parser remember some tokenList */
-	void (* print_tree)(Parser * p,  TreeNode * tree); /* can print some parser tree */
-	void (* free_tree)(Parser *p, TreeNode * tree); /* free the space of a parse tree */
-	void * info; /* Some data belonging to this parser object. It can contain the tokenList that the parser knows. */
-} Parser;
-
-
-
-
-/*
-extern TreeNode * syntaxTree;
-
-extern TokenNode * thisTokenNode;
-*/
-
-#endif
+/****************************************************
+
+ File: parse.h                               
+ A compiler for the C-Minus language
+
+ MUST CS106 2016 Fall
+ Programming designed by the teacher: Liang, Zhiyao
+***************************************************/
+
+#ifndef _PARSE_H_
+#define _PARSE_H_
+
+
+#include <stddef.h>
+#include "scan.h"
+#include "token_buffer.h"
+#include "thread_pool.h"
+#include "diagnostics.h"
+
+
+typedef enum {DCL_ND, PARAM_ND, STMT_ND, EXPR_ND} NodeKind;
+typedef enum {VAR_DCL, ARRAY_DCL, FUN_DCL} DclKind;
+typedef enum {VAR_PARAM, ARRAY_PARAM, VOID_PARAM} ParamKind;
+//No Need for ArgKind, since every argument is just an expression, 
+//typedef enum {VAR_ARG, ARRAY_ARG} ArgKind;
+//typedef enum {SLCT_STMT, ITER_STMT, EXPR_STMT, CMPD_STMT, RTN_STMT, NULL_STMT} StmtKind;
+// On 11152013 replace ITER_STMT, with WHILE_STMT and DO_WHILE_STMT
+// 12/nov/2014 add FOR_STMT
+typedef enum {SLCT_STMT, WHILE_STMT, EXPR_STMT, CMPD_STMT, RTN_STMT, NULL_STMT, ASSIGN_STMT, FUNC_STMT, DCL_STMT} StmtKind;
+/*Although assign  = is  an operator of C- according to our common sense, and it is true that according to its grammar, ( x = 3)*5 can appear in C-, which means x =3 has a return value 3, = is not treated as an operator according to the TINY grammar.  So in 2011-2013, it is considered necessary to to use Asn_EXPR
+Now, in 12/nov/2014, assignment is back to the common sense, it is an operator. , so ASN_EXPR is removed. 
+ */
+// Distuiguish ID_EXPR and Array_EXPR
+//typedef enum {OP_EXPR, CONST_EXPR, ID_EXPR, ARRAY_EXPR, CALL_EXPR,  ASN_EXPR} ExprKind;
+// Since for loop is used, the comma expression is considered, since without it for loop cannot do much. Put it as  bonus for student. 
+/* remove COMMA_EXPR, since commar is an operator */
+/* remove array_expr, since [] is introduced as an operator */
+typedef enum {OP_EXPR, CONST_EXPR, ID_EXPR, /* ARRAY_EXPR, */ CALL_EXPR} ExprKind;
+
+/* The type of the value of an expression
+   ExprType is used for type checking 
+*/
+/* No need for Boolean type, since C- uses integer as
+   boolean valus */
+
+typedef enum {VOID_TYPE, NUM_TYPE, INT_TYPE, ADDR_TYPE} ExprType;
+
+/* Raised when the trees the parser makes change, so the parse cache (cache.h) does not return older ones */
+#define PARSER_VERSION 1
+
+#define MAX_CHILDREN 4
+
+
+/**************************************************/
+/***********   Syntax tree for parsing ************/
+/**************************************************/
+
+typedef struct treeNode {
+  struct treeNode * child[MAX_CHILDREN];
+  struct treeNode * lSibling;
+  struct treeNode * rSibling;
+  // sibling is useful for declaration_list, param_list, local_declarations, statement_list, arg_list.
+  struct treeNode * parent;
+  /* parent is useful to check the containing structure of a node during parsing. So, the connected tree nodes can be found in all directions, up (to parents), down (to children), and horizontally (left and right to siblings).  */
+  /* LineNum:  At the momemt in parsing, when this treeNode is constructed, what is the line number of the token being handled. */
+  int lineNum; 
+  NodeKind nodeKind;
+  union {DclKind dcl; ParamKind param; StmtKind stmt; ExprKind expr;} kind;
+  union{
+    union {
+      TokenType op; // used by Op_EXPR
+      int val;      // used by Const_EXPR,
+      const char * name;  // used by ID_EXPR, Call_EXPR, Array_EXPR
+    } exprAttr;
+    struct { // it is a struct, not union, because an array declaration need all the three fields.
+      ExprType type; // used by all dcl and param
+      const char * name;  // used by all dcl and param
+      int size;     // used by array declaration
+      /* size is only used for and array declaration; i.e., when  Dcl_Kind is Array_DCL. The requirement that size must be a constant should be checked by semantic analyzer.   For parameters, for Array_PARAM, size is ignored. For array element argument, the index is a child of the node, and should not be considered as dclAttr. */
+    } dclAttr; // for declaration and parameters.
+  }attr;
+  ExprType type;
+  /* type is for type-checking of exps, will be updated by type-checker,  the parser does not touch it.  */
+  void * something; //can carry something possibly useful for other tasks of compiling
+} TreeNode;
+
+
+typedef struct parser Parser;
+
+/* Each function has a parameter p, that is a pointer to the parser itself, in order to use the resources belong to the parser */
+typedef struct parser{
+	TreeNode * (* parse)(Parser * p); /* returning a parse tree, based on the tokenList that the parser knows */
+	void (* set_token_list)(Parser * p, TokenList tokenList); /* let the parser remember some tokenList */
+	void (* print_tree)(Parser * p,  TreeNode * tree); /* can print some parser tree */
+	void (* free_tree)(Parser *p, TreeNode * tree); /* free the space of a parse tree */
+	void * info; /* Some data belonging to this parser object. It can contain the tokenList that the parser knows. */
+} Parser;
+
+
+/* Counters of one parse. Nodes come from a per-parse arena.
+ * The last three are only kept by a parser compiled with PARSER_INSTRUMENT (see instrument.h), and are 0 otherwise. */
+typedef struct {
+	size_t nodes;  /* number of TreeNode objects created */
+	size_t bytes;  /* bytes taken from the node arena, including alignment padding */
+	size_t nameBytes;  /* bytes taken by the interned names of the tree */
+	size_t arenaObjects;  /* arena allocations of the nodes and the names of the tree */
+	size_t tokens;  /* tokens the parse moved over */
+	size_t shared;  /* expression nodes replaced by an equal one made before, with parser_set_sharing() */
+	int syntaxErrors;
+	int maxLookahead;  /* the farthest token after the current one that the parser looked at */
+	int maxBlockDepth;  /* the deepest nesting of compound statements, which bounds the recursion of the parser */
+	int maxExpressionDepth;  /* the most operators and open parentheses pending at once in an expression */
+} ParseStats;
+
+/* Make a parser. Syntax errors are reported to listing, or to stderr when listing is NULL:
+ * they are collected while parsing and written out, in source order, when parse() returns.
+ * Each parser keeps all of its state in info, so parsers on different threads are independent.
+ * <Return:> NULL when memory runs out. */
+Parser * new_parser(FILE * listing);
+
+/* Free the parser together with every tree it built that is not freed yet */
+void delete_parser(Parser * p);
+
+/* The parser reads the tokens of the buffer, which must live until the parse returns.
+ * set_token_list() is the adapter for TokenList callers: it copies the list into a buffer kept by the parser. */
+void parser_set_token_buffer(Parser * p, TokenBuffer * tokenBuffer);
+
+/* With a pool, parse() splits a large program at its top-level functions and parses them on the
+ * workers of the pool; the tree and the syntax errors are the same as without. NULL turns it off.
+ * The pool must live as long as the parser uses it. */
+void parser_set_pool(Parser * p, ThreadPool * pool);
+
+/* With sharing on, the equal subexpressions without side effects of a region of the program are one
+ * node, made once (hashcons.h), so the tree is a DAG; see dag.h for its nodes. A region ends at every
+ * declaration and at both ends of a block. The tree prints the same. Off by default. */
+void parser_set_sharing(Parser * p, int sharing);
+
+/* With recursive on, expressions are parsed by recursive descent, one function call per precedence
+ * level, as before they were parsed by precedence climbing; the benchmarks (bench.h) compare the two.
+ * A program without syntax errors, nested less than 256 deep, gives the same tree either way. Off by default. */
+void parser_set_recursive_expressions(Parser * p, int recursive);
+
+/* The counters of the last parse of p */
+ParseStats parser_stats(Parser * p);
+
+/* TRUE when the last parse of p found a syntax error */
+int parser_error(Parser * p);
+
+/* The syntax errors of the last parse of p, in source order, as they were written to the listing.
+ * They stay valid until the next parse. */
+const DiagnosticList * parser_diagnostics(Parser * p);
+
+/* After a syntax error the parser reports it once, skips to the end of the statement, and goes on.
+ * After max errors it stops; 0 means no limit. Either way, the time is linear in the number of tokens. */
+#define PARSER_ERROR_LIMIT 100
+void parser_set_error_limit(Parser * p, int max);
+
+
+/*
+extern TreeNode * syntaxTree;
+
+extern TokenNode * thisTokenNode;
+*/
+
+#endif
@@ -0,0 +1,189 @@
+/****************************************************
+ File: parse_parallel.c
+
+ Intra-file parallel parsing. Each top-level function
+ is enclosed in ARROW ... SMILE, so a pre-scan of the
+ token types finds where functions start without
+ parsing anything. The program is cut there into
+ segments, each segment is parsed by a sub-parser on
+ the thread pool, and the statement chains are joined
+ in source order.
+
+ The top-level loop keeps no state but the token
+ position (see parse_statements()), so a segment gives
+ the sequential result exactly when the segment before
+ it stopped on the token where it starts. That is
+ checked while joining; from the first segment where
+ it fails, the rest is parsed sequentially. Each
+ segment collects its syntax errors in its own list,
+ and the lists are appended in order, so the
+ diagnostics are the sequential ones as well. A
+ segment that would bring the errors up to the error
+ limit is not joined either: the sequential parse
+ stops inside it, which only it can tell.
+****************************************************/
+
+#include "libs.h"
+#include "parser_info.h"
+#include "util.h"
+
+#include <limits.h>
+
+/* Programs with fewer tokens are parsed sequentially */
+#define PARALLEL_MIN_TOKENS 8192
+
+/* Segments are made about this many times more than the workers, to even out the load */
+#define SEGMENTS_PER_WORKER 4
+
+typedef struct {
+    ParserInfo info;     /* the sub-parser; it shares the tokens and the names of the main parser */
+    TreeStore store;     /* the nodes of the segment, moved into the main tree when joined */
+    long begin;          /* the first token */
+    long end;            /* the start of the next segment */
+    int first;           /* TRUE for the segment at the start of the program */
+    int ok;              /* FALSE when the segment could not be parsed, for lack of memory */
+    TreeNode * head;     /* the statements parsed */
+    TreeNode * last;
+} Segment;
+
+/* TRUE when the top-level statement at token i is a function declaration, as in declare_stmt() */
+static int function_start(const TokenBuffer * b, long i) {
+    TokenType t = (TokenType) b->types[i];
+    return (t == NUM || t == VOID)
+        && (b->types[i + 2] == LPAR || b->types[i + 3] == LPAR);
+}
+
+/* Find up to max - 1 function starts outside any ARROW ... SMILE, at least minTokens apart,
+ after token begin. starts[0] is begin; the count of starts is returned. */
+static size_t find_starts(const TokenBuffer * b, long begin, long minTokens, long * starts, size_t max) {
+    long i, count = (long) b->count;
+    int depth = 0;
+    size_t n = 1;
+
+    starts[0] = begin;
+    for (i = begin; i < count && n < max; i++) {
+        switch ((TokenType) b->types[i]) {
+            case ARROW: depth++; break;
+            case SMILE: if (depth > 0) depth--; break;
+            default:
+                if (depth == 0 && i - starts[n - 1] >= minTokens && function_start(b, i))
+                    starts[n++] = i;
+                break;
+        }
+    }
+    return n;
+}
+
+static void parse_segment(void * arg, int worker) {
+    Segment * seg = (Segment *) arg;
+    ParserInfo * ps = &seg->info;
+    (void) worker;
+
+    ps->pos = seg->begin;
+    ps->lineno = ps->tokens->lines[ps->pos];
+    ps->store = &seg->store;
+    seg->head = parse_statements(ps, seg->end, seg->first, &seg->last);
+    seg->ok = !ps->diagnostics.lost;
+}
+
+TreeNode * parse_parallel(ParserInfo * ps) {
+    TokenBuffer * b = ps->tokens;
+    long begin = ps->pos;
+    long remaining = (long) b->count - begin;
+    size_t max = (size_t) pool_size(ps->pool) * SEGMENTS_PER_WORKER;
+    long * starts;
+    Segment * segs;
+    size_t n, k;
+    TaskGroup group;
+    pthread_mutex_t namesLock;
+    TreeNode * t = NULL;
+    TreeNode * p = NULL;
+    int joined = TRUE;
+    int atStart = TRUE;     /* no segment joined yet */
+
+    if (remaining < PARALLEL_MIN_TOKENS || max < 2)
+        return parse_statements(ps, LONG_MAX, TRUE, &p);
+    starts = (long *) malloc(max * sizeof(long));
+    segs = (Segment *) calloc(max, sizeof(Segment));
+    if (starts == NULL || segs == NULL) {
+        free(starts);
+        free(segs);
+        return parse_statements(ps, LONG_MAX, TRUE, &p);
+    }
+    n = find_starts(b, begin, remaining / (long) max, starts, max);
+    if (n < 2) {
+        free(starts);
+        free(segs);
+        return parse_statements(ps, LONG_MAX, TRUE, &p);
+    }
+
+    pthread_mutex_init(&namesLock, NULL);
+    task_group_init(&group);
+    for (k = 0; k < n; k++) {
+        Segment * seg = &segs[k];
+        seg->info = *ps;
+        seg->info.namesLock = &namesLock;
+        seg->info.pool = NULL;
+        diagnostic_list_init(&seg->info.diagnostics);
+        seg->info.error = FALSE;
+        seg->info.errorCount = 0;
+        cons_init(&seg->info.shared);       /* each segment shares within its own regions */
+        arena_init(&seg->store.nodes);
+        intern_init(&seg->store.names);   /* unused: names go to the shared table */
+        seg->begin = starts[k];
+        seg->end = k + 1 < n ? starts[k + 1] : LONG_MAX;
+        seg->first = k == 0;
+        pool_submit(ps->pool, &group, parse_segment, seg);
+    }
+    pool_wait(ps->pool, &group);
+    task_group_destroy(&group);
+    pthread_mutex_destroy(&namesLock);
+
+    /* join the segments in order while each one starts where the one before it stopped */
+    for (k = 0; k < n; k++) {
+        Segment * seg = &segs[k];
+        int limited = ps->errorLimit > 0 && ps->errorCount + seg->info.errorCount >= ps->errorLimit;
+        if (joined && seg->ok && seg->begin == ps->pos && !limited) {
+            diagnostic_list_append(&ps->diagnostics, &seg->info.diagnostics, 0);
+            ps->errorCount += seg->info.errorCount;
+            INSTRUMENT_MAX(ps->stats.maxLookahead, seg->info.stats.maxLookahead);
+            INSTRUMENT_MAX(ps->stats.maxBlockDepth, seg->info.stats.maxBlockDepth);
+            INSTRUMENT_MAX(ps->stats.maxExpressionDepth, seg->info.stats.maxExpressionDepth);
+            if (seg->info.error)
+                ps->error = TRUE;
+            if (seg->head != NULL) {
+                if (t == NULL)
+                    t = seg->head;
+                else
+                    p->rSibling = seg->head;
+                p = seg->last;
+            }
+            arena_append(&ps->store->nodes, &seg->store.nodes);
+            ps->store->nodeCount += seg->store.nodeCount;
+            ps->stats.shared += seg->info.stats.shared;
+            ps->pos = seg->info.pos;
+            ps->lineno = seg->info.lineno;
+            atStart = FALSE;
+        } else {
+            joined = FALSE;
+            arena_release(&seg->store.nodes);
+        }
+        diagnostic_list_release(&seg->info.diagnostics);
+        cons_release(&seg->info.shared);
+    }
+    free(starts);
+    free(segs);
+
+    /* a segment did not fit: unless the loop ended before it, go on sequentially from where the joined ones stopped */
+    if (!joined && (atStart || !parse_statements_end(ps))) {
+        TreeNode * last;
+        TreeNode * rest = parse_statements(ps, LONG_MAX, atStart, &last);
+        if (rest != NULL) {
+            if (t == NULL)
+                t = rest;
+            else
+                p->rSibling = rest;
+        }
+    }
+    return t;
+}
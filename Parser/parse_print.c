@@ -6,6 +6,8 @@
 #include "util.h"
 
 #include "parse.h"
+#include "parse_print.h"
+#include "visit.h"
 
 
 /* macros of  increase/decrease indentation */
@@ -56,152 +58,373 @@ static char* token_type_to_string(TokenType type) {
     }
 }
 
-static void print_expr_type(ExprType t){
+static const char * expr_type_to_string(ExprType t){
 	switch(t) {
-	case VOID_TYPE: printf( "void"); break;
-	case NUM_TYPE: printf( "num"); break;
-	case ADDR_TYPE: printf( "address"); break;
-	default: printf( "Error ExpType"); break;
+	case VOID_TYPE: return "void";
+	case NUM_TYPE: return "num";
+	case ADDR_TYPE: return "address";
+	default: return "Error ExpType";
 	}
 }
 
-/* printSpaces indents by printing spaces */
-static void print_spaces(int indentNum) {
-	int i;
-	for (i=0;i<indentNum;i++)
-		printf(" ");
+/* The output of the printer goes through a buffer of
+   PRINT_BUFFER_SIZE characters, flushed when it is full,
+   to a FILE or to a caller's memory buffer. */
+#define PRINT_BUFFER_SIZE 65536
+
+typedef struct {
+	FILE * file;          /* the sink, or NULL for memory */
+	char * mem;           /* the memory sink, and its size */
+	size_t memSize;
+	int grow;             /* TRUE when mem is the printer's own, made larger as it fills */
+	size_t total;         /* characters flushed so far */
+	int ok;               /* FALSE after a write error */
+	size_t used;
+	char buf[PRINT_BUFFER_SIZE];
+} Printer;
+
+/* An entry of the explicit stack: a node still to print, and its indentation */
+typedef struct {
+	AstRef tree;
+	int indentNum;
+} PrintItem;
+
+static void flush(Printer * p) {
+	if (p->file != NULL) {
+		if (p->used > 0 && fwrite(p->buf, 1, p->used, p->file) != p->used)
+			p->ok = FALSE;
+	} else if (p->grow) {
+		if (p->total + p->used > p->memSize) {
+			size_t size = p->total + p->used > 2 * p->memSize ? p->total + p->used : 2 * p->memSize;
+			char * more = (char *) realloc(p->mem, size);
+			if (more == NULL) {
+				p->ok = FALSE;
+				p->used = 0;
+				return;
+			}
+			p->mem = more;
+			p->memSize = size;
+		}
+		if (p->used > 0)
+			memcpy(p->mem + p->total, p->buf, p->used);
+	} else if (p->total < p->memSize) {
+		/* keep the last byte of the memory sink for the terminating NUL */
+		size_t room = p->memSize - 1 - p->total;
+		memcpy(p->mem + p->total, p->buf, p->used < room ? p->used : room);
+	}
+	p->total += p->used;
+	p->used = 0;
+}
+
+static void put(Printer * p, const char * s, size_t n) {
+	while (n > 0) {
+		size_t room = PRINT_BUFFER_SIZE - p->used;
+		size_t k = n < room ? n : room;
+		memcpy(p->buf + p->used, s, k);
+		p->used += k;
+		s += k;
+		n -= k;
+		if (p->used == PRINT_BUFFER_SIZE)
+			flush(p);
+	}
+}
+
+static void put_str(Printer * p, const char * s) {
+	put(p, s, strlen(s));
+}
+
+/* a name as printf("%s") writes it, NULL included */
+static void put_name(Printer * p, const char * name) {
+	put_str(p, name != NULL ? name : "(null)");
+}
+
+static void put_int(Printer * p, int v) {
+	char digits[16];
+	put(p, digits, (size_t) sprintf(digits, "%d", v));
+}
+
+/* indents by indentNum spaces */
+static void put_spaces(Printer * p, int indentNum) {
+	while (indentNum > 0) {
+		size_t room = PRINT_BUFFER_SIZE - p->used;
+		size_t k = (size_t) indentNum < room ? (size_t) indentNum : room;
+		memset(p->buf + p->used, ' ', k);
+		p->used += k;
+		indentNum -= (int) k;
+		if (p->used == PRINT_BUFFER_SIZE)
+			flush(p);
+	}
+}
+
+/* prints the one line of a node, without the indentation.
+   It reads the node through the accessors of compact_tree.h,
+   so either layout of the tree prints the same. */
+static void print_node(Printer * p, AstRef tree) {
+	if (ast_node_kind(tree) == DCL_ND){
+		put_str(p, "Declare:  ");
+		put_str(p, expr_type_to_string(ast_dcl_type(tree)));
+		put_str(p, " ");
+		put_name(p, ast_name(tree));
+		put_str(p, " ");
+		// print the [size] only if it is an array.
+		switch(ast_kind(tree)){
+		case ARRAY_DCL:
+			put_str(p, "[");
+			put_int(p, ast_size(tree));
+			put_str(p, "]\n");
+			break;
+		case FUN_DCL:
+			put_str(p, "function with parameters :\n");
+			// Function parameters will be saved as child[0] of the node
+			break;
+		case VAR_DCL:
+			// do nothing
+			put_str(p, "\n");
+			break;
+		default:
+			put_str(p, "Unknown DclNode kind\n");
+			break;
+		}
+	}
+	else if (ast_node_kind(tree)==PARAM_ND){
+		put_str(p, "Parameter: ");
+		put_str(p, expr_type_to_string(ast_dcl_type(tree)));
+		if(ast_dcl_type(tree) != VOID_TYPE){
+			put_str(p, " ");
+			put_name(p, ast_name(tree));
+			if (ast_kind(tree) == ARRAY_PARAM)
+				put_str(p, "[ ]");
+		}
+		put_str(p, "\n");
+	}
+	else if(ast_node_kind(tree)==STMT_ND) {
+		switch (ast_kind(tree)) {
+		case SLCT_STMT:
+			put_str(p, "If ");
+			if (!ast_is_null(ast_child(tree, 2)))  // has else part
+				put_str(p, " with ELSE \n");
+			else
+				put_str(p, " without ELSE \n");
+			break;
+		case WHILE_STMT:
+			put_str(p, "while stmt: \n");
+			break;
+		case EXPR_STMT:
+			put_str(p, "Expression stmt: \n");
+			break;
+		case CMPD_STMT:
+			put_str(p, "Compound Stmt:\n");
+			break;
+		case RTN_STMT:
+			put_str(p, "Return \n");
+			//if there is a return value, it is  child[0].
+			break;
+		case NULL_STMT:
+			put_str(p, "Null statement:  ;\n");
+			break;
+		case FUNC_STMT:
+			put_str(p, "Function start:  ;\n");
+			break;
+		case ASSIGN_STMT:
+			put_str(p, "Assign statement:  ;\n");
+			break;
+		default:
+			put_str(p, "Unknown StmtNode kind\n");
+			break;
+		}
+	}
+	else if(ast_node_kind(tree)==EXPR_ND) {
+		switch (ast_kind(tree)) {
+		case OP_EXPR:
+			put_str(p, "Operator: ");
+			if(ast_op(tree) == LBR)
+				put_str(p, "[] index operator");
+			else
+				put_str(p, token_type_to_string(ast_op(tree)));
+			put_str(p, "\n");
+			break;
+		case CONST_EXPR:
+			put_str(p, "Const: ");
+			put_int(p, ast_val(tree));
+			put_str(p, "\n");
+			break;
+		case ID_EXPR:
+			put_str(p, "ID: ");
+			put_name(p, ast_name(tree));
+			put_str(p, "\n");
+			break;
+		case CALL_EXPR:
+			put_str(p, "Call function: ");
+			put_name(p, ast_name(tree));
+			put_str(p, ", with arguments:\n");
+			/* arguments are listed as  child[0] */
+			break;
+		default:
+			put_str(p, "Unknown ExpNode kind\n");
+			break;
+		}
+	}
+	else put_str(p, "Unknown node kind\n");
 }
 
-/* procedure print_tree prints a syntax tree to the
-   listing file using indentation to indicate subtrees
-   handle FOR_STMT  13/nov/2014
+/* print_subtree prints a syntax tree using indentation
+   to indicate subtrees: a node, then each of its
+   children one level deeper, then its right sibling at
+   the same level. handle FOR_STMT  13/nov/2014
+   The walk keeps the pending nodes on an explicit stack
+   rather than recursing, so deep trees cannot overflow
+   the call stack. It returns FALSE when the stack
+   cannot grow; the output then stops short.
  */
-void print_tree( TreeNode * tree ){
+static int print_subtree(Printer * p, AstRef tree) {
+	PrintItem * stack;
+	size_t top = 0, capacity = 256;
 	int i;
 
-	/* Variable indentNum is used by printTree to
-	 * store current number of spaces to indent
-	 */
-	static int indentNum = 0;
-
-	indentNum+= INDENT_GAP;
-	while (tree != NULL) {
-		print_spaces(indentNum); /* Each case only prints one line, If print more than one line, need use printSpaces() first.*/
-		//printf("%d ",  tree->lineNum);
-		if (tree->nodeKind == DCL_ND){
-			printf( "Declare:  ");
-			print_expr_type(tree->attr.dclAttr.type);
-			printf( " %s ", tree->attr.dclAttr.name );
-			// print the [size] only if it is an array.
-			switch(tree->kind.dcl){
-			case ARRAY_DCL:
-				printf( "[%d]\n", tree->attr.dclAttr.size );
-				break;
-			case FUN_DCL:
-				printf( "function with parameters :\n");
-				// Function parameters will be saved as child[0] of the node
-				break;
-			case VAR_DCL:
-				// do nothing
-				printf( "\n");
-				break;
-			default:
-				printf("Unknown DclNode kind\n");
-				break;
+	if (ast_is_null(tree))
+		return TRUE;
+	stack = (PrintItem *) malloc(capacity * sizeof(PrintItem));
+	if (stack == NULL)
+		return FALSE;
+	stack[top].tree = tree;
+	stack[top].indentNum = INDENT_GAP;
+	top++;
+	while (top > 0) {
+		PrintItem item = stack[--top];
+		tree = item.tree;
+		put_spaces(p, item.indentNum); /* Each node only prints one line */
+		print_node(p, tree);
+		if (top + MAX_CHILDREN + 1 > capacity) {
+			PrintItem * bigger = (PrintItem *) realloc(stack, capacity * 2 * sizeof(PrintItem));
+			if (bigger == NULL) {
+				free(stack);
+				return FALSE;
 			}
+			stack = bigger;
+			capacity *= 2;
 		}
-		else if (tree->nodeKind==PARAM_ND){
-			printf( "Parameter: ");
-			print_expr_type(tree->attr.dclAttr.type);
-			if(tree->attr.dclAttr.type != VOID_TYPE){
-				printf(" %s", tree->attr.dclAttr.name);
-				if (tree->kind.param == ARRAY_PARAM)
-					printf( "[ ]");
-			}
-			printf( "\n");
-		}
-		else if(tree->nodeKind==STMT_ND) {
-			switch (tree->kind.stmt) {
-			case SLCT_STMT:
-				printf("If ");
-				if (tree->child[2] != NULL)  // has else part
-					printf( " with ELSE \n");
-				else
-					printf( " without ELSE \n");
-				break;
-				//  case ITER_STMTMT:
-			case WHILE_STMT:
-				printf("while stmt: \n");
-				break;
-			case EXPR_STMT:
-				printf("Expression stmt: \n");
-				break;
-			case CMPD_STMT:
-				printf("Compound Stmt:\n");
-				break;
-			case RTN_STMT:
-				printf("Return \n");
-				//if there is a return value, it is  child[0].
-				break;
-			case NULL_STMT:
-				printf( "Null statement:  ;\n");
-				break;
-            case FUNC_STMT:
-                printf( "Function start:  ;\n");
-                break;
-            case ASSIGN_STMT:
-                printf( "Assign statement:  ;\n");
-                break;
-			default:
-				printf("Unknown StmtNode kind\n");
-				break;
-			}
+		/* pushed in reverse: child[0] is printed first, the sibling last */
+		stack[top].tree = ast_next(tree);
+		if (!ast_is_null(stack[top].tree)) {
+			stack[top].indentNum = item.indentNum;
+			top++;
 		}
-		else if(tree->nodeKind==EXPR_ND) {
-			switch (tree->kind.expr) {
-			case OP_EXPR:
-				printf("Operator: ");
-				if(tree->attr.exprAttr.op == LBR)
-					printf( "[] index operator");
-				else
-					printf("%s", token_type_to_string(tree->attr.exprAttr.op));
-				printf("\n");
-				break;
-			case CONST_EXPR:
-				printf("Const: %d\n",tree->attr.exprAttr.val);
-				break;
-			case ID_EXPR:
-				printf("ID: %s\n",tree->attr.exprAttr.name);
-				break;
-			/*
-			case ARRAY_EXPR:
-				printf("Array: %s, with member index:\n",tree->attr.exprAttr.name);
-				break;
-			*/
-			case CALL_EXPR:
-				printf("Call function: %s, with arguments:\n", tree->attr.exprAttr.name);
-				break;
-				/* arguments are listed as  child[0]
-				  remove ASN_EXP, since it is just an operator expression 13/NOV/2014
-            case ASN_EXP:
-	        printf("Assignment, with LHS and RHS:\n");
-	        break;
-				 */
-			default:
-				printf("Unknown ExpNode kind\n");
-				break;
+		for (i = MAX_CHILDREN - 1; i >= 0; i--) {
+			stack[top].tree = ast_child(tree, i);
+			if (!ast_is_null(stack[top].tree)) {
+				stack[top].indentNum = item.indentNum + INDENT_GAP;
+				top++;
 			}
 		}
-		else printf("Unknown node kind\n");
-		for (i=0;i<MAX_CHILDREN;i++)
-			print_tree(tree->child[i]);
-		tree = tree->rSibling;
-	}// end of while loop.
-	indentNum -= INDENT_GAP;
+	}
+	free(stack);
+	return TRUE;
+}
+
+int print_ast_file( FILE * out, AstRef tree ){
+	Printer * p = (Printer *) malloc(sizeof(Printer));
+	int ok;
+	if (p == NULL)
+		return FALSE;
+	p->file = out;
+	p->mem = NULL;
+	p->memSize = 0;
+	p->grow = FALSE;
+	p->total = 0;
+	p->ok = TRUE;
+	p->used = 0;
+	ok = print_subtree(p, tree);
+	flush(p);
+	ok = ok && p->ok;
+	free(p);
+	return ok;
 }
 
+size_t print_ast_buffer( char * buffer, size_t size, AstRef tree ){
+	Printer * p = (Printer *) malloc(sizeof(Printer));
+	size_t total;
+	if (p == NULL)
+		return (size_t) -1;
+	p->file = NULL;
+	p->mem = buffer;
+	p->memSize = size;
+	p->grow = FALSE;
+	p->total = 0;
+	p->ok = TRUE;
+	p->used = 0;
+	if (!print_subtree(p, tree))
+		p->ok = FALSE;
+	flush(p);
+	total = p->ok ? p->total : (size_t) -1;
+	if (size > 0)
+		buffer[p->total < size ? p->total : size - 1] = '\0';
+	free(p);
+	return total;
+}
+
+int print_tree_file( FILE * out, const TreeNode * tree ){
+	return print_ast_file(out, ast_of_tree(tree));
+}
 
+size_t print_tree_buffer( char * buffer, size_t size, const TreeNode * tree ){
+	return print_ast_buffer(buffer, size, ast_of_tree(tree));
+}
+
+/* The printer as a visitor (visit.h): each run of a list prints into
+   memory of its own, which is appended to the text of the list in order */
+static VisitResult print_visit(TreeNode * t, int depth, void * data) {
+	Printer * p = (Printer *) data;
+	put_spaces(p, INDENT_GAP * (depth + 1));
+	print_node(p, ast_of_tree(t));
+	return p->ok ? VISIT_CONTINUE : VISIT_FAILED;
+}
 
+static void * print_fork(void * data) {
+	Printer * p = (Printer *) malloc(sizeof(Printer));
+	(void) data;
+	if (p == NULL)
+		return NULL;
+	p->file = NULL;
+	p->mem = NULL;
+	p->memSize = 0;
+	p->grow = TRUE;
+	p->total = 0;
+	p->ok = TRUE;
+	p->used = 0;
+	return p;
+}
 
+static int print_join(void * data, void * run) {
+	Printer * p = (Printer *) data;
+	Printer * r = (Printer *) run;
+	if (r->ok) {
+		put(p, r->mem, r->total);
+		put(p, r->buf, r->used);
+	}
+	p->ok = p->ok && r->ok;
+	free(r->mem);
+	free(r);
+	return p->ok;
+}
 
+int print_tree_parallel( FILE * out, TreeNode * tree, ThreadPool * pool ){
+	Printer * p = (Printer *) print_fork(NULL);
+	Visitor v;
+	int ok;
+	if (p == NULL)
+		return FALSE;
+	p->file = out;
+	p->grow = FALSE;
+	visitor_init(&v, print_visit, NULL);
+	v.fork = print_fork;
+	v.join = print_join;
+	ok = visit_parallel(pool, &v, tree, p) == VISIT_CONTINUE;
+	flush(p);
+	ok = ok && p->ok;
+	free(p);
+	return ok;
+}
 
+void print_tree( TreeNode * tree ){
+	print_tree_file(stdout, tree);
+}
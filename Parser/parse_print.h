@@ -8,12 +8,33 @@
 #define _PARSE_PRINT_H_
 
 #include "parse.h"
+#include "compact_tree.h"
 /* TreeNode  is defined in parse.h.
  * If parse.h is not here, but some file includes parse_print.h before including
  * parse.h, then some strange error message appears.  */
 
+/* prints to stdout */
 void print_tree( TreeNode * );
 
+/* The same text, written to out through a large buffer.
+ * <Return:> FALSE on a write error or when memory runs out. */
+int print_tree_file( FILE * out, const TreeNode * tree );
+
+/* The same text, into buffer: at most size - 1 characters and a NUL, as snprintf() does.
+ * <Return:> the length of the whole text, which is >= size when it was cut,
+ * or (size_t) -1 when memory runs out. */
+size_t print_tree_buffer( char * buffer, size_t size, const TreeNode * tree );
+
+/* The same text as print_tree_file(), printed on the workers of pool
+ * (visit_parallel() of visit.h); with no pool, on this thread.
+ * <Return:> FALSE on a write error or when memory runs out. */
+int print_tree_parallel( FILE * out, TreeNode * tree, ThreadPool * pool );
+
+/* The same as print_tree_file() and print_tree_buffer(), for a tree in
+ * either layout: ast_of_tree(tree), or ast_of_compact() of a compact tree. */
+int print_ast_file( FILE * out, AstRef tree );
+size_t print_ast_buffer( char * buffer, size_t size, AstRef tree );
+
 //void print_token_type(TokenType );
 
 void print_expr_type(ExprType );
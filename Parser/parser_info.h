@@ -0,0 +1,117 @@
+/****************************************************
+ File: parser_info.h
+
+ The state of one Parser object, the data behind its
+ info pointer. Every grammar function of parse.c gets
+ this state as its first argument, so parse.c has no
+ global state and parsers on different threads do not
+ interfere.
+
+ This header is for the modules of the parser itself;
+ users of a Parser only need parse.h.
+****************************************************/
+
+#ifndef _PARSER_INFO_H_
+#define _PARSER_INFO_H_
+
+#include "libs.h"
+#include "parse.h"
+#include "arena.h"
+#include "intern.h"
+#include "token_buffer.h"
+#include "thread_pool.h"
+#include "diagnostics.h"
+#include "hashcons.h"
+
+struct tokenStream;
+
+/* The storage of one tree: every node and every name of the tree lives here,
+   so free_tree() releases the tree without walking it. */
+typedef struct treeStore {
+    struct treeStore * next;  /* the other live trees of the same parser */
+    TreeNode * root;
+    Arena nodes;
+    InternTable names;
+    size_t nodeCount;
+} TreeStore;
+
+typedef struct parserInfo {
+    TokenBuffer * tokens;     /* the tokens being parsed */
+    long pos;                 /* index of the current token in tokens */
+    TokenBuffer listTokens;   /* where the tokens of set_token_list() are copied */
+    struct tokenStream * stream; /* NULL, or where the tokens after those of tokens are read from (stream.h) */
+    void (* fill)(struct parserInfo * ps); /* NULL, or called when pos comes within TOKEN_LOOKAHEAD of the end of tokens */
+    void * fillData;          /* for fill */
+
+    int lineno;               /* line of the current token */
+    int error;                /* TRUE after a syntax error */
+    FILE * listing;           /* where the diagnostics are written at the end of a parse */
+    DiagnosticList diagnostics; /* the syntax errors of the parse so far, in order */
+    int errorLimit;           /* the parse stops after this many syntax errors, 0 for no limit */
+    int errorCount;
+    int recovering;           /* TRUE from a syntax error until a token is matched; no error is reported meanwhile */
+    int stopped;              /* TRUE when errorLimit was reached */
+    int depth;                /* how many compound statements enclose the current token */
+
+    TreeStore * store;        /* the storage of the tree being built */
+    InternTable * names;      /* where the names of the tree are interned, the names of store or of another parser */
+    pthread_mutex_t * namesLock; /* NULL, or the lock of names when several parsers share it */
+    ThreadPool * pool;        /* when not NULL, parse() splits the program over the workers of the pool */
+    TreeStore * trees;        /* all trees built by this parser and not yet freed */
+    TreeStore * spare;        /* NULL, or a store freed during a stream, emptied and kept for the next statement */
+    int sharing;              /* TRUE when equal expression nodes are shared (hashcons.h) */
+    ConsTable shared;         /* the expression nodes of the current region, with sharing */
+    int recursive;            /* TRUE when expressions are parsed by recursive descent (parser_set_recursive_expressions()) */
+    ParseStats stats;         /* the counters of the last parse, or of this one while it runs */
+} ParserInfo;
+
+/* Make a TreeStore for a new tree and let ps build into it. The parser keeps the store
+ until free_tree(). NULL when memory runs out. */
+TreeStore * tree_store_begin(ParserInfo * ps);
+
+/* Finish the tree of tree_store_begin(): root becomes its root, and the counters are set */
+void tree_store_end(ParserInfo * ps, TreeNode * root);
+
+/* Free a store of the parser with every node and name in it */
+void tree_store_free(ParserInfo * ps, TreeStore * store);
+
+/* TRUE when the top-level loop stops at the current token, which is then EOP */
+int parse_statements_end(ParserInfo * ps);
+
+/* Parse the iterations of the top-level stmt_sequence loop that start before token end.
+ first is TRUE at the start of the program, where the first statement needs no separator
+ before it. *last is the last statement of the returned rSibling chain. */
+TreeNode * parse_statements(ParserInfo * ps, long end, int first, TreeNode ** last);
+
+/* One iteration of the top-level loop, for a caller that cannot name its end token.
+ The result has no rSibling. */
+TreeNode * parse_statement(ParserInfo * ps, int first);
+
+/* End the window of the stream at pos, which becomes EOP: the rest of the input is not read */
+void token_stream_stop(ParserInfo * ps);
+
+/* program -> stmt_sequence, with the top-level functions parsed in parallel on ps->pool.
+ The tree and the diagnostics are the same as those of stmt_sequence(). */
+TreeNode * parse_parallel(ParserInfo * ps);
+
+#define PARSER_INFO(p) ((ParserInfo *) (p)->info)
+
+/* The counters of ParseStats that only an instrumented parser keeps. Compiled without
+   PARSER_INSTRUMENT, INSTRUMENT_MAX() is nothing and PEEK() records nothing. */
+#ifdef PARSER_INSTRUMENT
+#define INSTRUMENT_MAX(counter, value) do { if ((value) > (counter)) (counter) = (value); } while (0)
+#else
+#define INSTRUMENT_MAX(counter, value) ((void) 0)
+#endif
+
+/* The type of the token k steps away from the current one, -1 <= k <= TOKEN_LOOKAHEAD.
+   The buffer is padded on both ends, so no bounds check is needed. */
+#ifdef PARSER_INSTRUMENT
+#define PEEK(k) ((TokenType) ps->tokens->types[ps->pos + \
+    ((k) > ps->stats.maxLookahead ? (ps->stats.maxLookahead = (k)) : (k))])
+#else
+#define PEEK(k) ((TokenType) ps->tokens->types[ps->pos + (k)])
+#endif
+#define TOKEN PEEK(0)
+
+#endif
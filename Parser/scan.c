@@ -0,0 +1,218 @@
+/****************************************************
+ File: scan.c
+
+ A table-driven DFA scanner for C-Minus.
+ Every byte is first mapped to a character class by a
+ 256-entry table, and the DFA moves on the classes.
+ The longest match wins: the scanner remembers the last
+ final state it passed, so "--x" is two MINUS tokens
+ while "-->" is one ARROW.
+****************************************************/
+
+#include "util.h"
+#include "scan.h"
+#include "token_buffer.h"
+#include "source.h"
+
+/* Character classes, the columns of the transition table */
+typedef enum {
+    C_OTHER, C_LETTER, C_DIGIT, C_SPACE, C_NEWLINE,
+    C_PLUS, C_MINUS, C_STAR, C_SLASH, C_PERCENT,
+    C_LT, C_GT, C_EQ, C_BANG, C_SEMI, C_COMMA,
+    C_LPAR, C_RPAR, C_LBR, C_RBR, C_LCUR, C_RCUR,
+    C_COLON, C_QUOTE,
+    NUM_CLASSES
+} CharClass;
+
+/* DFA states. S_DEAD is 0, so every transition left out of the table below goes to it. */
+typedef enum {
+    S_DEAD, S_START, S_ID, S_NUMBER, S_NEWLINE,
+    S_PLUS, S_MINUS, S_MINUS_MINUS, S_ARROW, S_STAR, S_OVER,
+    S_COMMENT, S_COMMENT_STAR, S_COMMENT_END,
+    S_MOD, S_LT, S_LTE, S_GT, S_GTE, S_ASSIGN, S_EQ, S_BANG, S_NEQ,
+    S_SEMI, S_COMMA, S_LPAR, S_RPAR, S_LBR, S_RBR, S_LCUR, S_RCUR,
+    S_COLON, S_SMILE, S_STRING, S_STRING_END, S_ERROR,
+    NUM_STATES
+} ScanState;
+
+#define L C_LETTER
+#define D C_DIGIT
+static const unsigned char charClass[256] = {
+/*        0         1         2         3         4          5          6          7          8         9          a          b          c          d          e         f   */
+/* 0 */ C_OTHER, C_OTHER, C_OTHER, C_OTHER, C_OTHER,   C_OTHER,   C_OTHER,   C_OTHER,   C_OTHER, C_SPACE,   C_NEWLINE, C_SPACE,   C_SPACE,   C_SPACE,   C_OTHER, C_OTHER,
+/* 1 */ C_OTHER, C_OTHER, C_OTHER, C_OTHER, C_OTHER,   C_OTHER,   C_OTHER,   C_OTHER,   C_OTHER, C_OTHER,   C_OTHER,   C_OTHER,   C_OTHER,   C_OTHER,   C_OTHER, C_OTHER,
+/* 2 */ C_SPACE, C_BANG,  C_QUOTE, C_OTHER, C_OTHER,   C_PERCENT, C_OTHER,   C_OTHER,   C_LPAR,  C_RPAR,    C_STAR,    C_PLUS,    C_COMMA,   C_MINUS,   C_OTHER, C_SLASH,
+/* 3 */ D,       D,       D,       D,       D,         D,         D,         D,         D,       D,         C_COLON,   C_SEMI,    C_LT,      C_EQ,      C_GT,    C_OTHER,
+/* 4 */ C_OTHER, L,       L,       L,       L,         L,         L,         L,         L,       L,         L,         L,         L,         L,         L,       L,
+/* 5 */ L,       L,       L,       L,       L,         L,         L,         L,         L,       L,         L,         C_LBR,     C_OTHER,   C_RBR,     C_OTHER, L,
+/* 6 */ C_OTHER, L,       L,       L,       L,         L,         L,         L,         L,       L,         L,         L,         L,         L,         L,       L,
+/* 7 */ L,       L,       L,       L,       L,         L,         L,         L,         L,       L,         L,         C_LCUR,    C_OTHER,   C_RCUR,    C_OTHER, C_OTHER,
+/* 0x80 - 0xff are C_OTHER */
+};
+#undef L
+#undef D
+
+/* Inside a comment or a string every class keeps the state, except the four listed in each row */
+#define INSIDE(state) \
+    [C_OTHER] = state, [C_LETTER] = state, [C_DIGIT] = state, [C_SPACE] = state, \
+    [C_PLUS] = state, [C_MINUS] = state, [C_PERCENT] = state, \
+    [C_LT] = state, [C_GT] = state, [C_EQ] = state, [C_BANG] = state, [C_SEMI] = state, [C_COMMA] = state, \
+    [C_LPAR] = state, [C_RPAR] = state, [C_LBR] = state, [C_RBR] = state, [C_LCUR] = state, [C_RCUR] = state, \
+    [C_COLON] = state
+
+static const unsigned char delta[NUM_STATES][NUM_CLASSES] = {
+    [S_START] = {
+        [C_OTHER] = S_ERROR, [C_LETTER] = S_ID, [C_DIGIT] = S_NUMBER, [C_NEWLINE] = S_NEWLINE,
+        [C_PLUS] = S_PLUS, [C_MINUS] = S_MINUS, [C_STAR] = S_STAR, [C_SLASH] = S_OVER, [C_PERCENT] = S_MOD,
+        [C_LT] = S_LT, [C_GT] = S_GT, [C_EQ] = S_ASSIGN, [C_BANG] = S_BANG, [C_SEMI] = S_SEMI, [C_COMMA] = S_COMMA,
+        [C_LPAR] = S_LPAR, [C_RPAR] = S_RPAR, [C_LBR] = S_LBR, [C_RBR] = S_RBR, [C_LCUR] = S_LCUR, [C_RCUR] = S_RCUR,
+        [C_COLON] = S_COLON, [C_QUOTE] = S_STRING,
+    },
+    [S_ID] = { [C_LETTER] = S_ID, [C_DIGIT] = S_ID },
+    [S_NUMBER] = { [C_DIGIT] = S_NUMBER },
+    [S_MINUS] = { [C_MINUS] = S_MINUS_MINUS },
+    [S_MINUS_MINUS] = { [C_GT] = S_ARROW },
+    [S_OVER] = { [C_STAR] = S_COMMENT },
+    [S_COMMENT] = { INSIDE(S_COMMENT),
+        [C_NEWLINE] = S_COMMENT, [C_QUOTE] = S_COMMENT, [C_SLASH] = S_COMMENT, [C_STAR] = S_COMMENT_STAR },
+    [S_COMMENT_STAR] = { INSIDE(S_COMMENT),
+        [C_NEWLINE] = S_COMMENT, [C_QUOTE] = S_COMMENT, [C_SLASH] = S_COMMENT_END, [C_STAR] = S_COMMENT_STAR },
+    [S_LT] = { [C_EQ] = S_LTE },
+    [S_GT] = { [C_EQ] = S_GTE },
+    [S_ASSIGN] = { [C_EQ] = S_EQ },
+    [S_BANG] = { [C_EQ] = S_NEQ },
+    [S_COLON] = { [C_RPAR] = S_SMILE },
+    [S_STRING] = { INSIDE(S_STRING),
+        [C_NEWLINE] = S_DEAD, [C_STAR] = S_STRING, [C_SLASH] = S_STRING, [C_QUOTE] = S_STRING_END },
+};
+#undef INSIDE
+
+/* The token of each final state. NONE labels the non-final states. */
+static const TokenType accept[NUM_STATES] = {
+    [S_ID] = ID, [S_NUMBER] = NUMBER, [S_NEWLINE] = ENTER,
+    [S_PLUS] = PLUS, [S_MINUS] = MINUS, [S_ARROW] = ARROW, [S_STAR] = STAR, [S_OVER] = OVER,
+    [S_COMMENT_END] = COMMENT, [S_MOD] = MOD,
+    [S_LT] = LT, [S_LTE] = LTE, [S_GT] = GT, [S_GTE] = GTE, [S_ASSIGN] = ASSIGN, [S_EQ] = EQ, [S_NEQ] = NEQ,
+    [S_SEMI] = SEMI, [S_COMMA] = COMMA, [S_LPAR] = LPAR, [S_RPAR] = RPAR,
+    [S_LBR] = LBR, [S_RBR] = RBR, [S_LCUR] = LCUR, [S_RCUR] = RCUR,
+    [S_SMILE] = SMILE, [S_STRING_END] = STRING, [S_ERROR] = ERROR,
+};
+
+/* Keywords, placed by a perfect hash of their length and first letter, see keyword_type() */
+#define KEYWORD_HASH(len, first) ((((len) * 3) + (unsigned char) (first)) & 15)
+
+static const struct {
+    const char * text;
+    unsigned char length;
+    TokenType type;
+} keywords[16] = {
+    [KEYWORD_HASH(2, 'i')] = {"if", 2, IF},
+    [KEYWORD_HASH(4, 'e')] = {"else", 4, ELSE},
+    [KEYWORD_HASH(3, 'n')] = {"num", 3, NUM},
+    [KEYWORD_HASH(6, 'r')] = {"return", 6, RETURN},
+    [KEYWORD_HASH(4, 'v')] = {"void", 4, VOID},
+    [KEYWORD_HASH(5, 'w')] = {"while", 5, WHILE},
+};
+
+/* ID, or the keyword spelled by the len characters at s: one table probe and at most one memcmp */
+static TokenType keyword_type(const char * s, size_t len) {
+    if (len >= 2 && len <= 6) {
+        int k = KEYWORD_HASH(len, s[0]);
+        if (keywords[k].length == len && memcmp(keywords[k].text, s, len) == 0)
+            return keywords[k].type;
+    }
+    return ID;
+}
+
+TokenType scan_token(const char * text, size_t length, size_t * pos, size_t * begin, size_t * end) {
+    size_t p = *pos;
+    int state = S_START;
+    TokenType lastType = NONE;
+    size_t lastEnd;
+
+    while (p < length && charClass[(unsigned char) text[p]] == C_SPACE)
+        p++;
+    *begin = p;
+    if (p >= length) {
+        *pos = *end = p;
+        return EOP;
+    }
+
+    lastEnd = p;
+    while (p < length) {
+        int s = delta[state][charClass[(unsigned char) text[p]]];
+        if (s == S_DEAD)
+            break;
+        state = s;
+        p++;
+        if (accept[state] != NONE) {
+            lastType = accept[state];
+            lastEnd = p;
+        }
+    }
+
+    if (lastType == NONE || (lastType == OVER && (state == S_COMMENT || state == S_COMMENT_STAR))) {
+        /* No final state after the first byte: a lone '!' or ':', or a comment or string
+           that is not closed. The open comment or string becomes one ERROR token. */
+        if (state == S_COMMENT || state == S_COMMENT_STAR || state == S_STRING)
+            lastEnd = p;
+        else
+            lastEnd = *begin + 1;
+        lastType = ERROR;
+    }
+
+    *end = lastEnd;
+    *pos = lastEnd;
+    if (lastType == ID)
+        return keyword_type(text + *begin, lastEnd - *begin);
+    return lastType;
+}
+
+static void append_token(TokenList * list, TokenType type, const char * lexeme, size_t length) {
+    if (token_list_append(list, type, lexeme, length) == NULL) {
+        puts("Ran out of memory!");
+        exit(1);
+    }
+}
+
+TokenList scan_text(const char * text, size_t length) {
+    TokenList list = {NULL, NULL, NULL};
+    size_t pos = 0, begin, end;
+    TokenType type;
+
+    do {
+        type = scan_token(text, length, &pos, &begin, &end);
+        switch (type) {
+            case COMMENT:
+                /* comments are discarded */
+                break;
+            case ID:
+            case NUMBER:
+            case ERROR:
+                append_token(&list, type, text + begin, end - begin);
+                break;
+            case STRING:
+                /* the string without its quotes */
+                append_token(&list, type, text + begin + 1, end - begin - 2);
+                break;
+            default:
+                append_token(&list, type, NULL, 0);
+                break;
+        }
+    } while (type != EOP);
+
+    return list;
+}
+
+TokenList scan(const char * fileName) {
+    TokenList list = {NULL, NULL, NULL};
+    SourceFile src;
+
+    if (!source_open(&src, fileName)) {
+        printf("Cannot open the file %s\n", fileName);
+        return list;
+    }
+    list = scan_text(src.text, src.length);
+    source_close(&src);
+    return list;
+}
@@ -1,82 +1,98 @@
-﻿/****************************************************/
-/* File: scan.h                                     */
-/* The scanner interface for the N compiler         */
-/* Compiler Construction: Principles and Practice   */
-/* Programming by Zhiyao Liang                      */
-/* MUST FIT 2019 Fall                               */
-/****************************************************/
-
-#ifndef _SCAN_H_
-#define _SCAN_H_
-
-/* Maximum number of characters in the source file */
-#define MAX_FILE_LEN 10000
-
-/* MAXRESERVED = the number of reserved words/ keywords */
-#define MAX_RESERVED 6
-
-/* MAXTOKENLEN is the maximum size of a token */
-#define MAX_TOKEN_LEN 100
-
-
-
-/* tokenString array stores the lexeme of each token */
-//extern char tokenString[MAX_TOKEN_LEN+1];
-
-/* the line number of the current token */
-//extern int lineNum; /* source line number for listing */
-
-typedef enum 
-   {
-	NONE,  ERROR,/* book-keeping tokens, they are used to label non-final states in the DFA graph.*/
-    /* reserved words 
-     if else num return void while 
-    */
-    IF,ELSE,NUM,RETURN,VOID,WHILE,
-    /* multicharacter tokens */
-    ID, NUMBER, STRING, COMMENT,  /* comment token may can be discarded by scanner */
-    /* special symbols for 
-       + - * / % < <= > >= == != = ; , ( ) [ ] { } 
-    */
-    PLUS,MINUS,STAR,OVER,MOD,LT,LTE, GT, GTE, EQ, NEQ, ASSIGN, SEMI, COMMA, LPAR,RPAR, LBR, RBR, LCUR, RCUR,
-	/* book-keeping token, representing the EOS (end of stream) signal received at the end of the streamer */
-	ARROW, /* for --> */  
-   SMILE, /* for :) */
-   ENTER, /* end of line, when a new line is met */
-   EOP /* end of program */
-   } TokenType;
-
-
-
-
-typedef struct{
-  const char * string;   
-  // It is ok to assign  the return of copy_string(), which is char *, to string, 
-  TokenType type;
-} Token;
-
-// A node in a double linked list
-typedef struct TkNd{
-  Token* token;
-  //int lineNum;
-  struct TkNd * prev;
-  struct TkNd * next;
-}TokenNode;
-
-
-typedef struct {
-	TokenNode * head;
-	TokenNode * tail;
-}TokenList;
-
-
-TokenList  scan(const char* fileName);
-
-//void print_token_list_to_file(FILE* fp, TokenList tl);
-
-//Bool is_string_num(const char * str);
-// no need to check. Assume can only read tokens from a file that is generated by a correct scanner. 
-
-//Bool is_string_id(const char * str); 
-
-#endif
+﻿/****************************************************/
+/* File: scan.h                                     */
+/* The scanner interface for the N compiler         */
+/* Compiler Construction: Principles and Practice   */
+/* Programming by Zhiyao Liang                      */
+/* MUST FIT 2019 Fall                               */
+/****************************************************/
+
+#ifndef _SCAN_H_
+#define _SCAN_H_
+
+#include <stddef.h>
+#include "arena.h"
+
+/* There is no maximum number of characters in the source file any more:
+   scan() maps the whole file, see source.h */
+
+/* MAXRESERVED = the number of reserved words/ keywords */
+#define MAX_RESERVED 6
+
+/* MAXTOKENLEN is the maximum size of a token */
+#define MAX_TOKEN_LEN 100
+
+
+
+/* tokenString array stores the lexeme of each token */
+//extern char tokenString[MAX_TOKEN_LEN+1];
+
+/* the line number of the current token */
+//extern int lineNum; /* source line number for listing */
+
+typedef enum 
+   {
+	NONE,  ERROR,/* book-keeping tokens, they are used to label non-final states in the DFA graph.*/
+    /* reserved words 
+     if else num return void while 
+    */
+    IF,ELSE,NUM,RETURN,VOID,WHILE,
+    /* multicharacter tokens */
+    ID, NUMBER, STRING, COMMENT,  /* comment token may can be discarded by scanner */
+    /* special symbols for 
+       + - * / % < <= > >= == != = ; , ( ) [ ] { } 
+    */
+    PLUS,MINUS,STAR,OVER,MOD,LT,LTE, GT, GTE, EQ, NEQ, ASSIGN, SEMI, COMMA, LPAR,RPAR, LBR, RBR, LCUR, RCUR,
+	/* book-keeping token, representing the EOS (end of stream) signal received at the end of the streamer */
+	ARROW, /* for --> */  
+   SMILE, /* for :) */
+   ENTER, /* end of line, when a new line is met */
+   EOP /* end of program */
+   } TokenType;
+
+
+
+
+typedef struct{
+  const char * string;   
+  // It is ok to assign  the return of copy_string(), which is char *, to string, 
+  TokenType type;
+} Token;
+
+// A node in a double linked list
+typedef struct TkNd{
+  Token* token;
+  //int lineNum;
+  struct TkNd * prev;
+  struct TkNd * next;
+}TokenNode;
+
+
+/* The nodes, tokens and strings of a list come from its store, and token_list_free()
+   (token_buffer.h) releases them all at once */
+typedef struct {
+	TokenNode * head;
+	TokenNode * tail;
+	Arena * store;   /* NULL until the first token */
+}TokenList;
+
+
+/* Scan the C-Minus source file fileName. The list ends with an EOP token,
+   COMMENT tokens are discarded, and a file that cannot be read gives an empty list. */
+TokenList  scan(const char* fileName);
+
+/* Same as scan(), for the length characters at text. text does not need to be terminated. */
+TokenList scan_text(const char * text, size_t length);
+
+/* Scan one token of text, starting at *pos. The lexeme is text[*begin .. *end),
+   and *pos is moved to *end. Spaces are skipped; each newline is an ENTER token.
+   At the end of the text EOP is returned. */
+TokenType scan_token(const char * text, size_t length, size_t * pos, size_t * begin, size_t * end);
+
+//void print_token_list_to_file(FILE* fp, TokenList tl);
+
+//Bool is_string_num(const char * str);
+// no need to check. Assume can only read tokens from a file that is generated by a correct scanner. 
+
+//Bool is_string_id(const char * str); 
+
+#endif
@@ -0,0 +1,96 @@
+/****************************************************
+ File: sha256.c
+
+ SHA-256, see sha256.h
+****************************************************/
+
+#include "libs.h"
+#include "sha256.h"
+
+static const uint32_t rounds[64] = {
+    0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5, 0x3956c25b, 0x59f111f1, 0x923f82a4, 0xab1c5ed5,
+    0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3, 0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174,
+    0xe49b69c1, 0xefbe4786, 0x0fc19dc6, 0x240ca1cc, 0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+    0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7, 0xc6e00bf3, 0xd5a79147, 0x06ca6351, 0x14292967,
+    0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13, 0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85,
+    0xa2bfe8a1, 0xa81a664b, 0xc24b8b70, 0xc76c51a3, 0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
+    0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5, 0x391c0cb3, 0x4ed8aa4a, 0x5b9cca4f, 0x682e6ff3,
+    0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208, 0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2,
+};
+
+#define ROTR(x, n) (((x) >> (n)) | ((x) << (32 - (n))))
+
+static void compress(Sha256 * s, const unsigned char * p) {
+    uint32_t w[64], v[8], t1, t2;
+    int i;
+
+    for (i = 0; i < 16; i++)
+        w[i] = (uint32_t) p[4 * i] << 24 | (uint32_t) p[4 * i + 1] << 16 | (uint32_t) p[4 * i + 2] << 8 | p[4 * i + 3];
+    for (i = 16; i < 64; i++) {
+        uint32_t s0 = ROTR(w[i - 15], 7) ^ ROTR(w[i - 15], 18) ^ (w[i - 15] >> 3);
+        uint32_t s1 = ROTR(w[i - 2], 17) ^ ROTR(w[i - 2], 19) ^ (w[i - 2] >> 10);
+        w[i] = w[i - 16] + s0 + w[i - 7] + s1;
+    }
+    memcpy(v, s->state, sizeof(v));
+    for (i = 0; i < 64; i++) {
+        t1 = v[7] + (ROTR(v[4], 6) ^ ROTR(v[4], 11) ^ ROTR(v[4], 25)) + ((v[4] & v[5]) ^ (~v[4] & v[6])) + rounds[i] + w[i];
+        t2 = (ROTR(v[0], 2) ^ ROTR(v[0], 13) ^ ROTR(v[0], 22)) + ((v[0] & v[1]) ^ (v[0] & v[2]) ^ (v[1] & v[2]));
+        memmove(v + 1, v, 7 * sizeof(uint32_t));
+        v[4] += t1;
+        v[0] = t1 + t2;
+    }
+    for (i = 0; i < 8; i++)
+        s->state[i] += v[i];
+}
+
+void sha256_init(Sha256 * s) {
+    static const uint32_t initial[8] = {
+        0x6a09e667, 0xbb67ae85, 0x3c6ef372, 0xa54ff53a, 0x510e527f, 0x9b05688c, 0x1f83d9ab, 0x5be0cd19,
+    };
+    memcpy(s->state, initial, sizeof(initial));
+    s->length = 0;
+    s->used = 0;
+}
+
+void sha256_update(Sha256 * s, const void * data, size_t length) {
+    const unsigned char * p = (const unsigned char *) data;
+    s->length += length;
+    if (s->used > 0) {
+        size_t k = 64 - s->used < length ? 64 - s->used : length;
+        memcpy(s->block + s->used, p, k);
+        s->used += k;
+        p += k;
+        length -= k;
+        if (s->used < 64)
+            return;
+        compress(s, s->block);
+        s->used = 0;
+    }
+    /* whole blocks straight from the input */
+    for (; length >= 64; p += 64, length -= 64)
+        compress(s, p);
+    memcpy(s->block, p, length);
+    s->used = length;
+}
+
+void sha256_final(Sha256 * s, unsigned char digest[SHA256_BYTES]) {
+    uint64_t bits = s->length * 8;
+    int i;
+
+    s->block[s->used++] = 0x80;
+    if (s->used > 56) {
+        memset(s->block + s->used, 0, 64 - s->used);
+        compress(s, s->block);
+        s->used = 0;
+    }
+    memset(s->block + s->used, 0, 56 - s->used);
+    for (i = 0; i < 8; i++)
+        s->block[56 + i] = (unsigned char) (bits >> (56 - 8 * i));
+    compress(s, s->block);
+    for (i = 0; i < 8; i++) {
+        digest[4 * i] = (unsigned char) (s->state[i] >> 24);
+        digest[4 * i + 1] = (unsigned char) (s->state[i] >> 16);
+        digest[4 * i + 2] = (unsigned char) (s->state[i] >> 8);
+        digest[4 * i + 3] = (unsigned char) s->state[i];
+    }
+}
@@ -0,0 +1,31 @@
+/****************************************************
+ File: sha256.h
+
+ SHA-256 (FIPS 180-4), the hash that names the
+ entries of the parse cache (cache.h). The input can
+ be given in pieces of any size.
+****************************************************/
+
+#ifndef _SHA256_H_
+#define _SHA256_H_
+
+#include <stdint.h>
+#include <stddef.h>
+
+#define SHA256_BYTES 32
+
+typedef struct {
+    uint32_t state[8];
+    uint64_t length;          /* bytes hashed so far */
+    unsigned char block[64];  /* the bytes of a block not complete yet */
+    size_t used;
+} Sha256;
+
+void sha256_init(Sha256 * s);
+
+void sha256_update(Sha256 * s, const void * data, size_t length);
+
+/* The hash of all of the bytes given to sha256_update() */
+void sha256_final(Sha256 * s, unsigned char digest[SHA256_BYTES]);
+
+#endif
@@ -0,0 +1,103 @@
+/****************************************************
+ File: source.c
+
+ Source input by mmap, with a read() fallback, see source.h
+****************************************************/
+
+#include "libs.h"
+#include "source.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#define READ_BLOCK (64 * 1024)
+
+static void source_empty(SourceFile * src) {
+    src->text = "";
+    src->length = 0;
+    src->mapped = 0;
+}
+
+/* Read everything left on fd into a heap buffer that doubles as it fills */
+static int read_all(SourceFile * src, int fd) {
+    size_t capacity = READ_BLOCK, length = 0;
+    char * text = (char *) malloc(capacity);
+    if (text == NULL)
+        return 0;
+    for (;;) {
+        ssize_t n;
+        if (capacity - length < READ_BLOCK) {
+            char * bigger = (char *) realloc(text, capacity * 2);
+            if (bigger == NULL) {
+                free(text);
+                return 0;
+            }
+            text = bigger;
+            capacity *= 2;
+        }
+        n = read(fd, text + length, capacity - length);
+        if (n == 0)
+            break;
+        if (n < 0) {
+            if (errno == EINTR)
+                continue;
+            free(text);
+            return 0;
+        }
+        length += (size_t) n;
+    }
+    if (length == 0) {
+        free(text);
+        return 1;
+    }
+    src->text = text;
+    src->length = length;
+    src->mapped = 0;
+    return 1;
+}
+
+int source_open_fd(SourceFile * src, int fd) {
+    struct stat st;
+    source_empty(src);
+    if (fstat(fd, &st) == 0 && S_ISREG(st.st_mode)) {
+        void * p;
+        if (st.st_size == 0)
+            return 1;
+        p = mmap(NULL, (size_t) st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (p != MAP_FAILED) {
+            /* the scanner reads the file once from front to back */
+            madvise(p, (size_t) st.st_size, MADV_SEQUENTIAL);
+            src->text = (const char *) p;
+            src->length = (size_t) st.st_size;
+            src->mapped = 1;
+            return 1;
+        }
+    }
+    return read_all(src, fd);
+}
+
+int source_open(SourceFile * src, const char * fileName) {
+    int fd, ok;
+    if (strcmp(fileName, "-") == 0)
+        return source_open_fd(src, STDIN_FILENO);
+    fd = open(fileName, O_RDONLY);
+    if (fd < 0) {
+        source_empty(src);
+        return 0;
+    }
+    ok = source_open_fd(src, fd);
+    /* a mapping stays valid after its descriptor is closed */
+    close(fd);
+    return ok;
+}
+
+void source_close(SourceFile * src) {
+    if (src->mapped)
+        munmap((void *) src->text, src->length);
+    else if (src->length > 0)
+        free((void *) src->text);
+    source_empty(src);
+}
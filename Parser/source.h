@@ -0,0 +1,32 @@
+/****************************************************
+ File: source.h
+
+ Read-only view of a whole source file, with no size
+ limit. A regular file is mapped with mmap, so its
+ bytes are never copied; a pipe or stdin, which cannot
+ be mapped, is read with read() into a growing buffer.
+ The scanner points its lexemes into this view.
+****************************************************/
+
+#ifndef _SOURCE_H_
+#define _SOURCE_H_
+
+#include <stddef.h>
+
+typedef struct {
+    const char * text;  /* the bytes of the file; not '\0' terminated */
+    size_t length;
+    int mapped;         /* 1 when text is an mmap of the file, 0 when it is a heap copy */
+} SourceFile;
+
+/* Open fileName, or stdin when fileName is "-".
+ * <Return:> 1 on success; 0 when the file cannot be opened or read, and then src is empty. */
+int source_open(SourceFile * src, const char * fileName);
+
+/* Same as source_open(), for a descriptor that is already open. fd is not closed. */
+int source_open_fd(SourceFile * src, int fd);
+
+/* Unmap or free the text. Lexemes pointing into it become invalid. */
+void source_close(SourceFile * src);
+
+#endif
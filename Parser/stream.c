@@ -0,0 +1,248 @@
+/****************************************************
+ File: stream.c
+
+ Streaming parse, see stream.h
+
+ The window is a TokenBuffer whose text is the input
+ bytes still needed: from the lexeme of the first
+ token kept on. The grammar functions find nothing
+ different, except that next() asks for more tokens
+ when the current one comes near the end of the
+ window, and that the error limit ends the window
+ instead of jumping to its EOP.
+****************************************************/
+
+#include "libs.h"
+#include "stream.h"
+#include "parser_info.h"
+#include "util.h"
+
+/* The window is filled up to this many tokens past the lookahead of the current one */
+#define STREAM_TOKENS 512
+
+/* Bytes read from the input at a time */
+#define STREAM_CHUNK (64 * 1024)
+
+/* A token is only taken when this many bytes follow it, or the input has ended: the scanner may
+   look a few bytes past the end of a token (--> against -), and it is not done before it has seen them */
+#define STREAM_MARGIN 16
+
+typedef struct tokenStream {
+    FILE * in;
+    char * text;          /* the input bytes from the first lexeme the window needs */
+    size_t length;
+    size_t capacity;
+    size_t scanned;       /* where the scanner goes on in text */
+    int line;             /* the line of the next token */
+    int atEnd;            /* TRUE when in has no more bytes */
+    int failed;           /* TRUE when memory ran out or in could not be read */
+    TokenBuffer window;
+    size_t dropped;       /* tokens dropped from the front of the window so far */
+    StreamStats * stats;
+} TokenStream;
+
+/* Read more of the input after text, making text larger when it is full.
+ * <Return:> 0 when memory runs out or in cannot be read. */
+static int read_more(TokenStream * s) {
+    size_t n;
+    if (s->length == s->capacity) {
+        size_t capacity = s->capacity > 0 ? 2 * s->capacity : STREAM_CHUNK;
+        char * more;
+        /* offsets are 32 bits */
+        if (capacity >= NO_LEXEME)
+            return 0;
+        more = (char *) realloc(s->text, capacity);
+        if (more == NULL)
+            return 0;
+        s->text = more;
+        s->capacity = capacity;
+        s->window.text = more;
+    }
+    n = fread(s->text + s->length, 1, s->capacity - s->length, s->in);
+    if (n == 0) {
+        if (ferror(s->in))
+            return 0;
+        s->atEnd = TRUE;
+    }
+    s->length += n;
+    if (s->length > s->stats->maxTextBytes)
+        s->stats->maxTextBytes = s->length;
+    return 1;
+}
+
+/* Scan the next token into the window, COMMENT tokens are dropped as token_buffer_scan() does.
+ * <Return:> 0 when memory runs out or the input cannot be read. */
+static int scan_next(TokenStream * s) {
+    for (;;) {
+        size_t pos = s->scanned, begin, end, i;
+        TokenType type = scan_token(s->text, s->length, &pos, &begin, &end);
+        if (!s->atEnd && end + STREAM_MARGIN > s->length) {
+            /* the token may go on in the bytes not read yet */
+            if (!read_more(s))
+                return 0;
+            continue;
+        }
+        if (type == COMMENT || type == ERROR)
+            for (i = begin; i < end; i++)
+                if (s->text[i] == '\n')
+                    s->line++;
+        s->scanned = pos;
+        if (type == COMMENT)
+            continue;
+        if (!token_buffer_push(&s->window, type, (unsigned int) begin, (unsigned int) (end - begin), s->line))
+            return 0;
+        if (type == ENTER)
+            s->line++;
+        return 1;
+    }
+}
+
+/* Make the token at an EOP, the last token of the window */
+static void end_window(TokenBuffer * b, size_t at) {
+    int line = at > 0 ? b->lines[at - 1] : 1;
+    int k;
+    b->count = at + 1;
+    for (k = -1; k < TOKEN_LOOKAHEAD; k++) {
+        b->types[b->count + k] = EOP;
+        b->offsets[b->count + k] = NO_LEXEME;
+        b->lengths[b->count + k] = 0;
+        b->lines[b->count + k] = line;
+    }
+}
+
+/* Drop the tokens before keep, and the bytes before the first lexeme still needed */
+static void slide(TokenStream * s, size_t keep) {
+    TokenBuffer * b = &s->window;
+    size_t from = s->scanned, n = b->count - keep, i;
+
+    for (i = keep; i < b->count; i++)
+        if (b->offsets[i] != NO_LEXEME && b->offsets[i] < from)
+            from = b->offsets[i];
+    if (from > 0) {
+        memmove(s->text, s->text + from, s->length - from);
+        s->length -= from;
+        s->scanned -= from;
+        for (i = keep; i < b->count; i++)
+            if (b->offsets[i] != NO_LEXEME)
+                b->offsets[i] -= (unsigned int) from;
+    }
+    if (keep > 0) {
+        memmove(b->types, b->types + keep, n * sizeof(unsigned char));
+        memmove(b->offsets, b->offsets + keep, n * sizeof(unsigned int));
+        memmove(b->lengths, b->lengths + keep, n * sizeof(unsigned int));
+        memmove(b->lines, b->lines + keep, n * sizeof(int));
+        b->count = n;
+        s->dropped += keep;
+    }
+}
+
+/* The fill of the parser: when pos comes within TOKEN_LOOKAHEAD of the end of the window,
+   the tokens before pos - 1 are dropped and more are read */
+static void token_stream_fill(ParserInfo * ps) {
+    TokenStream * s = ps->stream;
+    TokenBuffer * b = &s->window;
+    size_t keep = ps->pos > 0 ? (size_t) ps->pos - 1 : 0;
+
+    if (b->count > 0 && b->types[b->count - 1] == EOP)
+        return;
+    /* the token before the current one stays, for the separator check */
+    slide(s, keep);
+    ps->pos -= (long) keep;
+    while (b->count <= (size_t) ps->pos + TOKEN_LOOKAHEAD + STREAM_TOKENS) {
+        if (!scan_next(s)) {
+            s->failed = TRUE;
+            if (b->count > 0)
+                end_window(b, b->count < b->capacity ? b->count : b->count - 1);
+            break;
+        }
+        if (b->types[b->count - 1] == EOP)
+            break;
+    }
+    if (b->count > s->stats->maxTokens)
+        s->stats->maxTokens = b->count;
+}
+
+void token_stream_stop(ParserInfo * ps) {
+    end_window(&ps->stream->window, (size_t) ps->pos);
+}
+
+int parse_stream(Parser * p, FILE * in, StatementCallback callback, void * data, StreamStats * stats) {
+    ParserInfo * ps = PARSER_INFO(p);
+    TokenBuffer * tokens = ps->tokens;
+    long pos = ps->pos;
+    size_t nodes = 0, bytes = 0, nameBytes = 0, arenaObjects = 0;
+    int first = TRUE, go = TRUE, ok;
+    TokenStream s;
+
+    memset(stats, 0, sizeof(StreamStats));
+    memset(&s, 0, sizeof(TokenStream));
+    s.in = in;
+    s.line = 1;
+    s.stats = stats;
+    token_buffer_init(&s.window);
+    memset(&ps->stats, 0, sizeof(ParseStats));
+    diagnostic_list_clear(&ps->diagnostics);
+    ps->error = FALSE;
+    ps->errorCount = 0;
+    ps->recovering = FALSE;
+    ps->stopped = FALSE;
+    ps->depth = 0;
+    ps->stream = &s;
+    ps->fill = token_stream_fill;
+    ps->tokens = &s.window;
+    ps->pos = 0;
+
+    token_stream_fill(ps);
+    if (s.window.count > 0)
+        ps->lineno = s.window.lines[0];
+    while (go && s.window.count > 0 && !parse_statements_end(ps)) {
+        TreeNode * t;
+        TreeStore * store = tree_store_begin(ps);
+        if (store == NULL) {
+            s.failed = TRUE;
+            break;
+        }
+        t = parse_statement(ps, first);
+        first = FALSE;
+        tree_store_end(ps, t);
+        nodes += ps->stats.nodes;
+        bytes += ps->stats.bytes;
+        nameBytes += ps->stats.nameBytes;
+        arenaObjects += ps->stats.arenaObjects;
+        if (ps->stats.bytes + ps->stats.nameBytes > stats->maxTreeBytes)
+            stats->maxTreeBytes = ps->stats.bytes + ps->stats.nameBytes;
+        diagnostic_list_write(&ps->diagnostics, 0, ps->listing);
+        diagnostic_list_clear(&ps->diagnostics);
+        if (t == NULL) {
+            tree_store_free(ps, store);
+            continue;
+        }
+        stats->statements++;
+        go = callback(p, t, data);
+    }
+    stats->stopped = !go;
+    stats->tokens = s.dropped + (size_t) ps->pos;
+    ps->stats.nodes = nodes;
+    ps->stats.bytes = bytes;
+    ps->stats.nameBytes = nameBytes;
+    ps->stats.arenaObjects = arenaObjects;
+    ps->stats.tokens = stats->tokens;
+    ps->stats.syntaxErrors = ps->errorCount;
+    diagnostic_list_write(&ps->diagnostics, 0, ps->listing);
+    diagnostic_list_clear(&ps->diagnostics);
+
+    ok = !s.failed && s.window.count > 0;
+    token_buffer_release(&s.window);
+    free(s.text);
+    ps->stream = NULL;
+    ps->fill = NULL;
+    if (ps->spare != NULL) {
+        arena_release(&ps->spare->nodes);
+        intern_release(&ps->spare->names);
+        free(ps->spare);
+        ps->spare = NULL;
+    }
+    ps->tokens = tokens;
+    ps->pos = pos;
+    return ok;
+}
@@ -0,0 +1,55 @@
+/****************************************************
+ File: stream.h
+
+ Streaming parse: a C-Minus source is read from a
+ FILE, scanned and parsed one top-level statement at
+ a time, and each statement is given to a callback as
+ soon as it is parsed. The parser sees a window of the
+ tokens: the one before the current token, and some
+ hundreds after it, which is more than the lookahead
+ of the grammar (at most TOKEN_LOOKAHEAD, see
+ token_buffer.h). Only the input bytes of the window
+ are kept.
+
+ Each statement is a tree of its own, in its own
+ storage, which the callback frees with free_tree()
+ when it is done with it, or keeps. So the memory of a
+ stream is the window plus the statements the callback
+ keeps, whatever the length of the input; a function
+ declaration is one statement, as large as the
+ function.
+
+ The tree of each statement and the syntax errors are
+ those of parse() on the whole input. The errors are
+ written to the listing after each statement, so a
+ stream keeps none of them; parser_stats() gives the
+ counters of the whole stream. The pool of the parser
+ (parser_set_pool()) is not used.
+****************************************************/
+
+#ifndef _STREAM_H_
+#define _STREAM_H_
+
+#include "libs.h"
+#include "parse.h"
+
+/* Called with each top-level statement, in order: a declaration, or another statement.
+ * Blank lines and lone separators are not statements.
+ * <Return:> 0 to stop the stream after this statement. */
+typedef int (* StatementCallback)(Parser * p, TreeNode * statement, void * data);
+
+typedef struct {
+    size_t statements;     /* given to the callback */
+    size_t tokens;         /* the parse moved over */
+    size_t maxTokens;      /* the most tokens in the window at once */
+    size_t maxTextBytes;   /* the most input bytes kept at once */
+    size_t maxTreeBytes;   /* the most arena and name bytes of one statement */
+    int stopped;           /* TRUE when the callback stopped the stream */
+} StreamStats;
+
+/* Parse the C-Minus source read from in with p, calling callback for each top-level statement.
+ * The tokens the parser was set to read are left as they were.
+ * <Return:> 0 when memory runs out or in cannot be read; the statements given so far stay valid. */
+int parse_stream(Parser * p, FILE * in, StatementCallback callback, void * data, StreamStats * stats);
+
+#endif
@@ -0,0 +1,116 @@
+/****************************************************
+ File: symtab.c
+
+ The scoped symbol table, see symtab.h
+****************************************************/
+
+#include "libs.h"
+#include "symtab.h"
+#include "intern.h"
+
+#define INITIAL_SLOTS 256
+
+/* Interned names have dense ids, which an odd multiplier spreads over the slots */
+static size_t slot_of(const SymbolTable * t, const char * name) {
+    return (size_t) (SYMBOL_ID(name) * 2654435761u) & (t->capacity - 1);
+}
+
+/* The slot of name, or the empty slot where it goes */
+static Symbol * find(const SymbolTable * t, const char * name) {
+    size_t j = slot_of(t, name);
+    while (t->slots[j].name != NULL && t->slots[j].name != name)
+        j = (j + 1) & (t->capacity - 1);
+    return &t->slots[j];
+}
+
+static int grow_slots(SymbolTable * t) {
+    SymbolTable bigger = *t;
+    size_t i;
+    bigger.capacity = t->capacity == 0 ? INITIAL_SLOTS : t->capacity * 2;
+    bigger.slots = (Symbol *) calloc(bigger.capacity, sizeof(Symbol));
+    if (bigger.slots == NULL)
+        return 0;
+    for (i = 0; i < t->capacity; i++)
+        if (t->slots[i].name != NULL)
+            *find(&bigger, t->slots[i].name) = t->slots[i];
+    free(t->slots);
+    t->slots = bigger.slots;
+    t->capacity = bigger.capacity;
+    return 1;
+}
+
+void symtab_init(SymbolTable * t) {
+    memset(t, 0, sizeof(SymbolTable));
+    t->level = -1;
+}
+
+void symtab_release(SymbolTable * t) {
+    free(t->slots);
+    free(t->saved);
+    free(t->scopes);
+    symtab_init(t);
+}
+
+int symtab_open_scope(SymbolTable * t) {
+    if (t->level + 1 == t->scopesCapacity) {
+        int capacity = t->scopesCapacity > 0 ? 2 * t->scopesCapacity : 64;
+        size_t * more = (size_t *) realloc(t->scopes, (size_t) capacity * sizeof(size_t));
+        if (more == NULL)
+            return 0;
+        t->scopes = more;
+        t->scopesCapacity = capacity;
+    }
+    t->scopes[++t->level] = t->savedCount;
+    return 1;
+}
+
+void symtab_close_scope(SymbolTable * t) {
+    size_t first;
+    if (t->level < 0)
+        return;
+    first = t->scopes[t->level--];
+    while (t->savedCount > first) {
+        const Symbol * s = &t->saved[--t->savedCount];
+        *find(t, s->name) = *s;
+    }
+}
+
+int symtab_declare(SymbolTable * t, const char * name, TreeNode * decl, TreeNode ** previous) {
+    Symbol * slot;
+
+    *previous = NULL;
+    if (t->level < 0 && !symtab_open_scope(t))
+        return 0;
+    /* keep the load factor at or below 1/2 */
+    if ((t->count + 1) * 2 > t->capacity && !grow_slots(t))
+        return 0;
+    slot = find(t, name);
+    if (slot->name != NULL && slot->decl != NULL && slot->level == t->level) {
+        *previous = slot->decl;
+        return 1;
+    }
+    if (t->savedCount == t->savedCapacity) {
+        size_t capacity = t->savedCapacity > 0 ? 2 * t->savedCapacity : 256;
+        Symbol * more = (Symbol *) realloc(t->saved, capacity * sizeof(Symbol));
+        if (more == NULL)
+            return 0;
+        t->saved = more;
+        t->savedCapacity = capacity;
+    }
+    /* what the slot held comes back when the scope closes; a new slot comes back empty of a declaration */
+    if (slot->name == NULL) {
+        slot->name = name;
+        slot->decl = NULL;
+        t->count++;
+    }
+    t->saved[t->savedCount++] = *slot;
+    slot->decl = decl;
+    slot->level = t->level;
+    return 1;
+}
+
+TreeNode * symtab_lookup(const SymbolTable * t, const char * name) {
+    if (t->capacity == 0)
+        return NULL;
+    return find(t, name)->decl;
+}
@@ -0,0 +1,58 @@
+/****************************************************
+ File: symtab.h
+
+ The symbol table of the semantic pass: the names in
+ scope, each bound to the node that declares it. All
+ of the open scopes share one open-addressing hash
+ table, keyed by the interned name (intern.h), which
+ holds the innermost declaration of each name; when a
+ declaration shadows an outer one, the outer binding
+ is saved on a stack and put back when its scope
+ closes. So a lookup is one probe sequence however
+ deep the scopes are, and closing a scope costs only
+ the declarations made in it.
+****************************************************/
+
+#ifndef _SYMTAB_H_
+#define _SYMTAB_H_
+
+#include "libs.h"
+#include "parse.h"
+
+typedef struct {
+    const char * name;    /* interned; NULL marks an empty slot */
+    TreeNode * decl;      /* the declaration in scope, or NULL when its scope has closed */
+    int level;            /* the scope of decl, 0 being the outermost */
+} Symbol;
+
+typedef struct {
+    Symbol * slots;       /* the table, its capacity a power of 2 */
+    size_t capacity;
+    size_t count;         /* slots in use */
+    Symbol * saved;       /* the bindings replaced by the declarations of the open scopes */
+    size_t savedCount;
+    size_t savedCapacity;
+    size_t * scopes;      /* savedCount when each open scope was opened */
+    int level;            /* the innermost open scope, -1 when none is */
+    int scopesCapacity;
+} SymbolTable;
+
+void symtab_init(SymbolTable * t);
+
+void symtab_release(SymbolTable * t);
+
+/* <Return:> 0 when memory runs out */
+int symtab_open_scope(SymbolTable * t);
+
+/* Forget the declarations of the innermost scope */
+void symtab_close_scope(SymbolTable * t);
+
+/* Declare the interned name in the innermost scope. When that scope declares it already,
+ * nothing changes and *previous is set to that declaration; otherwise *previous is NULL.
+ * <Return:> 0 when memory runs out. */
+int symtab_declare(SymbolTable * t, const char * name, TreeNode * decl, TreeNode ** previous);
+
+/* <Return:> The declaration of the interned name in scope, or NULL */
+TreeNode * symtab_lookup(const SymbolTable * t, const char * name);
+
+#endif
@@ -0,0 +1,284 @@
+/****************************************************
+ File: thread_pool.c
+
+ Work-stealing thread pool, see thread_pool.h
+****************************************************/
+
+#include "libs.h"
+#include "thread_pool.h"
+
+#include <unistd.h>
+
+typedef struct {
+    TaskFunction fn;
+    void * arg;
+    TaskGroup * group;
+} Task;
+
+/* A circular deque; the owner works at the back, thieves at the front */
+typedef struct {
+    Task * tasks;
+    size_t front;     /* index of the oldest task */
+    size_t count;
+    size_t capacity;  /* a power of 2 */
+    pthread_mutex_t lock;
+} TaskQueue;
+
+struct threadPool {
+    int size;
+    pthread_t * threads;
+    TaskQueue * queues;      /* queues[i] belongs to worker i, queues[size] takes tasks from outside the pool */
+    int queueCount;
+    atomic_long queued;      /* tasks in all queues */
+    pthread_mutex_t idleLock;
+    pthread_cond_t idle;     /* signalled when a task is queued or the pool stops */
+    int stopping;
+};
+
+/* which worker the current thread is, -1 outside the pool */
+static _Thread_local int currentWorker = -1;
+static _Thread_local ThreadPool * currentPool = NULL;
+
+int cpu_count(void) {
+    long n = sysconf(_SC_NPROCESSORS_ONLN);
+    return n < 1 ? 1 : (int) n;
+}
+
+static void queue_init(TaskQueue * q) {
+    /* the array is allocated by the first push */
+    q->tasks = NULL;
+    q->capacity = 0;
+    q->front = 0;
+    q->count = 0;
+    pthread_mutex_init(&q->lock, NULL);
+}
+
+/* Returns 0 when memory runs out */
+static int queue_push_back(TaskQueue * q, Task t) {
+    pthread_mutex_lock(&q->lock);
+    if (q->count == q->capacity) {
+        size_t capacity = q->capacity == 0 ? 64 : 2 * q->capacity;
+        Task * tasks = (Task *) malloc(capacity * sizeof(Task));
+        size_t i;
+        if (tasks == NULL) {
+            pthread_mutex_unlock(&q->lock);
+            return 0;
+        }
+        for (i = 0; i < q->count; i++)
+            tasks[i] = q->tasks[(q->front + i) & (q->capacity - 1)];
+        free(q->tasks);
+        q->tasks = tasks;
+        q->front = 0;
+        q->capacity = capacity;
+    }
+    q->tasks[(q->front + q->count) & (q->capacity - 1)] = t;
+    q->count++;
+    pthread_mutex_unlock(&q->lock);
+    return 1;
+}
+
+static int queue_pop_back(TaskQueue * q, Task * t) {
+    int found = 0;
+    pthread_mutex_lock(&q->lock);
+    if (q->count > 0) {
+        q->count--;
+        *t = q->tasks[(q->front + q->count) & (q->capacity - 1)];
+        found = 1;
+    }
+    pthread_mutex_unlock(&q->lock);
+    return found;
+}
+
+static int queue_pop_front(TaskQueue * q, Task * t) {
+    int found = 0;
+    pthread_mutex_lock(&q->lock);
+    if (q->count > 0) {
+        *t = q->tasks[q->front];
+        q->front = (q->front + 1) & (q->capacity - 1);
+        q->count--;
+        found = 1;
+    }
+    pthread_mutex_unlock(&q->lock);
+    return found;
+}
+
+/* Take a task for worker self: its own newest task, or else the oldest task of another queue */
+static int take_task(ThreadPool * pool, int self, Task * t) {
+    int n = pool->size + 1, k;
+    if (atomic_load(&pool->queued) == 0)
+        return 0;
+    if (queue_pop_back(&pool->queues[self], t)) {
+        atomic_fetch_sub(&pool->queued, 1);
+        return 1;
+    }
+    for (k = 1; k < n; k++) {
+        if (queue_pop_front(&pool->queues[(self + k) % n], t)) {
+            atomic_fetch_sub(&pool->queued, 1);
+            return 1;
+        }
+    }
+    return 0;
+}
+
+static void run_task(Task * t, int worker) {
+    TaskGroup * g = t->group;
+    t->fn(t->arg, worker);
+    /* under the lock, which pool_wait() takes before it returns: the group may be destroyed then */
+    pthread_mutex_lock(&g->lock);
+    if (atomic_fetch_sub(&g->pending, 1) == 1)
+        pthread_cond_broadcast(&g->done);
+    pthread_mutex_unlock(&g->lock);
+}
+
+typedef struct {
+    ThreadPool * pool;
+    int id;
+} WorkerStart;
+
+static void * worker_main(void * arg) {
+    WorkerStart * start = (WorkerStart *) arg;
+    ThreadPool * pool = start->pool;
+    int self = start->id;
+    Task t;
+    free(start);
+    currentWorker = self;
+    currentPool = pool;
+
+    for (;;) {
+        if (take_task(pool, self, &t)) {
+            run_task(&t, self);
+            continue;
+        }
+        pthread_mutex_lock(&pool->idleLock);
+        while (atomic_load(&pool->queued) == 0 && !pool->stopping)
+            pthread_cond_wait(&pool->idle, &pool->idleLock);
+        if (pool->stopping && atomic_load(&pool->queued) == 0) {
+            pthread_mutex_unlock(&pool->idleLock);
+            break;
+        }
+        pthread_mutex_unlock(&pool->idleLock);
+    }
+    return NULL;
+}
+
+ThreadPool * pool_create(int workers) {
+    ThreadPool * pool = (ThreadPool *) calloc(1, sizeof(ThreadPool));
+    int i;
+    if (pool == NULL)
+        return NULL;
+    if (workers < 1)
+        workers = cpu_count();
+    pool->size = workers;
+    pool->threads = (pthread_t *) calloc(workers, sizeof(pthread_t));
+    pool->queues = (TaskQueue *) calloc(workers + 1, sizeof(TaskQueue));
+    if (pool->threads == NULL || pool->queues == NULL) {
+        free(pool->threads);
+        free(pool->queues);
+        free(pool);
+        return NULL;
+    }
+    pool->queueCount = workers + 1;
+    for (i = 0; i < pool->queueCount; i++)
+        queue_init(&pool->queues[i]);
+    atomic_init(&pool->queued, 0);
+    pthread_mutex_init(&pool->idleLock, NULL);
+    pthread_cond_init(&pool->idle, NULL);
+    for (i = 0; i < workers; i++) {
+        WorkerStart * start = (WorkerStart *) malloc(sizeof(WorkerStart));
+        if (start == NULL) {
+            pool->size = i;
+            break;
+        }
+        start->pool = pool;
+        start->id = i;
+        if (pthread_create(&pool->threads[i], NULL, worker_main, start) != 0) {
+            free(start);
+            pool->size = i;
+            break;
+        }
+    }
+    if (pool->size == 0) {
+        pool_destroy(pool);
+        return NULL;
+    }
+    return pool;
+}
+
+void pool_destroy(ThreadPool * pool) {
+    int i;
+    pthread_mutex_lock(&pool->idleLock);
+    pool->stopping = 1;
+    pthread_cond_broadcast(&pool->idle);
+    pthread_mutex_unlock(&pool->idleLock);
+    for (i = 0; i < pool->size; i++)
+        pthread_join(pool->threads[i], NULL);
+    /* the queue count is fixed at creation, also when fewer threads could be started */
+    for (i = 0; i < pool->queueCount; i++) {
+        free(pool->queues[i].tasks);
+        pthread_mutex_destroy(&pool->queues[i].lock);
+    }
+    free(pool->queues);
+    free(pool->threads);
+    pthread_mutex_destroy(&pool->idleLock);
+    pthread_cond_destroy(&pool->idle);
+    free(pool);
+}
+
+int pool_size(ThreadPool * pool) {
+    return pool->size;
+}
+
+void task_group_init(TaskGroup * g) {
+    atomic_init(&g->pending, 0);
+    pthread_mutex_init(&g->lock, NULL);
+    pthread_cond_init(&g->done, NULL);
+}
+
+void task_group_destroy(TaskGroup * g) {
+    pthread_mutex_destroy(&g->lock);
+    pthread_cond_destroy(&g->done);
+}
+
+/* the queue of the calling thread: its own inside the pool, the shared one outside */
+static int self_index(ThreadPool * pool) {
+    return currentPool == pool && currentWorker >= 0 ? currentWorker : pool->size;
+}
+
+void pool_submit(ThreadPool * pool, TaskGroup * g, TaskFunction fn, void * arg) {
+    Task t;
+    int self = self_index(pool);
+    t.fn = fn;
+    t.arg = arg;
+    t.group = g;
+    atomic_fetch_add(&g->pending, 1);
+    atomic_fetch_add(&pool->queued, 1);
+    if (!queue_push_back(&pool->queues[self], t)) {
+        /* cannot queue it: run it here, which is correct, just not parallel */
+        atomic_fetch_sub(&pool->queued, 1);
+        run_task(&t, self);
+        return;
+    }
+    pthread_mutex_lock(&pool->idleLock);
+    pthread_cond_signal(&pool->idle);
+    pthread_mutex_unlock(&pool->idleLock);
+}
+
+void pool_wait(ThreadPool * pool, TaskGroup * g) {
+    int self = self_index(pool);
+    Task t;
+    while (atomic_load(&g->pending) > 0) {
+        if (take_task(pool, self, &t)) {
+            run_task(&t, self);
+            continue;
+        }
+        /* nothing left to help with: sleep until the group finishes. A task queued
+           later is queued by a running task, whose thread helps with it when it waits. */
+        pthread_mutex_lock(&g->lock);
+        if (atomic_load(&g->pending) > 0)
+            pthread_cond_wait(&g->done, &g->lock);
+        pthread_mutex_unlock(&g->lock);
+    }
+    /* the thread of the last task may still hold the lock of g */
+    pthread_mutex_lock(&g->lock);
+    pthread_mutex_unlock(&g->lock);
+}
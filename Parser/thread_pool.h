@@ -0,0 +1,53 @@
+/****************************************************
+ File: thread_pool.h
+
+ A work-stealing thread pool. Each worker owns a task
+ queue: it takes its own tasks from the back (newest
+ first) and, when its queue is empty, steals from the
+ front of the other queues (oldest first). Tasks are
+ counted in task groups; pool_wait() on a group runs
+ queued tasks while it waits, so a task may submit
+ more tasks and wait for them without deadlock.
+****************************************************/
+
+#ifndef _THREAD_POOL_H_
+#define _THREAD_POOL_H_
+
+#include <pthread.h>
+#include <stdatomic.h>
+
+/* worker is the index of the thread running the task, 0 .. pool_size() - 1,
+   or pool_size() for a thread outside the pool that helps inside pool_wait(). */
+typedef void (* TaskFunction)(void * arg, int worker);
+
+typedef struct threadPool ThreadPool;
+
+typedef struct {
+    atomic_long pending;   /* tasks submitted and not finished */
+    pthread_mutex_t lock;
+    pthread_cond_t done;
+} TaskGroup;
+
+/* Start a pool of workers threads; workers < 1 means one per online CPU.
+ * <Return:> NULL when the threads cannot be made. */
+ThreadPool * pool_create(int workers);
+
+/* Wait for the running tasks, stop the threads and free the pool */
+void pool_destroy(ThreadPool * pool);
+
+int pool_size(ThreadPool * pool);
+
+void task_group_init(TaskGroup * g);
+void task_group_destroy(TaskGroup * g);
+
+/* Queue fn(arg) as a task of group g. From a worker thread the task goes to that
+ * worker's own queue, from any other thread to a shared queue. */
+void pool_submit(ThreadPool * pool, TaskGroup * g, TaskFunction fn, void * arg);
+
+/* Return when every task of g is finished, running queued tasks meanwhile */
+void pool_wait(ThreadPool * pool, TaskGroup * g);
+
+/* The number of online CPUs, at least 1 */
+int cpu_count(void);
+
+#endif
@@ -0,0 +1,276 @@
+/****************************************************
+ File: tokenIO.c
+
+ Reading and writing a token list file, see
+ tokenListIO.h. Each line of the file is one token:
+
+   lineNumber TYPE
+   lineNumber ID: name
+   lineNumber NUMBER: digits
+   lineNumber STRING: the rest of the line
+
+ The file is read whole, in large blocks, and the
+ lines are taken apart in memory. The type names are
+ looked up in a perfect hash table. What is printed
+ is what the reader of the course always printed:
+ each token is echoed to stdout as it is read.
+****************************************************/
+
+#include "libs.h"
+#include "scan.h"
+#include "tokenListIO.h"
+#include "token_buffer.h"
+
+#define READ_BLOCK (1024 * 1024)
+
+/* The words of a line are read as scanf("%99s") reads them: longer ones are cut,
+   and the rest is the next word. The text of a STRING token is cut as fgets() with 99 cuts it. */
+#define WORD_MAX 99
+#define STRING_MAX 98
+
+static const char * const typeNames[EOP + 1] = {
+    "NONE", "ERROR", "IF", "ELSE", "NUM", "RETURN", "VOID", "WHILE", "ID", "NUMBER", "STRING", "COMMENT",
+    "PLUS", "MINUS", "STAR", "OVER", "MOD", "LT", "LTE", "GT", "GTE", "EQ", "NEQ", "ASSIGN", "SEMI", "COMMA",
+    "LPAR", "RPAR", "LBR", "RBR", "LCUR", "RCUR", "ARROW", "SMILE", "ENTER", "EOP"
+};
+
+typedef struct {
+    const char * name;
+    unsigned char length;
+    unsigned char type;
+} TypeName;
+
+/* Every type name, and ID:, NUMBER: and STRING:, in the slot of type_slot(); no two share a slot */
+#define TYPE_SLOTS 128
+static const TypeName typeSlots[TYPE_SLOTS] = {
+    [2] = {"LT", 2, LT},
+    [10] = {"NEQ", 3, NEQ},
+    [17] = {"LBR", 3, LBR},
+    [20] = {"EOP", 3, EOP},
+    [22] = {"LCUR", 4, LCUR},
+    [23] = {"RBR", 3, RBR},
+    [28] = {"RCUR", 4, RCUR},
+    [30] = {"ID:", 3, ID},
+    [32] = {"MOD", 3, MOD},
+    [33] = {"IF", 2, IF},
+    [34] = {"ELSE", 4, ELSE},
+    [37] = {"WHILE", 5, WHILE},
+    [42] = {"VOID", 4, VOID},
+    [48] = {"EQ", 2, EQ},
+    [49] = {"ARROW", 5, ARROW},
+    [53] = {"SMILE", 5, SMILE},
+    [55] = {"NONE", 4, NONE},
+    [60] = {"ENTER", 5, ENTER},
+    [67] = {"GTE", 3, GTE},
+    [69] = {"MINUS", 5, MINUS},
+    [72] = {"LTE", 3, LTE},
+    [74] = {"LPAR", 4, LPAR},
+    [76] = {"ERROR", 5, ERROR},
+    [80] = {"RPAR", 4, RPAR},
+    [82] = {"RETURN", 6, RETURN},
+    [83] = {"PLUS", 4, PLUS},
+    [89] = {"COMMA", 5, COMMA},
+    [97] = {"STAR", 4, STAR},
+    [98] = {"NUMBER", 6, NUMBER},
+    [101] = {"OVER", 4, OVER},
+    [104] = {"SEMI", 4, SEMI},
+    [106] = {"COMMENT", 7, COMMENT},
+    [107] = {"NUMBER:", 7, NUMBER},
+    [108] = {"STRING:", 7, STRING},
+    [111] = {"ID", 2, ID},
+    [118] = {"NUM", 3, NUM},
+    [121] = {"ASSIGN", 6, ASSIGN},
+    [124] = {"STRING", 6, STRING},
+    [125] = {"GT", 2, GT},
+};
+
+/* The longest name of typeSlots */
+#define TYPE_NAME_MAX 7
+
+static unsigned int type_slot(const char * s, size_t n) {
+    return ((unsigned char) s[0] + 4u * (unsigned char) s[1] + 21u * (unsigned char) s[n - 1] + (unsigned int) n) & (TYPE_SLOTS - 1);
+}
+
+/* The type of a type name of n characters; NONE, as for the name NONE, when there is no such name */
+static TokenType type_of_name(const char * s, size_t n) {
+    const TypeName * t;
+    if (n < 2 || n > TYPE_NAME_MAX)
+        return NONE;
+    t = &typeSlots[type_slot(s, n)];
+    if (t->name == NULL || t->length != n || memcmp(t->name, s, n) != 0)
+        return NONE;
+    return (TokenType) t->type;
+}
+
+typedef struct {
+    char * text;        /* the whole file */
+    size_t length;
+    size_t pos;
+    int line;           /* the line of the file at pos */
+} Reader;
+
+/* Read all of fp into r. <Return:> 0 when memory runs out. */
+static int read_all(Reader * r, FILE * fp) {
+    size_t capacity = 0, n;
+    r->text = NULL;
+    r->length = 0;
+    r->pos = 0;
+    r->line = 1;
+    do {
+        if (capacity - r->length < READ_BLOCK) {
+            char * more = (char *) realloc(r->text, capacity + READ_BLOCK);
+            if (more == NULL)
+                return 0;
+            r->text = more;
+            capacity += READ_BLOCK;
+        }
+        n = fread(r->text + r->length, 1, capacity - r->length, fp);
+        r->length += n;
+    } while (n > 0);
+    return 1;
+}
+
+static void skip_space(Reader * r) {
+    while (r->pos < r->length && isspace((unsigned char) r->text[r->pos])) {
+        if (r->text[r->pos] == '\n')
+            r->line++;
+        r->pos++;
+    }
+}
+
+/* Skip a number, as scanf("%d") does. <Return:> 0 when there is none. */
+static int skip_number(Reader * r) {
+    size_t begin;
+    skip_space(r);
+    if (r->pos < r->length && (r->text[r->pos] == '-' || r->text[r->pos] == '+'))
+        r->pos++;
+    begin = r->pos;
+    while (r->pos < r->length && isdigit((unsigned char) r->text[r->pos]))
+        r->pos++;
+    return r->pos > begin;
+}
+
+/* The next word, of at most WORD_MAX characters, in *word and *n. <Return:> 0 at the end of the file. */
+static int read_word(Reader * r, const char ** word, size_t * n) {
+    size_t begin;
+    skip_space(r);
+    begin = r->pos;
+    while (r->pos < r->length && r->pos - begin < WORD_MAX && !isspace((unsigned char) r->text[r->pos]))
+        r->pos++;
+    *word = r->text + begin;
+    *n = r->pos - begin;
+    return *n > 0;
+}
+
+/* The rest of the line, without its '\n', of at most STRING_MAX characters. <Return:> 0 at the end of the file. */
+static int read_rest(Reader * r, const char ** rest, size_t * n) {
+    size_t begin = r->pos;
+    if (r->pos >= r->length)
+        return 0;
+    while (r->pos < r->length && r->pos - begin < STRING_MAX && r->text[r->pos] != '\n')
+        r->pos++;
+    *rest = r->text + begin;
+    *n = r->pos - begin;
+    if (r->pos < r->length && r->pos - begin < STRING_MAX) {
+        r->pos++;
+        r->line++;
+    }
+    return 1;
+}
+
+/* Write the token as a line of a token list shows it, without the line number */
+static void put_token(FILE * fp, const Token * t) {
+    const char * name = t->type >= NONE && t->type <= EOP ? typeNames[t->type] : "";
+    fputs(name, fp);
+    if (t->type == ID || t->type == NUMBER || t->type == STRING) {
+        fputs(": ", fp);
+        fputs(t->string != NULL ? t->string : "(null)", fp);
+    }
+}
+
+/* Print "A token is read, which is: " and the token, whose string has length characters, in one write */
+static void echo(const Token * t, size_t length) {
+    static const char prefix[] = "A token is read, which is: ";
+    char line[sizeof(prefix) + TYPE_NAME_MAX + 2 + WORD_MAX + 1];
+    const char * name = typeNames[t->type];
+    size_t n = sizeof(prefix) - 1, k = strlen(name);
+
+    memcpy(line, prefix, n);
+    memcpy(line + n, name, k);
+    n += k;
+    if (t->type == ID || t->type == NUMBER || t->type == STRING) {
+        line[n++] = ':';
+        line[n++] = ' ';
+        memcpy(line + n, t->string, length);
+        n += length;
+    }
+    line[n++] = '\n';
+    fwrite(line, 1, n, stdout);
+}
+
+/* Read the next token of r into list and echo it. <Return:> NULL at the end of the file, or after an error. */
+static Token * read_token(Reader * r, TokenList * list) {
+    const char * word;
+    const char * s = NULL;
+    size_t n, length = 0;
+    TokenType type;
+    Token * t;
+
+    if (!skip_number(r))
+        printf("Error of reading a lineNumber at line %d\n", r->line);
+    if (!read_word(r, &word, &n))
+        return NULL;
+    type = type_of_name(word, n);
+    if (type == NONE) {
+        printf("Error, token type not recognized at line %d: %.*s\n", r->line, (int) n, word);
+        return NULL;
+    }
+    if (type == ID || type == NUMBER) {
+        if (!read_word(r, &s, &length)) {
+            printf("Error, token string of ID or Number is not found at line %d\n", r->line);
+            return NULL;
+        }
+    } else if (type == STRING && !read_rest(r, &s, &length)) {
+        printf("Error, token string of STRING is not found at line %d\n", r->line);
+        return NULL;
+    }
+    t = token_list_append(list, type, s, length);
+    if (t == NULL) {
+        printf("Out of memory while reading the token list at line %d\n", r->line);
+        return NULL;
+    }
+    echo(t, length);
+    return t;
+}
+
+TokenList read_token_list(FILE * fp) {
+    TokenList list = {NULL, NULL, NULL};
+    Reader r;
+    Token * t;
+
+    if (fp == NULL)
+        return list;
+    if (!read_all(&r, fp)) {
+        puts("Out of memory while reading the token list");
+        free(r.text);
+        return list;
+    }
+    while ((t = read_token(&r, &list)) != NULL && t->type != EOP)
+        ;
+    free(r.text);
+    return list;
+}
+
+void print_token_list(FILE * fp, TokenList list) {
+    TokenNode * n = list.head;
+    int line = 1;
+    if (n == NULL)
+        printf("token list is empty\n");
+    for (; n != NULL; n = n->next) {
+        fprintf(fp, "%d ", line);
+        put_token(fp, n->token);
+        fputc('\n', fp);
+        if (n->token->type == ENTER)
+            line++;
+    }
+}
@@ -0,0 +1,451 @@
+/****************************************************
+ File: token_buffer.c
+
+ Struct-of-arrays token buffer, see token_buffer.h
+****************************************************/
+
+#include "libs.h"
+#include "token_buffer.h"
+
+#define INITIAL_TOKENS 1024
+
+/* Each array has one slot in front of token 0 and TOKEN_LOOKAHEAD slots after the last token */
+#define SLOTS(capacity) ((capacity) + 1 + TOKEN_LOOKAHEAD)
+
+void token_buffer_init(TokenBuffer * b) {
+    b->types = NULL;
+    b->offsets = NULL;
+    b->lengths = NULL;
+    b->lines = NULL;
+    b->count = 0;
+    b->capacity = 0;
+    b->text = NULL;
+    b->pool = NULL;
+    b->poolLength = 0;
+    b->poolCapacity = 0;
+}
+
+void token_buffer_release(TokenBuffer * b) {
+    if (b->capacity > 0) {
+        free(b->types - 1);
+        free(b->offsets - 1);
+        free(b->lengths - 1);
+        free(b->lines - 1);
+    }
+    free(b->pool);
+    token_buffer_init(b);
+}
+
+/* realloc the array whose token 0 is at p, keeping the slot in front of it */
+static void * grow_array(void * p, size_t elementSize, size_t capacity) {
+    char * base = p == NULL ? NULL : (char *) p - elementSize;
+    base = (char *) realloc(base, SLOTS(capacity) * elementSize);
+    return base == NULL ? NULL : base + elementSize;
+}
+
+/* Make room for capacity tokens; the tokens stay in the slots they are in */
+static int grow_to(TokenBuffer * b, size_t capacity) {
+    unsigned char * types = (unsigned char *) grow_array(b->types, sizeof(unsigned char), capacity);
+    unsigned int * offsets;
+    unsigned int * lengths;
+    int * lines;
+    if (types == NULL)
+        return 0;
+    b->types = types;
+    offsets = (unsigned int *) grow_array(b->offsets, sizeof(unsigned int), capacity);
+    if (offsets == NULL)
+        return 0;
+    b->offsets = offsets;
+    lengths = (unsigned int *) grow_array(b->lengths, sizeof(unsigned int), capacity);
+    if (lengths == NULL)
+        return 0;
+    b->lengths = lengths;
+    lines = (int *) grow_array(b->lines, sizeof(int), capacity);
+    if (lines == NULL)
+        return 0;
+    b->lines = lines;
+    if (b->capacity == 0) {
+        /* the slot in front of token 0, read as the previous token of the first one */
+        b->types[-1] = NONE;
+        b->offsets[-1] = NO_LEXEME;
+        b->lengths[-1] = 0;
+        b->lines[-1] = 1;
+    }
+    b->capacity = capacity;
+    return 1;
+}
+
+static int grow(TokenBuffer * b) {
+    return grow_to(b, b->capacity == 0 ? INITIAL_TOKENS : b->capacity * 2);
+}
+
+/* The TOKEN_LOOKAHEAD slots after the last token read EOP */
+static void pad(TokenBuffer * b) {
+    int k;
+    for (k = 0; k < TOKEN_LOOKAHEAD; k++) {
+        b->types[b->count + k] = EOP;
+        b->offsets[b->count + k] = NO_LEXEME;
+        b->lengths[b->count + k] = 0;
+        b->lines[b->count + k] = b->lines[b->count - 1];
+    }
+}
+
+int token_buffer_push(TokenBuffer * b, TokenType type, unsigned int offset, unsigned int length, int line) {
+    size_t i = b->count;
+    int k;
+    if (i == b->capacity && !grow(b))
+        return 0;
+    b->types[i] = (unsigned char) type;
+    b->offsets[i] = offset;
+    b->lengths[i] = length;
+    b->lines[i] = line;
+    b->count++;
+    /* lookahead past the end reads EOP */
+    for (k = 0; k < TOKEN_LOOKAHEAD; k++) {
+        b->types[b->count + k] = EOP;
+        b->offsets[b->count + k] = NO_LEXEME;
+        b->lengths[b->count + k] = 0;
+        b->lines[b->count + k] = line;
+    }
+    return 1;
+}
+
+int token_buffer_scan(TokenBuffer * b, const char * text, size_t length) {
+    size_t pos = 0, begin, end, i;
+    int line = 1;
+    TokenType type;
+
+    /* offsets are 32 bits */
+    if (length >= NO_LEXEME)
+        return 0;
+    b->text = text;
+    do {
+        type = scan_token(text, length, &pos, &begin, &end);
+        if (type == COMMENT || type == ERROR) {
+            /* a comment, or an unterminated one, may span lines */
+            for (i = begin; i < end; i++)
+                if (text[i] == '\n')
+                    line++;
+            if (type == COMMENT)
+                continue;
+        }
+        if (!token_buffer_push(b, type, (unsigned int) begin, (unsigned int) (end - begin), line))
+            return 0;
+        if (type == ENTER)
+            line++;
+    } while (type != EOP);
+    return 1;
+}
+
+int token_gap_scan(TokenGap * g, const char * text, size_t length) {
+    token_buffer_init(&g->tokens);
+    g->back = 0;
+    g->length = length;
+    g->lastLine = 1;
+    g->moved = 0;
+    if (!token_buffer_scan(&g->tokens, text, length))
+        return 0;
+    g->back = g->tokens.capacity;
+    g->lastLine = g->tokens.lines[g->tokens.count - 1];
+    return 1;
+}
+
+void token_gap_release(TokenGap * g) {
+    token_buffer_release(&g->tokens);
+    g->back = 0;
+    g->length = 0;
+    g->lastLine = 1;
+}
+
+/* Token i of g, with its offset and line as they are in the text */
+static void gap_token(const TokenGap * g, size_t i, TokenType * type, unsigned int * offset, unsigned int * length, int * line) {
+    const TokenBuffer * b = &g->tokens;
+    if (i < b->count) {
+        *type = (TokenType) b->types[i];
+        *offset = b->offsets[i];
+        *length = b->lengths[i];
+        *line = b->lines[i];
+    } else {
+        size_t slot = g->back + (i - b->count);
+        *type = (TokenType) b->types[slot];
+        *offset = b->offsets[slot] == NO_LEXEME ? NO_LEXEME : (unsigned int) g->length - b->offsets[slot];
+        *length = b->lengths[slot];
+        *line = g->lastLine - b->lines[slot];
+    }
+}
+
+void token_gap_move(TokenGap * g, size_t at) {
+    TokenBuffer * b = &g->tokens;
+    while (b->count < at) {
+        size_t i = b->count, slot = g->back;
+        b->types[i] = b->types[slot];
+        b->offsets[i] = b->offsets[slot] == NO_LEXEME ? NO_LEXEME : (unsigned int) g->length - b->offsets[slot];
+        b->lengths[i] = b->lengths[slot];
+        b->lines[i] = g->lastLine - b->lines[slot];
+        b->count++;
+        g->back++;
+        g->moved++;
+    }
+    while (b->count > at) {
+        size_t i, slot;
+        b->count--;
+        g->back--;
+        g->moved++;
+        i = b->count;
+        slot = g->back;
+        b->types[slot] = b->types[i];
+        b->offsets[slot] = b->offsets[i] == NO_LEXEME ? NO_LEXEME : (unsigned int) g->length - b->offsets[i];
+        b->lengths[slot] = b->lengths[i];
+        b->lines[slot] = g->lastLine - b->lines[i];
+    }
+    if (g->back == b->capacity && b->count > 0)
+        pad(b);
+}
+
+int token_gap_line(const TokenGap * g, size_t i) {
+    TokenType type;
+    unsigned int offset, length;
+    int line;
+    gap_token(g, i, &type, &offset, &length, &line);
+    return line;
+}
+
+int token_gap_copy(const TokenGap * g, size_t from, size_t n, TokenBuffer * b) {
+    size_t i;
+    for (i = from; i < from + n; i++) {
+        TokenType type;
+        unsigned int offset, length;
+        int line;
+        gap_token(g, i, &type, &offset, &length, &line);
+        if (!token_buffer_push(b, type, offset, length, line))
+            return 0;
+    }
+    return 1;
+}
+
+/* Make the gap at least n tokens wide, moving the tokens after it to the end of the larger arrays */
+static int widen_gap(TokenGap * g, size_t n) {
+    TokenBuffer * b = &g->tokens;
+    size_t after = b->capacity - g->back, capacity = b->capacity == 0 ? INITIAL_TOKENS : b->capacity;
+    while (capacity - after - b->count < n)
+        capacity *= 2;
+    if (capacity == b->capacity)
+        return 1;
+    if (!grow_to(b, capacity))
+        return 0;
+    /* grow_to() set the new capacity only when every array has grown */
+    memmove(b->types + capacity - after, b->types + g->back, after * sizeof(unsigned char));
+    memmove(b->offsets + capacity - after, b->offsets + g->back, after * sizeof(unsigned int));
+    memmove(b->lengths + capacity - after, b->lengths + g->back, after * sizeof(unsigned int));
+    memmove(b->lines + capacity - after, b->lines + g->back, after * sizeof(int));
+    g->back = capacity - after;
+    return 1;
+}
+
+int token_gap_rescan(TokenGap * g, const char * text, size_t length, const TextEdit * edit, TokenChange * change) {
+    TokenBuffer * b = &g->tokens;
+    long delta = (long) edit->newEnd - (long) edit->oldEnd;
+    size_t count = TOKEN_GAP_COUNT(g), first, j, m, i, pos, begin, end, lo, hi;
+    int line, lineDelta = 0;
+    TokenType type;
+    TokenBuffer fresh;
+
+    if (length >= NO_LEXEME || count == 0)
+        return 0;
+    /* first: the first token that ends at or after the start of the edit, since typing
+       right after a token can extend it. The offsets grow with the index, and EOP ends
+       at the end of the old text, so it is found. */
+    lo = 0;
+    hi = count - 1;
+    while (lo < hi) {
+        size_t mid = lo + (hi - lo) / 2;
+        TokenType t;
+        unsigned int offset, len;
+        int l;
+        gap_token(g, mid, &t, &offset, &len, &l);
+        if (offset + len >= edit->start)
+            hi = mid;
+        else
+            lo = mid + 1;
+    }
+    first = lo;
+    token_gap_move(g, first);
+    /* scanning starts right after the token before, where the scanner starts from scratch */
+    pos = first == 0 ? 0 : b->offsets[first - 1] + b->lengths[first - 1];
+    line = first == 0 ? 1 : b->lines[first - 1] + (b->types[first - 1] == ENTER);
+
+    token_buffer_init(&fresh);
+    j = first;
+    change->scanned = 0;
+    for (;;) {
+        type = scan_token(text, length, &pos, &begin, &end);
+        change->scanned++;
+        if (type == COMMENT || type == ERROR) {
+            for (i = begin; i < end; i++)
+                if (text[i] == '\n')
+                    line++;
+            if (type == COMMENT)
+                continue;
+        }
+        if (begin >= edit->newEnd) {
+            /* the text from begin on is the old text from begin - delta on */
+            size_t old = (size_t) ((long) begin - delta);
+            while (j < count && g->length - b->offsets[g->back + (j - first)] < old)
+                j++;
+            if (j < count && g->length - b->offsets[g->back + (j - first)] == old) {
+                lineDelta = line - (g->lastLine - b->lines[g->back + (j - first)]);
+                break;
+            }
+        }
+        if (!token_buffer_push(&fresh, type, (unsigned int) begin, (unsigned int) (end - begin), line)) {
+            token_buffer_release(&fresh);
+            return 0;
+        }
+        if (type == ENTER)
+            line++;
+        if (type == EOP) {
+            /* not reached: EOP starts where the old EOP did */
+            j = count;
+            break;
+        }
+    }
+
+    /* replace the old tokens first .. j-1, the first ones after the gap, with the m fresh ones */
+    m = fresh.count;
+    if (!widen_gap(g, m > j - first ? m - (j - first) : 0)) {
+        token_buffer_release(&fresh);
+        return 0;
+    }
+    g->back += j - first;
+    if (m > 0) {
+        memcpy(b->types + first, fresh.types, m * sizeof(unsigned char));
+        memcpy(b->offsets + first, fresh.offsets, m * sizeof(unsigned int));
+        memcpy(b->lengths + first, fresh.lengths, m * sizeof(unsigned int));
+        memcpy(b->lines + first, fresh.lines, m * sizeof(int));
+    }
+    token_buffer_release(&fresh);
+    b->count = first + m;
+    b->text = text;
+    g->length = length;
+    /* the tokens after the gap are counted from the end, and so need no change */
+    if (g->back == b->capacity) {
+        g->lastLine = b->lines[b->count - 1];
+        pad(b);
+    } else
+        g->lastLine += lineDelta;
+
+    change->first = first;
+    change->oldEnd = j;
+    change->newEnd = first + m;
+    change->lineDelta = lineDelta;
+    return 1;
+}
+
+/* Copy len characters into the pool, followed by '\0'. Returns the offset, or NO_LEXEME when memory runs out. */
+static unsigned int pool_add(TokenBuffer * b, const char * s, size_t len) {
+    unsigned int offset;
+    if (b->poolLength + len + 1 > b->poolCapacity) {
+        size_t capacity = b->poolCapacity == 0 ? 4096 : b->poolCapacity;
+        char * pool;
+        while (b->poolLength + len + 1 > capacity)
+            capacity *= 2;
+        pool = (char *) realloc(b->pool, capacity);
+        if (pool == NULL)
+            return NO_LEXEME;
+        b->pool = pool;
+        b->poolCapacity = capacity;
+    }
+    offset = (unsigned int) b->poolLength;
+    memcpy(b->pool + offset, s, len);
+    b->pool[offset + len] = '\0';
+    b->poolLength += len + 1;
+    return offset;
+}
+
+int token_buffer_from_list(TokenBuffer * b, TokenList list) {
+    TokenNode * n;
+    int line = 1;
+    TokenType type = NONE;
+
+    for (n = list.head; n != NULL; n = n->next) {
+        const char * s = n->token->string;
+        unsigned int offset = NO_LEXEME, length = 0;
+        type = n->token->type;
+        if (s != NULL) {
+            length = (unsigned int) strlen(s);
+            offset = pool_add(b, s, length);
+            if (offset == NO_LEXEME)
+                return 0;
+        }
+        if (!token_buffer_push(b, type, offset, length, line))
+            return 0;
+        if (type == ENTER)
+            line++;
+        if (type == EOP)
+            break;
+    }
+    if (type != EOP && !token_buffer_push(b, EOP, NO_LEXEME, 0, line))
+        return 0;
+    b->text = b->pool;
+    return 1;
+}
+
+TokenList token_buffer_to_list(const TokenBuffer * b) {
+    TokenList list = {NULL, NULL, NULL};
+    size_t i;
+
+    for (i = 0; i < b->count; i++) {
+        if (token_list_append(&list, (TokenType) b->types[i], TOKEN_TEXT(b, i), b->lengths[i]) == NULL) {
+            /* nothing of a part of the list is kept */
+            token_list_free(list);
+            list.head = NULL;
+            list.tail = NULL;
+            list.store = NULL;
+            return list;
+        }
+    }
+    return list;
+}
+
+/* A token of a list, allocated with its node and followed by its string */
+typedef struct {
+    TokenNode node;
+    Token token;
+} ListedToken;
+
+Token * token_list_append(TokenList * list, TokenType type, const char * s, size_t n) {
+    ListedToken * e;
+    char * string = NULL;
+    if (list->store == NULL) {
+        list->store = (Arena *) malloc(sizeof(Arena));
+        if (list->store == NULL)
+            return NULL;
+        arena_init(list->store);
+    }
+    e = (ListedToken *) arena_alloc(list->store, sizeof(ListedToken) + (s != NULL ? n + 1 : 0));
+    if (e == NULL)
+        return NULL;
+    if (s != NULL) {
+        string = (char *) (e + 1);
+        memcpy(string, s, n);
+        string[n] = '\0';
+    }
+    e->token.type = type;
+    e->token.string = string;
+    e->node.token = &e->token;
+    e->node.next = NULL;
+    e->node.prev = list->tail;
+    if (list->tail == NULL)
+        list->head = &e->node;
+    else
+        list->tail->next = &e->node;
+    list->tail = &e->node;
+    return &e->token;
+}
+
+void token_list_free(TokenList list) {
+    if (list.store != NULL) {
+        arena_release(list.store);
+        free(list.store);
+    }
+}
@@ -0,0 +1,138 @@
+/****************************************************
+ File: token_buffer.h
+
+ A contiguous token buffer, kept as parallel arrays
+ (struct of arrays): the parser reads the type of the
+ token k steps ahead as types[pos + k], and the other
+ arrays are only touched when a lexeme or a line
+ number is needed.
+
+ The lexeme of token i is the length[i] characters at
+ text + offset[i]. When the tokens come from the
+ scanner, text is the source itself and nothing is
+ copied. When they come from a TokenList, the lexemes
+ are copied once into a text pool owned by the buffer.
+****************************************************/
+
+#ifndef _TOKEN_BUFFER_H_
+#define _TOKEN_BUFFER_H_
+
+#include <stddef.h>
+#include "scan.h"
+
+/* offset of a token that has no lexeme, such as a token of a TokenList whose string is NULL */
+#define NO_LEXEME 0xFFFFFFFFu
+
+/* Number of EOP tokens kept after the last token, so that a lookahead of up to
+   TOKEN_LOOKAHEAD tokens never needs a bounds check. types[-1] is NONE for the same reason. */
+#define TOKEN_LOOKAHEAD 4
+
+typedef struct {
+    unsigned char * types;   /* TokenType of each token */
+    unsigned int * offsets;  /* start of the lexeme in text, or NO_LEXEME */
+    unsigned int * lengths;  /* length of the lexeme */
+    int * lines;             /* source line of each token, starting at 1 */
+    size_t count;            /* number of tokens, including the final EOP */
+    size_t capacity;
+
+    const char * text;       /* the characters the offsets refer to */
+    char * pool;             /* text owned by the buffer, or NULL when text is the caller's */
+    size_t poolLength;
+    size_t poolCapacity;
+} TokenBuffer;
+
+/* An edit of a text: the bytes start .. oldEnd-1 of the old text were replaced,
+   and the replacement is the bytes start .. newEnd-1 of the new text. */
+typedef struct {
+    size_t start;
+    size_t oldEnd;
+    size_t newEnd;
+} TextEdit;
+
+/* The tokens first .. oldEnd-1 of a buffer were replaced by the tokens first .. newEnd-1.
+   The tokens after them are the old ones, moved, on lines lineDelta further. */
+typedef struct {
+    size_t first;
+    size_t oldEnd;
+    size_t newEnd;
+    int lineDelta;
+    size_t scanned;     /* tokens the scanner made, the ones kept included */
+} TokenChange;
+
+/* The tokens of a text that is edited again and again, with a gap at the last edit.
+   The tokens before the gap are those of tokens, tokens.count of them. The tokens after
+   it are at the end of the same arrays, in the slots back .. tokens.capacity-1, with
+   their offsets counted back from the end of the text and their lines back from the line
+   of the final EOP: an edit before them leaves them as they are. So an edit only rewrites
+   the tokens it replaces, and those the gap moves over on its way from the last edit. */
+typedef struct {
+    TokenBuffer tokens;
+    size_t back;        /* slot of the first token after the gap */
+    size_t length;      /* of the text */
+    int lastLine;       /* the line of the final EOP */
+    size_t moved;       /* tokens moved over by the gap so far */
+} TokenGap;
+
+void token_buffer_init(TokenBuffer * b);
+
+/* Free the arrays and the pool of the buffer and make it empty */
+void token_buffer_release(TokenBuffer * b);
+
+/* Append a token; returns 0 when memory runs out */
+int token_buffer_push(TokenBuffer * b, TokenType type, unsigned int offset, unsigned int length, int line);
+
+/* Scan the length characters at text into the buffer, COMMENT tokens are dropped.
+ * The lexemes point into text, which must live as long as the buffer is used.
+ * Returns 0 when memory runs out, or when text is 4 GiB or longer. */
+int token_buffer_scan(TokenBuffer * b, const char * text, size_t length);
+
+/* Scan the length characters at text into g, as token_buffer_scan() does. The gap is after the last token,
+ * so g->tokens is an ordinary buffer of them until the gap moves. */
+int token_gap_scan(TokenGap * g, const char * text, size_t length);
+
+void token_gap_release(TokenGap * g);
+
+/* The number of tokens, including the final EOP */
+#define TOKEN_GAP_COUNT(g) ((g)->tokens.count + (g)->tokens.capacity - (g)->back)
+
+/* Move the gap in front of token at */
+void token_gap_move(TokenGap * g, size_t at);
+
+/* The line of token i */
+int token_gap_line(const TokenGap * g, size_t i);
+
+/* Append the tokens from .. from+n-1 of g to b, with their offsets and lines as they are.
+ * <Return:> 0 when memory runs out. */
+int token_gap_copy(const TokenGap * g, size_t from, size_t n, TokenBuffer * b);
+
+/* g holds the scanned tokens of a text, and text is that text after edit. Move the gap to the
+ * edit and scan again from the token before it only until the scanner starts a token at the
+ * same place of the text as an old token did; from there on the old tokens are kept.
+ * *change receives the tokens replaced. Returns 0 when memory runs out, and then the tokens are
+ * unchanged, with the gap moved. */
+int token_gap_rescan(TokenGap * g, const char * text, size_t length, const TextEdit * edit, TokenChange * change);
+
+/* Adapter for TokenList callers: copy the types and lexemes of a token list into the buffer.
+ * Line numbers are counted from the ENTER tokens, as print_token_list() does.
+ * A list that does not end with EOP gets one. */
+int token_buffer_from_list(TokenBuffer * b, TokenList list);
+
+/* Build a TokenList with the same tokens, for code that still walks TokenNodes.
+ * Tokens without a lexeme get a NULL string, like the tokens of read_token_list().
+ * <Return:> an empty list when memory runs out. */
+TokenList token_buffer_to_list(const TokenBuffer * b);
+
+/* Append a token of type to list, with a copy of the n characters at s, or with a NULL string
+ * when s is NULL. The node, the token and the string are one allocation from the store of the list.
+ * <Return:> the token, or NULL when memory runs out. */
+Token * token_list_append(TokenList * list, TokenType type, const char * s, size_t n);
+
+/* Free a list of token_list_append(), as scan(), read_token_list() and token_buffer_to_list() make
+ * them, by releasing its store */
+void token_list_free(TokenList list);
+
+/* The lexeme of token i, or NULL when it has none. It is not '\0' terminated in general. */
+#define TOKEN_TEXT(b, i) ((b)->offsets[i] == NO_LEXEME ? NULL : (b)->text + (b)->offsets[i])
+#define TOKEN_LENGTH(b, i) ((b)->lengths[i])
+
+#endif
@@ -0,0 +1,351 @@
+/****************************************************
+ File: typecheck.c
+
+ The semantic pass, see typecheck.h
+****************************************************/
+
+#include "libs.h"
+#include "typecheck.h"
+#include "symtab.h"
+#include "util.h"
+
+#include <stdarg.h>
+
+/* An entry of the explicit stack of an expression: a node, and whether its children are pushed */
+typedef struct {
+    TreeNode * node;
+    int visited;
+} CheckItem;
+
+typedef struct {
+    SymbolTable symbols;
+    DiagnosticList * diagnostics;
+    TypeCheckStats stats;
+    TreeNode * function;  /* the FUN_DCL being checked, or NULL at the top level */
+    CheckItem * stack;
+    size_t capacity;
+} Checker;
+
+static const char * type_name(ExprType type) {
+    switch (type) {
+        case VOID_TYPE: return "void";
+        case NUM_TYPE: return "num";
+        case INT_TYPE: return "int";
+        case ADDR_TYPE: return "address";
+        default: return "unknown";
+    }
+}
+
+static const char * op_name(TokenType op) {
+    switch (op) {
+        case PLUS: return "+";
+        case MINUS: return "-";
+        case STAR: return "*";
+        case OVER: return "/";
+        case MOD: return "%";
+        case LT: return "<";
+        case LTE: return "<=";
+        case GT: return ">";
+        case GTE: return ">=";
+        case EQ: return "==";
+        case NEQ: return "!=";
+        case ASSIGN: return "=";
+        default: return "?";
+    }
+}
+
+static const char * show(const char * name) {
+    return name != NULL ? name : "(null)";
+}
+
+static void semanticError(Checker * c, int lineno, const char * format, ...) {
+    char message[512];
+    va_list args;
+    va_start(args, format);
+    vsnprintf(message, sizeof(message), format, args);
+    va_end(args);
+    diagnostic_list_add(c->diagnostics, lineno, "\n>>> Semantic error at line %d: %s\n", lineno, message);
+    c->stats.errors++;
+}
+
+/* The type of the value of a name declared by decl */
+static ExprType declared_type(const TreeNode * decl) {
+    if (decl->nodeKind == PARAM_ND)
+        return decl->kind.param == ARRAY_PARAM ? ADDR_TYPE : decl->attr.dclAttr.type;
+    return decl->kind.dcl == ARRAY_DCL ? ADDR_TYPE : decl->attr.dclAttr.type;
+}
+
+static int declare(Checker * c, TreeNode * decl) {
+    TreeNode * previous;
+    if (decl->attr.dclAttr.name == NULL)
+        return 1;      /* after a syntax error */
+    if (!symtab_declare(&c->symbols, decl->attr.dclAttr.name, decl, &previous))
+        return 0;
+    if (previous != NULL)
+        semanticError(c, decl->lineNum, "%s is already declared at line %d", decl->attr.dclAttr.name, previous->lineNum);
+    else
+        c->stats.declarations++;
+    if (decl->attr.dclAttr.type == VOID_TYPE
+        && ((decl->nodeKind == DCL_ND && decl->kind.dcl == VAR_DCL) || (decl->nodeKind == PARAM_ND && decl->kind.param == VAR_PARAM)))
+        semanticError(c, decl->lineNum, "%s is declared void", decl->attr.dclAttr.name);
+    return 1;
+}
+
+/* TRUE for a name that is not declared, whose type is not known: it is reported once, where it is used */
+static int unknown(const TreeNode * t) {
+    return t->nodeKind == EXPR_ND && (t->kind.expr == ID_EXPR || t->kind.expr == CALL_EXPR)
+        && t->attr.exprAttr.name != NULL && t->something == NULL;
+}
+
+/* Bind the ID_EXPR or CALL_EXPR t to its declaration and give it its type */
+static void resolve(Checker * c, TreeNode * t) {
+    const char * name = t->attr.exprAttr.name;
+    TreeNode * decl = name != NULL ? symtab_lookup(&c->symbols, name) : NULL;
+    int call = t->kind.expr == CALL_EXPR;
+    TreeNode * param;
+    TreeNode * arg;
+    int n, k;
+
+    t->type = NUM_TYPE;
+    if (name == NULL)
+        return;
+    if (decl == NULL) {
+        semanticError(c, t->lineNum, call ? "function %s is not declared" : "%s is not declared", name);
+        return;
+    }
+    t->something = decl;
+    c->stats.resolved++;
+    if (!call) {
+        if (decl->nodeKind == DCL_ND && decl->kind.dcl == FUN_DCL)
+            semanticError(c, t->lineNum, "function %s is used as a variable", name);
+        else
+            t->type = declared_type(decl);
+        return;
+    }
+    if (decl->nodeKind != DCL_ND || decl->kind.dcl != FUN_DCL) {
+        semanticError(c, t->lineNum, "%s is not a function", name);
+        return;
+    }
+    t->type = decl->attr.dclAttr.type;
+
+    /* the arguments against the parameters; (void) leaves no parameter, or a VOID_PARAM one */
+    param = decl->child[0];
+    if (param != NULL && param->kind.param == VOID_PARAM)
+        param = NULL;
+    for (arg = t->child[0], k = 1; arg != NULL && param != NULL; arg = arg->rSibling, param = param->rSibling, k++) {
+        ExprType expected = declared_type(param);
+        if (arg->type != expected && !unknown(arg))
+            semanticError(c, arg->lineNum, "argument %d of %s is %s, not %s", k, name, type_name(arg->type), type_name(expected));
+    }
+    if (arg != NULL || param != NULL) {
+        for (n = k - 1; arg != NULL; arg = arg->rSibling)
+            n++;
+        for (k = k - 1; param != NULL; param = param->rSibling)
+            k++;
+        semanticError(c, t->lineNum, "%s takes %d arguments, not %d", name, k, n);
+    }
+}
+
+/* Type the operator t, an OP_EXPR or an ASSIGN_STMT, whose operands are typed already */
+static void type_operator(Checker * c, TreeNode * t) {
+    const TreeNode * a = t->child[0];
+    const TreeNode * b = t->child[1];
+    TokenType op = t->attr.exprAttr.op;
+    ExprType x, y;
+    int ok;
+
+    t->type = NUM_TYPE;
+    if (a == NULL || b == NULL || unknown(a) || unknown(b))
+        return;      /* after a syntax error, or an error reported already */
+    x = a->type;
+    y = b->type;
+    switch (op) {
+        case LBR:
+            if (x != ADDR_TYPE)
+                semanticError(c, t->lineNum, "a %s value is indexed", type_name(x));
+            if (y != NUM_TYPE)
+                semanticError(c, t->lineNum, "an index is %s, not num", type_name(y));
+            return;
+        case ASSIGN:
+            t->type = x;
+            if (x != y)
+                semanticError(c, t->lineNum, "a %s value is assigned to %s", type_name(y), type_name(x));
+            return;
+        case PLUS:
+            ok = (x == NUM_TYPE || y == NUM_TYPE) && x != VOID_TYPE && y != VOID_TYPE;
+            if (ok && (x == ADDR_TYPE || y == ADDR_TYPE))
+                t->type = ADDR_TYPE;
+            break;
+        case MINUS:
+            ok = (x == NUM_TYPE || x == ADDR_TYPE) && (y == NUM_TYPE || y == x);
+            if (ok && x == ADDR_TYPE && y == NUM_TYPE)
+                t->type = ADDR_TYPE;
+            break;
+        case STAR:
+        case OVER:
+        case MOD:
+            ok = x == NUM_TYPE && y == NUM_TYPE;
+            break;
+        default:      /* the comparisons */
+            ok = x == y && x != VOID_TYPE;
+            break;
+    }
+    if (!ok)
+        semanticError(c, t->lineNum, "the operands of %s are %s and %s", op_name(op), type_name(x), type_name(y));
+}
+
+/* Resolve and type the expression tree, children before parents, without recursion */
+static int check_expression(Checker * c, TreeNode * tree) {
+    size_t top = 0;
+    if (tree == NULL)
+        return 1;
+    if (c->capacity == 0) {
+        c->stack = (CheckItem *) malloc(256 * sizeof(CheckItem));
+        if (c->stack == NULL)
+            return 0;
+        c->capacity = 256;
+    }
+    c->stack[top].node = tree;
+    c->stack[top].visited = FALSE;
+    top++;
+    while (top > 0) {
+        CheckItem * item = &c->stack[top - 1];
+        TreeNode * t = item->node;
+        int i;
+        if (item->visited) {
+            top--;
+            if (t->nodeKind == EXPR_ND && (t->kind.expr == ID_EXPR || t->kind.expr == CALL_EXPR))
+                resolve(c, t);
+            else if (t->nodeKind == EXPR_ND && t->kind.expr == CONST_EXPR)
+                t->type = NUM_TYPE;
+            else
+                type_operator(c, t);
+            continue;
+        }
+        item->visited = TRUE;
+        /* pushed so that child[0] and the first of each list of arguments come off first */
+        for (i = MAX_CHILDREN - 1; i >= 0; i--) {
+            size_t first = top, j;
+            TreeNode * q;
+            for (q = t->child[i]; q != NULL; q = q->rSibling) {
+                if (top == c->capacity) {
+                    CheckItem * more = (CheckItem *) realloc(c->stack, 2 * c->capacity * sizeof(CheckItem));
+                    if (more == NULL)
+                        return 0;
+                    c->stack = more;
+                    c->capacity *= 2;
+                }
+                c->stack[top].node = q;
+                c->stack[top].visited = FALSE;
+                top++;
+            }
+            for (j = 0; first + j < top - 1 - j; j++) {
+                CheckItem swap = c->stack[first + j];
+                c->stack[first + j] = c->stack[top - 1 - j];
+                c->stack[top - 1 - j] = swap;
+            }
+        }
+    }
+    return 1;
+}
+
+static int check_list(Checker * c, TreeNode * list);
+
+/* The statements of a block, in a scope of their own */
+static int check_block(Checker * c, TreeNode * list) {
+    int ok;
+    if (list == NULL)
+        return 1;
+    if (!symtab_open_scope(&c->symbols))
+        return 0;
+    ok = check_list(c, list);
+    symtab_close_scope(&c->symbols);
+    return ok;
+}
+
+static int check_function(Checker * c, TreeNode * t) {
+    TreeNode * outer = c->function;
+    TreeNode * p;
+    int ok = TRUE;
+
+    if (!declare(c, t) || !symtab_open_scope(&c->symbols))
+        return 0;
+    c->function = t;
+    for (p = t->child[0]; p != NULL && ok; p = p->rSibling)
+        if (p->nodeKind == PARAM_ND && p->kind.param != VOID_PARAM)
+            ok = declare(c, p);
+    /* the body is a FUNC_STMT, whose statements share the scope of the parameters */
+    if (ok && t->child[1] != NULL)
+        ok = check_list(c, t->child[1]->child[0]);
+    symtab_close_scope(&c->symbols);
+    c->function = outer;
+    return ok;
+}
+
+static int check_statement(Checker * c, TreeNode * t) {
+    TreeNode * value = t->child[0];
+    ExprType returns;
+
+    if (t->nodeKind == EXPR_ND)
+        return check_expression(c, t);
+    if (t->nodeKind == DCL_ND)
+        return t->kind.dcl == FUN_DCL ? check_function(c, t) : declare(c, t);
+    if (t->nodeKind != STMT_ND)
+        return 1;
+    switch (t->kind.stmt) {
+        case ASSIGN_STMT:
+            return check_expression(c, t);
+        case RTN_STMT:
+            if (!check_expression(c, value))
+                return 0;
+            if (c->function == NULL) {
+                semanticError(c, t->lineNum, "return is outside of a function");
+                return 1;
+            }
+            returns = c->function->attr.dclAttr.type;
+            if (value != NULL && returns == VOID_TYPE)
+                semanticError(c, t->lineNum, "%s returns void, but return has a value", show(c->function->attr.dclAttr.name));
+            else if (value == NULL && returns != VOID_TYPE)
+                semanticError(c, t->lineNum, "%s returns %s, but return has no value", show(c->function->attr.dclAttr.name),
+                              type_name(returns));
+            else if (value != NULL && value->type != returns && !unknown(value))
+                semanticError(c, t->lineNum, "%s returns %s, not %s", show(c->function->attr.dclAttr.name),
+                              type_name(returns), type_name(value->type));
+            return 1;
+        case SLCT_STMT:
+        case WHILE_STMT:
+            if (!check_expression(c, value))
+                return 0;
+            if (value != NULL && value->type == VOID_TYPE)
+                semanticError(c, t->lineNum, "the condition has no value");
+            return check_block(c, t->child[1]) && check_block(c, t->child[2]);
+        case CMPD_STMT:
+        case FUNC_STMT:
+            return check_block(c, value);
+        default:
+            return 1;
+    }
+}
+
+/* This recurses once per level of nested blocks, which the parser bounds */
+static int check_list(Checker * c, TreeNode * list) {
+    for (; list != NULL; list = list->rSibling)
+        if (!check_statement(c, list))
+            return 0;
+    return 1;
+}
+
+int typecheck_tree(TreeNode * tree, DiagnosticList * diagnostics, TypeCheckStats * stats) {
+    Checker c;
+    int ok;
+
+    memset(&c, 0, sizeof(Checker));
+    symtab_init(&c.symbols);
+    c.diagnostics = diagnostics;
+    ok = symtab_open_scope(&c.symbols) && check_list(&c, tree);
+    symtab_release(&c.symbols);
+    free(c.stack);
+    if (stats != NULL)
+        *stats = c.stats;
+    return ok;
+}
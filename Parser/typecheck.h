@@ -0,0 +1,53 @@
+/****************************************************
+ File: typecheck.h
+
+ The semantic pass over the tree of a program. It
+ resolves every ID_EXPR and CALL_EXPR to the node that
+ declares the name, a DCL_ND or a PARAM_ND, which it
+ puts in the something of the node, and sets the type
+ of every expression and assignment:
+
+   a constant, a num variable or parameter,
+   * / % and the comparisons            num
+   an array or a * variable or parameter  address
+   an index a[i]                          num
+   address + num, num + address,
+   address - num                          address
+   address - address                      num
+   a call                                 the type the
+                                          function returns
+   an assignment                          its left side
+
+ Names must be declared before they are used, once in
+ each scope. The parameters of a function and the
+ declarations of its body share one scope, and each
+ block of an if or a while opens a scope of its own.
+ Calls must give a function as many arguments as it
+ has parameters, of their types, and return must
+ agree with the function around it. An expression of
+ void type has no value to use.
+
+ The names of the tree must be interned (intern.h), as
+ the parser makes them. Each error is reported once; a
+ name that is not declared is taken as num afterwards.
+****************************************************/
+
+#ifndef _TYPECHECK_H_
+#define _TYPECHECK_H_
+
+#include "libs.h"
+#include "parse.h"
+#include "diagnostics.h"
+
+typedef struct {
+    size_t declarations;  /* names declared */
+    size_t resolved;      /* ID_EXPR and CALL_EXPR nodes bound to their declaration */
+    int errors;           /* semantic errors reported */
+} TypeCheckStats;
+
+/* Check the statement list tree, a whole program. The errors are added to diagnostics,
+ * in the order of the tree. stats may be NULL.
+ * <Return:> 0 when memory runs out, and the check stops there. */
+int typecheck_tree(TreeNode * tree, DiagnosticList * diagnostics, TypeCheckStats * stats);
+
+#endif
@@ -0,0 +1,74 @@
+/****************************************************/
+/* File: util.c                                     */
+/* General tools for the C-Minus compiler, see      */
+/* util.h                                           */
+/* Programming designed by Zhiyao Liang             */
+/* MUST  2016 Fall                                  */
+/****************************************************/
+
+#include "util.h"
+
+void pause_msg(const char * msg){
+    printf("%s", msg);
+    clear_input_queue();
+}
+
+char * string_clone(const char* str){
+    size_t length = strlen(str);
+    char * clone = (char *) malloc(length + 1);
+    if (clone == NULL) {
+        puts("Ran out of memory!");
+        exit(1);
+    }
+    if (strcpy(clone, str) != clone) {
+        puts("error of strcpy in string_clone.");
+        exit(1);
+    }
+    return clone;
+}
+
+void clear_input_queue(void){
+    int c;
+    while ((c = getchar()) != '\n' && c != EOF)
+        ;
+}
+
+void *checked_malloc(int len){
+    void * p = malloc((size_t) len);
+    if (p == NULL) {
+        fprintf(stderr, "Ran out of memory!\n");
+        exit(1);
+    }
+    return p;
+}
+
+/* Reads the characters of stream into array, at most arrayLength - 1 of them, and ends them with '\0'.
+ * <Return:> the number of characters read. */
+int read_file_to_char_array( char * array, int arrayLength, FILE * stream){
+    int n = 0, c;
+    if (arrayLength < 1)
+        return 0;
+    while ((c = getc(stream)) != EOF) {
+        if (n >= arrayLength - 1) {
+            puts("!!Danger!! The array size limit is reached. the file is too large to read");
+            break;
+        }
+        array[n++] = (char) c;
+    }
+    array[n] = '\0';
+    return n;
+}
+
+/* <Return:> a new string of the characters of str from index begin to index end, both included,
+ * or NULL when the indexes are wrong. */
+char *  clone_string_section(const char * str, int begin, int end){
+    char * section;
+    if (begin < 0 || end < begin || (size_t) end >= strlen(str)) {
+        puts("Wrong indexes in the function clone_string_section()");
+        return NULL;
+    }
+    section = (char *) checked_malloc(end - begin + 2);
+    memcpy(section, str + begin, (size_t) (end - begin + 1));
+    section[end - begin + 1] = '\0';
+    return section;
+}
@@ -0,0 +1,244 @@
+/****************************************************
+ File: visit.c
+
+ Walking a syntax tree with callbacks, see visit.h
+****************************************************/
+
+#include "libs.h"
+#include "visit.h"
+#include "util.h"
+
+/* The runs of a list are made about this many times more than the workers, to even out the load */
+#define RUNS_PER_WORKER 4
+
+/* Inside a run, a list of siblings is cut into runs of at least this many nodes, and only
+   when it has two runs of them: shorter ones cost more to hand out than to walk */
+#define MIN_RUN 32
+
+#define ALL ((size_t) -1)
+
+typedef struct {
+    const Visitor * v;
+    ThreadPool * pool;    /* NULL for a walk on one thread */
+    atomic_int * ended;   /* set when a run ends the walk; NULL on one thread */
+} Walk;
+
+/* What to do with the node of an entry of the stack */
+typedef enum {STEP_ENTER, STEP_ENTER_ALONE, STEP_LEAVE, STEP_FAN_OUT} VisitStep;
+
+typedef struct {
+    TreeNode * node;
+    int depth;
+    VisitStep step;       /* STEP_ENTER_ALONE: not the sibling, STEP_FAN_OUT: the node and its siblings on the pool */
+} VisitItem;
+
+typedef struct {
+    const Walk * walk;
+    TreeNode * first;
+    size_t count;         /* the nodes of the list from first on */
+    int depth;
+    void * data;          /* forked for the run */
+    VisitResult result;
+} Run;
+
+void visitor_init(Visitor * v, VisitFunction pre, VisitFunction post) {
+    int n, k;
+    for (n = 0; n <= EXPR_ND; n++)
+        for (k = 0; k < VISIT_KINDS; k++) {
+            v->pre[n][k] = pre;
+            v->post[n][k] = post;
+        }
+    v->otherPre = pre;
+    v->otherPost = post;
+    v->fork = NULL;
+    v->join = NULL;
+}
+
+void visitor_on(Visitor * v, NodeKind nodeKind, int kind, VisitFunction pre, VisitFunction post) {
+    v->pre[nodeKind][kind] = pre;
+    v->post[nodeKind][kind] = post;
+}
+
+/* The kind of t, from the member of the union its nodeKind uses; -1 for an unknown nodeKind */
+static int kind_of(const TreeNode * t) {
+    switch (t->nodeKind) {
+        case DCL_ND: return (int) t->kind.dcl;
+        case PARAM_ND: return (int) t->kind.param;
+        case STMT_ND: return (int) t->kind.stmt;
+        case EXPR_ND: return (int) t->kind.expr;
+        default: return -1;
+    }
+}
+
+static VisitFunction pick(const Visitor * v, const TreeNode * t, int post) {
+    int kind = kind_of(t);
+    if (kind < 0 || kind >= VISIT_KINDS)
+        return post ? v->otherPost : v->otherPre;
+    return post ? v->post[t->nodeKind][kind] : v->pre[t->nodeKind][kind];
+}
+
+/* TRUE when the list has enough nodes to be cut into runs */
+static int long_list(const TreeNode * t) {
+    size_t n = 0;
+    for (; t != NULL && n < 2 * MIN_RUN; t = t->rSibling)
+        n++;
+    return n == 2 * MIN_RUN;
+}
+
+static VisitResult fan_out(const Walk * w, TreeNode * list, int depth, size_t minRun, void * data);
+
+/* Walk count nodes of list, from the first, each with what is under it */
+static VisitResult walk(const Walk * w, TreeNode * list, size_t count, int depth, void * data) {
+    const Visitor * v = w->v;
+    VisitItem * stack;
+    size_t top = 0, capacity = 256;
+    VisitResult result = VISIT_CONTINUE;
+    int i;
+
+    stack = (VisitItem *) malloc(capacity * sizeof(VisitItem));
+    if (stack == NULL)
+        return VISIT_FAILED;
+    for (; list != NULL && count > 0 && result == VISIT_CONTINUE; list = list->rSibling, count--) {
+        stack[0].node = list;
+        stack[0].depth = depth;
+        stack[0].step = STEP_ENTER_ALONE;
+        top = 1;
+        while (top > 0 && result == VISIT_CONTINUE) {
+            VisitItem item = stack[--top];
+            TreeNode * t = item.node;
+            VisitFunction f;
+
+            if (item.step == STEP_FAN_OUT) {
+                result = fan_out(w, t, item.depth, MIN_RUN, data);
+                continue;
+            }
+            f = pick(v, t, item.step == STEP_LEAVE);
+            result = f != NULL ? f(t, item.depth, data) : VISIT_CONTINUE;
+            if (item.step == STEP_LEAVE) {
+                if (result == VISIT_SKIP)
+                    result = VISIT_CONTINUE;
+                continue;
+            }
+            if (w->ended != NULL && atomic_load_explicit(w->ended, memory_order_relaxed))
+                result = VISIT_STOP;
+            if (result == VISIT_STOP || result == VISIT_FAILED)
+                break;
+            if (top + MAX_CHILDREN + 2 > capacity) {
+                VisitItem * bigger = (VisitItem *) realloc(stack, 2 * capacity * sizeof(VisitItem));
+                if (bigger == NULL) {
+                    result = VISIT_FAILED;
+                    break;
+                }
+                stack = bigger;
+                capacity *= 2;
+            }
+            /* pushed in reverse: child[0] is walked first, the sibling last */
+            if (item.step == STEP_ENTER && t->rSibling != NULL) {
+                stack[top].node = t->rSibling;
+                stack[top].depth = item.depth;
+                stack[top].step = STEP_ENTER;
+                top++;
+            }
+            if (pick(v, t, TRUE) != NULL) {
+                stack[top].node = t;
+                stack[top].depth = item.depth;
+                stack[top].step = STEP_LEAVE;
+                top++;
+            }
+            if (result == VISIT_SKIP) {
+                result = VISIT_CONTINUE;
+                continue;
+            }
+            for (i = MAX_CHILDREN - 1; i >= 0; i--) {
+                TreeNode * c = t->child[i];
+                if (c == NULL)
+                    continue;
+                stack[top].node = c;
+                stack[top].depth = item.depth + 1;
+                stack[top].step = w->pool != NULL && long_list(c) ? STEP_FAN_OUT : STEP_ENTER;
+                top++;
+            }
+        }
+    }
+    free(stack);
+    return result;
+}
+
+static void walk_run(void * arg, int worker) {
+    Run * r = (Run *) arg;
+    (void) worker;
+    r->result = walk(r->walk, r->first, r->count, r->depth, r->data);
+    if (r->result != VISIT_CONTINUE)
+        atomic_store(r->walk->ended, 1);
+}
+
+/* Walk the list and its siblings as runs of at least minRun nodes on the pool, and join
+   their data into data; a list too short for two runs is walked here */
+static VisitResult fan_out(const Walk * w, TreeNode * list, int depth, size_t minRun, void * data) {
+    const Visitor * v = w->v;
+    size_t n = 0, runs, max = (size_t) pool_size(w->pool) * RUNS_PER_WORKER, made, k;
+    TreeNode * t;
+    Run * r;
+    TaskGroup group;
+    VisitResult result = VISIT_CONTINUE;
+
+    for (t = list; t != NULL; t = t->rSibling)
+        n++;
+    runs = n / minRun < max ? n / minRun : max;
+    if (runs < 2)
+        return walk(w, list, ALL, depth, data);
+    r = (Run *) calloc(runs, sizeof(Run));
+    if (r == NULL)
+        return VISIT_FAILED;
+    t = list;
+    for (made = 0; made < runs; made++) {
+        /* the first n % runs runs have one node more */
+        r[made].walk = w;
+        r[made].first = t;
+        r[made].count = n / runs + (made < n % runs);
+        r[made].depth = depth;
+        r[made].data = v->fork(data);
+        if (r[made].data == NULL)
+            break;
+        for (k = 0; k < r[made].count; k++)
+            t = t->rSibling;
+    }
+    if (made == runs) {
+        task_group_init(&group);
+        for (k = 0; k < runs; k++)
+            pool_submit(w->pool, &group, walk_run, &r[k]);
+        pool_wait(w->pool, &group);
+        task_group_destroy(&group);
+    } else
+        result = VISIT_FAILED;
+    /* in source order, so the data comes out as from one walk */
+    for (k = 0; k < made; k++) {
+        if (!v->join(data, r[k].data))
+            result = VISIT_FAILED;
+        if (r[k].result == VISIT_FAILED || (r[k].result == VISIT_STOP && result == VISIT_CONTINUE))
+            result = r[k].result;
+    }
+    free(r);
+    return result;
+}
+
+VisitResult visit_tree(const Visitor * v, TreeNode * tree, void * data) {
+    Walk w;
+    w.v = v;
+    w.pool = NULL;
+    w.ended = NULL;
+    return walk(&w, tree, ALL, 0, data);
+}
+
+VisitResult visit_parallel(ThreadPool * pool, const Visitor * v, TreeNode * tree, void * data) {
+    Walk w;
+    atomic_int ended;
+    if (pool == NULL || pool_size(pool) < 2 || v->fork == NULL || v->join == NULL)
+        return visit_tree(v, tree, data);
+    atomic_init(&ended, 0);
+    w.v = v;
+    w.pool = pool;
+    w.ended = &ended;
+    /* the top-level statements are cut however few they are: a function may be large */
+    return fan_out(&w, tree, 0, 1, data);
+}
@@ -0,0 +1,79 @@
+/****************************************************
+ File: visit.h
+
+ A walk over a syntax tree that a pass fills in with
+ callbacks, instead of walking child[0 .. MAX_CHILDREN)
+ and rSibling itself. The nodes are visited in the
+ order the printer prints them: a node, the lists of
+ its children in order, then its right sibling. Each
+ node gets a pre callback before its children and a
+ post callback after them, picked from tables by its
+ nodeKind and kind. The walk keeps the pending nodes
+ on an explicit stack, so deep trees cannot overflow
+ the call stack.
+
+ visit_parallel() walks on the workers of a thread
+ pool. The top-level list is cut into runs of
+ statements, and so is any long list of siblings met
+ inside them, such as the body of a large function;
+ each run is a task with a data of its own, made by
+ the fork callback, and the data of the runs are
+ joined into the data of the list in source order
+ when they are all done. A pass whose data joins as
+ if the runs were walked one after the other, like
+ counters or text appended, gives the same result as
+ visit_tree().
+****************************************************/
+
+#ifndef _VISIT_H_
+#define _VISIT_H_
+
+#include "libs.h"
+#include "parse.h"
+#include "thread_pool.h"
+
+typedef enum {
+    VISIT_CONTINUE,   /* go on */
+    VISIT_SKIP,       /* from pre: do not visit the children; the post callback of the node is still called */
+    VISIT_STOP,       /* end the walk here */
+    VISIT_FAILED      /* end the walk: memory ran out */
+} VisitResult;
+
+/* depth is 0 for the list the walk starts with, and one more for each level of children */
+typedef VisitResult (* VisitFunction)(TreeNode * t, int depth, void * data);
+
+/* The most kinds of one node kind: those of StmtKind */
+#define VISIT_KINDS (DCL_STMT + 1)
+
+typedef struct {
+    VisitFunction pre[EXPR_ND + 1][VISIT_KINDS];    /* by nodeKind and kind; NULL to do nothing */
+    VisitFunction post[EXPR_ND + 1][VISIT_KINDS];
+    VisitFunction otherPre;       /* for a node whose kinds are not in the tables */
+    VisitFunction otherPost;
+    /* For visit_parallel(): a new data for a run of the list that data is walking.
+     * <Return:> NULL when memory runs out. */
+    void * (* fork)(void * data);
+    /* Add the data of a run into the data it was forked from, and free it; runs are joined in
+     * source order. <Return:> 0 when memory runs out. */
+    int (* join)(void * data, void * run);
+} Visitor;
+
+/* Set every entry of the tables, other ones included, to pre and post, and fork and join to NULL */
+void visitor_init(Visitor * v, VisitFunction pre, VisitFunction post);
+
+/* Set the callbacks of the nodes of nodeKind and kind, a DclKind, ParamKind, StmtKind or ExprKind */
+void visitor_on(Visitor * v, NodeKind nodeKind, int kind, VisitFunction pre, VisitFunction post);
+
+/* Walk the list tree and what is under it.
+ * <Return:> VISIT_CONTINUE when the whole tree was walked, VISIT_STOP or VISIT_FAILED when a
+ * callback ended the walk, or VISIT_FAILED when the stack cannot grow. */
+VisitResult visit_tree(const Visitor * v, TreeNode * tree, void * data);
+
+/* The same walk on the workers of pool, for a visitor with fork and join. Without them, or
+ * with no pool or a pool of one worker, it is visit_tree(). The runs of a list are walked at
+ * the same time, so the callbacks must only change their own data and the nodes they are
+ * given. A walk that is ended stops the other runs at their next node, after nodes past
+ * the one that ended it may have been visited; the data of every run is joined all the same. */
+VisitResult visit_parallel(ThreadPool * pool, const Visitor * v, TreeNode * tree, void * data);
+
+#endif
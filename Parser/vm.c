@@ -0,0 +1,214 @@
+/****************************************************
+ File: vm.c
+
+ The bytecode virtual machine, see vm.h
+****************************************************/
+
+#include "libs.h"
+#include "vm.h"
+
+#if (defined(__GNUC__) || defined(__clang__)) && !defined(VM_SWITCH)
+#define VM_THREADED
+#endif
+
+#ifdef VM_THREADED
+#define CASE(op) L_##op
+#define DISPATCH() goto *labels[ip->op]
+#else
+#define CASE(op) case op
+#define DISPATCH() continue
+#endif
+
+/* A call under way, for its return */
+typedef struct {
+    const Instr * ret;    /* where the caller goes on */
+    int * r;              /* the window of the caller */
+    int dst;              /* the register of the caller that gets the value */
+    int fp;               /* the frame of the caller in memory */
+    int memTop;
+} Frame;
+
+/* r[a] = r[b] op r[c] */
+#define BINARY(op, value) CASE(op): { int x = r[ip->b], y = r[ip->c]; r[ip->a] = (value); ip++; } DISPATCH();
+
+/* go to c if r[a] op r[b], or r[a] op b for the K forms */
+#define JUMP(op, cmp) CASE(op): ip = r[ip->a] cmp r[ip->b] ? code + ip->c : ip + 1; DISPATCH();
+#define JUMPK(op, cmp) CASE(op): ip = r[ip->a] cmp ip->b ? code + ip->c : ip + 1; DISPATCH();
+
+static RunStatus run(const Program * p, int * mem, int * regs, Frame * frames, int * value) {
+#ifdef VM_THREADED
+    static const void * const labels[OP_COUNT] = {
+        [OP_LOADK] = &&L_OP_LOADK, [OP_MOVE] = &&L_OP_MOVE, [OP_GLOAD] = &&L_OP_GLOAD, [OP_GSTORE] = &&L_OP_GSTORE,
+        [OP_FADDR] = &&L_OP_FADDR, [OP_LOAD] = &&L_OP_LOAD, [OP_STORE] = &&L_OP_STORE,
+        [OP_ADD] = &&L_OP_ADD, [OP_SUB] = &&L_OP_SUB, [OP_MUL] = &&L_OP_MUL, [OP_DIV] = &&L_OP_DIV, [OP_MOD] = &&L_OP_MOD,
+        [OP_LT] = &&L_OP_LT, [OP_LE] = &&L_OP_LE, [OP_GT] = &&L_OP_GT, [OP_GE] = &&L_OP_GE,
+        [OP_EQ] = &&L_OP_EQ, [OP_NE] = &&L_OP_NE, [OP_ADDK] = &&L_OP_ADDK,
+        [OP_JMP] = &&L_OP_JMP, [OP_JZ] = &&L_OP_JZ, [OP_JNZ] = &&L_OP_JNZ,
+        [OP_JLT] = &&L_OP_JLT, [OP_JLE] = &&L_OP_JLE, [OP_JGT] = &&L_OP_JGT,
+        [OP_JGE] = &&L_OP_JGE, [OP_JEQ] = &&L_OP_JEQ, [OP_JNE] = &&L_OP_JNE,
+        [OP_JLTK] = &&L_OP_JLTK, [OP_JLEK] = &&L_OP_JLEK, [OP_JGTK] = &&L_OP_JGTK,
+        [OP_JGEK] = &&L_OP_JGEK, [OP_JEQK] = &&L_OP_JEQK, [OP_JNEK] = &&L_OP_JNEK,
+        [OP_CALL] = &&L_OP_CALL, [OP_RET] = &&L_OP_RET, [OP_RETZ] = &&L_OP_RETZ,
+    };
+#endif
+    const Instr * code = p->code;
+    const BcFunction * main = &p->functions[p->main];
+    const Instr * ip = code + main->entry;
+    const int * regsEnd = regs + VM_REGISTERS;
+    int memEnd = p->globalCells + VM_FRAME_CELLS;
+    int * r = regs;
+    int fp = p->globalCells;
+    int memTop = fp + main->frameCells;
+    int depth = 0;
+    int result;
+    unsigned address;
+
+    if (main->registers > VM_REGISTERS || memTop > memEnd)
+        return RUN_STACK_OVERFLOW;
+#ifdef VM_THREADED
+    DISPATCH();
+#else
+dispatch:
+    for (;;) switch (ip->op) {
+#endif
+    CASE(OP_LOADK): r[ip->a] = ip->b; ip++; DISPATCH();
+    CASE(OP_MOVE): r[ip->a] = r[ip->b]; ip++; DISPATCH();
+    CASE(OP_GLOAD): r[ip->a] = mem[ip->b]; ip++; DISPATCH();
+    CASE(OP_GSTORE): mem[ip->a] = r[ip->b]; ip++; DISPATCH();
+    CASE(OP_FADDR): r[ip->a] = fp + ip->b; ip++; DISPATCH();
+    CASE(OP_LOAD):
+        address = (unsigned) NUM_ADD(r[ip->b], r[ip->c]);
+        if (address >= (unsigned) memTop)
+            return RUN_BAD_ADDRESS;
+        r[ip->a] = mem[address];
+        ip++;
+        DISPATCH();
+    CASE(OP_STORE):
+        address = (unsigned) NUM_ADD(r[ip->a], r[ip->b]);
+        if (address >= (unsigned) memTop)
+            return RUN_BAD_ADDRESS;
+        mem[address] = r[ip->c];
+        ip++;
+        DISPATCH();
+    BINARY(OP_ADD, NUM_ADD(x, y))
+    BINARY(OP_SUB, NUM_SUB(x, y))
+    BINARY(OP_MUL, NUM_MUL(x, y))
+    CASE(OP_DIV):
+        if (r[ip->c] == 0)
+            return RUN_DIVIDE_BY_ZERO;
+        r[ip->a] = NUM_DIV(r[ip->b], r[ip->c]);
+        ip++;
+        DISPATCH();
+    CASE(OP_MOD):
+        if (r[ip->c] == 0)
+            return RUN_DIVIDE_BY_ZERO;
+        r[ip->a] = NUM_MOD(r[ip->b], r[ip->c]);
+        ip++;
+        DISPATCH();
+    BINARY(OP_LT, x < y)
+    BINARY(OP_LE, x <= y)
+    BINARY(OP_GT, x > y)
+    BINARY(OP_GE, x >= y)
+    BINARY(OP_EQ, x == y)
+    BINARY(OP_NE, x != y)
+    CASE(OP_ADDK): r[ip->a] = NUM_ADD(r[ip->b], ip->c); ip++; DISPATCH();
+    CASE(OP_JMP): ip = code + ip->a; DISPATCH();
+    CASE(OP_JZ): ip = r[ip->a] == 0 ? code + ip->b : ip + 1; DISPATCH();
+    CASE(OP_JNZ): ip = r[ip->a] != 0 ? code + ip->b : ip + 1; DISPATCH();
+    JUMP(OP_JLT, <)
+    JUMP(OP_JLE, <=)
+    JUMP(OP_JGT, >)
+    JUMP(OP_JGE, >=)
+    JUMP(OP_JEQ, ==)
+    JUMP(OP_JNE, !=)
+    JUMPK(OP_JLTK, <)
+    JUMPK(OP_JLEK, <=)
+    JUMPK(OP_JGTK, >)
+    JUMPK(OP_JGEK, >=)
+    JUMPK(OP_JEQK, ==)
+    JUMPK(OP_JNEK, !=)
+    CASE(OP_CALL): {
+        const BcFunction * f = &p->functions[ip->b];
+        int * callee = r + ip->c;
+        Frame * frame = &frames[depth];
+        if (depth == VM_CALL_DEPTH_MAX || callee + f->registers > regsEnd || memTop + f->frameCells > memEnd)
+            return RUN_STACK_OVERFLOW;
+        frame->ret = ip + 1;
+        frame->r = r;
+        frame->dst = ip->a;
+        frame->fp = fp;
+        frame->memTop = memTop;
+        depth++;
+        /* the arguments are in place; the variables and the local arrays start at 0 */
+        memset(callee + f->params, 0, (size_t) (f->registers - f->params) * sizeof(int));
+        memset(mem + memTop, 0, (size_t) f->frameCells * sizeof(int));
+        fp = memTop;
+        memTop += f->frameCells;
+        r = callee;
+        ip = code + f->entry;
+        DISPATCH();
+    }
+    CASE(OP_RET): result = r[ip->a]; goto ret;
+    CASE(OP_RETZ): result = 0; goto ret;
+#ifndef VM_THREADED
+    default:
+        return RUN_BAD_ADDRESS;
+    }
+#endif
+ret:
+    if (depth == 0) {
+        *value = result;
+        return RUN_OK;
+    }
+    {
+        const Frame * frame = &frames[--depth];
+        r = frame->r;
+        fp = frame->fp;
+        memTop = frame->memTop;
+        r[frame->dst] = result;
+        ip = frame->ret;
+    }
+#ifdef VM_THREADED
+    DISPATCH();
+#else
+    goto dispatch;
+#endif
+}
+
+int vm_run(const Program * p, RunResult * result) {
+    int * mem = (int *) calloc((size_t) p->globalCells + VM_FRAME_CELLS, sizeof(int));
+    int * regs = (int *) calloc(VM_REGISTERS, sizeof(int));
+    Frame * frames = (Frame *) malloc(VM_CALL_DEPTH_MAX * sizeof(Frame));
+
+    memset(result, 0, sizeof(RunResult));
+    result->status = RUN_NO_MEMORY;
+    if (mem != NULL && regs != NULL && frames != NULL && p->main >= 0 && p->main < p->functionCount) {
+        result->status = run(p, mem, regs, frames, &result->value);
+        result->globals = (int *) malloc(((size_t) p->globalCells + 1) * sizeof(int));
+        if (result->globals != NULL) {
+            memcpy(result->globals, mem, (size_t) p->globalCells * sizeof(int));
+            result->globalCells = p->globalCells;
+        } else
+            result->status = RUN_NO_MEMORY;
+    }
+    free(mem);
+    free(regs);
+    free(frames);
+    return result->status == RUN_OK;
+}
+
+const char * run_status_text(RunStatus status) {
+    switch (status) {
+        case RUN_OK: return "ok";
+        case RUN_DIVIDE_BY_ZERO: return "division by 0";
+        case RUN_BAD_ADDRESS: return "address outside of the memory in use";
+        case RUN_STACK_OVERFLOW: return "calls nested too deeply";
+        default: return "ran out of memory";
+    }
+}
+
+void run_result_release(RunResult * result) {
+    free(result->globals);
+    result->globals = NULL;
+    result->globalCells = 0;
+}
@@ -0,0 +1,55 @@
+/****************************************************
+ File: vm.h
+
+ The virtual machine that runs the bytecode of
+ bytecode.h. Its loop dispatches each instruction
+ with a computed goto to the code of the next one,
+ where the compiler has labels as values (gcc,
+ clang), and with a switch elsewhere or when
+ VM_SWITCH is defined.
+
+ A run starts main() with every global and every
+ variable 0 and ends when main() returns, or at the
+ first runtime error: a division by 0, an address
+ outside of the memory in use, or calls nested more
+ than VM_CALL_DEPTH_MAX deep.
+****************************************************/
+
+#ifndef _VM_H_
+#define _VM_H_
+
+#include "libs.h"
+#include "bytecode.h"
+
+/* The registers of all of the calls under way, and the cells of their local arrays */
+#define VM_REGISTERS (1 << 20)
+#define VM_FRAME_CELLS (1 << 20)
+#define VM_CALL_DEPTH_MAX 1000
+
+/* The arithmetic of num when a program runs, in the VM and in the tree interpreter alike:
+   it wraps around, and INT_MIN / -1 is INT_MIN. The divisor must not be 0. */
+#define NUM_ADD(a, b) ((int) ((unsigned) (a) + (unsigned) (b)))
+#define NUM_SUB(a, b) ((int) ((unsigned) (a) - (unsigned) (b)))
+#define NUM_MUL(a, b) ((int) ((unsigned) (a) * (unsigned) (b)))
+#define NUM_DIV(a, b) ((b) == -1 ? NUM_SUB(0, a) : (a) / (b))
+#define NUM_MOD(a, b) ((b) == -1 ? 0 : (a) % (b))
+
+typedef enum {RUN_OK, RUN_DIVIDE_BY_ZERO, RUN_BAD_ADDRESS, RUN_STACK_OVERFLOW, RUN_NO_MEMORY} RunStatus;
+
+typedef struct {
+    RunStatus status;
+    int value;            /* what main() returned; 0 for a void main() */
+    int * globals;        /* the cells of the globals when the run ended */
+    int globalCells;
+} RunResult;
+
+/* Run main() of the program.
+ * <Return:> 0 when the run stopped at an error; result->status says which. */
+int vm_run(const Program * program, RunResult * result);
+
+/* What went wrong, for a status */
+const char * run_status_text(RunStatus status);
+
+void run_result_release(RunResult * result);
+
+#endif
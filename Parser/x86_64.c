@@ -0,0 +1,671 @@
+/****************************************************
+ File: x86_64.c
+
+ The x86-64 backend, see x86_64.h
+****************************************************/
+
+#include "libs.h"
+#include "x86_64.h"
+#include "layout.h"
+#include "typecheck.h"
+#include "vm.h"
+#include "util.h"
+
+#include <stdarg.h>
+
+/* The compiler recurses once per level of an expression; deeper expressions are not compiled */
+#define COMPILE_DEPTH_MAX 10000
+
+/* A use of a variable in a loop counts this many times as much as one around the loop */
+#define LOOP_WEIGHT 8
+#define WEIGHT_MAX (1L << 40)
+
+#define SLOT_REGISTERS 4
+#define TEMPS 6
+#define ARG_REGISTERS 6
+
+/* The callee-saved registers of the variables used most */
+static const char * const slotRegisters[SLOT_REGISTERS] = {"ebx", "r12d", "r13d", "r14d"};
+static const char * const slotRegisters64[SLOT_REGISTERS] = {"rbx", "r12", "r13", "r14"};
+/* The stack of the values of an expression; ecx is the spare for when it runs out, and eax and edx
+   are taken by division. r15 holds the address of the memory for the whole run. */
+static const char * const temps[TEMPS] = {"r10d", "r11d", "r9d", "r8d", "esi", "edi"};
+static const char * const temps64[TEMPS] = {"r10", "r11", "r9", "r8", "rsi", "rdi"};
+static const char * const args[ARG_REGISTERS] = {"edi", "esi", "edx", "ecx", "r8d", "r9d"};
+
+#define OPERAND_SIZE 48
+
+typedef struct {
+    FILE * out;
+    const Layout * layout;
+    DiagnosticList * diagnostics;
+    const FunctionLayout * function;
+    int index;                       /* of the function */
+    char (* homes)[OPERAND_SIZE];    /* where each slot of the function lives, as an operand */
+    long * uses;                     /* of each slot, weighted by the loops around them */
+    char fp[OPERAND_SIZE];           /* where the frame of the call starts in memory */
+    int saved;                       /* the callee-saved registers of the function */
+    int pushed;                      /* bytes pushed on the machine stack since the prologue */
+    int labels;
+    int depth;
+    int ok;
+} X86;
+
+static void compileError(X86 * x, const TreeNode * t, const char * message) {
+    int lineno = t != NULL ? t->lineNum : 0;
+    if (x->ok)
+        diagnostic_list_add(x->diagnostics, lineno, "\n>>> Compile error at line %d: %s\n", lineno, message);
+    x->ok = FALSE;
+}
+
+/* One instruction, on a line of its own */
+static void emit(X86 * x, const char * format, ...) {
+    va_list ap;
+    fputs("    ", x->out);
+    va_start(ap, format);
+    vfprintf(x->out, format, ap);
+    va_end(ap);
+    fputc('\n', x->out);
+}
+
+static int new_label(X86 * x) {
+    return x->labels++;
+}
+
+static void label(X86 * x, int n) {
+    fprintf(x->out, ".L%d:\n", n);
+}
+
+static const Storage * storage_of(X86 * x, const TreeNode * t) {
+    const Storage * s = layout_find(x->layout, (const TreeNode *) t->something);
+    if (s == NULL)
+        compileError(x, t, "a name has no storage");
+    return s;
+}
+
+static int is_const(const TreeNode * t) {
+    return t != NULL && t->nodeKind == EXPR_ND && t->kind.expr == CONST_EXPR;
+}
+
+/* The operand that t is without any code, when it is a constant or a num variable */
+static int simple(X86 * x, const TreeNode * t, char * operand) {
+    const Storage * s;
+    if (is_const(t)) {
+        sprintf(operand, "%d", t->attr.exprAttr.val);
+        return TRUE;
+    }
+    if (t == NULL || t->nodeKind != EXPR_ND || t->kind.expr != ID_EXPR)
+        return FALSE;
+    s = layout_find(x->layout, (const TreeNode *) t->something);
+    if (s == NULL || s->array)
+        return FALSE;
+    if (s->kind == STORE_SLOT)
+        strcpy(operand, x->homes[s->offset]);
+    else if (s->kind == STORE_GLOBAL)
+        sprintf(operand, "dword ptr [r15 + %d]", 4 * s->offset);
+    else
+        return FALSE;
+    return TRUE;
+}
+
+/* TRUE when t is a variable that lives in a register, which is copied to operand */
+static int in_register(X86 * x, const TreeNode * t, char * operand) {
+    int k;
+    if (is_const(t) || !simple(x, t, operand))
+        return FALSE;
+    for (k = 0; k < SLOT_REGISTERS; k++)
+        if (strcmp(operand, slotRegisters[k]) == 0)
+            return TRUE;
+    return FALSE;
+}
+
+static void compile_expression(X86 * x, const TreeNode * t, int d);
+
+/* Evaluate t, the operand after the value in temps[d]: into the next temporary, or into ecx when
+   there is none. <Return:> the register it is in. */
+static const char * next_operand(X86 * x, const TreeNode * t, int d) {
+    if (d + 1 < TEMPS) {
+        compile_expression(x, t, d + 1);
+        return temps[d + 1];
+    }
+    emit(x, "push %s", temps64[d]);
+    x->pushed += 8;
+    compile_expression(x, t, d);
+    emit(x, "mov ecx, %s", temps[d]);
+    emit(x, "pop %s", temps64[d]);
+    x->pushed -= 8;
+    return "ecx";
+}
+
+/* The operand t after the value in temps[d], as an operand */
+static void operand_of(X86 * x, const TreeNode * t, int d, char * operand) {
+    if (!simple(x, t, operand))
+        strcpy(operand, next_operand(x, t, d));
+}
+
+/* The address in temps[d] must be inside of the memory in use */
+static void check_address(X86 * x, int d) {
+    emit(x, "cmp %s, dword ptr [rip + cm_memTop]", temps[d]);
+    emit(x, "jae cm_bad_address");
+}
+
+/* temps[d] = temps[d] / divisor, or % when mod, with the arithmetic of vm.h */
+static void compile_divide(X86 * x, int d, const char * divisor, int mod) {
+    int minus = new_label(x), done = new_label(x);
+    emit(x, "cmp %s, 0", divisor);
+    emit(x, "je cm_divide_by_zero");
+    emit(x, "cmp %s, -1", divisor);
+    emit(x, "jne .L%d", minus);
+    emit(x, mod ? "xor %s, %s" : "neg %s", temps[d], temps[d]);
+    emit(x, "jmp .L%d", done);
+    label(x, minus);
+    emit(x, "mov eax, %s", temps[d]);
+    emit(x, "cdq");
+    emit(x, "idiv %s", divisor);
+    emit(x, "mov %s, %s", temps[d], mod ? "edx" : "eax");
+    label(x, done);
+}
+
+/* The condition code of a comparison, or NULL for another operator */
+static const char * condition(TokenType op, int negate) {
+    switch (op) {
+        case LT: return negate ? "ge" : "l";
+        case LTE: return negate ? "g" : "le";
+        case GT: return negate ? "le" : "g";
+        case GTE: return negate ? "l" : "ge";
+        case EQ: return negate ? "ne" : "e";
+        case NEQ: return negate ? "e" : "ne";
+        default: return NULL;
+    }
+}
+
+/* An assignment, an OP_EXPR or an ASSIGN_STMT; with value, its value is left in temps[d] */
+static void compile_assign(X86 * x, const TreeNode * t, int d, int value) {
+    const TreeNode * left = t->child[0];
+    const char * r = temps[d];
+    char operand[OPERAND_SIZE];
+    const Storage * s;
+
+    if (left == NULL || t->child[1] == NULL) {
+        compileError(x, t, "an assignment is incomplete");
+        return;
+    }
+    if (left->nodeKind == EXPR_ND && left->kind.expr == ID_EXPR) {
+        s = storage_of(x, left);
+        if (s == NULL)
+            return;
+        if (s->array || (s->kind != STORE_SLOT && s->kind != STORE_GLOBAL)) {
+            compileError(x, t, "an array or a function is assigned");
+            return;
+        }
+        if (is_const(t->child[1]) && !value) {
+            sprintf(operand, "%d", t->child[1]->attr.exprAttr.val);
+            r = operand;
+        } else
+            compile_expression(x, t->child[1], d);
+        if (s->kind == STORE_SLOT)
+            emit(x, "mov %s, %s", x->homes[s->offset], r);
+        else
+            emit(x, "mov dword ptr [r15 + %d], %s", 4 * s->offset, r);
+        return;
+    }
+    /* left is a[i]: its address, then the value, then the check of the address, as in the VM */
+    if (left->child[0] == NULL || left->child[1] == NULL) {
+        compileError(x, t, "an assignment is incomplete");
+        return;
+    }
+    compile_expression(x, left->child[0], d);
+    operand_of(x, left->child[1], d, operand);
+    emit(x, "add %s, %s", r, operand);
+    if (is_const(t->child[1]))
+        sprintf(operand, "%d", t->child[1]->attr.exprAttr.val);
+    else
+        strcpy(operand, next_operand(x, t->child[1], d));
+    check_address(x, d);
+    emit(x, "mov dword ptr [r15 + 4 * %s], %s", temps64[d], operand);
+    if (value)
+        emit(x, "mov %s, %s", r, operand);
+}
+
+/* The arguments are evaluated into an area of the stack, then the first ones move to their registers */
+static void compile_call(X86 * x, const TreeNode * t, int d) {
+    const Storage * s = storage_of(x, t);
+    const TreeNode * arg;
+    int n = 0, k, stacked, pad, area;
+
+    if (s == NULL)
+        return;
+    if (s->kind != STORE_FUNCTION) {
+        compileError(x, t, "a variable is called");
+        return;
+    }
+    for (arg = t->child[0]; arg != NULL; arg = arg->rSibling)
+        n++;
+    for (k = 0; k < d; k++)
+        emit(x, "push %s", temps64[k]);
+    x->pushed += 8 * d;
+    stacked = n > ARG_REGISTERS ? n - ARG_REGISTERS : 0;
+    /* the stack is aligned to 16 bytes at the call */
+    pad = (x->pushed + 8 * stacked) % 16 != 0 ? 8 : 0;
+    area = pad + 8 * n;
+    if (area > 0)
+        emit(x, "sub rsp, %d", area);
+    x->pushed += area;
+    for (arg = t->child[0], k = 0; arg != NULL; arg = arg->rSibling, k++) {
+        compile_expression(x, arg, 0);
+        emit(x, "mov dword ptr [rsp + %d], %s", 8 * k, temps[0]);
+    }
+    for (k = 0; k < n && k < ARG_REGISTERS; k++)
+        emit(x, "mov %s, dword ptr [rsp + %d]", args[k], 8 * k);
+    if (n - stacked > 0)
+        emit(x, "add rsp, %d", 8 * (n - stacked));
+    emit(x, "call cminus_%s", x->layout->functions[s->offset].decl->attr.dclAttr.name);
+    if (pad + 8 * stacked > 0)
+        emit(x, "add rsp, %d", pad + 8 * stacked);
+    x->pushed -= area;
+    emit(x, "mov %s, eax", temps[d]);
+    for (k = d - 1; k >= 0; k--)
+        emit(x, "pop %s", temps64[k]);
+    x->pushed -= 8 * d;
+}
+
+static void compile_name(X86 * x, const TreeNode * t, int d) {
+    const Storage * s = storage_of(x, t);
+    if (s == NULL)
+        return;
+    switch (s->kind) {
+        case STORE_SLOT:
+            emit(x, "mov %s, %s", temps[d], x->homes[s->offset]);
+            break;
+        case STORE_GLOBAL:
+            if (s->array)
+                emit(x, "mov %s, %d", temps[d], s->offset);
+            else
+                emit(x, "mov %s, dword ptr [r15 + %d]", temps[d], 4 * s->offset);
+            break;
+        case STORE_FRAME:
+            emit(x, "mov %s, %s", temps[d], x->fp);
+            if (s->offset != 0)
+                emit(x, "add %s, %d", temps[d], s->offset);
+            break;
+        default:
+            compileError(x, t, "a function is used as a variable");
+            break;
+    }
+}
+
+/* The value of t into temps[d], with the values of temps[0] to temps[d - 1] kept */
+static void compile_expression(X86 * x, const TreeNode * t, int d) {
+    const char * r = temps[d];
+    char operand[OPERAND_SIZE];
+    TokenType op;
+
+    if (t == NULL) {
+        compileError(x, t, "an expression is missing");
+        return;
+    }
+    if (++x->depth > COMPILE_DEPTH_MAX) {
+        compileError(x, t, "an expression is nested too deeply to compile");
+        x->depth--;
+        return;
+    }
+    op = t->attr.exprAttr.op;
+    if (t->nodeKind == STMT_ND || (t->kind.expr == OP_EXPR && op == ASSIGN))
+        compile_assign(x, t, d, TRUE);
+    else if (t->kind.expr == CONST_EXPR) {
+        if (t->attr.exprAttr.val == 0)
+            emit(x, "xor %s, %s", r, r);
+        else
+            emit(x, "mov %s, %d", r, t->attr.exprAttr.val);
+    } else if (t->kind.expr == ID_EXPR)
+        compile_name(x, t, d);
+    else if (t->kind.expr == CALL_EXPR)
+        compile_call(x, t, d);
+    else if (t->child[0] == NULL || t->child[1] == NULL)
+        compileError(x, t, "an expression is incomplete");
+    else {
+        compile_expression(x, t->child[0], d);
+        if ((op == OVER || op == MOD) && is_const(t->child[1])) {
+            int k = t->child[1]->attr.exprAttr.val;
+            if (k == 0)
+                emit(x, "jmp cm_divide_by_zero");
+            else if (k == -1)
+                emit(x, op == MOD ? "xor %s, %s" : "neg %s", r, r);
+            else {
+                emit(x, "mov ecx, %d", k);
+                compile_divide(x, d, "ecx", op == MOD);
+            }
+        } else {
+            operand_of(x, t->child[1], d, operand);
+            switch (op) {
+                case LBR:
+                    emit(x, "add %s, %s", r, operand);
+                    check_address(x, d);
+                    emit(x, "mov %s, dword ptr [r15 + 4 * %s]", r, temps64[d]);
+                    break;
+                case PLUS:
+                    emit(x, "add %s, %s", r, operand);
+                    break;
+                case MINUS:
+                    emit(x, "sub %s, %s", r, operand);
+                    break;
+                case STAR:
+                    if (is_const(t->child[1]))
+                        emit(x, "imul %s, %s, %s", r, r, operand);
+                    else
+                        emit(x, "imul %s, %s", r, operand);
+                    break;
+                case OVER:
+                case MOD:
+                    compile_divide(x, d, operand, op == MOD);
+                    break;
+                default:
+                    emit(x, "cmp %s, %s", r, operand);
+                    emit(x, "set%s al", condition(op, FALSE) != NULL ? condition(op, FALSE) : "ne");
+                    emit(x, "movzx %s, al", r);
+                    break;
+            }
+        }
+    }
+    x->depth--;
+}
+
+/* A jump to target taken when the condition t is when */
+static void compile_branch(X86 * x, const TreeNode * t, int when, int target) {
+    char operand[OPERAND_SIZE];
+    const char * cc;
+
+    if (t == NULL) {
+        compileError(x, t, "a condition is missing");
+        return;
+    }
+    cc = t->nodeKind == EXPR_ND && t->kind.expr == OP_EXPR ? condition(t->attr.exprAttr.op, !when) : NULL;
+    if (cc == NULL || t->child[0] == NULL || t->child[1] == NULL) {
+        compile_expression(x, t, 0);
+        emit(x, "test %s, %s", temps[0], temps[0]);
+        emit(x, "%s .L%d", when ? "jne" : "je", target);
+    } else {
+        const char * left = temps[0];
+        char first[OPERAND_SIZE];
+        /* a variable in a register is compared with a constant where it is */
+        if (in_register(x, t->child[0], first) && is_const(t->child[1]))
+            left = first;
+        else
+            compile_expression(x, t->child[0], 0);
+        operand_of(x, t->child[1], 0, operand);
+        emit(x, "cmp %s, %s", left, operand);
+        emit(x, "j%s .L%d", cc, target);
+    }
+}
+
+static void compile_list(X86 * x, const TreeNode * list);
+
+static void compile_statement(X86 * x, const TreeNode * t) {
+    int end, other, body;
+
+    if (t->nodeKind == EXPR_ND) {
+        compile_expression(x, t, 0);
+    } else if (t->nodeKind == STMT_ND) {
+        switch (t->kind.stmt) {
+            case ASSIGN_STMT:
+                compile_assign(x, t, 0, FALSE);
+                break;
+            case RTN_STMT:
+                if (t->child[0] != NULL) {
+                    compile_expression(x, t->child[0], 0);
+                    emit(x, "mov eax, %s", temps[0]);
+                } else
+                    emit(x, "xor eax, eax");
+                emit(x, "jmp .Lreturn%d", x->index);
+                break;
+            case SLCT_STMT:
+                other = new_label(x);
+                compile_branch(x, t->child[0], FALSE, other);
+                compile_list(x, t->child[1]);
+                if (t->child[2] != NULL) {
+                    end = new_label(x);
+                    emit(x, "jmp .L%d", end);
+                    label(x, other);
+                    compile_list(x, t->child[2]);
+                    label(x, end);
+                } else
+                    label(x, other);
+                break;
+            case WHILE_STMT:
+                /* the test comes after the body, as in the bytecode */
+                end = new_label(x);
+                body = new_label(x);
+                emit(x, "jmp .L%d", end);
+                label(x, body);
+                compile_list(x, t->child[1]);
+                label(x, end);
+                compile_branch(x, t->child[0], TRUE, body);
+                break;
+            case CMPD_STMT:
+            case FUNC_STMT:
+                compile_list(x, t->child[0]);
+                break;
+            default:
+                break;
+        }
+    }
+}
+
+/* This recurses once per level of nested blocks, which the parser bounds */
+static void compile_list(X86 * x, const TreeNode * list) {
+    for (; list != NULL && x->ok; list = list->rSibling)
+        compile_statement(x, list);
+}
+
+/* Add the uses of the slots in t and in the nodes after it, each weighing weight times the loops around it */
+static void count_uses(X86 * x, const TreeNode * t, long weight, int depth) {
+    int k;
+    for (; t != NULL && depth <= COMPILE_DEPTH_MAX; t = t->rSibling) {
+        long inner = weight;
+        if (t->nodeKind == EXPR_ND && t->kind.expr == ID_EXPR) {
+            const Storage * s = layout_find(x->layout, (const TreeNode *) t->something);
+            if (s != NULL && s->kind == STORE_SLOT)
+                x->uses[s->offset] += weight;
+        }
+        if (t->nodeKind == STMT_ND && t->kind.stmt == WHILE_STMT && weight < WEIGHT_MAX)
+            inner = weight * LOOP_WEIGHT;
+        for (k = 0; k < MAX_CHILDREN; k++)
+            count_uses(x, t->child[k], inner, depth + 1);
+    }
+}
+
+/* The slots used most go to the callee-saved registers; the rest to the frame, or stay where
+   the caller put them for the parameters after the sixth. <Return:> the bytes of the frame. */
+static int place_slots(X86 * x) {
+    const FunctionLayout * f = x->function;
+    const TreeNode * body = f->decl->child[1];
+    int s, k, stacked = 0, frame;
+
+    memset(x->uses, 0, (size_t) f->slots * sizeof(long));
+    if (body != NULL)
+        count_uses(x, body->child[0], 1, 0);
+    for (s = 0; s < f->slots; s++)
+        x->homes[s][0] = '\0';
+    for (x->saved = 0; x->saved < SLOT_REGISTERS; x->saved++) {
+        int best = -1;
+        for (s = 0; s < f->slots; s++)
+            if (x->homes[s][0] == '\0' && x->uses[s] > 0 && (best < 0 || x->uses[s] > x->uses[best]))
+                best = s;
+        if (best < 0)
+            break;
+        strcpy(x->homes[best], slotRegisters[x->saved]);
+    }
+    /* below the saved registers: the start of the frame of the call in memory, then the slots */
+    sprintf(x->fp, "dword ptr [rbp - %d]", 8 * x->saved + 4);
+    for (s = 0; s < f->slots; s++) {
+        if (x->homes[s][0] != '\0')
+            continue;
+        if (s < f->params && s >= ARG_REGISTERS)
+            sprintf(x->homes[s], "dword ptr [rbp + %d]", 16 + 8 * (s - ARG_REGISTERS));
+        else
+            sprintf(x->homes[s], "dword ptr [rbp - %d]", 8 * x->saved + 8 + 4 * stacked++);
+    }
+    frame = 4 + 4 * stacked;
+    k = (8 * x->saved + frame) % 16;
+    return k == 0 ? frame : frame + 16 - k;
+}
+
+static void compile_function(X86 * x, int index) {
+    const FunctionLayout * f = &x->layout->functions[index];
+    const TreeNode * body = f->decl->child[1];
+    const char * name = f->decl->attr.dclAttr.name;
+    int s, frame;
+
+    x->function = f;
+    x->index = index;
+    x->pushed = 0;
+    x->depth = 0;
+    x->homes = (char (*)[OPERAND_SIZE]) malloc(((size_t) f->slots + 1) * OPERAND_SIZE);
+    x->uses = (long *) malloc(((size_t) f->slots + 1) * sizeof(long));
+    if (x->homes == NULL || x->uses == NULL) {
+        compileError(x, f->decl, "ran out of memory");
+        free(x->homes);
+        free(x->uses);
+        return;
+    }
+    frame = place_slots(x);
+
+    fprintf(x->out, "\n    .type cminus_%s, @function\ncminus_%s:\n", name, name);
+    emit(x, "push rbp");
+    emit(x, "mov rbp, rsp");
+    for (s = 0; s < x->saved; s++)
+        emit(x, "push %s", slotRegisters64[s]);
+    emit(x, "sub rsp, %d", frame);
+    for (s = 0; s < f->params; s++) {
+        char incoming[OPERAND_SIZE];
+        if (s < ARG_REGISTERS)
+            strcpy(incoming, args[s]);
+        else
+            sprintf(incoming, "dword ptr [rbp + %d]", 16 + 8 * (s - ARG_REGISTERS));
+        if (strcmp(x->homes[s], incoming) != 0)
+            emit(x, "mov %s, %s", x->homes[s], incoming);
+    }
+    for (; s < f->slots; s++)
+        emit(x, "mov %s, 0", x->homes[s]);
+    /* the checks of a call of the VM, then the frame of the local arrays, zeroed */
+    emit(x, "mov eax, dword ptr [rip + cm_depth]");
+    emit(x, "cmp eax, %d", VM_CALL_DEPTH_MAX);
+    emit(x, "je cm_stack_overflow");
+    emit(x, "add eax, 1");
+    emit(x, "mov dword ptr [rip + cm_depth], eax");
+    emit(x, "mov eax, dword ptr [rip + cm_memTop]");
+    emit(x, "mov %s, eax", x->fp);
+    if (f->frameCells > 0) {
+        emit(x, "lea edx, [rax + %d]", f->frameCells);
+        emit(x, "cmp edx, dword ptr [rip + cm_memEnd]");
+        emit(x, "ja cm_stack_overflow");
+        emit(x, "mov dword ptr [rip + cm_memTop], edx");
+        emit(x, "lea rdi, [r15 + 4 * rax]");
+        emit(x, "mov ecx, %d", f->frameCells);
+        emit(x, "xor eax, eax");
+        emit(x, "rep stosd");
+    }
+    if (body != NULL)
+        compile_list(x, body->child[0]);
+    emit(x, "xor eax, eax");
+    fprintf(x->out, ".Lreturn%d:\n", index);
+    if (f->frameCells > 0) {
+        emit(x, "mov edx, %s", x->fp);
+        emit(x, "mov dword ptr [rip + cm_memTop], edx");
+    }
+    emit(x, "sub dword ptr [rip + cm_depth], 1");
+    emit(x, "lea rsp, [rbp - %d]", 8 * x->saved);
+    for (s = x->saved - 1; s >= 0; s--)
+        emit(x, "pop %s", slotRegisters64[s]);
+    emit(x, "pop rbp");
+    emit(x, "ret");
+    emit(x, ".size cminus_%s, .-cminus_%s", name, name);
+    free(x->homes);
+    free(x->uses);
+    x->homes = NULL;
+    x->uses = NULL;
+}
+
+/* cm_run(), the ways out of a run, and the state of a run */
+static void compile_runtime(X86 * x) {
+    const char * name = x->layout->functions[x->layout->main].decl->attr.dclAttr.name;
+    FILE * out = x->out;
+
+    fputs("\n    .globl cm_run\n    .type cm_run, @function\ncm_run:\n", out);
+    emit(x, "push rbx");
+    emit(x, "push rbp");
+    emit(x, "push r12");
+    emit(x, "push r13");
+    emit(x, "push r14");
+    emit(x, "push r15");
+    emit(x, "push rdx");
+    emit(x, "mov qword ptr [rip + cm_sp], rsp");
+    emit(x, "mov r15, rdi");
+    emit(x, "mov dword ptr [rip + cm_memEnd], esi");
+    emit(x, "mov dword ptr [rip + cm_memTop], %d", x->layout->globalCells);
+    emit(x, "mov dword ptr [rip + cm_depth], -1");
+    emit(x, "mov ecx, %d", x->layout->globalCells);
+    emit(x, "xor eax, eax");
+    emit(x, "rep stosd");
+    emit(x, "call cminus_%s", name);
+    emit(x, "pop rdx");
+    emit(x, "mov dword ptr [rdx], eax");
+    emit(x, "mov eax, %d", RUN_OK);
+    fputs("cm_leave:\n", out);
+    emit(x, "pop r15");
+    emit(x, "pop r14");
+    emit(x, "pop r13");
+    emit(x, "pop r12");
+    emit(x, "pop rbp");
+    emit(x, "pop rbx");
+    emit(x, "ret");
+    /* a runtime error leaves all of the calls at once, with the stack of cm_run() */
+    fprintf(out, "cm_divide_by_zero:\n    mov eax, %d\n    jmp cm_unwind\n", RUN_DIVIDE_BY_ZERO);
+    fprintf(out, "cm_bad_address:\n    mov eax, %d\n    jmp cm_unwind\n", RUN_BAD_ADDRESS);
+    fprintf(out, "cm_stack_overflow:\n    mov eax, %d\n", RUN_STACK_OVERFLOW);
+    fputs("cm_unwind:\n", out);
+    emit(x, "mov rsp, qword ptr [rip + cm_sp]");
+    emit(x, "add rsp, 8");
+    emit(x, "jmp cm_leave");
+    emit(x, ".size cm_run, .-cm_run");
+
+    fputs("\n    .section .rodata\n    .globl cm_global_cells\n    .align 4\n", out);
+    fprintf(out, "cm_global_cells:\n    .long %d\n", x->layout->globalCells);
+    fputs("\n    .bss\n    .align 8\ncm_sp:\n    .zero 8\ncm_memTop:\n    .zero 4\n"
+          "cm_memEnd:\n    .zero 4\ncm_depth:\n    .zero 4\n", out);
+    fputs("\n    .section .note.GNU-stack,\"\",@progbits\n", out);
+}
+
+int x86_compile(FILE * out, TreeNode * tree, DiagnosticList * diagnostics) {
+    X86 x;
+    Layout layout;
+    TypeCheckStats checked;
+    int k;
+
+    if (!typecheck_tree(tree, diagnostics, &checked)) {
+        diagnostic_list_add(diagnostics, 0, "\n>>> Compile error at line 0: ran out of memory\n");
+        return 0;
+    }
+    if (checked.errors > 0)
+        return 0;
+    if (!layout_program(&layout, tree, diagnostics)) {
+        layout_release(&layout);
+        return 0;
+    }
+    memset(&x, 0, sizeof(X86));
+    x.out = out;
+    x.layout = &layout;
+    x.diagnostics = diagnostics;
+    x.ok = TRUE;
+    fputs("# generated by Parser\n    .intel_syntax noprefix\n    .text\n", out);
+    for (k = 0; k < layout.functionCount && x.ok; k++)
+        compile_function(&x, k);
+    if (x.ok)
+        compile_runtime(&x);
+    layout_release(&layout);
+    if (x.ok && ferror(out)) {
+        diagnostic_list_add(diagnostics, 0, "\n>>> Compile error at line 0: the assembly cannot be written\n");
+        x.ok = FALSE;
+    }
+    return x.ok;
+}
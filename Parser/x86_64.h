@@ -0,0 +1,46 @@
+/****************************************************
+ File: x86_64.h
+
+ A backend that compiles the tree of a program to
+ x86-64 assembly for the System V ABI, in the Intel
+ syntax of the GNU assembler. The assembly builds
+ with the system assembler (cc -c) into an object
+ that links into a program or a shared library.
+
+ Each function becomes a System V function, its
+ parameters coming in edi, esi, edx, ecx, r8d, r9d
+ and then on the stack, its value going out in eax.
+ The variables of a function that are used most,
+ a use in a loop counting for more, live in the
+ callee-saved registers ebx, r12d, r13d and r14d;
+ the others live in its stack frame. Expressions are
+ evaluated in a stack of scratch registers, spilled
+ to the machine stack when it runs out.
+
+ The code keeps the memory model of the VM (vm.h):
+ memory is an array of num cells, addresses are cell
+ indexes, and a run stops at the same runtime errors,
+ so the VM checks it. The object exports
+
+   int cm_run(int * mem, int memEnd, int * value);
+   extern const int cm_global_cells;
+
+ cm_run() zeroes the globals in mem, runs main() with
+ memEnd cells of memory in mem and sets *value to
+ what it returns. It returns a RunStatus of vm.h.
+****************************************************/
+
+#ifndef _X86_64_H_
+#define _X86_64_H_
+
+#include "libs.h"
+#include "parse.h"
+#include "diagnostics.h"
+
+/* Check (typecheck.h), lay out (layout.h) and compile the program tree, which must have no
+ * syntax error, writing the assembly to out. The reasons it cannot be compiled are added to
+ * diagnostics.
+ * <Return:> 0 when it cannot be, when memory runs out, or when out cannot be written. */
+int x86_compile(FILE * out, TreeNode * tree, DiagnosticList * diagnostics);
+
+#endif
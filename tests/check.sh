@@ -0,0 +1,66 @@
+#!/bin/sh
+# Runs the programs of tests/ through Parser and compares what it prints with
+# the expected output checked in next to each of them:
+#   tests/fold/NAME.cm    Parser -f NAME.cm, against NAME.out
+#   tests/run/NAME.cm     Parser -x NAME.cm, against NAME.out; Parser -r 1 NAME.cm must
+#                         also find that the VM and the tree walk end the same way;
+#                         on x86-64 Linux, Parser -N NAME.cm runs it natively, against NAME.out
+#   Parser -e on a generated program: each edit at its top gives the tree of a full
+#                         parse, and does the same work in a large program as in a small one
+# Usage: tests/check.sh path/to/Parser
+
+if [ $# -ne 1 ]; then
+    echo "Usage: tests/check.sh path/to/Parser"
+    exit 2
+fi
+parser=$(cd "$(dirname "$1")" && pwd)/$(basename "$1")
+tests=$(cd "$(dirname "$0")" && pwd)
+work=$(mktemp -d)
+trap 'rm -rf "$work"' EXIT
+passed=0
+failed=0
+
+# expect_output expected args...: the output of Parser args, run in a scratch directory, is expected
+expect_output() {
+    expected=$1
+    shift
+    (cd "$work" && "$parser" "$@") > "$work/actual" 2>&1
+    if cmp -s "$work/actual" "$expected"; then
+        passed=$((passed + 1))
+    else
+        failed=$((failed + 1))
+        echo "FAIL: Parser $*"
+        diff "$expected" "$work/actual" | head -20
+    fi
+}
+
+# expect_success args...: Parser args, run in a scratch directory, exits with 0
+expect_success() {
+    if (cd "$work" && "$parser" "$@") > "$work/actual" 2>&1; then
+        passed=$((passed + 1))
+    else
+        failed=$((failed + 1))
+        echo "FAIL: Parser $*"
+        head -20 "$work/actual"
+    fi
+}
+
+for f in "$tests"/fold/*.cm; do
+    expect_output "${f%.cm}.out" -f "$f"
+done
+for f in "$tests"/run/*.cm; do
+    expect_output "${f%.cm}.out" -x "$f"
+    expect_success -r 1 "$f"
+    if [ "$(uname -sm)" = "Linux x86_64" ]; then
+        expect_output "${f%.cm}.out" -N "$f"
+    fi
+done
+
+"$parser" -g mixed 20 > "$work/small.cm"
+"$parser" -g mixed 400 > "$work/large.cm"
+expect_success -e "$work/small.cm"
+cp "$work/actual" "$work/small.out"
+expect_output "$work/small.out" -e "$work/large.cm"
+
+echo "$passed passed, $failed failed"
+[ $failed -eq 0 ]